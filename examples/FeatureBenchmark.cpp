@@ -0,0 +1,110 @@
+#include <Arduino.h>
+#include "FeatureExtractor.h"
+
+// Benchmark and equivalence check for the feature extraction kernels.
+// Runs the same frames through the reference and ESP-DSP backends, prints
+// the cycles per frame of each and the largest difference between them.
+
+const uint16_t FRAME_SIZE = 1024;
+const float SAMPLE_RATE = 4000.0f;
+const int ITERATIONS = 50;
+
+// Features may differ by rounding only
+const float TOLERANCE = 1e-3f;
+
+FeatureExtractor reference(FRAME_SIZE, SAMPLE_RATE);
+FeatureExtractor optimized(FRAME_SIZE, SAMPLE_RATE);
+
+float frame[FRAME_SIZE];
+
+// Vibration-like test signal: offset, three tones and some noise
+void fillFrame(uint32_t seed) {
+  randomSeed(seed);
+  for (int i = 0; i < FRAME_SIZE; i++) {
+    float t = i / SAMPLE_RATE;
+    frame[i] = 1.5f
+      + 1.0f * sinf(2.0f * PI * 97.0f * t)
+      + 0.4f * sinf(2.0f * PI * 433.0f * t + 0.3f)
+      + 0.1f * sinf(2.0f * PI * 1210.0f * t)
+      + (random(-1000, 1000) / 20000.0f);
+  }
+}
+
+float relativeError(float a, float b) {
+  float scale = max(fabsf(a), fabsf(b));
+  return scale > 1e-6f ? fabsf(a - b) / scale : 0.0f;
+}
+
+// Largest relative difference over every feature
+float compare(const FeatureVector& a, const FeatureVector& b) {
+  float worst = 0.0f;
+  worst = max(worst, relativeError(a.mean, b.mean));
+  worst = max(worst, relativeError(a.rms, b.rms));
+  worst = max(worst, relativeError(a.peak, b.peak));
+  worst = max(worst, relativeError(a.crest, b.crest));
+
+  for (int i = 0; i < a.bandCount; i++) {
+    worst = max(worst, relativeError(a.bandPower[i], b.bandPower[i]));
+  }
+
+  if (a.peakCount != b.peakCount) {
+    return 1.0f;
+  }
+  for (int i = 0; i < a.peakCount; i++) {
+    worst = max(worst, relativeError(a.peaks[i].frequencyHz, b.peaks[i].frequencyHz));
+    worst = max(worst, relativeError(a.peaks[i].amplitude, b.peaks[i].amplitude));
+  }
+  return worst;
+}
+
+// Average cycles per frame of one backend
+uint32_t benchmark(FeatureExtractor& extractor, FeatureVector& features) {
+  uint64_t total = 0;
+  for (int i = 0; i < ITERATIONS; i++) {
+    uint32_t start = ESP.getCycleCount();
+    extractor.process(frame, features);
+    total += ESP.getCycleCount() - start;
+  }
+  return total / ITERATIONS;
+}
+
+void setupExtractor(FeatureExtractor& extractor, DspBackend backend) {
+  extractor.addBand(0, 200);
+  extractor.addBand(200, 600);
+  extractor.addBand(600, 2000);
+  extractor.begin();
+  extractor.setBackend(backend);
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(1000);
+  Serial.println("\n\n--- Feature Extraction Benchmark ---");
+  Serial.printf("Frame: %u points at %.0f Hz, CPU %u MHz\n", FRAME_SIZE, SAMPLE_RATE, getCpuFrequencyMhz());
+
+  setupExtractor(reference, DspBackend::Reference);
+  setupExtractor(optimized, DspBackend::EspDsp);
+
+  if (optimized.backend() != DspBackend::EspDsp) {
+    Serial.println("ESP-DSP not available, only the reference backend will be measured");
+  }
+}
+
+void loop() {
+  static uint32_t round = 0;
+  fillFrame(++round);
+
+  FeatureVector expected;
+  FeatureVector actual;
+  uint32_t referenceCycles = benchmark(reference, expected);
+  uint32_t optimizedCycles = benchmark(optimized, actual);
+  float error = compare(expected, actual);
+
+  Serial.printf("Reference: %u cycles/frame (%.1f us)\n", referenceCycles, referenceCycles / (float)getCpuFrequencyMhz());
+  Serial.printf("ESP-DSP:   %u cycles/frame (%.1f us), speedup %.2fx\n",
+    optimizedCycles, optimizedCycles / (float)getCpuFrequencyMhz(), referenceCycles / (float)optimizedCycles);
+  Serial.printf("Max relative difference: %.2e %s\n", error, error <= TOLERANCE ? "PASS" : "FAIL");
+  Serial.printf("RMS %.3f, crest %.2f, dominant %.1f Hz\n\n", actual.rms, actual.crest, actual.peaks[0].frequencyHz);
+
+  delay(5000);
+}
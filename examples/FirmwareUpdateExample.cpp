@@ -7,8 +7,9 @@
 // Status LED pin
 const int LED_PIN = 2;  // Use appropriate LED pin for your board
 
-// Firmware update URL (replace with your actual firmware server)
-const char* updateUrl = "http://your-server.com/firmware.bin";
+// Update manifest written by scripts/make_manifest.py (replace with your
+// actual firmware server)
+const char* manifestUrl = "http://your-server.com/manifest.json";
 
 // Create a WiFi manager instance
 WiFiManager wifiManager("YourSSID", "YourPassword", LED_PIN);
@@ -25,25 +26,24 @@ void setup() {
   if (wifiManager.begin()) {
     Serial.println("Connected to WiFi successfully!");
     wifiManager.printStatus();
-    
-    // Check for and perform firmware update
-    Serial.println("Checking for firmware updates...");
-    bool updateResult = wifiManager.updateFirmware(updateUrl, FIRMWARE_VERSION);
-    
-    if (updateResult) {
-      Serial.println("Firmware update process completed.");
-    } else {
-      Serial.println("Firmware update failed or not needed.");
-    }
   } else {
     Serial.println("Failed to connect to WiFi!");
   }
+  
+  // Check the manifest every 6 hours, at a random point of the following
+  // hour so devices do not all ask at once. The manifest is only
+  // downloaded again when it changed, the image only when it differs from
+  // the running one.
+  wifiManager.scheduleUpdateCheck(manifestUrl, FIRMWARE_VERSION);
 }
 
 void loop() {
   // Check WiFi connection status periodically
   wifiManager.checkConnection();
   
+  // Runs the update check when it is due
+  wifiManager.handleUpdateCheck();
+  
   // Your main code here
   
   delay(10000);
@@ -13,15 +13,14 @@ void setup() {
   
   Serial.println("\n\n===== Multi-WiFi Network Example =====");
   
-  // Add multiple WiFi networks (priority order - first added = highest priority)
-  wifiManager.addNetwork("PrimaryNetwork", "password1");
-  wifiManager.addNetwork("BackupNetwork", "password2");
+  // Add multiple WiFi networks; visible ones are ranked by signal strength,
+  // each priority level counting as 10 dB. Networks are kept in NVS, so
+  // re-adding a stored one on every boot only updates it.
+  wifiManager.addNetwork("PrimaryNetwork", "password1", 2);
+  wifiManager.addNetwork("BackupNetwork", "password2", 1);
   wifiManager.addNetwork("WorkNetwork", "password3");
   
-  // Scan for available networks
-  wifiManager.scanNetworks();
-  
-  // Try to connect (will try networks in the order they were added)
+  // Scan once and connect to the best network in range
   if (wifiManager.begin()) {
     Serial.println("Connected to WiFi successfully!");
   } else {
@@ -30,17 +29,20 @@ void setup() {
 }
 
 void loop() {
-  // Periodically check WiFi connection
-  if (!wifiManager.checkConnection()) {
-    Serial.println("WiFi connection lost!");
-    
-    // Attempt to reconnect (will try all networks)
-    if (wifiManager.reconnect()) {
-      Serial.println("Reconnected to WiFi!");
+  static bool wasConnected = true;
+  
+  // Advances the connection state machine; returns immediately
+  bool connected = wifiManager.checkConnection();
+  
+  if (connected != wasConnected) {
+    if (connected) {
+      Serial.printf("Reconnected to WiFi in %lu ms\n", wifiManager.getLastConnectDuration());
     } else {
-      Serial.println("Failed to reconnect to any WiFi network!");
+      // Reconnection (trying all networks) runs in the background
+      Serial.println("WiFi connection lost!");
     }
+    wasConnected = connected;
   }
   
-  delay(10000);  // Check connection every 10 seconds
+  delay(100);
 }
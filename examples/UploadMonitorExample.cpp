@@ -1,5 +1,7 @@
 #include <Arduino.h>
 #include "WiFiManager.h"
+#include "HttpServer.h"
+#include "Log.h"
 
 // Define firmware version
 #define FIRMWARE_VERSION "1.0.0"
@@ -10,6 +12,9 @@ const int LED_PIN = 2;  // Use appropriate LED pin for your board
 // Create WiFi manager
 WiFiManager wifiManager("YourSSID", "YourPassword", LED_PIN);
 
+// One web server for the dashboard, the API and the OTA upload page
+HttpServer httpServer(&wifiManager, 80);
+
 // Sample sensor data
 float temperature = 0.0;
 float humidity = 0.0;
@@ -18,6 +23,9 @@ void setup() {
   Serial.begin(115200);
   delay(1000);
   
+  // Log output (UART and remote monitor) is written by a background task
+  Log::begin();
+  
   Serial.println("\n\n===== Upload & Monitor Example =====");
   Serial.print("Firmware version: ");
   Serial.println(FIRMWARE_VERSION);
@@ -26,8 +34,8 @@ void setup() {
   if (wifiManager.begin()) {
     Serial.println("Connected to WiFi successfully!");
     
-    // Start web server for OTA updates
-    wifiManager.beginUploadServer(80);
+    // Start web server; firmware is uploaded at http://<ip>/update
+    httpServer.begin();
     
     // Start remote monitoring server
     wifiManager.beginRemoteMonitor(23);
@@ -43,7 +51,7 @@ void loop() {
   wifiManager.checkConnection();
   
   // Handle web server requests
-  wifiManager.handleUploadServer();
+  httpServer.handleClient();
   
   // Handle remote monitor
   wifiManager.handleRemoteMonitor();
@@ -57,14 +65,7 @@ void loop() {
     temperature = 20.0 + (random(100) / 10.0);
     humidity = 40.0 + (random(300) / 10.0);
     
-    // Log to serial
-    Serial.print("Temperature: ");
-    Serial.print(temperature);
-    Serial.print("°C, Humidity: ");
-    Serial.print(humidity);
-    Serial.println("%");
-    
-    // Log to remote monitor if connected
+    // Logged to serial and to every connected remote monitor client
     String sensorData = "Sensor reading: Temp=" + String(temperature) + 
                         "°C, Humidity=" + String(humidity) + "%";
     wifiManager.remoteLog(sensorData);
@@ -0,0 +1,67 @@
+#ifndef CHANGE_FILTER_H
+#define CHANGE_FILTER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Maximum number of distinct fields (including nested ones) tracked per filter
+#define CHANGE_FILTER_MAX_FIELDS 16
+
+// Decides whether a JSON document differs enough from the last published one.
+// Numeric fields use a deadband (absolute or percentage of the last published
+// value), everything else is compared by content hash. Nested fields are
+// addressed with dotted paths such as "sampler.jitter_us".
+class ChangeFilter {
+public:
+    // Constructor (maxSilenceMs = 0 disables the keepalive)
+    explicit ChangeFilter(unsigned long maxSilenceMs = 0);
+
+    // A numeric field must move by more than absolute or percent% to count as changed
+    bool setDeadband(const char* field, float absolute, float percent = 0.0f);
+
+    // Exclude a field from change detection (e.g. timestamps)
+    bool ignoreField(const char* field);
+
+    // Publish at least this often even when nothing changed (0 = never)
+    void setMaxSilence(unsigned long maxSilenceMs) { _maxSilenceMs = maxSilenceMs; }
+
+    // True if the document changed or the keepalive is due
+    bool shouldPublish(const JsonDocument& doc);
+
+    // Remember the document as the new baseline
+    void markPublished(const JsonDocument& doc);
+
+    // Forget the baseline so the next document is always published
+    void reset();
+
+    // Counters
+    uint32_t publishedCount() const { return _published; }
+    uint32_t suppressedCount() const { return _suppressed; }
+
+private:
+    struct Field {
+        uint32_t pathHash;
+        float absolute;
+        float percent;
+        float lastValue;
+        uint32_t lastHash;
+        uint16_t seenEpoch;
+        bool ignore;
+        bool hasValue;
+    };
+
+    Field _fields[CHANGE_FILTER_MAX_FIELDS];
+    int _fieldCount;
+    unsigned long _maxSilenceMs;
+    unsigned long _lastPublish;
+    bool _hasBaseline;
+    uint16_t _epoch;
+    uint32_t _published;
+    uint32_t _suppressed;
+
+    Field* findField(uint32_t pathHash, bool create);
+    bool objectChanged(JsonObjectConst object, uint32_t parentHash, bool root);
+    void storeObject(JsonObjectConst object, uint32_t parentHash, bool root);
+};
+
+#endif // CHANGE_FILTER_H
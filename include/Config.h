@@ -11,6 +11,7 @@
 #define WIFI_RETRY_COUNT 5  // Number of times to retry connection
 #define WIFI_RETRY_DELAY 5000  // Delay between retry attempts (5 seconds)
 #define WIFI_CHANNEL 1  // Fixed channel to try connecting on (optional, can help with some routers)
+#define WIFI_POWER_PROFILE WiFiPowerProfile::Balanced  // LowLatency, Balanced or LowPower
 
 // MQTT Configuration (if needed)
 #define MQTT_SERVER "broker.hivemq.com"  // Replace with your MQTT broker address
@@ -29,8 +30,21 @@
 #define HTTP_USERNAME "admin"             // Optional: Username for web interface (uncomment to enable)
 #define HTTP_PASSWORD "admin"             // Optional: Password for web interface (uncomment to enable)
 
+// Firmware version reported over MQTT
+#define FIRMWARE_VERSION "1.0.0"
+
 // Other configurations
 #define SERIAL_BAUD_RATE 115200   // Serial baud rate
+
+// Binary trace stream on the serial port instead of text (decode with
+// scripts/trace_decode.py); 2000000 needs a USB bridge that supports it
+#define TRACE_SERIAL_ENABLED 0    // 1: samples, events and logs as binary frames
+#define TRACE_BAUD_RATE 2000000   // Serial baud rate in trace mode
 #define LED_EXTERNAL_PIN 4        // External LED on GPIO4
 
+// GPIOs that rule actions ("led", "servo") may drive (bit n = GPIO n). Rules
+// arrive over MQTT, so the status LEDs, flash and strapping pins stay out.
+#define RULE_ACTION_PINS ((1ULL << 13) | (1ULL << 14) | (1ULL << 25) | (1ULL << 26) | \
+                          (1ULL << 27) | (1ULL << 32) | (1ULL << 33))
+
 #endif // CONFIG_H
@@ -0,0 +1,94 @@
+#ifndef CREDENTIAL_STORE_H
+#define CREDENTIAL_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Storage layout: one fixed-size NVS blob per network plus an index blob of
+// SSID hashes. 48 records take about 8 KB of the default 20 KB NVS partition.
+#define CREDENTIAL_CAPACITY 48
+#define CREDENTIAL_TABLE_SIZE 128               // hash table slots, power of two >= 2x capacity
+#define CREDENTIAL_PENDING_MAX 4                // networks added before begin()
+#define CREDENTIAL_FAIL_LIMIT 8                 // failStreak saturates here, bounding flash writes during outages
+#define CREDENTIAL_NAMESPACE "wifi_creds"
+
+// One stored network (also the NVS record format)
+struct WiFiCredential {
+    char ssid[33];
+    char password[65];
+    int8_t priority;
+    uint8_t failStreak;                         // consecutive failed attempts
+    uint8_t channel;                            // of the last successful connection
+    uint8_t bssid[6];
+    uint16_t successes;
+    uint32_t lastSuccess;                       // success sequence number, higher = more recent, 0 = never
+};
+
+// WiFi networks persisted in NVS. Only the SSID hashes are kept in RAM
+// (loaded from a single index blob at boot); records are read when a hash
+// matches, so matching a scan result costs one hash and no flash read unless
+// the SSID is stored.
+class CredentialStore {
+public:
+    // Constructor
+    CredentialStore();
+
+    // Load the index and store the networks added so far (needs NVS, so not
+    // from a global constructor)
+    bool begin();
+    bool isReady() const { return _ready; }
+
+    // Add a network, or update the password and priority of a stored one.
+    // Before begin() up to CREDENTIAL_PENDING_MAX are kept in RAM; the next
+    // one opens the store.
+    bool add(const char* ssid, const char* password, int priority);
+
+    // Forget a network
+    bool remove(const char* ssid);
+
+    // Slot of an SSID, or -1; optionally returns the record
+    int find(const char* ssid, WiFiCredential* credential = nullptr) const;
+
+    // Read or rewrite a record
+    bool load(int slot, WiFiCredential& credential) const;
+    bool save(int slot, const WiFiCredential& credential);
+
+    // Connection history (written to NVS)
+    void recordSuccess(int slot, const uint8_t* bssid, uint8_t channel);
+    void recordFailure(int slot);
+
+    // Sequence number of the newest success (lastSuccess of that network).
+    // A persisted counter rather than wall time, which is unknown when a
+    // connection completes.
+    uint32_t lastSequence() const { return _sequence; }
+
+    // Used slots: for (int s = first(); s >= 0; s = next(s))
+    int first() const { return next(-1); }
+    int next(int slot) const;
+    bool isUsed(int slot) const { return slot >= 0 && slot < CREDENTIAL_CAPACITY && _slotHash[slot] != 0; }
+    uint32_t slotHash(int slot) const { return isUsed(slot) ? _slotHash[slot] : 0; }
+
+    // Stored networks (pending ones included before begin())
+    int count() const { return _ready ? _count : _pendingCount; }
+
+    // FNV-1a of an SSID, never 0
+    static uint32_t hash(const char* ssid);
+
+private:
+    uint32_t _slotHash[CREDENTIAL_CAPACITY];    // 0 = free; persisted as the index
+    uint8_t _table[CREDENTIAL_TABLE_SIZE];      // open addressing, slot + 1, 0 = empty
+    int _count = 0;
+    uint32_t _sequence = 0;
+    bool _ready = false;
+    mutable Preferences _prefs;                 // kept open after begin()
+
+    WiFiCredential _pending[CREDENTIAL_PENDING_MAX];
+    int _pendingCount = 0;
+
+    void rebuildTable();
+    void insertTable(int slot);
+    bool saveIndex();
+    static void recordKey(int slot, char* key);
+};
+
+#endif // CREDENTIAL_STORE_H
@@ -0,0 +1,94 @@
+#ifndef DELTA_PATCHER_H
+#define DELTA_PATCHER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <esp_partition.h>
+
+// Patch format made by scripts/make_delta.py (little endian):
+//   header  "ESPD", version, 3 reserved bytes, source size, target size,
+//           source digest (as esp_partition_get_sha256() reports for the
+//           running app), target digest (SHA-256 of the new image)
+//   records diff length, extra length, source seek (signed), then the diff
+//           bytes (added to the source bytes) and the extra bytes (copied)
+#define DELTA_MAGIC "ESPD"
+#define DELTA_VERSION 1
+#define DELTA_HEADER_SIZE 80
+#define DELTA_RECORD_SIZE 12
+#define DELTA_READ_CHUNK 1024                   // source bytes read from flash at a time
+
+// Rebuilds a new image from the running app partition and a bsdiff-style
+// patch streamed in any chunk size. RAM use is the header plus one read
+// chunk; the output goes to the sink as it is produced.
+class DeltaPatcher {
+public:
+    // Receives reconstructed image data; returns false to stop
+    typedef std::function<bool(const uint8_t* data, size_t len)> Sink;
+
+    // Constructor
+    DeltaPatcher();
+
+    // Destructor
+    ~DeltaPatcher();
+
+    // Start applying a patch against source
+    bool begin(const esp_partition_t* source, Sink sink);
+
+    // Apply the next patch bytes; false on error
+    bool write(const uint8_t* data, size_t len);
+
+    // Free the read buffer
+    void end();
+
+    // Header parsed (target size and digest valid)
+    bool hasHeader() const { return _stage > Stage::Header; }
+
+    // The whole target image was produced
+    bool isDone() const { return _stage == Stage::Done; }
+    bool hasError() const { return _stage == Stage::Error; }
+    const char* errorString() const { return _errorString; }
+
+    size_t getTargetSize() const { return _targetSize; }
+    const uint8_t* getTargetDigest() const { return _header + 48; }
+
+    // First byte of a patch
+    static bool isPatch(uint8_t firstByte) { return firstByte == DELTA_MAGIC[0]; }
+
+private:
+    enum class Stage : uint8_t {
+        Header,
+        Record,
+        Diff,
+        Extra,
+        Done,
+        Error
+    };
+
+    const esp_partition_t* _source = nullptr;
+    Sink _sink;
+    Stage _stage = Stage::Error;
+    const char* _errorString = "";
+
+    uint8_t _header[DELTA_HEADER_SIZE];
+    uint8_t _record[DELTA_RECORD_SIZE];
+    size_t _position = 0;                       // within the header or record
+    uint8_t* _buffer = nullptr;
+
+    size_t _sourceSize = 0;
+    size_t _targetSize = 0;
+    size_t _sourcePos = 0;
+    size_t _output = 0;
+    size_t _diffRemaining = 0;
+    size_t _extraRemaining = 0;
+    int32_t _seek = 0;
+
+    size_t readHeader(const uint8_t* data, size_t len);
+    size_t readRecord(const uint8_t* data, size_t len);
+    size_t applyDiff(const uint8_t* data, size_t len);
+    size_t copyExtra(const uint8_t* data, size_t len);
+    void nextRecord();
+    bool fail(const char* message);
+    static uint32_t readLE32(const uint8_t* data);
+};
+
+#endif // DELTA_PATCHER_H
@@ -4,15 +4,65 @@
 #include <Arduino.h>
 #include "WiFiManager.h"
 #include "MQTTManager.h"
+#include "Scheduler.h"
+#include "NetworkTask.h"
+#include "SensorPipeline.h"
+#include "ChangeFilter.h"
+#include "FeatureExtractor.h"
+#include "TimeSeriesStore.h"
+#include "RuleEngine.h"
+#include "TraceChannel.h"
+
+// Intervals of the periodic tasks registered by DeviceManager
+#define DEVICE_CONNECTION_CHECK_INTERVAL 1000
+#define DEVICE_MQTT_LOOP_INTERVAL 10
+#define DEVICE_COMMAND_POLL_INTERVAL 20
+#define DEVICE_SAMPLE_DRAIN_INTERVAL 20
+#define DEVICE_STATUS_CHECK_INTERVAL 60000
+
+// Change-driven publishing: unchanged telemetry is held back until the
+// keepalive expires, unchanged retained status is never republished
+#define DEVICE_TELEMETRY_MAX_SILENCE 300000
+#define DEVICE_HEAP_DEADBAND_PERCENT 10
+#define DEVICE_RSSI_DEADBAND 6
+#define DEVICE_JITTER_DEADBAND_US 100
 
 class DeviceManager {
 private:
     WiFiManager* _wifiManager;
     MQTTManager* _mqttManager;
     
-    unsigned long _lastDataPublish;
+    // Network task owning WiFi/MQTT when running split across cores
+    NetworkTask* _network;
+    uint32_t _mqttConnectsSeen;             // network task connect count already handled
+    
+    // Periodic work runs on a scheduler (internal unless a shared one is set)
+    Scheduler _ownScheduler;
+    Scheduler* _scheduler;
+    int _telemetryTaskId;
     unsigned long _dataSendInterval;
     
+    // Sensor sampling with one aggregation window per source
+    Sampler _sampler;
+    StreamingStats _windows[SAMPLER_MAX_SOURCES];
+    
+    // Change detection for every published document
+    ChangeFilter _heartbeatFilter;
+    ChangeFilter _statusFilter;
+    ChangeFilter _sensorFilters[SAMPLER_MAX_SOURCES];
+    
+    // Optional per-sensor DSP stage
+    FeatureExtractor* _extractors[SAMPLER_MAX_SOURCES];
+    
+    // On-device history of every telemetry value (optional)
+    TimeSeriesStore* _history;
+    
+    // Binary serial stream receiving every sample (optional)
+    TraceChannel* _trace;
+    
+    // Local rules evaluated on every sample; only their events leave the device
+    RuleEngine _rules;
+    
     // LED pins for status indication
     int _wifiLedPin;
     int _mqttLedPin;
@@ -32,19 +82,54 @@ public:
         unsigned long dataSendInterval = 30000
     );
     
+    // Use a shared scheduler instead of the internal one (call before begin)
+    void useScheduler(Scheduler* scheduler);
+    
+    // Run application logic only and exchange data with a network task
+    // through its queues (call before begin)
+    void attachNetworkTask(NetworkTask* network);
+    
+    // Sample a sensor at rateHz; its windowed statistics are published with
+    // every telemetry message. With an extractor, every completed frame is
+    // also reduced to a feature vector on features/<name> (call before begin)
+    bool addSensor(SensorSource* source, float rateHz, FeatureExtractor* extractor = nullptr);
+    
+    // Keep a history of heap, sensor statistics and features, recorded
+    // whether or not MQTT is connected
+    void attachHistory(TimeSeriesStore* history);
+    
+    // Stream every raw sample over a trace channel, ahead of any
+    // aggregation (call after begin() so the actual rates are announced)
+    void attachTrace(TraceChannel* trace);
+    
+    // Rules engine (register local actions such as "led" or "servo" here).
+    // Rules are loaded at runtime through control/rules/<id> messages
+    RuleEngine& rules() { return _rules; }
+    
+    // Change the telemetry publish interval
+    void setDataSendInterval(unsigned long intervalMs);
+    
+    // Statistics of the named sensor must move by more than absolute or
+    // percent% before they are published again
+    bool setSensorDeadband(const char* sensorName, float absolute, float percent = 0.0f);
+    
+    // Publish unchanged telemetry at least this often (0 = only on change)
+    void setTelemetryKeepalive(unsigned long maxSilenceMs);
+    
     // Initialize device manager
     bool begin();
     
     // Main loop function - call this in the main Arduino loop
+    // (not needed when a shared scheduler is used)
     void loop();
     
     // Check connections status (WiFi and MQTT)
     bool checkConnections();
     
-    // Send device status information
-    void sendStatusInfo();
+    // Send device status information if it changed (force = publish anyway)
+    void sendStatusInfo(bool force = false);
     
-    // Send telemetry data (should be implemented in derived classes)
+    // Send telemetry data (heartbeat plus sensor statistics; may be extended in derived classes)
     virtual void sendTelemetryData();
     
     // Process MQTT commands
@@ -55,6 +140,48 @@ public:
     
     // Set status LED states
     void updateStatusLEDs();
+    
+protected:
+    // Publish through the network task when attached, directly otherwise
+    bool publishJson(const char* topic, const JsonDocument& jsonDoc, bool retain = false);
+    bool publish(const char* topic, const char* payload, bool retain = false);
+    
+    // MQTT connection state (safe to call from the application core)
+    bool isMqttConnected() const;
+    
+    // Called on the application core for every sample taken
+    virtual void onSample(int sourceIndex, float value, uint32_t timestampUs);
+    
+    // Called for every completed feature frame (publishes it by default)
+    virtual void onFeatures(int sourceIndex, const FeatureVector& features);
+    
+    // Publish the statistics of every sensor window and start new windows
+    void publishSensorStats();
+    
+    // Add, replace or remove a rule received over MQTT and report the result
+    void handleRuleCommand(const char* id, const String& payload);
+    
+    // Change log levels from a control/log message
+    void handleLogCommand(const String& payload);
+    
+    // Publish a rule transition to events/<rule id>
+    void publishRuleEvent(const RuleEvent& event);
+    
+    // Record a value in the history, if one is attached
+    void recordHistory(const char* metric, float value);
+    
+    // Publish a document only if its filter reports a change
+    bool publishIfChanged(ChangeFilter& filter, const char* topic, const JsonDocument& jsonDoc, bool retain);
+    
+private:
+    // Register connection, MQTT and telemetry tasks on the scheduler
+    void registerTasks();
+    
+    // Handle commands queued by the network task
+    void processQueuedCommands();
+    
+    // Move buffered samples into the aggregation windows
+    void drainSamples();
 };
 
 #endif // DEVICE_MANAGER_H
@@ -0,0 +1,113 @@
+#ifndef FEATURE_EXTRACTOR_H
+#define FEATURE_EXTRACTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Feature extraction limits
+#define FEATURE_MAX_FRAME 1024          // largest FFT size (power of two)
+#define FEATURE_MAX_BANDS 8
+#define FEATURE_MAX_PEAKS 3
+
+// ESP-DSP ships with the ESP32 Arduino core; elsewhere only the reference
+// implementation is compiled
+#if defined(ESP_PLATFORM) && defined(__has_include)
+#if __has_include("esp_dsp.h")
+#define FEATURE_HAVE_ESP_DSP 1
+#endif
+#endif
+#ifndef FEATURE_HAVE_ESP_DSP
+#define FEATURE_HAVE_ESP_DSP 0
+#endif
+
+// Kernels used to process a frame
+enum class DspBackend {
+    Reference,      // portable C++, also builds on the host
+    EspDsp          // ESP-DSP optimized routines (SIMD on ESP32-S3)
+};
+
+// A spectral peak with interpolated frequency and sinusoid amplitude
+struct SpectralPeak {
+    float frequencyHz;
+    float amplitude;
+};
+
+// Compact summary of one frame
+struct FeatureVector {
+    uint32_t frame;                     // frame counter
+    float mean;                         // DC component
+    float rms;                          // RMS of the AC component
+    float peak;                         // largest absolute deviation from the mean
+    float crest;                        // peak / rms
+    uint8_t peakCount;
+    SpectralPeak peaks[FEATURE_MAX_PEAKS];      // strongest first
+    uint8_t bandCount;
+    float bandPower[FEATURE_MAX_BANDS];         // mean-square power per band
+};
+
+// Windowed FFT, band powers, RMS, crest factor and peak detection over
+// fixed-size, non-overlapping frames
+class FeatureExtractor {
+public:
+    // Constructor (frameSize must be a power of two up to FEATURE_MAX_FRAME)
+    explicit FeatureExtractor(uint16_t frameSize = FEATURE_MAX_FRAME, float sampleRateHz = 1000.0f);
+
+    // Destructor
+    ~FeatureExtractor();
+
+    // Report the power between lowHz and highHz (call before begin)
+    bool addBand(float lowHz, float highHz);
+
+    // Sample rate of the incoming data (the sampler may round the requested rate)
+    void setSampleRate(float sampleRateHz) { _sampleRate = sampleRateHz; }
+
+    // Allocate buffers and initialize the selected backend
+    bool begin();
+
+    // Release buffers
+    void end();
+
+    // Select the kernels; EspDsp falls back to Reference when unavailable
+    void setBackend(DspBackend backend);
+    DspBackend backend() const { return _backend; }
+
+    // Append one sample; returns true when a frame completed and features() was updated
+    bool push(float sample);
+
+    // Process a complete frame of frameSize() samples
+    bool process(const float* frame, FeatureVector& features);
+
+    // Features of the last completed frame
+    const FeatureVector& features() const { return _features; }
+
+    uint16_t frameSize() const { return _frameSize; }
+    float sampleRate() const { return _sampleRate; }
+    int bandCount() const { return _bandCount; }
+    float bandLow(int index) const { return _bandLow[index]; }
+    float bandHigh(int index) const { return _bandHigh[index]; }
+
+private:
+    uint16_t _frameSize;
+    float _sampleRate;
+    DspBackend _backend;
+
+    int _bandCount;
+    float _bandLow[FEATURE_MAX_BANDS];
+    float _bandHigh[FEATURE_MAX_BANDS];
+
+    float* _frame;          // samples collected by push()
+    float* _scratch;        // AC component of the frame
+    float* _window;         // Hann window
+    float* _work;           // interleaved complex FFT buffer, then power spectrum
+    float* _twiddle;        // reference twiddle factors
+    float _windowSum;
+    float _windowPower;
+    uint16_t _fill;
+    uint32_t _frameCount;
+    FeatureVector _features;
+
+    void referenceFft(float* data) const;
+    void extractSpectralFeatures(FeatureVector& features) const;
+};
+
+#endif // FEATURE_EXTRACTOR_H
@@ -0,0 +1,180 @@
+#ifndef FIRMWARE_UPDATER_H
+#define FIRMWARE_UPDATER_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include "OtaWriter.h"
+
+#define FIRMWARE_UPDATE_CHUNK 1460              // one TCP segment per read
+#define FIRMWARE_UPDATE_TIMEOUT 20000           // no data for this long drops the connection (ms)
+#define FIRMWARE_UPDATE_REPORT 65536            // progress log interval (bytes)
+
+// Resuming: after a drop the download continues with a Range request; a
+// checkpoint in NVS lets a plain image continue after a reboot as well
+#define FIRMWARE_UPDATE_RETRIES 8               // consecutive attempts without progress
+#define FIRMWARE_UPDATE_RETRY_DELAY 1000        // first retry delay, doubled per attempt (ms)
+#define FIRMWARE_UPDATE_RETRY_MAX_DELAY 30000
+#define FIRMWARE_CHECKPOINT_INTERVAL 65536      // flash progress between NVS checkpoints (bytes)
+#define FIRMWARE_CHECKPOINT_NAMESPACE "ota_resume"
+
+// Manifest checks (see checkManifest())
+#define FIRMWARE_MANIFEST_MAX_SIZE 6144         // larger manifests are rejected (bytes)
+#define FIRMWARE_MANIFEST_NAMESPACE "ota_manifest"
+#define FIRMWARE_CHECK_INTERVAL 21600000UL      // time between scheduled checks (6 h)
+#define FIRMWARE_CHECK_WINDOW 3600000UL         // each check lands at a random point of this window (1 h)
+
+// Peer-assisted downloads: devices advertise their running image as mDNS
+// _firmware._tcp (TXT "sha" = first 16 hex digits of its SHA-256) and serve
+// it at /firmware.bin (HttpServer)
+#define FIRMWARE_PEER_SERVICE "firmware"
+#define FIRMWARE_PEER_PATH "/firmware.bin"
+#define FIRMWARE_PEER_MAX 8                     // peers used per download
+#define FIRMWARE_PEER_MAX_FAILURES 2            // failed chunks before a peer is dropped
+#define FIRMWARE_PEER_TIMEOUT 5000              // no data for this long fails a chunk (ms)
+#define FIRMWARE_CHUNK_MAX 16384                // largest manifest chunk accepted (buffered in RAM)
+#define FIRMWARE_CHUNK_HASH_SIZE 16             // truncated SHA-256 per chunk in the manifest
+
+// Outcome of an update check
+enum class FirmwareUpdateResult : uint8_t {
+    Updated,                                    // new image written, reboot to run it
+    NoUpdate,                                   // server answered 304 Not Modified
+    Failed
+};
+
+// Interrupted download of a plain image (NVS record)
+struct FirmwareCheckpoint {
+    uint32_t urlHash;
+    uint32_t partition;                         // address of the partition being written
+    uint32_t size;                              // whole image
+    uint32_t offset;                            // bytes in flash, sector aligned
+    uint8_t sha256[32];                         // expected image digest
+    bool hasSha256;
+    char etag[64];                              // sent as If-Range, empty if the server gave none
+};
+
+// A device on the LAN serving the image being downloaded
+struct FirmwarePeer {
+    IPAddress ip;
+    uint16_t port;
+    uint8_t failures;
+};
+
+// Manifest already acted on (NVS record), valid while the same image runs
+struct FirmwareManifestState {
+    uint8_t runningDigest[32];                  // as esp_partition_get_sha256() reports
+    char etag[64];                              // sent as If-None-Match
+};
+
+// Downloads a firmware image over HTTP straight into an OtaWriter. Plain and
+// gzip images (scripts/compress_firmware.py) are accepted; gzip is asked for
+// with Accept-Encoding and recognised by its magic bytes, so a server may
+// serve either for the same URL. The digest of the running image is sent as
+// x-ESP32-delta-base, so a server holding a patch from that image
+// (scripts/make_delta.py) can send the patch instead; if applying it fails
+// the full image is requested.
+//
+// A dropped connection is resumed with "Range: bytes=<received>-" and
+// If-Range (the ETag), keeping the decoder state, so nothing is downloaded
+// twice. Plain images are also checkpointed to NVS and resume after a reboot
+// from the last checkpoint; the bytes already in flash are hashed again and
+// the whole image is verified at the end. scripts/flaky_ota_server.py serves
+// images with injected drops for testing, and scripts/ota_host/run.sh runs
+// this class on Linux against it.
+class FirmwareUpdater {
+public:
+    // Constructor
+    FirmwareUpdater();
+
+    // Download and verify an image; sha256 (optional) is that of the
+    // uncompressed image (or the image a patch rebuilds)
+    FirmwareUpdateResult update(const String& url, const String& currentVersion = "",
+                                const uint8_t* sha256 = nullptr);
+
+    // Fetch a JSON manifest and update only when it names a different image:
+    //   {"version": "1.2.0", "url": "firmware.bin", "sha256": "<hex>",
+    //    "chunk": 16384, "chunks": "<hex>"}
+    // url may be relative to the manifest. The image is downloaded when its
+    // sha256 differs from the running image and its version is newer (or the
+    // same version rebuilt); older versions are never installed. The
+    // manifest's ETag is kept once it has been found current and sent as
+    // If-None-Match, so an unchanged manifest costs a 304.
+    //
+    // With chunk hashes (scripts/make_manifest.py) the image is fetched in
+    // chunks from peers already running it, each chunk checked against the
+    // manifest; a chunk no peer delivers comes from the origin (a Range
+    // request), and without peers the image is downloaded as by update().
+    FirmwareUpdateResult checkManifest(const String& manifestUrl, const String& currentVersion);
+
+    // Basic auth credentials of the peers' HttpServer
+    void setPeerCredentials(const String& username, const String& password);
+
+    // Bytes of the last update that came from peers and from the origin
+    size_t getPeerBytes() const { return _peerBytes; }
+    size_t getOriginBytes() const { return _originBytes; }
+
+    // SHA-256 and size of the running image file, as a manifest lists it;
+    // hashed from flash on first use
+    static bool getRunningImage(uint8_t* sha256, size_t* size);
+
+    // Semantic version precedence (-1, 0, 1); a leading "v" and build
+    // metadata are ignored
+    static int compareVersions(const char* a, const char* b);
+
+    // Error of the last failed update
+    const char* errorString() const { return _errorString; }
+
+    // Transfer statistics of the last update
+    OtaStats getStats() const { return _writer.getStats(); }
+    float getKBps() const { return _writer.getKBps(); }
+
+    // Connections that were resumed during the last update
+    int getResumeCount() const { return _resumes; }
+
+    // Drop a saved checkpoint (the next update starts from zero)
+    static void clearCheckpoint();
+
+private:
+    enum class FetchResult : uint8_t {
+        Complete,
+        NotModified,
+        Dropped,                                // retry from where it stopped
+        Failed
+    };
+
+    OtaWriter _writer;
+    const char* _errorString = "";
+    uint8_t _buffer[FIRMWARE_UPDATE_CHUNK];
+    char _runningDigest[65] = "";               // hex, computed on first use
+
+    // Peer downloads
+    String _peerUsername;
+    String _peerPassword;
+    uint8_t* _chunk = nullptr;                  // chunk being verified
+    size_t _peerBytes = 0;
+    size_t _originBytes = 0;
+
+    // Current download
+    FirmwareCheckpoint _checkpoint;
+    size_t _fetched = 0;                        // body bytes of the last request
+    int _resumes = 0;
+
+    FirmwareUpdateResult download(const String& url, const String& currentVersion, const uint8_t* sha256,
+                                  bool allowDelta);
+    FetchResult fetch(const String& url, const String& currentVersion, const uint8_t* sha256, bool allowDelta);
+    bool startImage(size_t size, const uint8_t* sha256, const String& etag);
+    bool resumeFromCheckpoint(const String& url, const uint8_t* sha256);
+    void saveCheckpoint(bool force);
+    FirmwareUpdateResult downloadChunks(const String& url, const String& currentVersion, const uint8_t* sha256,
+                                        size_t size, size_t chunkSize, const uint8_t* chunkHashes);
+    int discoverPeers(const uint8_t* sha256, FirmwarePeer* peers);
+    bool fetchRange(const String& url, size_t start, size_t length, bool peer);
+    bool chunkMatches(const uint8_t* expected, size_t length);
+    const char* runningDigest();
+    static void storeManifestState(const char* etag);
+    static String resolveUrl(const String& base, const String& url);
+    static bool parseHex(const char* hex, uint8_t* data, size_t length);
+    FirmwareUpdateResult fail(const char* message);
+    static uint32_t hashUrl(const String& url);
+};
+
+#endif // FIRMWARE_UPDATER_H
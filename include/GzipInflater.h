@@ -0,0 +1,100 @@
+#ifndef GZIP_INFLATER_H
+#define GZIP_INFLATER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <esp32/rom/miniz.h>
+
+// Deflate history kept in RAM. Images made by scripts/compress_firmware.py
+// carry an "ES" extra field (window bits, image size) so the ring buffer
+// only needs to cover the window they were compressed with; plain gzip
+// files fall back to the full 32 KB.
+#define GZIP_WINDOW_MAX TINFL_LZ_DICT_SIZE
+#define GZIP_WINDOW_MIN 1024
+#define GZIP_EXTRA_ID1 'E'
+#define GZIP_EXTRA_ID2 'S'
+#define GZIP_EXTRA_BUFFER 32                    // extra field bytes examined
+
+// Streaming gzip decoder on top of the ROM inflater (tinfl). Input of any
+// size is decompressed through a fixed ring window and handed to the sink as
+// it is produced; the CRC-32 and length in the trailer are checked.
+class GzipInflater {
+public:
+    // Receives decompressed data; returns false to stop
+    typedef std::function<bool(const uint8_t* data, size_t len)> Sink;
+
+    // Constructor
+    GzipInflater();
+
+    // Destructor
+    ~GzipInflater();
+
+    // Start a stream
+    bool begin(Sink sink);
+
+    // Decompress the next input bytes; false on error
+    bool write(const uint8_t* data, size_t len);
+
+    // Free the window and decompressor
+    void end();
+
+    // Trailer read and verified
+    bool isDone() const { return _stage == Stage::Done; }
+    bool hasError() const { return _stage == Stage::Error; }
+    const char* errorString() const { return _errorString; }
+
+    // Decompressed bytes so far
+    size_t getOutputSize() const { return _outputSize; }
+
+    // Uncompressed size from the "ES" extra field, 0 = unknown
+    size_t getImageSize() const { return _imageSize; }
+    size_t getWindowSize() const { return _windowSize; }
+
+    // gzip magic
+    static bool isGzip(uint8_t firstByte) { return firstByte == 0x1F; }
+
+private:
+    enum class Stage : uint8_t {
+        Header,
+        ExtraLength,
+        Extra,
+        Name,
+        Comment,
+        HeaderCrc,
+        Body,
+        Trailer,
+        Done,
+        Error
+    };
+
+    Sink _sink;
+    Stage _stage = Stage::Error;
+    const char* _errorString = "";
+
+    // Header parsing
+    uint8_t _header[10];
+    uint8_t _extra[GZIP_EXTRA_BUFFER];
+    size_t _position = 0;                       // within the current header field or trailer
+    size_t _extraLength = 0;
+    uint8_t _windowBits = 0;
+    size_t _imageSize = 0;
+
+    // Decompression
+    tinfl_decompressor* _decompressor = nullptr;
+    uint8_t* _window = nullptr;
+    size_t _windowSize = 0;
+    size_t _windowPos = 0;
+    size_t _outputSize = 0;
+    uint32_t _crc = 0;
+    uint8_t _trailer[8];
+
+    size_t parseHeader(const uint8_t* data, size_t len);
+    void nextField(Stage stage);
+    void parseExtra();
+    bool startBody();
+    size_t inflate(const uint8_t* data, size_t len);
+    size_t readTrailer(const uint8_t* data, size_t len);
+    bool fail(const char* message);
+};
+
+#endif // GZIP_INFLATER_H
@@ -6,6 +6,7 @@
 #include <WebServer.h>
 #include <functional>
 #include "WiFiManager.h"
+#include "OtaWriter.h"
 
 class HttpServer {
 private:
@@ -18,7 +19,20 @@ private:
     void handleNotFound();
     void handleStatus();
     void handleNetworkInfo();
+    void handleWiFiScan();
+    void handleWiFiMetrics();
+    void handleWiFiPower();
+    void handleFirmwareImage();
     void setupDefaultRoutes();
+    void advertiseFirmware();
+    
+    // Firmware upload (/update), flashed while it is received
+    OtaWriter _otaWriter;
+    size_t _otaLastReport;
+    bool _uploadAuthorized;
+    void handleUpdatePage();
+    void handleUpdateUpload();
+    void handleUpdateComplete();
     
     // Security (optional for basic auth)
     String _username;
@@ -0,0 +1,31 @@
+#ifndef JSON_SNAPSHOT_H
+#define JSON_SNAPSHOT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/semphr.h>
+
+// Serialized JSON document handed from one core to another: the owner of
+// the state stores a fresh copy periodically, readers on the other core
+// (HTTP handlers on the network task) get the last stored text. Only the
+// copy is done under the lock, never the serialization.
+class JsonSnapshot {
+public:
+    // Constructor
+    JsonSnapshot();
+
+    // Destructor
+    ~JsonSnapshot();
+
+    // Replace the stored document (owner side)
+    void store(const JsonDocument& doc);
+
+    // Last stored document as JSON text ("{}" before the first store)
+    String load() const;
+
+private:
+    SemaphoreHandle_t _mutex;
+    String _json;
+};
+
+#endif // JSON_SNAPSHOT_H
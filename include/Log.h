@@ -0,0 +1,157 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+#include <freertos/ringbuf.h>
+
+// Levels, most severe first
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+// Build-time ceiling: calls above it are compiled out together with their
+// arguments. Set with -DLOG_LEVEL=..., or per module with -DLOG_LEVEL_WIFI=...
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef LOG_LEVEL_APP
+#define LOG_LEVEL_APP LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_HTTP
+#define LOG_LEVEL_HTTP LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_DEVICE
+#define LOG_LEVEL_DEVICE LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_NET
+#define LOG_LEVEL_NET LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_OTA
+#define LOG_LEVEL_OTA LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_STORAGE
+#define LOG_LEVEL_STORAGE LOG_LEVEL
+#endif
+
+#define LOG_MESSAGE_MAX 160                     // longer messages are truncated
+#define LOG_QUEUE_SIZE 4096                     // bytes of messages waiting for the log task
+#define LOG_TASK_STACK 4096
+#define LOG_TASK_PRIORITY 1                     // just above idle: output waits for everything else
+#define LOG_MAX_SINKS 4
+#define LOG_FLUSH_TIMEOUT 500                   // longest flush() wait (ms)
+
+// Source of a message; each has its own runtime level
+enum class LogModule : uint8_t {
+    App,
+    WiFi,
+    Mqtt,
+    Http,
+    Device,
+    Net,
+    Ota,
+    Storage,
+    Count
+};
+
+// A formatted message as queued for the log task (only the used part of
+// text is queued)
+struct LogEntry {
+    uint32_t ms;                                // millis() when logged
+    LogModule module;
+    uint8_t level;
+    uint16_t length;
+    char text[LOG_MESSAGE_MAX];
+};
+
+// Receives the messages at or below its level, on the log task
+typedef std::function<void(const LogEntry& entry)> LogSink;
+
+// Logging from a source file: define its module and build-time level, e.g.
+//   #define LOG_MODULE LogModule::WiFi
+//   #define LOG_MODULE_LEVEL LOG_LEVEL_WIFI
+// then LOG_E/W/I/D/V("format", ...) with printf formatting
+#define LOG_AT(level, ...)                                                          \
+    do {                                                                            \
+        if ((level) <= LOG_MODULE_LEVEL && Log::enabled(LOG_MODULE, (level))) {     \
+            Log::write(LOG_MODULE, (level), __VA_ARGS__);                           \
+        }                                                                           \
+    } while (0)
+#define LOG_E(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_W(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_I(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_D(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_V(...) LOG_AT(LOG_LEVEL_VERBOSE, __VA_ARGS__)
+
+// Leveled logging with deferred output. A call formats its message into a
+// small record (a few microseconds) and queues it in a ring buffer that any
+// task may write to without waiting; a low-priority task takes the records
+// and hands them to the sinks (UART, remote monitor, MQTT), so no caller
+// waits for the UART. When the buffer is full the message is dropped and
+// counted. Before begin() messages go straight to Serial.
+class Log {
+public:
+    // Start the log task with a UART sink
+    static bool begin(uint8_t uartLevel = LOG_LEVEL_VERBOSE);
+
+    // Queue a message (use the LOG_x macros, which filter first)
+    static void write(LogModule module, uint8_t level, const char* format, ...)
+        __attribute__((format(printf, 3, 4)));
+
+    // Runtime filter
+    static bool enabled(LogModule module, uint8_t level) { return level <= _levels[(uint8_t)module]; }
+    static void setLevel(LogModule module, uint8_t level);
+    static void setLevel(uint8_t level);        // every module
+    static uint8_t getLevel(LogModule module) { return _levels[(uint8_t)module]; }
+
+    // Set a level by name ("wifi", "debug"); module "all" sets every module
+    static bool setLevel(const char* module, const char* level);
+
+    // Add a sink receiving messages at or below level; false when full
+    static bool addSink(LogSink sink, uint8_t level = LOG_LEVEL_VERBOSE);
+
+    // Format an entry as one output line ("W (12345) wifi: text\r\n")
+    static size_t format(const LogEntry& entry, char* out, size_t size);
+
+    // Names as used by format() and setLevel()
+    static const char* moduleName(LogModule module);
+    static const char* levelName(uint8_t level);
+
+    // Wait until the queued messages are written (before a restart)
+    static void flush(uint32_t timeoutMs = LOG_FLUSH_TIMEOUT);
+
+    // Messages lost because the buffer was full
+    static uint32_t dropped() { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Sink {
+        LogSink sink;
+        uint8_t level;
+    };
+
+    static uint8_t _levels[(uint8_t)LogModule::Count];
+    static Sink _sinks[LOG_MAX_SINKS];
+    static std::atomic<int> _sinkCount;
+    static RingbufHandle_t _ring;
+    static TaskHandle_t _task;
+    static std::atomic<uint32_t> _dropped;
+    static std::atomic<uint32_t> _queued;
+    static std::atomic<uint32_t> _delivered;
+    static uint32_t _reportedDrops;             // log task only
+
+    static void taskEntry(void* arg);
+    static void deliver(const LogEntry& entry);
+    static void reportDrops();
+};
+
+#endif // LOG_H
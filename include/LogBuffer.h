@@ -0,0 +1,57 @@
+#ifndef LOG_BUFFER_H
+#define LOG_BUFFER_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define LOG_BUFFER_SIZE 8192                    // must be a power of two
+#define LOG_BACKLOG 4096                        // replayed to a newly attached reader (bytes)
+#define LOG_GAP_MARKER_SIZE 48
+
+// A reader's position in the log stream
+struct LogCursor {
+    uint32_t position = 0;                      // next byte to read
+    uint32_t gap = 0;                           // bytes skipped, reported before the next data
+    uint32_t dropped = 0;                       // total bytes this reader missed
+};
+
+// Lock-free byte ring for log text with any number of readers, each keeping
+// its own LogCursor. Exactly one task may call write(); it never blocks and
+// overwrites the oldest bytes when the ring is full. Readers never modify
+// the ring, so they cannot hold the writer up: a reader that falls more than
+// the ring size behind is moved to the oldest intact line and gets a gap
+// marker ("[... N bytes dropped]") in place of what it missed.
+class LogBuffer {
+public:
+    // Constructor
+    LogBuffer();
+
+    // Append log text (writer only); only the last LOG_BUFFER_SIZE bytes of
+    // a longer message are kept
+    void write(const char* data, size_t len);
+    void write(const String& text) { write(text.c_str(), text.length()); }
+
+    // Cursor at the first line starting within the last backlog bytes
+    LogCursor attach(size_t backlog = LOG_BACKLOG) const;
+
+    // Copy the next bytes for a reader (a gap marker first if it fell
+    // behind) without moving its cursor; returns 0 when it is up to date
+    size_t read(LogCursor& cursor, char* out, size_t max) const;
+
+    // Move the cursor past bytes returned by read() that were delivered
+    void advance(LogCursor& cursor, size_t len) const;
+
+    // Total bytes written since start
+    uint32_t written() const { return _head.load(std::memory_order_acquire); }
+
+private:
+    char _data[LOG_BUFFER_SIZE];
+    std::atomic<uint32_t> _head;                // end of the published bytes
+    std::atomic<uint32_t> _reserved;            // end of the bytes being written (>= _head)
+
+    size_t copy(uint32_t position, char* out, size_t len) const;
+    bool intact(uint32_t position) const;
+    uint32_t nextLine(uint32_t position, uint32_t head) const;
+};
+
+#endif // LOG_BUFFER_H
@@ -6,6 +6,9 @@
 #include <WiFi.h>
 #include <ArduinoJson.h>
 
+// PubSubClient packet buffer (default of 256 bytes is too small for JSON documents)
+#define MQTT_BUFFER_SIZE 1536
+
 class MQTTManager {
 private:
     WiFiClient _wifiClient;
@@ -50,6 +53,9 @@ public:
     // Publish message to a topic
     bool publish(const String& topic, const String& payload, bool retain = false);
     
+    // Publish raw bytes to a topic
+    bool publish(const char* topic, const uint8_t* payload, size_t length, bool retain = false);
+    
     // Publish JSON data to a topic
     bool publishJson(const String& topic, const JsonDocument& jsonDoc, bool retain = false);
     
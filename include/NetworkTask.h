@@ -0,0 +1,128 @@
+#ifndef NETWORK_TASK_H
+#define NETWORK_TASK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "WiFiManager.h"
+#include "MQTTManager.h"
+#include "HttpServer.h"
+#include "Scheduler.h"
+#include "SpscQueue.h"
+#include "Log.h"
+
+// Network task placement (core 0 is shared with the WiFi driver; the Arduino
+// loop and all application logic stay on core 1)
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_STACK 8192
+#define NETWORK_TASK_PRIORITY 2
+
+// Intervals of the periodic work done by the network task
+#define NETWORK_WIFI_CHECK_INTERVAL 100     // drives the WiFi state machine, O(1) per call
+#define NETWORK_MQTT_INTERVAL 10
+#define NETWORK_HTTP_INTERVAL 20
+#define NETWORK_STATUS_INTERVAL 5000        // refresh of the WiFi status snapshot
+
+// SNTP servers queried once WiFi is up; timestamps (history, credential
+// metadata) are uptime-based until the clock has been set
+#define NETWORK_NTP_SERVER_1 "pool.ntp.org"
+#define NETWORK_NTP_SERVER_2 "time.google.com"
+
+// Message sizes exchanged between the cores
+#define NETWORK_TOPIC_MAX 64
+#define NETWORK_PAYLOAD_MAX 384
+#define NETWORK_OUTBOUND_SLOTS 16
+#define NETWORK_COMMAND_SLOTS 8
+
+// Log messages at or below this level are published to <prefix><device>/log
+#define NETWORK_LOG_LEVEL LOG_LEVEL_WARN
+#define NETWORK_LOG_SLOTS 4
+
+// Outbound MQTT message (application core -> network core)
+struct OutboundMessage {
+    char topic[NETWORK_TOPIC_MAX];      // suffix, prefixed by MQTTManager::buildTopic
+    char payload[NETWORK_PAYLOAD_MAX];
+    uint16_t length;
+    bool retain;
+};
+
+// Inbound MQTT command (network core -> application core)
+struct InboundCommand {
+    char topic[NETWORK_TOPIC_MAX + 32]; // full topic as received
+    char payload[NETWORK_PAYLOAD_MAX];
+    uint16_t length;
+};
+
+typedef SpscQueue<OutboundMessage, NETWORK_OUTBOUND_SLOTS> OutboundQueue;
+typedef SpscQueue<InboundCommand, NETWORK_COMMAND_SLOTS> CommandQueue;
+typedef SpscQueue<OutboundMessage, NETWORK_LOG_SLOTS> LogQueue;        // log task -> network core
+
+class NetworkTask {
+public:
+    // Constructor (httpServer is optional)
+    NetworkTask(WiFiManager* wifiManager, MQTTManager* mqttManager, HttpServer* httpServer = nullptr);
+
+    // Create the network task pinned to a core; WiFi, MQTT and HTTP are started from it
+    bool begin(BaseType_t core = NETWORK_TASK_CORE);
+
+    // Queue a message for publishing (application side, never blocks)
+    bool publish(const char* topicSuffix, const char* payload, bool retain = false);
+
+    // Serialize a JSON document straight into the outbound queue
+    bool publishJson(const char* topicSuffix, const JsonDocument& jsonDoc, bool retain = false);
+
+    // Take the next received command (application side)
+    bool nextCommand(InboundCommand& command);
+
+    // Scheduler running on the network core; only add tasks to it before
+    // begin() or from code already running on the network task
+    Scheduler& scheduler() { return _scheduler; }
+
+    // Connection snapshots that are safe to read from any core
+    bool isWiFiConnected() const { return _wifiConnected.load(); }
+    bool isMqttConnected() const { return _mqttConnected.load(); }
+
+    // Number of MQTT (re)connections so far; a change means the broker just
+    // came up
+    uint32_t mqttConnectCount() const { return _mqttConnects.load(); }
+
+    // Copy of the WiFi status taken on the network core (at most
+    // NETWORK_STATUS_INTERVAL old)
+    void getWiFiStatus(WiFiStatus& status) const;
+
+    // Queue statistics
+    uint32_t droppedOutbound() const { return _outbound.dropped(); }
+    uint32_t droppedCommands() const { return _commands.dropped(); }
+    uint32_t droppedLogs() const { return _logs.dropped(); }
+
+private:
+    WiFiManager* _wifiManager;
+    MQTTManager* _mqttManager;
+    HttpServer* _httpServer;
+
+    Scheduler _scheduler;
+    TaskHandle_t _handle;
+
+    OutboundQueue _outbound;
+    CommandQueue _commands;
+    LogQueue _logs;
+
+    std::atomic<bool> _wifiConnected;
+    std::atomic<bool> _mqttConnected;
+    std::atomic<uint32_t> _mqttConnects;
+    bool _clockStarted;                 // SNTP started (network core only)
+
+    SemaphoreHandle_t _statusMutex;
+    WiFiStatus _status;
+
+    static void taskEntry(void* arg);
+    void run();
+    void checkWiFi();
+    void serviceMqtt();
+    void publishWiFiMetrics();
+    void updateWiFiStatus();
+    void onMqttMessage(char* topic, byte* payload, unsigned int length);
+    void queueLog(const LogEntry& entry);
+    template <typename Queue> void publishQueued(Queue& queue);
+};
+
+#endif // NETWORK_TASK_H
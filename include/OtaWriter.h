@@ -0,0 +1,143 @@
+#ifndef OTA_WRITER_H
+#define OTA_WRITER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_partition.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+#include "GzipInflater.h"
+#include "DeltaPatcher.h"
+
+// Pipeline sizing: the receiver fills one buffer while the writer task
+// programs the other; flash is erased ahead of the write cursor while
+// the writer would otherwise wait for data
+#define OTA_WRITER_BUFFERS 2
+#define OTA_WRITER_BUFFER_SIZE 4096             // one flash sector
+#define OTA_WRITER_ERASE_AHEAD (64 * 1024)      // erased space kept ahead of the write cursor
+#define OTA_WRITER_ERASE_BLOCK (64 * 1024)      // block erase, several times faster per byte than sectors
+#define OTA_WRITER_TIMEOUT 10000                // receiver gives up waiting for a free buffer (ms)
+#define OTA_WRITER_STACK 4096
+#define OTA_WRITER_PRIORITY 3                   // above the network task, so buffers turn around quickly
+
+// Timing of the last (or running) update
+struct OtaStats {
+    size_t bytes;                               // received
+    size_t imageBytes;                          // written to flash (more than received when compressed)
+    uint32_t elapsedMs;                         // first byte to end()
+    uint32_t stallMs;                           // receiver waited for a free buffer
+    uint32_t eraseMs;                           // writer task time spent erasing
+    uint32_t writeMs;                           // writer task time spent programming
+    bool compressed;                            // gzip image
+    bool delta;                                 // rebuilt from a patch against the running image
+    bool verified;                              // matched the supplied SHA-256
+};
+
+// Streams a firmware image into the next OTA partition without blocking the
+// receiver on flash: write() copies into a double buffer, a writer task
+// erases ahead, programs and hashes (SHA-256) behind it, and end() checks
+// the digest and the image before switching the boot partition. A gzip
+// image (detected by its magic) is decompressed on the way in, and a delta
+// patch (scripts/make_delta.py) is applied against the running partition;
+// the digest is always that of the resulting image.
+class OtaWriter {
+public:
+    // Constructor
+    OtaWriter();
+
+    // Destructor
+    ~OtaWriter();
+
+    // Start an update; size (0 = unknown) bounds the erase-ahead, sha256
+    // (32 bytes, optional, of the uncompressed image) is checked by end().
+    // resumeFrom continues a plain image whose first bytes are already in
+    // the partition (a getResumeOffset() value from before a reboot); they
+    // are hashed again rather than downloaded.
+    bool begin(size_t size = 0, const uint8_t* sha256 = nullptr, size_t resumeFrom = 0);
+
+    // Queue image data (receiver side); returns len, or 0 on error
+    size_t write(const uint8_t* data, size_t len);
+
+    // Flush, verify and select the new image for the next boot
+    bool end();
+
+    // Stop the update and discard what was written
+    void abort();
+
+    bool isActive() const { return _active; }
+    bool hasError() const { return _error; }
+    const char* errorString() const { return _errorString; }
+
+    // Throughput and stall statistics
+    OtaStats getStats() const;
+    float getKBps() const;
+
+    // Bytes of a plain image programmed to flash, sector aligned: where
+    // begin() can resume after a reboot. 0 for gzip and delta streams,
+    // whose decoder state is only held in RAM.
+    size_t getResumeOffset() const;
+
+    // SHA-256 of the received image as hex (valid after end())
+    const char* getDigest() const { return _digestHex; }
+
+    // Parse a 64 character hex digest
+    static bool parseDigest(const String& hex, uint8_t* digest);
+
+private:
+    struct Chunk {
+        uint8_t buffer;
+        uint16_t length;                        // 0 = end of stream
+    };
+
+    const esp_partition_t* _partition = nullptr;
+    uint8_t* _buffers[OTA_WRITER_BUFFERS] = {};
+    QueueHandle_t _filled = nullptr;            // receiver -> writer
+    QueueHandle_t _free = nullptr;              // writer -> receiver
+    SemaphoreHandle_t _done = nullptr;
+    TaskHandle_t _task = nullptr;
+
+    uint8_t _current = 0;                       // buffer being filled
+    size_t _fill = 0;
+    size_t _received = 0;
+    size_t _imageBytes = 0;
+    std::atomic<size_t> _limit{0};              // erase-ahead stops here
+    bool _active = false;
+    std::atomic<bool> _error{false};
+    const char* _errorString = "";
+    GzipInflater _inflater;
+    bool _compressed = false;
+    DeltaPatcher _patcher;
+    bool _delta = false;
+    bool _formatKnown = false;                  // first decompressed byte seen
+
+    // Writer task state
+    std::atomic<size_t> _written{0};
+    size_t _erasedEnd = 0;
+    mbedtls_sha256_context _sha;
+    uint8_t _expected[32];
+    bool _hasExpected = false;
+    char _digestHex[65] = "";
+
+    // Statistics
+    uint32_t _startMs = 0;
+    uint32_t _endMs = 0;
+    uint64_t _stallUs = 0;
+    uint64_t _eraseUs = 0;
+    uint64_t _writeUs = 0;
+    bool _verified = false;
+
+    size_t decode(const uint8_t* data, size_t len);
+    size_t writeImage(const uint8_t* data, size_t len);
+    bool submit(uint16_t length, bool last);
+    void fail(const char* message);
+    void release();
+
+    // Writer task
+    static void taskEntry(void* arg);
+    void run();
+    bool eraseNext();
+    bool rehash(size_t length);
+};
+
+#endif // OTA_WRITER_H
@@ -0,0 +1,204 @@
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <Arduino.h>
+#include <functional>
+
+// Rule limits
+#define RULE_MAX_RULES 8
+#define RULE_ID_MAX 24
+#define RULE_MAX_OPS 32             // compiled instructions per expression
+#define RULE_MAX_STACK 16           // evaluation stack depth
+#define RULE_MAX_NESTING 8          // parentheses, calls and prefix operators inside each other
+#define RULE_MAX_WINDOWS 2          // avg/min/max windows per rule
+#define RULE_WINDOW_MAX 64          // samples per window
+#define RULE_MAX_SOURCES 8          // sensor sources expressions can refer to
+#define RULE_MAX_ACTIONS 4          // registered local action types
+
+// Local action run when a rule fires or clears
+struct RuleAction {
+    char type[12];                  // "" = event only, otherwise a registered handler ("led", "servo", ...)
+    int pin;
+    float value;                    // applied while the rule is active
+    float restValue;                // applied when it clears
+};
+
+// Passed to the event handler and to action handlers
+struct RuleEvent {
+    const char* ruleId;
+    const RuleAction* action;
+    bool active;                    // fired (true) or cleared (false)
+    float value;                    // sample that triggered the transition
+    int source;
+};
+
+// Per-rule information for reporting
+struct RuleInfo {
+    const char* id;
+    bool active;
+    uint32_t fireCount;
+    uint32_t evaluations;
+    uint32_t avgCycles;
+    uint32_t maxCycles;
+};
+
+// Evaluates compiled expressions over sensor samples. Each rule has a
+// trigger expression, an optional clear expression (hysteresis), a hold
+// time the trigger must stay true ("for") and a cooldown between firings.
+//
+// Expressions: numbers, sensor names, + - * /, comparisons, && || !,
+// abs(x), rate(sensor) in units/s, avg|min|max(sensor, samples).
+class RuleEngine {
+public:
+    typedef std::function<int(const char* name)> VariableResolver;
+    typedef std::function<void(const RuleEvent& event)> EventHandler;
+
+    // Constructor
+    RuleEngine();
+
+    // Map sensor names in expressions to source indices
+    void setResolver(VariableResolver resolver) { _resolver = resolver; }
+
+    // Called on every fire/clear transition
+    void setEventHandler(EventHandler handler) { _eventHandler = handler; }
+
+    // Register a local action type usable in rules
+    bool registerAction(const char* type, EventHandler handler);
+
+    // GPIOs rule actions may name (bit n = GPIO n); none until set
+    void setActionPins(uint64_t mask) { _actionPins = mask; }
+
+    // Add or replace a rule from its JSON definition; an empty definition removes it
+    bool setRule(const char* id, const char* json, size_t length);
+
+    // Remove a rule
+    bool removeRule(const char* id);
+
+    // Remove every rule
+    void clear();
+
+    // Evaluate the rules that depend on this source
+    void onSample(int source, float value, uint32_t timestampUs);
+
+    // Reason the last setRule() failed
+    const char* lastError() const { return _error; }
+
+    // Rules
+    int ruleCount() const;
+    bool getRuleInfo(int index, RuleInfo& info) const;
+
+    // Evaluation cost over all rules, per sample that triggered at least one rule
+    uint32_t evaluatedSamples() const { return _samples; }
+    uint32_t avgCyclesPerSample() const { return _samples ? (uint32_t)(_totalCycles / _samples) : 0; }
+    uint32_t maxCyclesPerSample() const { return _maxCycles; }
+
+private:
+    enum Op : uint8_t {
+        OP_CONST, OP_VAR, OP_RATE, OP_AVG, OP_MIN, OP_MAX,
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_ABS, OP_NOT,
+        OP_GT, OP_LT, OP_GE, OP_LE, OP_EQ, OP_NE, OP_AND, OP_OR
+    };
+
+    struct Instruction {
+        Op op;
+        uint8_t arg;                // source index or window slot
+        float value;
+    };
+
+    struct Expression {
+        Instruction code[RULE_MAX_OPS];
+        uint8_t length;
+    };
+
+    struct Window {
+        int8_t source;
+        uint8_t size;
+        uint8_t count;
+        uint8_t head;
+        float values[RULE_WINDOW_MAX];
+    };
+
+    struct Rule {
+        bool used;
+        char id[RULE_ID_MAX];
+        Expression when;
+        Expression clear;
+        bool hasClear;
+        uint32_t holdMs;
+        uint32_t cooldownMs;
+        RuleAction action;
+        uint8_t sourceMask;
+        Window windows[RULE_MAX_WINDOWS];
+        uint8_t windowCount;
+
+        bool active;
+        bool pending;
+        unsigned long pendingSince;
+        unsigned long lastFired;
+        uint32_t fireCount;
+        uint32_t evaluations;
+        uint64_t totalCycles;
+        uint32_t maxCycles;
+    };
+
+    // Latest readings per source (shared by all rules)
+    struct SourceState {
+        float value;
+        float previous;
+        uint32_t timestampUs;
+        uint32_t previousUs;
+        uint32_t count;
+    };
+
+    struct ActionEntry {
+        char type[12];
+        EventHandler handler;
+    };
+
+    // Recursive-descent compiler state
+    struct Compiler {
+        const char* text;
+        Rule* rule;
+        Expression* out;
+        int depth;
+        int nesting;                // bounds the recursion, i.e. the loop task's stack use
+    };
+
+    Rule _rules[RULE_MAX_RULES];
+    Rule _candidate;                // setRule() compiles here (too large for the stack)
+    SourceState _sources[RULE_MAX_SOURCES];
+    ActionEntry _actions[RULE_MAX_ACTIONS];
+    int _actionCount;
+    uint64_t _actionPins;
+    VariableResolver _resolver;
+    EventHandler _eventHandler;
+    const char* _error;
+
+    uint32_t _samples;
+    uint64_t _totalCycles;
+    uint32_t _maxCycles;
+
+    Rule* findRule(const char* id);
+    bool isActionPin(int pin) const;
+    bool compile(const char* text, Rule& rule, Expression& out);
+    bool isTrue(float value) const { return value != 0.0f && !isnan(value); }
+    float evaluate(const Rule& rule, const Expression& expr) const;
+    void dispatch(Rule& rule, bool active, float value, int source);
+    void release(Rule& rule);
+
+    // Compiler stages, lowest precedence first
+    void skipSpace(Compiler& c);
+    bool emit(Compiler& c, Op op, uint8_t arg = 0, float value = 0.0f);
+    bool parseOr(Compiler& c);
+    bool parseAnd(Compiler& c);
+    bool parseComparison(Compiler& c);
+    bool parseAdditive(Compiler& c);
+    bool parseTerm(Compiler& c);
+    bool parseUnary(Compiler& c);
+    bool parsePrimary(Compiler& c);
+    bool parseFunction(Compiler& c, const char* name);
+    int parseSource(Compiler& c);
+    bool fail(Compiler& c, const char* message);
+};
+
+#endif // RULE_ENGINE_H
@@ -0,0 +1,108 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+
+// Maximum number of tasks a scheduler can hold at once
+#define SCHEDULER_MAX_TASKS 16
+
+// Hierarchical timer wheel geometry (1 ms tick, 4 levels of 64 slots ~ 4.6 hours)
+#define SCHEDULER_WHEEL_BITS 6
+#define SCHEDULER_WHEEL_SIZE (1 << SCHEDULER_WHEEL_BITS)
+#define SCHEDULER_WHEEL_LEVELS 4
+
+// One-shot tasks starting later than this are counted as a missed deadline
+#define SCHEDULER_DEADLINE_SLACK_MS 10
+
+// Longest time run() will sleep when nothing is scheduled
+#define SCHEDULER_MAX_SLEEP_MS 1000
+
+class Scheduler {
+public:
+    typedef std::function<void()> TaskCallback;
+
+    // Per-task run-time statistics
+    struct TaskStats {
+        const char* name;
+        unsigned long interval;     // 0 for one-shot tasks
+        uint32_t runCount;
+        uint32_t missedDeadlines;
+        uint32_t lastRunUs;
+        uint32_t maxRunUs;
+        uint64_t totalRunUs;
+        uint32_t maxLatenessMs;
+    };
+
+    // Constructor
+    Scheduler();
+
+    // Add a task that runs every intervalMs (first run after firstDelayMs)
+    int addPeriodic(const char* name, unsigned long intervalMs, TaskCallback callback,
+                    unsigned long firstDelayMs = 0);
+
+    // Add a task that runs once after delayMs
+    int addOneShot(const char* name, unsigned long delayMs, TaskCallback callback);
+
+    // Remove a task; returns false if the id is unknown or already finished
+    bool cancel(int taskId);
+
+    // Move the next deadline of a task to delayMs from now
+    bool reschedule(int taskId, unsigned long delayMs);
+
+    // Change the period of a periodic task (takes effect after its next run)
+    bool setInterval(int taskId, unsigned long intervalMs);
+
+    // Run all tasks whose deadline has passed, in deadline order
+    void runPending();
+
+    // Run due tasks, then sleep until the next deadline or a notification
+    void run(unsigned long maxSleepMs = SCHEDULER_MAX_SLEEP_MS);
+
+    // Wake the owning task early (from another task or an ISR)
+    void notify();
+    void notifyFromISR();
+
+    // Milliseconds until the next deadline (capped at maxMs)
+    unsigned long timeUntilNextDeadline(unsigned long maxMs = SCHEDULER_MAX_SLEEP_MS) const;
+
+    // Get statistics of a task
+    bool getStats(int taskId, TaskStats& stats) const;
+
+    // Iterate over the ids of all active tasks
+    int taskIds(int* ids, int maxIds) const;
+
+    // Print statistics of all tasks
+    void printStats(Print& out) const;
+
+private:
+    struct Task {
+        TaskCallback callback;
+        const char* name;
+        uint32_t deadline;
+        unsigned long interval;
+        int16_t next;
+        int16_t prev;
+        int16_t bucket;         // wheel bucket index, -1 when not queued
+        uint8_t generation;
+        bool active;
+        TaskStats stats;
+    };
+
+    Task _tasks[SCHEDULER_MAX_TASKS];
+    int16_t _wheel[SCHEDULER_WHEEL_LEVELS * SCHEDULER_WHEEL_SIZE];
+    uint32_t _now;              // last tick processed by the wheel
+    int _pendingCount;
+    int _firing;                // slot whose callback is running, -1 if none
+    TaskHandle_t _owner;
+
+    int addTask(const char* name, unsigned long intervalMs, unsigned long delayMs, TaskCallback callback);
+    int slotFromId(int taskId) const;
+    void link(int slot, bool allowCurrentTick = false);
+    void unlink(int slot);
+    void cascade(int level);
+    void advanceTo(uint32_t target);
+    void fire(int slot);
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,170 @@
+#ifndef SENSOR_PIPELINE_H
+#define SENSOR_PIPELINE_H
+
+#include <Arduino.h>
+#include <functional>
+#include <esp_timer.h>
+#include "SpscQueue.h"
+
+// Sampler limits
+#define SAMPLER_MAX_SOURCES 8
+#define SAMPLER_QUEUE_SIZE 512          // samples buffered between sampler and aggregator
+#define SAMPLER_MAX_RATE_HZ 4000
+
+// Sampler task placement (application core, above the Arduino loop)
+#define SAMPLER_TASK_CORE 1
+#define SAMPLER_TASK_STACK 4096
+#define SAMPLER_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+
+// A sensor that can be read from the sampler task
+class SensorSource {
+public:
+    virtual ~SensorSource() {}
+
+    // Short name used in telemetry topics and JSON keys
+    virtual const char* name() const = 0;
+
+    // Take one reading (called at the configured rate, keep it short)
+    virtual float read() = 0;
+};
+
+// Reads an ADC pin and applies value = raw * scale + offset
+class AnalogSensorSource : public SensorSource {
+public:
+    AnalogSensorSource(const char* name, int pin, float scale = 1.0f, float offset = 0.0f);
+
+    const char* name() const override { return _name; }
+    float read() override;
+
+private:
+    const char* _name;
+    int _pin;
+    float _scale;
+    float _offset;
+};
+
+// Wraps any callable as a sensor
+class FunctionSensorSource : public SensorSource {
+public:
+    FunctionSensorSource(const char* name, std::function<float()> reader);
+
+    const char* name() const override { return _name; }
+    float read() override { return _reader(); }
+
+private:
+    const char* _name;
+    std::function<float()> _reader;
+};
+
+// Streaming quantile estimate using the P-square algorithm (O(1) per sample, no sample storage)
+class P2Quantile {
+public:
+    explicit P2Quantile(float quantile = 0.5f);
+
+    void add(float x);
+    void reset();
+    float value() const;
+
+private:
+    float _p;
+    uint32_t _count;
+    float _heights[5];
+    float _positions[5];
+    float _desired[5];
+    float _increments[5];
+
+    float parabolic(int i, float d) const;
+    float linear(int i, int d) const;
+};
+
+// Windowed statistics updated incrementally in O(1) per sample
+class StreamingStats {
+public:
+    StreamingStats();
+
+    void add(float x);
+    void reset();
+
+    uint32_t count() const { return _count; }
+    float minimum() const { return _min; }
+    float maximum() const { return _max; }
+    float mean() const { return _mean; }
+    float stddev() const;
+    float p50() const { return _p50.value(); }
+    float p90() const { return _p90.value(); }
+    float p99() const { return _p99.value(); }
+
+private:
+    uint32_t _count;
+    float _min;
+    float _max;
+    double _mean;
+    double _m2;                 // Welford running sum of squared deviations
+    P2Quantile _p50;
+    P2Quantile _p90;
+    P2Quantile _p99;
+};
+
+// One reading produced by the sampler
+struct Sample {
+    uint32_t timestampUs;
+    uint8_t source;
+    float value;
+};
+
+// Timer-driven sampler: an esp_timer wakes a high-priority task that reads every
+// due source and pushes the readings into a lock-free ring buffer
+class Sampler {
+public:
+    // Constructor
+    Sampler();
+
+    // Destructor
+    ~Sampler();
+
+    // Add a source sampled at rateHz; returns its index or -1 (call before begin)
+    int addSource(SensorSource* source, float rateHz);
+
+    // Start the sampler task and timer
+    bool begin();
+
+    // Stop sampling
+    void end();
+
+    // Take the next buffered sample (consumer side)
+    bool read(Sample& sample);
+
+    // Registered sources
+    int sourceCount() const { return _sourceCount; }
+    SensorSource* source(int index) const;
+    float rate(int index) const;
+
+    // Samples lost because the consumer fell behind
+    uint32_t overruns() const { return _queue.dropped(); }
+
+    // Worst deviation of a sampling tick from its ideal period
+    uint32_t maxJitterUs() const { return _maxJitterUs; }
+
+    bool isRunning() const { return _timer != nullptr; }
+
+private:
+    SensorSource* _sources[SAMPLER_MAX_SOURCES];
+    float _rates[SAMPLER_MAX_SOURCES];
+    uint16_t _dividers[SAMPLER_MAX_SOURCES];
+    int _sourceCount;
+
+    uint32_t _periodUs;
+    uint32_t _tick;
+    int64_t _lastTickUs;
+    volatile uint32_t _maxJitterUs;
+
+    esp_timer_handle_t _timer;
+    TaskHandle_t _task;
+    SpscQueue<Sample, SAMPLER_QUEUE_SIZE> _queue;
+
+    static void timerCallback(void* arg);
+    static void taskEntry(void* arg);
+    void sampleDue();
+};
+
+#endif // SENSOR_PIPELINE_H
@@ -0,0 +1,91 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer ring buffer.
+// Exactly one task may call push() and exactly one (possibly on the other
+// core) may call pop(); neither side ever blocks or takes a lock.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    // Constructor
+    SpscQueue() : _head(0), _tail(0), _dropped(0) {}
+
+    // Append an item; returns false (and counts a drop) when full
+    bool push(const T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= Capacity) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        _items[head & (Capacity - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Reserve the next free slot for in-place construction (producer only);
+    // returns nullptr when full. Must be followed by commit().
+    T* reserve() {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= Capacity) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &_items[head & (Capacity - 1)];
+    }
+
+    // Publish the slot returned by reserve()
+    void commit() {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Remove the oldest item; returns false when empty
+    bool pop(T& item) {
+        const T* front = peek();
+        if (front == nullptr) {
+            return false;
+        }
+
+        item = *front;
+        release();
+        return true;
+    }
+
+    // Access the oldest item without copying (consumer only); nullptr when empty
+    const T* peek() const {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &_items[tail & (Capacity - 1)];
+    }
+
+    // Drop the item returned by peek()
+    void release() {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Number of queued items (approximate when called from a third task)
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return Capacity; }
+
+    // Number of items rejected because the queue was full
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    T _items[Capacity];
+    std::atomic<uint32_t> _head;    // written by the producer only
+    std::atomic<uint32_t> _tail;    // written by the consumer only
+    std::atomic<uint32_t> _dropped;
+};
+
+#endif // SPSC_QUEUE_H
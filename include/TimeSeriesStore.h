@@ -0,0 +1,136 @@
+#ifndef TIME_SERIES_STORE_H
+#define TIME_SERIES_STORE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <freertos/semphr.h>
+
+// Storage layout
+#define HISTORY_MAX_METRICS 16
+#define HISTORY_METRIC_NAME_MAX 24
+#define HISTORY_BLOCK_SIZE 1024                 // one compressed block, 4 per flash sector
+#define HISTORY_RAM_BYTES (256 * 1024)          // block pool when PSRAM is available
+#define HISTORY_RAM_BYTES_NO_PSRAM (32 * 1024)  // block pool in internal RAM
+
+// Optional flash ring (a data partition with this label, see partitions_history.csv)
+#define HISTORY_PARTITION_LABEL "history"
+
+// Largest number of points a single query returns
+#define HISTORY_MAX_QUERY_POINTS 1000
+
+// Timestamps below this are seconds of uptime (SNTP has not set the clock yet);
+// such blocks stay in RAM because they cannot be ordered against other boots
+#define HISTORY_MIN_EPOCH 1600000000
+
+// Header of a compressed block (also the on-flash format)
+struct HistoryBlockHeader {
+    uint16_t magic;
+    uint16_t count;
+    uint32_t metricHash;
+    uint32_t sequence;
+    uint32_t firstTimestamp;
+    uint32_t lastTimestamp;
+    uint16_t bitCount;
+    uint16_t reserved;
+};
+
+#define HISTORY_BLOCK_DATA (HISTORY_BLOCK_SIZE - sizeof(HistoryBlockHeader))
+
+struct HistoryBlock {
+    HistoryBlockHeader header;
+    uint8_t data[HISTORY_BLOCK_DATA];
+};
+
+// One result of a range query (raw points have count 1 and min == max == mean)
+struct HistoryPoint {
+    uint32_t timestamp;
+    float mean;
+    float min;
+    float max;
+    uint32_t count;
+};
+
+// Compressed time-series history. Timestamps are delta-of-delta encoded and
+// values XOR encoded (Facebook Gorilla), in fixed-size blocks kept in a RAM
+// ring (PSRAM when present). Evicted blocks optionally spill to a flash ring.
+// Appends and queries may come from different tasks.
+class TimeSeriesStore {
+public:
+    // Constructor
+    TimeSeriesStore();
+
+    // Destructor
+    ~TimeSeriesStore();
+
+    // Allocate the block pool and open the flash ring if its partition exists
+    bool begin(size_t ramBytes = 0, bool useFlash = true);
+
+    // Record a value (timestamps in seconds, non-decreasing per metric)
+    bool append(const char* metric, uint32_t timestamp, float value);
+
+    // Record a value at the current time
+    bool append(const char* metric, float value) { return append(metric, now(), value); }
+
+    // Points of a metric in [from, to]; step > 0 aggregates into buckets of
+    // step seconds. Returns the number of points written to out.
+    size_t query(const char* metric, uint32_t from, uint32_t to, uint32_t step,
+                 HistoryPoint* out, size_t maxPoints, bool* truncated = nullptr);
+
+    // Seconds since the epoch once the clock is set, uptime otherwise
+    static uint32_t now();
+
+    // Known metrics
+    int metricCount() const { return _metricCount; }
+    const char* metricName(int index) const;
+
+    // Storage statistics
+    uint32_t pointCount() const { return _points; }
+    size_t ramBytes() const { return _blockCount * sizeof(HistoryBlock); }
+    size_t flashBytes() const { return _flashSlots * sizeof(HistoryBlock); }
+    float bitsPerPoint() const;
+    bool hasFlash() const { return _partition != nullptr; }
+
+private:
+    // Encoder state of the open block of a metric
+    struct Metric {
+        char name[HISTORY_METRIC_NAME_MAX];
+        uint32_t hash;
+        int openBlock;
+        uint32_t prevTimestamp;
+        int32_t prevDelta;
+        uint32_t prevBits;
+        uint8_t leading;
+        uint8_t trailing;
+    };
+
+    // RAM copy of a flash block header so queries don't touch flash needlessly
+    struct FlashIndexEntry {
+        uint32_t metricHash;
+        uint32_t firstTimestamp;
+        uint32_t lastTimestamp;
+    };
+
+    HistoryBlock* _blocks;
+    int _blockCount;
+    int _nextBlock;
+    uint32_t _sequence;
+
+    Metric _metrics[HISTORY_MAX_METRICS];
+    int _metricCount;
+
+    const esp_partition_t* _partition;
+    FlashIndexEntry* _flashIndex;
+    int _flashSlots;
+    int _flashNext;
+
+    SemaphoreHandle_t _mutex;
+    uint32_t _points;
+    uint64_t _bitsUsed;
+
+    Metric* findMetric(const char* name, bool create);
+    int allocateBlock(Metric& metric, uint32_t timestamp);
+    void spillToFlash(const HistoryBlock& block);
+    void loadFlashIndex();
+};
+
+#endif // TIME_SERIES_STORE_H
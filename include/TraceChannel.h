@@ -0,0 +1,114 @@
+#ifndef TRACE_CHANNEL_H
+#define TRACE_CHANNEL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/ringbuf.h>
+#include "Log.h"
+
+#define TRACE_PROTOCOL_VERSION 1
+#define TRACE_BUFFER_SIZE 16384                 // bytes of records waiting for the writer task
+#define TRACE_UART_TX_BUFFER 8192               // UART driver TX ring, drained by its interrupt
+#define TRACE_BATCH_SIZE 1024                   // encoded bytes handed to the UART at once
+#define TRACE_TASK_STACK 3072
+#define TRACE_TASK_PRIORITY 2                   // above the log task, below the sampler
+#define TRACE_ANNOUNCE_INTERVAL 2000            // hello and source frames repeated (ms)
+#define TRACE_MAX_SOURCES 8
+#define TRACE_NAME_MAX 24
+
+// Record header as queued by producers: type, timestamp
+#define TRACE_RECORD_HEADER 5
+#define TRACE_RECORD_MAX (TRACE_RECORD_HEADER + 2 + LOG_MESSAGE_MAX)
+
+// Frame before encoding: type, sequence, timestamp, body, CRC
+#define TRACE_FRAME_MAX (TRACE_RECORD_MAX + 2 + 4)
+#define TRACE_ENCODED_MAX (TRACE_FRAME_MAX + TRACE_FRAME_MAX / 254 + 2)
+
+// Frame types
+enum class TraceType : uint8_t {
+    Hello = 1,                                  // version u8, firmware text
+    Source = 2,                                 // index u8, rate f32 (Hz), name text
+    Sample = 3,                                 // source u8, value f32
+    Event = 4,                                  // id u16, arg u32
+    Log = 5,                                    // level u8, module u8, text
+    Dropped = 6                                 // records u32 lost since start
+};
+
+// Binary telemetry/trace stream over a UART, replacing the text output for
+// bench captures (decode with scripts/trace_decode.py).
+//
+// Every frame is, little-endian:
+//   type u8 | sequence u16 | timestamp u32 (us) | body | crc32 u32
+// The CRC is the IEEE/zlib CRC-32 of the bytes before it. Frames are COBS
+// encoded and terminated by a 0x00 byte, so a reader that starts mid-stream
+// or sees garbage (boot messages, a stray print) resynchronizes at the next
+// zero. The sequence number lets the host count frames lost on the link;
+// records lost on the device are reported in Dropped frames.
+//
+// Producers (any task, including the sampler drain) only copy a few bytes
+// into a ring buffer and never wait; a full buffer drops the record and
+// counts it. A writer task encodes the records in batches and hands them to
+// the UART driver, whose interrupt moves them out of a large TX ring.
+class TraceChannel {
+public:
+    // Constructor
+    TraceChannel(HardwareSerial& serial);
+
+    // Open the UART at baud (up to 2000000 on a capable USB bridge) and
+    // start the writer task
+    bool begin(unsigned long baud, const char* firmwareVersion = "");
+
+    // Queue a sensor sample
+    void sample(uint8_t source, float value, uint32_t timestampUs);
+
+    // Queue a trace event (ids are chosen by the application)
+    void event(uint16_t id, uint32_t arg = 0);
+
+    // Queue a log message (usable as a Log sink)
+    void log(const LogEntry& entry);
+
+    // Name a sample source; the names are repeated periodically so a host
+    // attaching later can label the samples
+    void describeSource(uint8_t index, const char* name, float rateHz);
+
+    // Records lost because the buffer was full
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+    // Frames written to the UART
+    uint32_t framesWritten() const { return _frames.load(std::memory_order_relaxed); }
+
+private:
+    struct SourceInfo {
+        char name[TRACE_NAME_MAX];
+        float rate;
+    };
+
+    HardwareSerial& _serial;
+    RingbufHandle_t _ring;
+    TaskHandle_t _task;
+    std::atomic<uint32_t> _dropped;
+    std::atomic<uint32_t> _frames;
+
+    // Announced periodically by the writer task
+    char _firmwareVersion[TRACE_NAME_MAX];
+    SourceInfo _sources[TRACE_MAX_SOURCES];
+    std::atomic<uint8_t> _sourceCount;
+
+    // Writer task only
+    uint8_t _batch[TRACE_BATCH_SIZE];
+    size_t _batchLength;
+    uint16_t _sequence;
+    uint32_t _reportedDrops;
+    unsigned long _lastAnnounce;
+
+    bool queue(TraceType type, uint32_t timestamp, const void* body, size_t length);
+    static void taskEntry(void* arg);
+    void run();
+    void emit(TraceType type, uint32_t timestamp, const uint8_t* body, size_t length);
+    void announce();
+    void reportDrops();
+    void flushBatch();
+    static size_t encode(const uint8_t* in, size_t length, uint8_t* out);
+};
+
+#endif // TRACE_CHANNEL_H
@@ -12,12 +12,153 @@
     #error "This library only supports ESP8266 and ESP32 boards"
 #endif
 
-// Include required libraries for web server functionality
-#include <WebServer.h>
 #include <Update.h>
 
-// Maximum number of WiFi networks to store
-#define MAX_WIFI_NETWORKS 5
+#include <ArduinoJson.h>
+#include <ping/ping_sock.h>
+#include "SpscQueue.h"
+#include "CredentialStore.h"
+#include "FirmwareUpdater.h"
+#include "LogBuffer.h"
+
+// Fast reconnect: direct association with the cached BSSID/channel and the
+// cached DHCP lease applied as static configuration until half of the lease
+// has passed (its renewal time), then DHCP takes over
+#define WIFI_FAST_CONNECT_TIMEOUT 3000      // give up on the cached AP after this long (ms)
+
+// Connection state machine
+#define WIFI_ATTEMPT_RETRIES 2              // rejections tolerated before moving to the next step
+#define WIFI_RETRY_BACKOFF 10000            // wait after every step failed (ms)
+#define WIFI_EVENT_QUEUE_SIZE 16            // link events between the WiFi task and checkConnection()
+#define WIFI_REASON_SLOTS 80                // disconnect reason histogram size
+
+// Link metrics
+#define WIFI_RECONNECT_BUCKETS 8            // reconnect duration histogram, see WiFiManager::reconnectBucketLimit()
+#define WIFI_RSSI_BUCKETS 14                // 5 dB wide from -100 dBm, the last one open-ended
+#define WIFI_METRICS_INTERVAL 300000        // MQTT export period (ms)
+
+// Background scanning
+#define WIFI_SCAN_MAX_RESULTS 20            // strongest access points kept
+#define WIFI_SCAN_TTL 30000                 // cached results are served for this long (ms)
+#define WIFI_SCAN_TIMEOUT 8000              // connection plan gives up waiting for a scan (ms)
+
+// Network selection: candidates are ranked by RSSI plus these adjustments (dB)
+#define WIFI_MAX_CANDIDATES 6               // access points tried per round
+#define WIFI_CANDIDATE_TIMEOUT 10000        // per candidate: association + DHCP (ms)
+#define WIFI_PRIORITY_WEIGHT 10             // per configured priority level
+#define WIFI_HISTORY_BONUS 5                // network connected before and has not failed since
+#define WIFI_RECENT_BONUS 5                 // network of the most recent successful connection
+#define WIFI_FAILURE_PENALTY 10             // per consecutive failure (up to 3)
+#define WIFI_UNSEEN_RSSI -100               // rank of networks tried without a scan match
+
+// Roaming between access points of the same SSID
+#define WIFI_ROAM_RSSI_THRESHOLD -75        // smoothed RSSI below which stronger APs are looked for (dBm)
+#define WIFI_ROAM_MIN_GAIN 8                // a new AP must be this much stronger (dB)
+#define WIFI_ROAM_SMOOTHING 0.2f            // EWMA weight of a new RSSI sample
+#define WIFI_ROAM_SAMPLE_INTERVAL 1000      // RSSI sampling period (ms)
+#define WIFI_ROAM_SCAN_INTERVAL 30000       // minimum time between roaming scans (ms)
+#define WIFI_ROAM_MIN_INTERVAL 120000       // minimum time between roams (ms)
+
+// Power profiles: TX power is in 0.25 dBm units (esp_wifi_set_max_tx_power)
+#define WIFI_TX_TARGET_RSSI -67             // the adaptive TX power keeps each profile's margin above this (dBm)
+#define WIFI_TX_ADAPT_INTERVAL 10000        // minimum time between TX power changes (ms)
+#define WIFI_TX_STEP 8                      // 2 dB
+#define WIFI_TX_MIN_POWER 34                // 8.5 dBm
+#define WIFI_FALLBACK_TX_POWER 68           // 17 dBm, used by the reduced-power fallback method
+#define WIFI_LATENCY_PROBE_INTERVAL 30000   // gateway ping period while connected (ms)
+#define WIFI_LATENCY_PROBE_TIMEOUT 2000     // a ping counts as lost after this long (ms)
+
+// Radio duty cycle model: the receiver wakes for one beacon per wake period
+#define WIFI_BEACON_INTERVAL_MS 102.4f      // 100 TU, the AP default
+#define WIFI_DTIM_PERIOD 1                  // assumed AP DTIM period (beacons)
+#define WIFI_BEACON_WAKE_MS 3.0f            // radio-on time per wake-up (ms)
+
+// Remote monitor: log text goes through a LogBuffer, each client reads it at its own pace
+#define REMOTE_MONITOR_MAX_CLIENTS 4
+#define REMOTE_MONITOR_SEND_CHUNK 512       // bytes offered to a client socket per loop pass
+
+// Connection state
+enum class WiFiState : uint8_t {
+    Idle,
+    FastConnect,                            // cached BSSID/channel/lease
+    Scanning,                               // one scan to rank the candidates
+    Connecting,                             // ranked candidates in turn
+    Advanced,                               // fallback methods
+    Connected,
+    Roaming,                                // reassociating with a stronger AP
+    Backoff                                 // every step failed, waiting to start over
+};
+
+#define WIFI_STATE_COUNT 8
+
+// Power-save trade-off, see POWER_PROFILES in WiFiManager.cpp
+enum class WiFiPowerProfile : uint8_t {
+    LowLatency,                             // no modem sleep, full TX power
+    Balanced,                               // modem sleep between DTIM beacons
+    LowPower                                // sleeps through several beacons, lowest TX power
+};
+
+#define WIFI_POWER_PROFILE_COUNT 3
+
+// Gateway round-trip times measured under one power profile
+struct WiFiPowerStats {
+    uint32_t probes;
+    uint32_t lost;
+    uint32_t lastRttMs;
+    uint32_t maxRttMs;
+    uint64_t totalRttMs;                    // over answered probes
+};
+
+// One access point from the last scan
+struct WiFiScanResult {
+    char ssid[33];
+    uint8_t bssid[6];
+    int8_t rssi;
+    uint8_t channel;
+    uint8_t encryption;                     // wifi_auth_mode_t
+};
+
+// Connection attempt statistics
+struct WiFiMetrics {
+    uint32_t attempts;
+    uint32_t successes;
+    uint32_t failures;                      // attempts that timed out or were rejected
+    uint32_t disconnects;                   // established links lost
+    uint32_t lastAttemptMs;                 // duration of the last successful attempt
+    uint32_t lastAssociateMs;               // association part of the last attempt
+    uint32_t maxAttemptMs;
+    uint64_t totalAttemptMs;                // over successful attempts
+    uint32_t roams;                         // successful moves to a stronger AP
+    uint32_t roamFailures;
+    uint32_t lastRoamMs;                    // reassociation time of the last roam
+    uint64_t totalRoamMs;
+    int16_t lastRoamGain;                   // RSSI gained by the last roam (dB)
+    int32_t totalRoamGain;
+    uint32_t reconnects;                    // link losses followed by a new connection
+    uint16_t reconnectHistogram[WIFI_RECONNECT_BUCKETS];
+    uint64_t stateMs[WIFI_STATE_COUNT];     // time spent in each WiFiState (current one excluded)
+    uint32_t rssiHistogram[WIFI_RSSI_BUCKETS];  // RSSI samples while connected
+    uint32_t dhcpCount;                     // association to IP address
+    uint32_t lastDhcpMs;
+    uint32_t maxDhcpMs;
+    uint64_t totalDhcpMs;
+    uint32_t channelChanges;
+    uint8_t channel;                        // channel of the current/last connection
+    uint16_t reasons[WIFI_REASON_SLOTS];    // disconnect reasons, see WiFiManager::slotReason()
+};
+
+// Address, signal and roaming summary copied out of the WiFi state machine
+// (NetworkTask hands it to the application core)
+struct WiFiStatus {
+    char ip[16];                            // "Not connected" while offline
+    int rssi;
+    uint32_t roams;
+    uint32_t roamFailures;
+    uint32_t lastRoamMs;
+    uint32_t avgRoamMs;
+    int16_t lastRoamGain;
+    int32_t totalRoamGain;
+};
 
 class WiFiManager {
 public:
@@ -28,21 +169,75 @@ public:
     // Multi-network constructor
     explicit WiFiManager(int statusLedPin = -1, unsigned long connectionTimeout = 30000);
     
-    // Initialize WiFi connection
+    // Initialize WiFi connection (blocks until connected or every method failed)
     bool begin();
     
-    // Add a WiFi network to the list
-    bool addNetwork(const String& ssid, const String& password);
+    // Start connecting in the background; progress is made by checkConnection()
+    void start();
+    
+    // Block until connected, every method failed, or the timeout (0 = none) elapsed
+    bool waitForConnection(unsigned long timeout = 0);
+    
+    // Add a WiFi network to the credential store, or update a stored one
+    // (higher priority is preferred, 10 dB per level). Stored networks
+    // persist across reboots.
+    bool addNetwork(const String& ssid, const String& password, int priority = 0);
     
-    // Check and maintain WiFi connection
+    // Remove a network from the credential store
+    bool removeNetwork(const String& ssid);
+    
+    // Stored networks
+    int getNetworkCount() const { return _credentials.count(); }
+    CredentialStore& getCredentialStore() { return _credentials; }
+    
+    // Check and maintain WiFi connection (never blocks, call often)
     bool checkConnection();
     
-    // Reconnect to WiFi if disconnected
+    // Restart the connection plan now, starting with the cached AP
     bool reconnect();
     
-    // Try advanced connection methods when standard approach fails
+    // Skip to the advanced connection methods
     bool tryAdvancedConnection();
     
+    // Connection state
+    WiFiState getState() const { return _state; }
+    const char* getStateName() const;
+    
+    // Smoothed RSSI used for roaming decisions
+    float getSmoothedRssi() const { return _rssiAverage; }
+    
+    // Attempt timing, roaming and disconnect reasons
+    const WiFiMetrics& getMetrics() const { return _metrics; }
+    uint16_t getDisconnectCount(uint8_t reason) const;
+    
+    // Disconnect reason histogram slots
+    static uint8_t reasonSlot(uint8_t reason);
+    static uint8_t slotReason(int slot);
+    
+    // Upper bound of a reconnect histogram bucket in ms (0 = open-ended)
+    static uint32_t reconnectBucketLimit(int bucket);
+    
+    // Link metrics as JSON (for MQTT and HTTP)
+    void getMetricsJson(JsonObject out) const;
+    
+    // Address, signal and roaming summary (call from the core running the
+    // state machine)
+    void getStatus(WiFiStatus& status) const;
+    
+    // Power profile: modem sleep, listen interval and TX power ceiling. The
+    // listen interval takes effect at the next association.
+    void setPowerProfile(WiFiPowerProfile profile);
+    WiFiPowerProfile getPowerProfile() const { return _powerProfile; }
+    const char* getPowerProfileName() const { return powerProfileName(_powerProfile); }
+    static const char* powerProfileName(WiFiPowerProfile profile);
+    static bool parsePowerProfile(const String& name, WiFiPowerProfile& profile);
+    
+    // Current TX power (dBm), per-profile latency and estimated radio duty cycle
+    float getTxPower() const { return _txPower / 4.0f; }
+    const WiFiPowerStats& getPowerStats(WiFiPowerProfile profile) const { return _powerStats[(int)profile]; }
+    static float estimateDutyCycle(WiFiPowerProfile profile);
+    void getPowerJson(JsonObject out) const;
+    
     // Connection status
     bool isConnected() const;
     
@@ -55,20 +250,49 @@ public:
     // Get MAC address as string
     String getMACAddress() const;
     
+    // Status LED (-1 when none), also blinked by the OTA upload page
+    int getStatusLedPin() const { return _statusLedPin; }
+    
     // Print WiFi status to Serial
     void printStatus() const;
     
-    // Scan for available WiFi networks
+    // Print the cached scan results, refreshing them in the background when stale
     void scanNetworks();
     
-    // OTA firmware update
+    // Start a background scan unless one is running or the cached results
+    // are still fresh. Never disconnects; deferred while connecting.
+    bool startScan(bool force = false);
+    bool isScanning() const { return _scanRunning || _scanRequested; }
+    
+    // Cached scan results, strongest first
+    int getScanCount() const { return _scanCount; }
+    const WiFiScanResult& getScanResult(int index) const { return _scanResults[index]; }
+    bool hasFreshScan() const { return _scanValid && millis() - _scanTime < WIFI_SCAN_TTL; }
+    unsigned long getScanAge() const { return _scanValid ? millis() - _scanTime : 0; }
+    
+    // Name of a wifi_auth_mode_t
+    static const char* encryptionName(uint8_t type);
+    
+    // OTA firmware update (plain or gzip image, see scripts/compress_firmware.py)
     bool updateFirmware(const String& firmwareUrl, const String& currentVersion = "");
     
-    // Start web server for file uploads
-    void beginUploadServer(int port = 80);
+    // Check a firmware manifest (scripts/make_manifest.py) and install the
+    // image it names when it differs from the running one; reboots after an
+    // update. False if the check failed.
+    bool checkForUpdate(const String& manifestUrl, const String& currentVersion);
+    
+    // Check the manifest every interval, each time at a random point of the
+    // following window so a fleet does not hit the server at once (the first
+    // check falls within one window of the call). Runs from handleUpdateCheck().
+    void scheduleUpdateCheck(const String& manifestUrl, const String& currentVersion,
+                             unsigned long interval = FIRMWARE_CHECK_INTERVAL,
+                             unsigned long window = FIRMWARE_CHECK_WINDOW);
+    
+    // Run a scheduled check when due (call in loop; blocks while downloading)
+    void handleUpdateCheck();
     
-    // Handle server tasks (call in loop)
-    void handleUploadServer();
+    // HTTP firmware downloads (peer credentials, statistics)
+    FirmwareUpdater& getFirmwareUpdater() { return _firmwareUpdater; }
     
     // Start telnet-style monitoring
     void beginRemoteMonitor(int port = 23);
@@ -76,22 +300,67 @@ public:
     // Handle monitoring tasks (call in loop)
     void handleRemoteMonitor();
     
-    // Write to remote monitor
+    // Log a message at info level (remote monitor, UART and other sinks); never waits
     void remoteLog(const String& message);
     
-    // Print WiFi connection status
+    // Number of connected monitor clients
+    int getMonitorClientCount();
+    
+    // Log WiFi connection status
     void printConnectionStatus(wl_status_t status);
     
+    // Time the last successful connection took (ms) and whether the cache was used
+    unsigned long getLastConnectDuration() const { return _lastConnectDuration; }
+    bool lastConnectWasFast() const { return _lastConnectFast; }
+    
+    // Forget the cached access point and lease
+    void clearFastConnectCache();
+    
 private:
-    // WiFi credentials for multiple networks
-    struct WiFiNetwork {
-        String ssid;
-        String password;
-        bool active;
+    // Link events queued by the WiFi event task
+    enum LinkEventType : uint8_t {
+        LINK_ASSOCIATED,
+        LINK_GOT_IP,
+        LINK_LOST_IP,
+        LINK_DISCONNECTED
+    };
+    
+    struct LinkEvent {
+        LinkEventType type;
+        uint8_t reason;
+        uint32_t timestamp;
+    };
+    
+    // Last successful association, kept in RTC memory and NVS
+    struct FastConnectCache {
+        uint32_t magic;
+        uint32_t ssidHash;
+        uint8_t networkIndex;
+        uint8_t channel;
+        uint8_t bssid[6];
+        uint32_t ip;
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns1;
+        uint32_t dns2;
+        uint32_t leaseSeconds;              // lease time granted by the DHCP server, 0 = unknown
+        uint32_t leaseAcquired;             // system time (s) the lease was obtained
+        uint32_t crc;
     };
     
-    WiFiNetwork _networks[MAX_WIFI_NETWORKS];
-    int _networkCount;
+    // An access point to try, ranked by score
+    struct Candidate {
+        uint8_t network;                    // credential store slot
+        bool visible;                       // seen in the scan: BSSID and channel are known
+        uint8_t channel;
+        uint8_t bssid[6];
+        int8_t rssi;
+        int16_t score;
+    };
+    
+    // Stored networks; only the one being tried or used is held in RAM
+    CredentialStore _credentials;
+    WiFiCredential _credential = {};
     int _currentNetworkIndex;
     
     // Legacy support for single network
@@ -100,29 +369,145 @@ private:
     
     int _statusLedPin;
     unsigned long _connectionTimeout;
-    unsigned long _lastReconnectAttempt;
     bool _isConnected;
     bool _isLegacyMode;
     
-    // Web server for OTA uploads
-    WebServer* _uploadServer = nullptr;
-    int _uploadServerPort = 80;
-    bool _uploadServerActive = false;
+    // HTTP firmware download
+    FirmwareUpdater _firmwareUpdater;
+    String _manifestUrl;
+    String _manifestVersion;
+    unsigned long _updateCheckInterval = 0;
+    unsigned long _updateCheckWindow = 0;
+    unsigned long _updateCheckFrom = 0;
+    unsigned long _updateCheckDelay = 0;    // from _updateCheckFrom, jitter included
     
     // Telnet-style monitoring
+    struct MonitorClient {
+        WiFiClient client;
+        LogCursor cursor;
+    };
     WiFiServer* _monitorServer = nullptr;
-    WiFiClient _monitorClient;
+    MonitorClient _monitorClients[REMOTE_MONITOR_MAX_CLIENTS];
+    LogBuffer _monitorLog;
     int _monitorPort = 23;
     bool _monitorActive = false;
+    int _monitorScanClient = -1;            // client waiting for scan results
+    
+    unsigned long _lastConnectDuration = 0;
+    bool _lastConnectFast = false;
+    
+    // Connection state machine
+    WiFiState _state = WiFiState::Idle;
+    SpscQueue<LinkEvent, WIFI_EVENT_QUEUE_SIZE> _events;
+    bool _eventsRegistered = false;
+    int _step = 0;
+    Candidate _candidates[WIFI_MAX_CANDIDATES];
+    int _candidateCount = 0;
+    int _attemptNetwork = 0;
+    int _attemptRetries = 0;
+    bool _attemptTargeted = false;          // BSSID and channel given
+    unsigned long _attemptStart = 0;
+    unsigned long _attemptTimeout = 0;
+    unsigned long _cycleStart = 0;
+    unsigned long _backoffStart = 0;
+    unsigned long _lastBlink = 0;
+    unsigned long _stateSince = 0;
+    unsigned long _associatedAt = 0;
+    bool _associated = false;
+    bool _reconnecting = false;
+    bool _staticConfig = false;
+    bool _fastUseLease = false;
+    uint32_t _leaseSeconds = 0;             // DHCP lease of the current address
+    uint32_t _leaseAcquired = 0;
+    WiFiMetrics _metrics = {};
+    
+    // Scan cache
+    WiFiScanResult _scanResults[WIFI_SCAN_MAX_RESULTS];
+    int _scanCount = 0;
+    unsigned long _scanTime = 0;
+    bool _scanValid = false;
+    bool _scanRunning = false;
+    bool _scanRequested = false;
+    bool _printScanWhenDone = false;
+    
+    // Roaming monitor
+    float _rssiAverage = 0;
+    float _roamFromRssi = 0;
+    unsigned long _lastRssiSample = 0;
+    unsigned long _lastRoamScan = 0;
+    unsigned long _lastRoamAttempt = 0;
+    bool _roamScanPending = false;
+    
+    // Power management
+    WiFiPowerProfile _powerProfile = WiFiPowerProfile::Balanced;
+    WiFiPowerStats _powerStats[WIFI_POWER_PROFILE_COUNT] = {};
+    int8_t _txPower = 0;                    // 0.25 dBm units, 0 = not set yet
+    unsigned long _lastTxAdjust = 0;
+    esp_ping_handle_t _latencyProbe = nullptr;
+    SpscQueue<uint32_t, 4> _latencySamples; // RTTs from the ping task, UINT32_MAX = lost
+    
+    // WiFi event callback (WiFi task)
+    void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info);
+    
+    // State machine steps
+    bool isAttempting() const {
+        return _state == WiFiState::FastConnect || _state == WiFiState::Connecting ||
+               _state == WiFiState::Advanced || _state == WiFiState::Roaming;
+    }
+    void setState(WiFiState state);
+    void handleLinkEvent(const LinkEvent& event);
+    void startPlan(int firstStep);
+    void nextStep();
+    bool startStep(int step);
+    bool beginAttempt(WiFiState state, int networkIndex, unsigned long timeout);
+    void endAttempt();
+    void failAttempt();
+    void onAttemptConnected();
+    void onLinkLost(uint8_t reason);
+    
+    // Direct association using the cached BSSID, channel and lease
+    bool startFastConnect();
+    
+    // Network selection
+    void buildCandidates(bool scanned);
+    int scoreCandidate(const WiFiCredential& credential, int rssi) const;
+    void addCandidate(const Candidate& candidate);
+    
+    // Roaming
+    void monitorRoaming(unsigned long now);
+    void evaluateRoam();
+    
+    // Association with the current credential and the power profile's listen interval
+    void associate(int32_t channel = 0, const uint8_t* bssid = nullptr);
+    
+    // Power management
+    void applyPowerProfile();
+    void setTxPower(int8_t power);
+    void adaptTxPower(unsigned long now);
+    void startLatencyProbe();
+    void stopLatencyProbe();
+    void recordLatency(uint32_t rttMs);
+    static void onProbeSuccess(esp_ping_handle_t handle, void* arg);
+    static void onProbeTimeout(esp_ping_handle_t handle, void* arg);
+    
+    // Scan service
+    void updateScan();
+    void printScan(Print& out) const;
+    int findScanResult(const String& ssid) const;
+    
+    // Fast connect cache persistence
+    bool loadFastConnectCache(FastConnectCache& cache, bool* inRtc = nullptr);
+    void saveFastConnectCache();
     
-    // Try to connect to a specific network
-    bool tryConnect(const String& ssid, const String& password);
+    // DHCP lease bookkeeping
+    static uint32_t dhcpLeaseSeconds();
+    bool leaseUsable(uint32_t leaseSeconds, uint32_t leaseAcquired) const;
+    void checkLeaseRenewal();
     
-    // Upload server pages
-    void setupUploadServer();
-    void handleUploadRoot();
-    void handleFileUpload();
-    void handleUploadComplete();
+    // Remote monitor clients
+    void acceptMonitorClient();
+    void handleMonitorCommand(MonitorClient& monitor, int index);
+    void flushMonitorClient(MonitorClient& monitor);
 };
 
 #endif // WIFI_MANAGER_H
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Compress a firmware image for OTA.
+
+Writes <image>.gz: a standard gzip file whose deflate stream is limited to a
+small window, so the device can decompress it with a ring buffer of that size
+instead of the full 32 KB. An "ES" extra field records the window bits and
+the uncompressed size (used by the device to size the erase-ahead).
+
+    python3 scripts/compress_firmware.py .pio/build/node32s/firmware.bin
+
+Also runs as a PlatformIO post script (extra_scripts = post:...), producing
+firmware.bin.gz next to firmware.bin after every build.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+import zlib
+
+DEFAULT_WINDOW_BITS = 12                        # 4 KB ring buffer on the device
+GZIP_EXTRA_ID = b"ES"
+
+
+def compress(image, window_bits=DEFAULT_WINDOW_BITS, level=9):
+    """Return the gzip file for an image."""
+    extra = GZIP_EXTRA_ID + struct.pack("<HBI", 5, window_bits, len(image))
+    header = struct.pack("<BBBBIBB", 0x1F, 0x8B, 8, 0x04, 0, 2 if level == 9 else 0, 255)
+    header += struct.pack("<H", len(extra)) + extra
+
+    deflate = zlib.compressobj(level, zlib.DEFLATED, -window_bits, 9)
+    body = deflate.compress(image) + deflate.flush()
+    trailer = struct.pack("<II", zlib.crc32(image) & 0xFFFFFFFF, len(image) & 0xFFFFFFFF)
+    return header + body + trailer
+
+
+def compress_file(path, output=None, window_bits=DEFAULT_WINDOW_BITS):
+    """Compress one image file and print the ratio and digest."""
+    with open(path, "rb") as f:
+        image = f.read()
+    if not image or image[0] != 0xE9:
+        raise ValueError("%s is not an ESP firmware image" % path)
+
+    data = compress(image, window_bits)
+    output = output or path + ".gz"
+    with open(output, "wb") as f:
+        f.write(data)
+
+    # The round trip is cheap and catches a broken zlib before a device does
+    if zlib.decompress(data, 16 + 15) != image:
+        raise RuntimeError("Round trip check failed")
+
+    print("%s: %d -> %d bytes (%.1f%%), window %d bytes" %
+          (output, len(image), len(data), 100.0 * len(data) / len(image), 1 << window_bits))
+    print("SHA-256 of the image: %s" % hashlib.sha256(image).hexdigest())
+    return output
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("image", help="firmware .bin")
+    parser.add_argument("-o", "--output", help="output file (default: <image>.gz)")
+    parser.add_argument("-w", "--window-bits", type=int, default=DEFAULT_WINDOW_BITS,
+                        help="deflate window, 10..15 (default %d)" % DEFAULT_WINDOW_BITS)
+    args = parser.parse_args()
+
+    if not 10 <= args.window_bits <= 15:
+        parser.error("window bits must be between 10 and 15")
+    try:
+        compress_file(args.image, args.output, args.window_bits)
+    except (OSError, ValueError, RuntimeError) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+try:
+    Import("env")  # noqa: F821 (defined by PlatformIO)
+
+    def _after_build(source, target, env):
+        compress_file(os.path.join(env.subst("$BUILD_DIR"), env.subst("${PROGNAME}.bin")))
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", _after_build)  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        sys.exit(main())
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Serve firmware images over HTTP with injected connection drops.
+
+    python3 scripts/flaky_ota_server.py .pio/build/node32s --drop-after 100000
+
+Serves the files of a directory for FirmwareUpdater, the way a production
+server should: an ETag per file (304 for a matching If-None-Match, as for
+manifest.json), "Range: bytes=<first>-[<last>]" answered with 206 and
+Content-Range (honouring If-Range), <name>.gz when Accept-Encoding allows gzip, and
+<name>.<digest16>.delta (scripts/make_delta.py) when the x-ESP32-delta-base
+header matches. Responses are cut off part way through the
+body to exercise resuming:
+
+    --drop-after N   close every response after N body bytes
+    --drop-rate P    close a response with probability P, at a random point
+
+A device (or the host build of FirmwareUpdater, scripts/ota_host/run.sh)
+pointed at http://<this machine>:8080/firmware.bin should then finish the
+download in several pieces, each one a Range request continuing where the
+last stopped.
+"""
+
+import argparse
+import hashlib
+import os
+import random
+import re
+import socket
+import sys
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+CHUNK = 1460
+
+
+class FlakyHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    directory = "."
+    drop_after = 0
+    drop_rate = 0.0
+
+    def do_GET(self):
+        path = os.path.join(self.directory, os.path.basename(self.path.split("?")[0]))
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+
+        # Pick the representation: a patch for the running image, gzip, or plain
+        variant, encoding = path, None
+        base = self.headers.get("x-ESP32-delta-base", "")
+        if base and os.path.isfile("%s.%s.delta" % (path, base[:16])):
+            variant = "%s.%s.delta" % (path, base[:16])
+        elif "gzip" in self.headers.get("Accept-Encoding", "") and os.path.isfile(path + ".gz"):
+            variant, encoding = path + ".gz", "gzip"
+        with open(variant, "rb") as f:
+            data = f.read()
+        etag = '"%s"' % hashlib.sha256(data).hexdigest()[:16]
+        if self.headers.get("If-None-Match") == etag:
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+
+        start, end = 0, len(data)
+        requested = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        partial = requested is not None and self.headers.get("If-Range") in (None, etag)
+        if partial:
+            start = int(requested.group(1))
+            if requested.group(2):
+                end = min(end, int(requested.group(2)) + 1)
+            if start >= end:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % len(data))
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+
+        self.send_response(206 if partial else 200)
+        self.send_header("Content-Type", "application/json" if path.endswith(".json") else "application/octet-stream")
+        self.send_header("Content-Length", str(end - start))
+        self.send_header("ETag", etag)
+        self.send_header("Accept-Ranges", "bytes")
+        if encoding:
+            self.send_header("Content-Encoding", encoding)
+        if partial:
+            self.send_header("Content-Range", "bytes %d-%d/%d" % (start, end - 1, len(data)))
+        self.end_headers()
+
+        # Where this response is cut off, if at all
+        body = end - start
+        drop = body
+        if self.drop_after:
+            drop = min(drop, self.drop_after)
+        if self.drop_rate and random.random() < self.drop_rate:
+            drop = min(drop, random.randrange(body))
+
+        sent = 0
+        while sent < drop:
+            count = min(CHUNK, drop - sent)
+            self.wfile.write(data[start + sent:start + sent + count])
+            sent += count
+        if drop < body:
+            self.wfile.flush()
+            self.connection.shutdown(socket.SHUT_RDWR)
+            self.close_connection = True
+        self.log_message("%s bytes %d-%d of %d%s", os.path.basename(variant), start, start + sent,
+                         len(data), " (dropped)" if drop < body else "")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("directory", nargs="?", default=".", help="directory with the images (default .)")
+    parser.add_argument("-p", "--port", type=int, default=8080)
+    parser.add_argument("--drop-after", type=int, default=0, metavar="N",
+                        help="close every response after N body bytes")
+    parser.add_argument("--drop-rate", type=float, default=0.0, metavar="P",
+                        help="close a response at a random point with probability P")
+    parser.add_argument("--seed", type=int, help="random seed, for repeatable drops")
+    args = parser.parse_args()
+
+    random.seed(args.seed)
+    FlakyHandler.directory = args.directory
+    FlakyHandler.drop_after = args.drop_after
+    FlakyHandler.drop_rate = args.drop_rate
+
+    server = ThreadingHTTPServer(("", args.port), FlakyHandler)
+    print("Serving %s on port %d" % (os.path.abspath(args.directory), args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Make a delta OTA patch between two firmware images.
+
+    python3 scripts/make_delta.py old/firmware.bin new/firmware.bin
+
+The patch rebuilds the new image from the one running on the device, which
+reads it from flash while the patch streams in. Like bsdiff, matching regions
+are stored as byte-wise differences (mostly zeros where code moved and only
+addresses changed) and the rest as literal bytes; the patch is then gzipped
+(see compress_firmware.py), which is where the differences shrink.
+
+Devices send the digest of their running image in the x-ESP32-delta-base
+header. Serve the patch when that header equals the source digest printed
+here, and the full image otherwise; a device falls back to the full image by
+itself if a patch cannot be applied.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from compress_firmware import DEFAULT_WINDOW_BITS, compress  # noqa: E402
+
+MAGIC = b"ESPD"
+VERSION = 1
+BLOCK = 16                                      # seed length, old image indexed every BLOCK bytes
+MIN_MATCH = 24                                  # shorter matches are stored as literals
+CANDIDATES = 4                                  # old positions kept per seed
+GIVE_UP = 64                                    # extension stops this far below its best score
+
+
+def source_digest(image):
+    """The digest esp_partition_get_sha256() reports for a running app."""
+    # Byte 23 is hash_appended in the extended image header; the bootloader
+    # then returns the stored SHA-256 (the last 32 bytes)
+    if len(image) > 56 and image[23] == 1:
+        return image[-32:]
+    return hashlib.sha256(image).digest()
+
+
+def extend(old, new, old_pos, new_pos, limit, step):
+    """Length of an approximate match from the given positions.
+
+    Walks forward (step 1) or backward (step -1) and keeps the length that
+    maximises 2 * matching bytes - length, as bsdiff does.
+    """
+    best = score = length = best_length = 0
+    while length < limit:
+        if step > 0:
+            o, n = old_pos + length, new_pos + length
+        else:
+            o, n = old_pos - length - 1, new_pos - length - 1
+        if o < 0 or o >= len(old):
+            break
+        score += 1 if old[o] == new[n] else -1
+        length += 1
+        if score > best:
+            best, best_length = score, length
+        elif best - score > GIVE_UP:
+            break
+    return best_length
+
+
+def find_matches(old, new):
+    """Matching regions as (new start, old start, length), in new order."""
+    index = {}
+    for i in range(0, len(old) - BLOCK + 1, BLOCK):
+        candidates = index.setdefault(old[i:i + BLOCK], [])
+        if len(candidates) < CANDIDATES:
+            candidates.append(i)
+
+    matches = []
+    new_end = old_end = 0
+    pos = 0
+    while pos <= len(new) - BLOCK:
+        candidates = index.get(new[pos:pos + BLOCK])
+        if not candidates:
+            pos += 1
+            continue
+
+        # Prefer continuing the previous alignment, then the longest run
+        expected = old_end + (pos - new_end)
+        if expected not in candidates and old[expected:expected + BLOCK] == new[pos:pos + BLOCK]:
+            candidates = [expected] + candidates
+        old_pos = max(candidates, key=lambda o: (o == expected, extend(old, new, o, pos, 256, 1)))
+
+        forward = extend(old, new, old_pos, pos, len(new) - pos, 1)
+        backward = extend(old, new, old_pos, pos, min(pos - new_end, old_pos), -1)
+        if forward + backward < MIN_MATCH:
+            pos += 1
+            continue
+
+        start = pos - backward
+        matches.append((start, old_pos - backward, forward + backward))
+        new_end = start + forward + backward
+        old_end = old_pos + forward
+        pos = new_end
+    return matches
+
+
+def make_patch(old, new):
+    """Uncompressed patch rebuilding new from old."""
+    header = MAGIC + struct.pack("<B3xII", VERSION, len(old), len(new))
+    header += source_digest(old) + hashlib.sha256(new).digest()
+
+    records = [header]
+    matches = find_matches(old, new)
+    new_pos = old_pos = 0
+
+    # Leading literal bytes and seek to the first match, then one record per
+    # match: its difference, the literal bytes up to the next match and the
+    # seek to that match
+    if not matches or matches[0][:2] != (0, 0):
+        first_old = matches[0][1] if matches else 0
+        extra_end = matches[0][0] if matches else len(new)
+        records.append(struct.pack("<IIi", 0, extra_end, first_old))
+        records.append(new[:extra_end])
+        new_pos, old_pos = extra_end, first_old
+
+    for i, (start, old_start, length) in enumerate(matches):
+        assert start == new_pos and old_start == old_pos
+        next_new, next_old = matches[i + 1][:2] if i + 1 < len(matches) else (len(new), old_start + length)
+        diff = bytes((new[start + j] - old[old_start + j]) & 0xFF for j in range(length))
+        extra = new[start + length:next_new]
+        records.append(struct.pack("<IIi", length, len(extra), next_old - (old_start + length)))
+        records.append(diff)
+        records.append(extra)
+        new_pos, old_pos = next_new, next_old
+    return b"".join(records)
+
+
+def apply_patch(old, patch):
+    """Rebuild the new image the way the device does (for verification)."""
+    source_size, target_size = struct.unpack_from("<II", patch, 8)
+    if patch[:4] != MAGIC or source_digest(old) != patch[16:48]:
+        raise ValueError("Patch is for a different source image")
+
+    output = bytearray()
+    offset, old_pos = 80, 0
+    while len(output) < target_size:
+        diff_length, extra_length, seek = struct.unpack_from("<IIi", patch, offset)
+        offset += 12
+        output += bytes((old[old_pos + j] + patch[offset + j]) & 0xFF for j in range(diff_length))
+        offset += diff_length
+        old_pos += diff_length
+        output += patch[offset:offset + extra_length]
+        offset += extra_length
+        old_pos += seek
+    if hashlib.sha256(output).digest() != patch[48:80]:
+        raise ValueError("Rebuilt image does not match the target digest")
+    return bytes(output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("old", help="firmware .bin running on the devices")
+    parser.add_argument("new", help="new firmware .bin")
+    parser.add_argument("-o", "--output", help="patch file (default: <new>.<source digest>.delta)")
+    parser.add_argument("-w", "--window-bits", type=int, default=DEFAULT_WINDOW_BITS,
+                        help="deflate window of the gzipped patch (default %d)" % DEFAULT_WINDOW_BITS)
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+    for path, image in ((args.old, old), (args.new, new)):
+        if not image or image[0] != 0xE9:
+            print("error: %s is not an ESP firmware image" % path, file=sys.stderr)
+            return 1
+
+    patch = make_patch(old, new)
+    if apply_patch(old, patch) != new:
+        print("error: patch does not rebuild the new image", file=sys.stderr)
+        return 1
+    data = compress(patch, args.window_bits)
+
+    digest = source_digest(old).hex()
+    output = args.output or "%s.%s.delta" % (args.new, digest[:16])
+    with open(output, "wb") as f:
+        f.write(data)
+
+    full = len(compress(new, args.window_bits))
+    print("%s: %d bytes, %.1fx smaller than the gzipped image (%d bytes), %.1fx than the raw image" %
+          (output, len(data), full / len(data), full, len(new) / len(data)))
+    print("Source digest (x-ESP32-delta-base): %s" % digest)
+    print("SHA-256 of the new image: %s" % hashlib.sha256(new).hexdigest())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""Write the update manifest for a firmware image.
+
+    python3 scripts/make_manifest.py .pio/build/node32s/firmware.bin
+
+Writes manifest.json next to the image:
+
+    {"version": "1.0.0", "url": "firmware.bin", "sha256": "<hex>", "size": 1024128,
+     "chunk": 16384, "chunks": "<hex>"}
+
+Devices calling checkManifest() (WiFiManager::checkForUpdate()) compare the
+version and the SHA-256 with the running image and download the url (relative
+to the manifest) only when they differ. Serve the manifest with an ETag so
+unchanged manifests are answered with 304; most static file servers do.
+
+"chunks" holds the first 16 bytes of the SHA-256 of every chunk. With it,
+devices fetch the image from peers on the LAN that already run it and check
+each chunk as it arrives; the origin then only needs to answer Range requests
+for chunks no peer delivers.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import re
+import sys
+
+DEFAULT_CHUNK = 16384                           # FIRMWARE_CHUNK_MAX on the device
+CHUNK_HASH_SIZE = 16
+CONFIG_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "include", "Config.h")
+
+
+def config_version():
+    """FIRMWARE_VERSION from include/Config.h, if it is there."""
+    try:
+        with open(CONFIG_H) as f:
+            match = re.search(r'#define\s+FIRMWARE_VERSION\s+"([^"]+)"', f.read())
+    except OSError:
+        return None
+    return match.group(1) if match else None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("image", help="firmware .bin")
+    parser.add_argument("-v", "--version", help="version of the image (default FIRMWARE_VERSION in Config.h)")
+    parser.add_argument("-u", "--url", help="image URL, absolute or relative to the manifest (default: file name)")
+    parser.add_argument("-o", "--output", help="manifest file (default: manifest.json next to the image)")
+    parser.add_argument("-c", "--chunk", type=int, default=DEFAULT_CHUNK,
+                        help="peer download chunk, a multiple of 4096 up to %d (default %d, 0 = no chunk hashes)"
+                        % (DEFAULT_CHUNK, DEFAULT_CHUNK))
+    args = parser.parse_args()
+
+    version = args.version or config_version()
+    if not version:
+        parser.error("no --version given and FIRMWARE_VERSION not found in Config.h")
+    if not re.match(r"^v?\d+(\.\d+){0,2}(-[0-9A-Za-z.-]+)?(\+[0-9A-Za-z.-]+)?$", version):
+        parser.error("%s is not a semantic version" % version)
+    if args.chunk < 0 or args.chunk % 4096 or args.chunk > DEFAULT_CHUNK:
+        parser.error("chunk must be a multiple of 4096 up to %d" % DEFAULT_CHUNK)
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+    if not image or image[0] != 0xE9:
+        print("error: %s is not an ESP firmware image" % args.image, file=sys.stderr)
+        return 1
+
+    manifest = {
+        "version": version,
+        "url": args.url or os.path.basename(args.image),
+        "sha256": hashlib.sha256(image).hexdigest(),
+        "size": len(image),
+    }
+    if args.chunk:
+        manifest["chunk"] = args.chunk
+        manifest["chunks"] = "".join(hashlib.sha256(image[i:i + args.chunk]).digest()[:CHUNK_HASH_SIZE].hex()
+                                     for i in range(0, len(image), args.chunk))
+    output = args.output or os.path.join(os.path.dirname(args.image), "manifest.json")
+    with open(output, "w") as f:
+        json.dump(manifest, f, indent=2)
+        f.write("\n")
+    print("%s: version %s, %s" % (output, version, manifest["sha256"]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
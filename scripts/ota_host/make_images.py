@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Make the firmware images the OTA host harness downloads.
+
+    python3 scripts/ota_host/make_images.py <dir>
+
+Writes old.bin (the "running" image), new.bin (old.bin with a function
+inserted, another removed and the addresses after it moved, which is what a
+delta patch is good at) and new2.bin (a further build, which the server
+switches to part way through one download). Each looks like an ESP32 app to
+FirmwareUpdater: magic byte 0xE9, hash_appended set, SHA-256 appended.
+"""
+
+import hashlib
+import os
+import random
+import struct
+import sys
+
+SIZE = 1000 * 1024
+
+
+def code(rng, size):
+    # Words from a small vocabulary with some noise, so it compresses about
+    # as well as real firmware
+    vocabulary = [rng.getrandbits(32) for _ in range(4096)]
+    data = bytearray()
+    while len(data) < size:
+        word = rng.choice(vocabulary) if rng.random() < 0.8 else rng.getrandbits(32)
+        data += struct.pack("<I", word)
+    return data[:size]
+
+
+def relocate(rng, data, start, share, offset):
+    for i in range(start - start % 4, len(data) - 4, 4):
+        if rng.random() < share:
+            value = struct.unpack_from("<I", data, i)[0]
+            struct.pack_into("<I", data, i, (value + offset) & 0xFFFFFFFF)
+
+
+def finish(data):
+    data = bytearray(data)
+    data[0] = 0xE9
+    data[23] = 1
+    data = bytes(data[:len(data) // 16 * 16])
+    return data + hashlib.sha256(data).digest()
+
+
+def main():
+    out = sys.argv[1] if len(sys.argv) > 1 else "."
+    rng = random.Random(1)
+    old = code(rng, SIZE)
+
+    new = bytearray(old)
+    inserted = len(new) * 3 // 10
+    new[inserted:inserted] = bytes(rng.getrandbits(8) for _ in range(300))
+    removed = len(new) * 6 // 10
+    del new[removed:removed + 200]
+    relocate(rng, new, inserted + 300, 0.01, 0x140)
+    new[5000:5005] = b"1.0.1"
+
+    new2 = bytearray(new)
+    for _ in range(10):
+        at = rng.randrange(len(new2))
+        new2[at:at] = bytes(rng.getrandbits(8) for _ in range(2048))
+    relocate(rng, new2, 0, 0.05, 0x800)
+
+    for name, image in (("old.bin", old), ("new.bin", new), ("new2.bin", new2)):
+        with open(os.path.join(out, name), "wb") as f:
+            f.write(finish(image))
+
+
+if __name__ == "__main__":
+    main()
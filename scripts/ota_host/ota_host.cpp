@@ -0,0 +1,268 @@
+// Host build of FirmwareUpdater (with OtaWriter, GzipInflater and
+// DeltaPatcher) downloading from scripts/flaky_ota_server.py, which cuts
+// responses off part way through. Flash, NVS and HTTPClient are the stand-ins
+// in stubs/; run.sh builds the images and runs this.
+//
+//   ota_host <flaky_ota_server.py> <work dir> [port]
+//
+// The work dir holds old.bin, new.bin, new2.bin (make_images.py) and the
+// served directories srv_plain, srv_gz, srv_delta and srv_change. Every
+// scenario must end with the expected image in flash, having resumed.
+#include <Arduino.h>
+#include <ESPmDNS.h>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <iterator>
+#include <openssl/sha.h>
+#include <sys/wait.h>
+#include "FirmwareUpdater.h"
+#include "Log.h"
+
+// Stand-ins' state
+Print Serial;
+MDNSResponder MDNS;
+uint8_t g_flash[0x140000];
+esp_partition_t g_updatePartition = {0x150000, sizeof(g_flash), "app1"};
+esp_partition_t g_runningPartition = {0x10000, sizeof(g_flash), "app0"};
+std::vector<uint8_t> g_running;
+uint32_t g_runningImageLength;
+uint8_t g_runningDigest[32];
+int g_eraseSectorUs = 45000;
+int g_writeUsPerKB = 2500;
+int g_delayScale = 1000;
+int g_bootPartitionSets = 0;
+std::map<std::string, std::vector<uint8_t>> g_nvs;
+std::atomic<int> g_nvsWrites(0);
+std::vector<std::string> g_requests;
+
+// Log output straight to stdout
+uint8_t Log::_levels[(uint8_t)LogModule::Count] = {
+    LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO,
+    LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO, LOG_LEVEL_INFO
+};
+
+void Log::write(LogModule module, uint8_t level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("   ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+static const char* serverScript;
+static std::string workDir;
+static int port = 18080;
+static pid_t serverPid = 0;
+static int failures = 0;
+
+static std::vector<uint8_t> load(const std::string& name) {
+    std::ifstream file(workDir + "/" + name, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
+
+static void copy(const std::string& from, const std::string& to) {
+    std::vector<uint8_t> data = load(from);
+    std::ofstream(workDir + "/" + to, std::ios::binary).write((const char*)data.data(), data.size());
+}
+
+static void stopServer() {
+    if (serverPid > 0) {
+        kill(serverPid, SIGTERM);
+        waitpid(serverPid, nullptr, 0);
+        serverPid = 0;
+    }
+}
+
+// Serve a directory with the given drop options, once it accepts connections
+static void startServer(const char* directory, std::vector<std::string> options) {
+    std::string path = workDir + "/" + directory;
+    std::string portText = std::to_string(port);
+    std::vector<const char*> argv = {"python3", serverScript, path.c_str(), "-p", portText.c_str()};
+    for (auto& option : options) {
+        argv.push_back(option.c_str());
+    }
+    argv.push_back(nullptr);
+
+    fflush(stdout);
+    serverPid = fork();
+    if (serverPid == 0) {
+        freopen("/dev/null", "w", stdout);
+        freopen((workDir + "/server.log").c_str(), "a", stderr);
+        execvp("python3", (char* const*)argv.data());
+        _exit(127);
+    }
+
+    for (int i = 0; i < 100; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        bool up = connect(fd, (sockaddr*)&address, sizeof(address)) == 0;
+        close(fd);
+        if (up) {
+            return;
+        }
+        usleep(50000);
+    }
+    fprintf(stderr, "flaky_ota_server.py did not start\n");
+    exit(2);
+}
+
+// Stop the server once the updater has saved a checkpoint, as if the device lost
+// the network and rebooted
+static std::thread stopAfterCheckpoint() {
+    g_nvsWrites = 0;
+    return std::thread([] {
+        while (g_nvsWrites == 0) {
+            usleep(1000);
+        }
+        stopServer();
+    });
+}
+
+static void check(const char* name, bool passed, const char* what) {
+    printf("%s %-12s %s\n", passed ? "PASS" : "FAIL", name, what);
+    if (!passed) {
+        failures++;
+    }
+}
+
+static bool flashHolds(const std::vector<uint8_t>& image) {
+    return memcmp(g_flash, image.data(), image.size()) == 0;
+}
+
+static bool firstRequestResumes() {
+    return !g_requests.empty() && g_requests.front().find("Range=") != std::string::npos;
+}
+
+static void report(FirmwareUpdater& updater, FirmwareUpdateResult result) {
+    OtaStats stats = updater.getStats();
+    printf("   result %d%s%s, %u bytes received, %d resumes, %s%s\n", (int)result,
+           result == FirmwareUpdateResult::Failed ? ": " : "", result == FirmwareUpdateResult::Failed ? updater.errorString() : "",
+           (unsigned)stats.bytes, updater.getResumeCount(), stats.delta ? "delta" : stats.compressed ? "gzip" : "plain",
+           stats.verified ? ", verified" : "");
+    for (auto& request : g_requests) {
+        printf("   GET %s\n", request.c_str());
+    }
+}
+
+static FirmwareUpdateResult run(FirmwareUpdater& updater, const String& url, const uint8_t* sha256) {
+    g_requests.clear();
+    FirmwareUpdateResult result = updater.update(url, "", sha256);
+    report(updater, result);
+    return result;
+}
+
+// A fresh download, resumed after every drop
+static void download(const char* name, const char* directory, std::vector<std::string> options,
+                     const String& url, const uint8_t* sha256, const std::vector<uint8_t>& image) {
+    printf("-- %s\n", name);
+    startServer(directory, options);
+    memset(g_flash, 0, sizeof(g_flash));
+    FirmwareUpdater updater;
+    FirmwareUpdateResult result = run(updater, url, sha256);
+    stopServer();
+    check(name, result == FirmwareUpdateResult::Updated && flashHolds(image) && updater.getResumeCount() > 0,
+          "image in flash after resuming");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <flaky_ota_server.py> <work dir> [port]\n", argv[0]);
+        return 2;
+    }
+    serverScript = argv[1];
+    workDir = argv[2];
+    if (argc > 3) {
+        port = atoi(argv[3]);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    g_running = load("old.bin");
+    g_runningImageLength = g_running.size() - 32;
+    memcpy(g_runningDigest, g_running.data() + g_runningImageLength, 32);
+    g_running.resize(g_runningPartition.size, 0xFF);
+    std::vector<uint8_t> image = load("new.bin");
+    std::vector<uint8_t> image2 = load("new2.bin");
+    if (g_runningImageLength == 0 || image.empty() || image2.empty()) {
+        fprintf(stderr, "no images in %s (make_images.py)\n", workDir.c_str());
+        return 2;
+    }
+    uint8_t sha256[32];
+    SHA256(image.data(), image.size(), sha256);
+    const String url = "http://127.0.0.1:" + std::to_string(port) + "/firmware.bin";
+
+    download("plain", "srv_plain", {"--drop-after", "300000"}, url, sha256, image);
+    download("gzip", "srv_gz", {"--drop-after", "150000"}, url, nullptr, image);
+    download("delta", "srv_delta", {"--drop-after", "2000"}, url, sha256, image);
+    download("random", "srv_plain", {"--drop-rate", "0.7", "--seed", "3"}, url, sha256, image);
+
+    // The updater gives up when the server goes away; after the "reboot" a
+    // new one continues from the NVS checkpoint
+    {
+        printf("-- reboot\n");
+        startServer("srv_plain", {"--drop-after", "400000"});
+        memset(g_flash, 0, sizeof(g_flash));
+        std::thread stopper = stopAfterCheckpoint();
+        {
+            FirmwareUpdater updater;
+            run(updater, url, sha256);
+        }
+        stopper.join();
+        startServer("srv_plain", {});
+        FirmwareUpdater updater;
+        FirmwareUpdateResult result = run(updater, url, sha256);
+        stopServer();
+        check("reboot", result == FirmwareUpdateResult::Updated && flashHolds(image) && firstRequestResumes(),
+              "resumed from the checkpoint");
+    }
+
+    // A checkpoint for another expected image is not resumed
+    {
+        printf("-- other sha\n");
+        startServer("srv_plain", {"--drop-after", "400000"});
+        memset(g_flash, 0, sizeof(g_flash));
+        std::thread stopper = stopAfterCheckpoint();
+        {
+            FirmwareUpdater updater;
+            run(updater, url, sha256);
+        }
+        stopper.join();
+        startServer("srv_plain", {});
+        uint8_t other[32] = {1};
+        FirmwareUpdater updater;
+        FirmwareUpdateResult result = run(updater, url, other);
+        stopServer();
+        check("other sha", result == FirmwareUpdateResult::Failed && !firstRequestResumes(),
+              "started over and rejected the image");
+    }
+
+    // The file is replaced between two pieces: If-Range no longer matches,
+    // the server sends the new file whole and the download starts over
+    {
+        printf("-- changed\n");
+        copy("new.bin", "srv_change/firmware.bin");
+        startServer("srv_change", {"--drop-after", "300000"});
+        memset(g_flash, 0, sizeof(g_flash));
+        g_nvsWrites = 0;
+        std::thread changer([] {
+            while (g_nvsWrites == 0) {
+                usleep(1000);
+            }
+            copy("new2.bin", "srv_change/firmware.bin");
+        });
+        FirmwareUpdater updater;
+        g_requests.clear();
+        FirmwareUpdateResult result = updater.update(url);
+        changer.join();
+        report(updater, result);
+        stopServer();
+        check("changed", result == FirmwareUpdateResult::Updated && flashHolds(image2), "new file in flash");
+    }
+
+    printf("%s\n", failures == 0 ? "all passed" : "FAILED");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Build the host harness and run it against scripts/flaky_ota_server.py.
+#
+#     scripts/ota_host/run.sh [port]
+#
+# Needs g++, python3 and the zlib and OpenSSL development headers.
+set -e
+
+here=$(cd "$(dirname "$0")" && pwd)
+repo=$(cd "$here/../.." && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+python3 "$here/make_images.py" "$work"
+mkdir "$work/srv_plain" "$work/srv_gz" "$work/srv_delta" "$work/srv_change"
+cp "$work/new.bin" "$work/srv_plain/firmware.bin"
+cp "$work/new.bin" "$work/srv_gz/firmware.bin"
+python3 "$repo/scripts/compress_firmware.py" "$work/srv_gz/firmware.bin" >/dev/null
+cp "$work/new.bin" "$work/srv_delta/firmware.bin"
+python3 "$repo/scripts/make_delta.py" "$work/old.bin" "$work/srv_delta/firmware.bin" >/dev/null
+
+g++ -std=gnu++17 -O1 -DESP32 -I "$here/stubs" -I "$repo/include" -o "$work/ota_host" \
+    "$here/ota_host.cpp" \
+    "$repo/src/FirmwareUpdater.cpp" "$repo/src/OtaWriter.cpp" \
+    "$repo/src/GzipInflater.cpp" "$repo/src/DeltaPatcher.cpp" \
+    -lcrypto -lz -lpthread
+
+"$work/ota_host" "$repo/scripts/flaky_ota_server.py" "$work" "$@"
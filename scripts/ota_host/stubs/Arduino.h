@@ -0,0 +1,83 @@
+#pragma once
+// Host stand-ins for the parts of the Arduino core and FreeRTOS used by
+// FirmwareUpdater, OtaWriter, GzipInflater and DeltaPatcher
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+inline uint32_t micros() {
+    using namespace std::chrono;
+    static auto start = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+inline uint32_t millis() { return micros() / 1000; }
+
+// Retry back-off and other delays run this many times faster than on the device
+extern int g_delayScale;
+inline void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms / g_delayScale)); }
+
+struct String : std::string {
+    using std::string::string;
+    String() {}
+    String(const std::string& s) : std::string(s) {}
+    String(const char* s) : std::string(s) {}
+    explicit String(size_t value) : std::string(std::to_string(value)) {}
+    explicit String(int value) : std::string(std::to_string(value)) {}
+    unsigned length() const { return size(); }
+    int indexOf(const char* s, unsigned from = 0) const { auto p = find(s, from); return p == npos ? -1 : (int)p; }
+    int indexOf(char c, unsigned from = 0) const { auto p = find(c, from); return p == npos ? -1 : (int)p; }
+    int lastIndexOf(char c) const { auto p = rfind(c); return p == npos ? -1 : (int)p; }
+    bool startsWith(const char* s) const { return compare(0, strlen(s), s) == 0; }
+    String substring(unsigned from, unsigned to) const { return String(substr(from, to - from)); }
+};
+
+struct Print {
+    size_t printf(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int n = vprintf(format, args);
+        va_end(args);
+        return n;
+    }
+    void println(const char* s) { puts(s); }
+    size_t write(const uint8_t* data, size_t length) { return fwrite(data, 1, length, stdout); }
+};
+extern Print Serial;
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffffu
+#define pdMS_TO_TICKS(x) (x)
+
+inline BaseType_t xTaskCreate(void (*entry)(void*), const char*, int, void* arg, int, TaskHandle_t* handle) {
+    std::thread(entry, arg).detach();
+    if (handle != nullptr) {
+        *handle = (void*)1;
+    }
+    return pdPASS;
+}
+inline void vTaskDelete(void*) {}
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return (void*)1; }
+
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size > 0) {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+inline uint32_t esp_random() { return rand(); }
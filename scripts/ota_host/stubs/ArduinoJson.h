@@ -0,0 +1,50 @@
+#pragma once
+// Flat JSON objects of strings and numbers, enough for the update manifest
+#include <cstdlib>
+#include <map>
+#include <string>
+
+struct JsonVariantConst {
+    const std::string* value;
+    const char* operator|(const char* fallback) const { return value != nullptr ? value->c_str() : fallback; }
+    int operator|(int fallback) const { return value != nullptr ? atoi(value->c_str()) : fallback; }
+};
+
+struct JsonDocument {
+    std::map<std::string, std::string> members;
+    JsonVariantConst operator[](const char* key) const {
+        auto it = members.find(key);
+        return {it == members.end() ? nullptr : &it->second};
+    }
+};
+
+struct DeserializationError {
+    enum Code { Ok, InvalidInput };
+};
+
+inline DeserializationError::Code deserializeJson(JsonDocument& doc, const std::string& text) {
+    size_t pos = text.find('{');
+    if (pos == std::string::npos) {
+        return DeserializationError::InvalidInput;
+    }
+    for (;;) {
+        size_t keyStart = text.find('"', pos);
+        if (keyStart == std::string::npos) {
+            break;
+        }
+        size_t keyEnd = text.find('"', keyStart + 1);
+        std::string key = text.substr(keyStart + 1, keyEnd - keyStart - 1);
+        size_t valueStart = text.find_first_not_of(" \t\r\n", text.find(':', keyEnd) + 1);
+        size_t valueEnd;
+        if (text[valueStart] == '"') {
+            valueEnd = text.find('"', valueStart + 1);
+            doc.members[key] = text.substr(valueStart + 1, valueEnd - valueStart - 1);
+            valueEnd++;
+        } else {
+            valueEnd = text.find_first_of(",}", valueStart);
+            doc.members[key] = text.substr(valueStart, valueEnd - valueStart);
+        }
+        pos = valueEnd;
+    }
+    return doc.members.empty() ? DeserializationError::InvalidInput : DeserializationError::Ok;
+}
@@ -0,0 +1,11 @@
+#pragma once
+// No peers are ever found: the harness exercises the server download only
+#include <HTTPClient.h>
+
+struct MDNSResponder {
+    int queryService(const char*, const char*) { return 0; }
+    String txt(int, const char*) { return String(); }
+    IPAddress IP(int) { return IPAddress(); }
+    uint16_t port(int) { return 0; }
+};
+extern MDNSResponder MDNS;
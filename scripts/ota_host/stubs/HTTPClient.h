@@ -0,0 +1,196 @@
+#pragma once
+// Blocking HTTP/1.1 client over POSIX sockets with the HTTPClient calls
+// FirmwareUpdater makes. Each request is recorded in g_requests with its
+// Range, If-Range and If-None-Match headers.
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+enum {
+    HTTP_CODE_OK = 200,
+    HTTP_CODE_PARTIAL_CONTENT = 206,
+    HTTP_CODE_NOT_MODIFIED = 304,
+    HTTP_CODE_RANGE_NOT_SATISFIABLE = 416
+};
+
+enum followRedirects_t {
+    HTTPC_DISABLE_FOLLOW_REDIRECTS,
+    HTTPC_STRICT_FOLLOW_REDIRECTS,
+    HTTPC_FORCE_FOLLOW_REDIRECTS
+};
+
+extern std::vector<std::string> g_requests;
+
+struct IPAddress {
+    uint32_t address;
+    IPAddress(uint32_t value = 0) : address(value) {}
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", address & 255, address >> 8 & 255, address >> 16 & 255, address >> 24);
+        return String(text);
+    }
+};
+
+class WiFiClient {
+public:
+    int fd = -1;
+    std::string pending;
+    bool eof = false;
+
+    // Read what has arrived, waiting up to timeoutMs for something
+    void fill(int timeoutMs) {
+        if (eof || fd < 0) {
+            return;
+        }
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, timeoutMs) <= 0) {
+            return;
+        }
+        char buffer[4096];
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+        if (count <= 0) {
+            eof = true;
+        } else {
+            pending.append(buffer, count);
+        }
+    }
+
+    size_t available() {
+        if (pending.empty()) {
+            fill(0);
+        }
+        return pending.size();
+    }
+
+    int read(uint8_t* data, size_t length) {
+        length = std::min(length, pending.size());
+        memcpy(data, pending.data(), length);
+        pending.erase(0, length);
+        return length;
+    }
+
+    bool connected() {
+        fill(0);
+        return !eof;
+    }
+};
+
+class HTTPClient {
+public:
+    bool begin(const String& url) {
+        if (url.compare(0, 7, "http://") != 0) {
+            return false;
+        }
+        std::string rest = url.substr(7);
+        size_t slash = rest.find('/');
+        std::string hostPort = rest.substr(0, slash);
+        _path = rest.substr(slash);
+        size_t colon = hostPort.find(':');
+        _host = hostPort.substr(0, colon);
+        _port = colon == std::string::npos ? 80 : atoi(hostPort.c_str() + colon + 1);
+        return true;
+    }
+
+    void end() {
+        if (_client.fd >= 0) {
+            close(_client.fd);
+        }
+        _client.fd = -1;
+    }
+
+    void setTimeout(uint16_t) {}
+    void setFollowRedirects(followRedirects_t) {}
+    void collectHeaders(const char* keys[], size_t count) {}
+    void addHeader(const String& name, const String& value) { _sent[name] = value; }
+    void setAuthorization(const char* user, const char* password) {
+        _sent["Authorization"] = std::string("Basic ") + user + ":" + password;
+    }
+
+    int GET() {
+        _client.fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(_port);
+        inet_pton(AF_INET, _host.c_str(), &address.sin_addr);
+        if (connect(_client.fd, (sockaddr*)&address, sizeof(address)) < 0) {
+            return -1;
+        }
+
+        std::string request = "GET " + _path + " HTTP/1.1\r\nHost: " + _host + "\r\nConnection: close\r\n";
+        std::string logged = std::to_string(_port) + _path;
+        for (auto& header : _sent) {
+            request += header.first + ": " + header.second + "\r\n";
+            if (header.first == "Range" || header.first == "If-Range" || header.first == "If-None-Match") {
+                logged += " " + header.first + "=" + header.second;
+            }
+        }
+        request += "\r\n";
+        g_requests.push_back(logged);
+        send(_client.fd, request.data(), request.size(), MSG_NOSIGNAL);
+
+        size_t end;
+        while ((end = _client.pending.find("\r\n\r\n")) == std::string::npos) {
+            if (_client.eof) {
+                return -4;
+            }
+            _client.fill(1000);
+        }
+        std::string head = _client.pending.substr(0, end);
+        _client.pending.erase(0, end + 4);
+
+        int code = atoi(head.c_str() + 9);
+        size_t pos = head.find("\r\n");
+        while (pos != std::string::npos) {
+            size_t next = head.find("\r\n", pos + 2);
+            std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                std::string name = lower(line.substr(0, colon));
+                std::string value = line.substr(line.find_first_not_of(' ', colon + 1));
+                _received[name] = value;
+                if (name == "content-length") {
+                    _size = atol(value.c_str());
+                }
+            }
+            pos = next;
+        }
+        return code;
+    }
+
+    int getSize() { return _size; }
+    String header(const char* name) {
+        auto it = _received.find(lower(name));
+        return it == _received.end() ? String() : String(it->second);
+    }
+    String errorToString(int code) { return String("connection error ") + std::to_string(code); }
+    WiFiClient* getStreamPtr() { return &_client; }
+    bool connected() { return _client.connected(); }
+
+    String getString() {
+        while (!_client.eof && (long)_client.pending.size() < _size) {
+            _client.fill(1000);
+        }
+        return String(_client.pending.substr(0, _size));
+    }
+
+private:
+    static std::string lower(std::string text) {
+        for (char& c : text) {
+            c = tolower(c);
+        }
+        return text;
+    }
+
+    std::string _host;
+    std::string _path;
+    int _port = 80;
+    std::map<std::string, std::string> _sent;
+    std::map<std::string, std::string> _received;
+    WiFiClient _client;
+    long _size = -1;
+};
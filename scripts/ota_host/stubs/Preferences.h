@@ -0,0 +1,40 @@
+#pragma once
+// NVS as a map that outlives the FirmwareUpdater instances, as across a reboot
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+extern std::map<std::string, std::vector<uint8_t>> g_nvs;
+extern std::atomic<int> g_nvsWrites;
+
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false) {
+        _name = name;
+        return true;
+    }
+    void end() {}
+
+    size_t getBytes(const char* key, void* buffer, size_t length) {
+        auto it = g_nvs.find(_name + "/" + key);
+        if (it == g_nvs.end() || it->second.size() > length) {
+            return 0;
+        }
+        memcpy(buffer, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+
+    size_t putBytes(const char* key, const void* data, size_t length) {
+        g_nvsWrites++;
+        g_nvs[_name + "/" + key].assign((const uint8_t*)data, (const uint8_t*)data + length);
+        return length;
+    }
+
+    bool remove(const char* key) { return g_nvs.erase(_name + "/" + key) > 0; }
+
+private:
+    std::string _name;
+};
@@ -0,0 +1,77 @@
+#pragma once
+// The ROM tinfl on zlib's raw inflate, writing into the caller's ring
+// buffer. At the end of the stream it keeps up to 3 bytes past the deflate
+// data in the bit buffer, as the ROM (miniz 1.x) does, so GzipInflater's
+// handling of the read-ahead before the gzip trailer is exercised.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <zlib.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+
+typedef uint32_t tinfl_bit_buf_t;
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+struct tinfl_decompressor {
+    uint32_t m_state;
+    uint32_t m_num_bits;
+    tinfl_bit_buf_t m_bit_buf;
+    z_stream stream;
+    uint8_t tables[11000];                      // about the size of the ROM decompressor
+};
+
+#define tinfl_init(r)                                   \
+    do {                                                \
+        (r)->m_state = 0;                               \
+        (r)->m_num_bits = 0;                            \
+        (r)->m_bit_buf = 0;                             \
+        memset(&(r)->stream, 0, sizeof(z_stream));      \
+        inflateInit2(&(r)->stream, -15);                \
+    } while (0)
+
+#define TINFL_READ_AHEAD 3
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* inSize, uint8_t* start,
+                                     uint8_t* next, size_t* outSize, uint32_t flags) {
+    size_t mask = (next - start) + *outSize - 1;
+    if (((mask + 1) & mask) != 0) {
+        return TINFL_STATUS_BAD_PARAM;
+    }
+    r->stream.next_in = (Bytef*)in;
+    r->stream.avail_in = *inSize;
+    r->stream.next_out = next;
+    r->stream.avail_out = *outSize;
+    int result = inflate(&r->stream, Z_NO_FLUSH);
+    size_t used = *inSize - r->stream.avail_in;
+    size_t produced = *outSize - r->stream.avail_out;
+
+    tinfl_status status;
+    if (result == Z_STREAM_END) {
+        status = TINFL_STATUS_DONE;
+        inflateEnd(&r->stream);
+        size_t extra = std::min<size_t>(TINFL_READ_AHEAD, r->stream.avail_in);
+        for (size_t i = 0; i < extra; i++) {
+            r->m_bit_buf |= (uint32_t)in[used + i] << (8 * i);
+        }
+        r->m_num_bits = 8 * extra + 5;
+        r->m_bit_buf = (r->m_bit_buf << 5) | 0x1F;
+        used += extra;
+    } else if (result == Z_OK || result == Z_BUF_ERROR) {
+        status = r->stream.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+    } else {
+        status = TINFL_STATUS_FAILED;
+    }
+    *inSize = used;
+    *outSize = produced;
+    return status;
+}
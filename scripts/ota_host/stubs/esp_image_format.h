@@ -0,0 +1,20 @@
+#pragma once
+#include <esp_partition.h>
+
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+
+struct esp_partition_pos_t {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct esp_image_metadata_t {
+    uint32_t image_len;
+};
+
+// The running image is g_running up to its appended digest
+inline esp_err_t esp_image_get_metadata(const esp_partition_pos_t*, esp_image_metadata_t* metadata) {
+    extern uint32_t g_runningImageLength;
+    metadata->image_len = g_runningImageLength;
+    return ESP_OK;
+}
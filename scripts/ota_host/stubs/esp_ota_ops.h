@@ -0,0 +1,15 @@
+#pragma once
+#include <esp_partition.h>
+
+#define ESP_ERR_OTA_VALIDATE_FAILED 0x1503
+
+extern int g_bootPartitionSets;
+
+inline const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*) { return &g_updatePartition; }
+inline const esp_partition_t* esp_ota_get_running_partition() { return &g_runningPartition; }
+
+// Only the image magic is checked here
+inline esp_err_t esp_ota_set_boot_partition(const esp_partition_t*) {
+    g_bootPartitionSets++;
+    return g_flash[0] == 0xE9 ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
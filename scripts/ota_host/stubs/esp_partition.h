@@ -0,0 +1,60 @@
+#pragma once
+// Flash partitions in memory: the update partition is g_flash (erase sets
+// 0xFF, writes can only clear bits, as on NOR flash), the running partition
+// is g_running. Erases and writes take about as long as on the device.
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define SPI_FLASH_SEC_SIZE 4096
+
+struct esp_partition_t {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+};
+
+extern uint8_t g_flash[];
+extern esp_partition_t g_updatePartition;
+extern esp_partition_t g_runningPartition;
+extern std::vector<uint8_t> g_running;
+extern uint8_t g_runningDigest[32];
+extern int g_eraseSectorUs;                     // per 4 KB sector, a quarter of that per 64 KB block
+extern int g_writeUsPerKB;
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t*, size_t offset, size_t length) {
+    int us = length >= 65536 ? g_eraseSectorUs * 4 * (int)(length / 65536) : g_eraseSectorUs * (int)(length / 4096);
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+    memset(g_flash + offset, 0xFF, length);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t*, size_t offset, const void* data, size_t length) {
+    std::this_thread::sleep_for(std::chrono::microseconds(g_writeUsPerKB * length / 1024));
+    for (size_t i = 0; i < length; i++) {
+        g_flash[offset + i] &= ((const uint8_t*)data)[i];
+    }
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* data, size_t length) {
+    if (partition == &g_updatePartition && offset + length <= partition->size) {
+        memcpy(data, g_flash + offset, length);
+        return ESP_OK;
+    }
+    if (partition == &g_runningPartition && offset + length <= g_running.size()) {
+        memcpy(data, g_running.data() + offset, length);
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+inline esp_err_t esp_partition_get_sha256(const esp_partition_t*, uint8_t* digest) {
+    memcpy(digest, g_runningDigest, 32);
+    return ESP_OK;
+}
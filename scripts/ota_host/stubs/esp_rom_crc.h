@@ -0,0 +1,4 @@
+#pragma once
+#include <zlib.h>
+
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* data, uint32_t length) { return crc32(crc, data, length); }
@@ -0,0 +1,50 @@
+#pragma once
+// FreeRTOS queues on a mutex and condition variable
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct HostQueue {
+    size_t itemSize;
+    size_t capacity;
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+typedef HostQueue* QueueHandle_t;
+
+inline std::chrono::milliseconds queueWait(uint32_t ticks) {
+    return std::chrono::milliseconds(ticks == 0xffffffffu ? 100000000u : ticks);
+}
+
+inline QueueHandle_t xQueueCreate(size_t length, size_t itemSize) {
+    HostQueue* queue = new HostQueue;
+    queue->itemSize = itemSize;
+    queue->capacity = length;
+    return queue;
+}
+inline void vQueueDelete(QueueHandle_t queue) { delete queue; }
+
+inline int xQueueSend(QueueHandle_t queue, const void* item, uint32_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!queue->changed.wait_for(lock, queueWait(ticks), [&] { return queue->items.size() < queue->capacity; })) {
+        return 0;
+    }
+    queue->items.emplace_back((const uint8_t*)item, (const uint8_t*)item + queue->itemSize);
+    queue->changed.notify_all();
+    return 1;
+}
+
+inline int xQueueReceive(QueueHandle_t queue, void* item, uint32_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!queue->changed.wait_for(lock, queueWait(ticks), [&] { return !queue->items.empty(); })) {
+        return 0;
+    }
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+    queue->items.pop_front();
+    queue->changed.notify_all();
+    return 1;
+}
@@ -0,0 +1,3 @@
+#pragma once
+// Only the types Log.h refers to; log messages go straight to stdout here
+typedef void* RingbufHandle_t;
@@ -0,0 +1,16 @@
+#pragma once
+// Binary semaphores as one-item queues
+#include "queue.h"
+
+typedef HostQueue* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return xQueueCreate(1, 1); }
+inline int xSemaphoreTake(SemaphoreHandle_t semaphore, uint32_t ticks) {
+    uint8_t token;
+    return xQueueReceive(semaphore, &token, ticks);
+}
+inline int xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    uint8_t token = 0;
+    return xQueueSend(semaphore, &token, 0);
+}
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
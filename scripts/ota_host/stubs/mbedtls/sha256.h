@@ -0,0 +1,19 @@
+#pragma once
+// mbedtls SHA-256 on OpenSSL
+#include <openssl/sha.h>
+
+typedef SHA256_CTX mbedtls_sha256_context;
+
+inline void mbedtls_sha256_init(mbedtls_sha256_context*) {}
+inline void mbedtls_sha256_free(mbedtls_sha256_context*) {}
+inline int mbedtls_sha256_starts_ret(mbedtls_sha256_context* ctx, int) { return !SHA256_Init(ctx); }
+inline int mbedtls_sha256_update_ret(mbedtls_sha256_context* ctx, const unsigned char* data, size_t length) {
+    return !SHA256_Update(ctx, data, length);
+}
+inline int mbedtls_sha256_finish_ret(mbedtls_sha256_context* ctx, unsigned char* digest) {
+    return !SHA256_Final(digest, ctx);
+}
+inline int mbedtls_sha256_ret(const unsigned char* data, size_t length, unsigned char* digest, int) {
+    SHA256(data, length, digest);
+    return 0;
+}
@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""Decode the binary trace stream of a device built with TRACE_SERIAL_ENABLED.
+
+    python3 scripts/trace_decode.py /dev/ttyUSB0 --out capture/
+    python3 scripts/trace_decode.py capture/raw.bin --out replay/
+
+Reads a serial port (needs pyserial) or a file of raw bytes and writes:
+
+    samples.csv   time_us,source,name,value   (one row per sample)
+    events.csv    time_us,id,arg
+    log.txt       log lines, also printed to stdout
+
+Frames are COBS encoded and end with a 0x00 byte; inside, all little-endian:
+
+    type u8 | sequence u16 | timestamp u32 (us) | body | crc32 u32
+
+Frames failing the CRC (boot messages, text printed before the channel
+started) are skipped and counted. Timestamps are extended past the 32-bit
+wrap, so time_us keeps increasing over long captures. --raw saves the bytes
+as received for a later replay.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+import zlib
+
+PROTOCOL_VERSION = 1                            # TRACE_PROTOCOL_VERSION on the device
+
+HELLO, SOURCE, SAMPLE, EVENT, LOG, DROPPED = 1, 2, 3, 4, 5, 6
+
+MODULES = ["app", "wifi", "mqtt", "http", "device", "net", "ota", "storage"]
+LEVELS = "-EWIDV"
+
+READ_SIZE = 65536
+
+
+def cobs_decode(data):
+    """Decode one COBS block (without its 0x00 terminator); None if malformed."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Clock:
+    """Extends wrapping 32-bit microsecond timestamps to 64 bits."""
+
+    def __init__(self):
+        self.last = None
+        self.high = 0
+
+    def extend(self, timestamp):
+        # Timestamps from different producers interleave slightly out of
+        # order, so only a large backwards step counts as a wrap
+        if self.last is not None and timestamp < self.last and self.last - timestamp > 0x80000000:
+            self.high += 1 << 32
+        elif self.last is not None and timestamp > self.last and timestamp - self.last > 0x80000000:
+            return self.high - (1 << 32) + timestamp
+        self.last = timestamp
+        return self.high + timestamp
+
+
+class Decoder:
+    def __init__(self, out_dir):
+        os.makedirs(out_dir, exist_ok=True)
+        self.samples = open(os.path.join(out_dir, "samples.csv"), "w", buffering=1 << 20)
+        self.events = open(os.path.join(out_dir, "events.csv"), "w", buffering=1 << 16)
+        self.log = open(os.path.join(out_dir, "log.txt"), "w", buffering=1)
+        self.samples.write("time_us,source,name,value\n")
+        self.events.write("time_us,id,arg\n")
+
+        self.clock = Clock()
+        self.names = {}
+        self.pending = b""
+        self.sequence = None
+        self.frames = 0
+        self.sample_count = 0
+        self.bad_frames = 0
+        self.lost_frames = 0
+        self.device_dropped = 0
+
+    def feed(self, data):
+        parts = (self.pending + data).split(b"\x00")
+        self.pending = parts.pop()
+        for part in parts:
+            if part:
+                self.frame(part)
+
+    def frame(self, encoded):
+        frame = cobs_decode(encoded)
+        if frame is None or len(frame) < 11:
+            self.bad_frames += 1
+            return
+        (crc,) = struct.unpack_from("<I", frame, len(frame) - 4)
+        if zlib.crc32(frame[:-4]) != crc:
+            self.bad_frames += 1
+            return
+
+        kind, sequence, timestamp = struct.unpack_from("<BHI", frame)
+        body = frame[7:-4]
+        if self.sequence is not None:
+            self.lost_frames += (sequence - self.sequence - 1) & 0xFFFF
+        self.sequence = sequence
+        self.frames += 1
+        time_us = self.clock.extend(timestamp)
+        try:
+            self.record(kind, time_us, body)
+        except (struct.error, IndexError):
+            self.bad_frames += 1
+
+    def record(self, kind, time_us, body):
+        if kind == SAMPLE:
+            source, value = struct.unpack_from("<Bf", body)
+            self.samples.write("%d,%d,%s,%.9g\n" % (time_us, source, self.names.get(source, ""), value))
+            self.sample_count += 1
+        elif kind == EVENT:
+            event_id, arg = struct.unpack_from("<HI", body)
+            self.events.write("%d,%d,%d\n" % (time_us, event_id, arg))
+        elif kind == LOG:
+            level, module = body[0], body[1]
+            text = body[2:].decode("utf-8", "replace")
+            module_name = MODULES[module] if module < len(MODULES) else "?"
+            line = "%s (%d) %s: %s" % (LEVELS[min(level, 5)], time_us // 1000, module_name, text)
+            self.log.write(line + "\n")
+            print(line)
+        elif kind == SOURCE:
+            index, rate = struct.unpack_from("<Bf", body)
+            name = body[5:].decode("utf-8", "replace")
+            if self.names.get(index) != name:
+                print("# source %d: %s at %.1f Hz" % (index, name, rate), file=sys.stderr)
+            self.names[index] = name
+        elif kind == HELLO:
+            if body[0] != PROTOCOL_VERSION:
+                print("# protocol version %d, expected %d" % (body[0], PROTOCOL_VERSION), file=sys.stderr)
+        elif kind == DROPPED:
+            (self.device_dropped,) = struct.unpack_from("<I", body)
+
+    def stats(self):
+        return "%d frames, %d samples, %d bad, %d lost on the link, %d dropped on the device" % (
+            self.frames, self.sample_count, self.bad_frames, self.lost_frames, self.device_dropped)
+
+    def close(self):
+        for f in (self.samples, self.events, self.log):
+            f.close()
+
+
+def open_input(path, baud):
+    if os.path.exists(path) and not path.startswith("/dev/"):
+        return open(path, "rb"), False
+    try:
+        import serial
+    except ImportError:
+        sys.exit("pyserial is needed to read a serial port: pip install pyserial")
+    return serial.Serial(path, baud, timeout=0.1), True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="serial port or file of raw bytes")
+    parser.add_argument("--baud", type=int, default=2000000, help="TRACE_BAUD_RATE (default 2000000)")
+    parser.add_argument("--out", default="trace", help="output directory (default ./trace)")
+    parser.add_argument("--raw", help="also save the raw bytes to this file")
+    args = parser.parse_args()
+
+    source, live = open_input(args.input, args.baud)
+    raw = open(args.raw, "wb") if args.raw else None
+    decoder = Decoder(args.out)
+
+    last_report = time.monotonic()
+    try:
+        while True:
+            data = source.read(READ_SIZE)
+            if not data:
+                if live:
+                    continue
+                break
+            if raw:
+                raw.write(data)
+            decoder.feed(data)
+
+            if live and time.monotonic() - last_report >= 5:
+                print("# " + decoder.stats(), file=sys.stderr)
+                last_report = time.monotonic()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        source.close()
+        if raw:
+            raw.close()
+        decoder.close()
+
+    print("# " + decoder.stats(), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,197 @@
+#include "ChangeFilter.h"
+
+// FNV-1a, used both for field paths and for non-numeric values
+static const uint32_t FNV_OFFSET = 2166136261UL;
+static const uint32_t FNV_PRIME = 16777619UL;
+
+static uint32_t fnvUpdate(uint32_t hash, const char* text) {
+    while (*text) {
+        hash = (hash ^ (uint8_t)*text++) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t childHash(uint32_t parentHash, const char* key, bool root) {
+    return fnvUpdate(root ? parentHash : fnvUpdate(parentHash, "."), key);
+}
+
+// Print sink that hashes serialized JSON without buffering it
+class HashPrint : public Print {
+public:
+    uint32_t hash = FNV_OFFSET;
+
+    size_t write(uint8_t c) override {
+        hash = (hash ^ c) * FNV_PRIME;
+        return 1;
+    }
+};
+
+static uint32_t valueHash(JsonVariantConst value) {
+    HashPrint hasher;
+    serializeJson(value, hasher);
+    return hasher.hash;
+}
+
+// Constructor
+ChangeFilter::ChangeFilter(unsigned long maxSilenceMs) :
+    _fieldCount(0),
+    _maxSilenceMs(maxSilenceMs),
+    _lastPublish(0),
+    _hasBaseline(false),
+    _epoch(0),
+    _published(0),
+    _suppressed(0) {
+}
+
+// Configure the deadband of a numeric field
+bool ChangeFilter::setDeadband(const char* field, float absolute, float percent) {
+    Field* entry = findField(fnvUpdate(FNV_OFFSET, field), true);
+    if (entry == nullptr) {
+        return false;
+    }
+
+    entry->absolute = absolute;
+    entry->percent = percent;
+    entry->ignore = false;
+    return true;
+}
+
+// Exclude a field from change detection
+bool ChangeFilter::ignoreField(const char* field) {
+    Field* entry = findField(fnvUpdate(FNV_OFFSET, field), true);
+    if (entry == nullptr) {
+        return false;
+    }
+
+    entry->ignore = true;
+    return true;
+}
+
+// Decide whether a document should be published
+bool ChangeFilter::shouldPublish(const JsonDocument& doc) {
+    bool changed = !_hasBaseline ||
+        (_maxSilenceMs > 0 && millis() - _lastPublish >= _maxSilenceMs);
+
+    if (!changed) {
+        _epoch++;
+        changed = objectChanged(doc.as<JsonObjectConst>(), FNV_OFFSET, true);
+    }
+
+    if (!changed) {
+        // A field that disappeared is a change too
+        for (int i = 0; i < _fieldCount; i++) {
+            if (_fields[i].hasValue && !_fields[i].ignore && _fields[i].seenEpoch != _epoch) {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (!changed) {
+        _suppressed++;
+    }
+    return changed;
+}
+
+// Store the published document as the new baseline
+void ChangeFilter::markPublished(const JsonDocument& doc) {
+    for (int i = 0; i < _fieldCount; i++) {
+        _fields[i].hasValue = false;
+    }
+
+    storeObject(doc.as<JsonObjectConst>(), FNV_OFFSET, true);
+
+    _hasBaseline = true;
+    _lastPublish = millis();
+    _published++;
+}
+
+// Force the next publish
+void ChangeFilter::reset() {
+    _hasBaseline = false;
+}
+
+ChangeFilter::Field* ChangeFilter::findField(uint32_t pathHash, bool create) {
+    for (int i = 0; i < _fieldCount; i++) {
+        if (_fields[i].pathHash == pathHash) {
+            return &_fields[i];
+        }
+    }
+
+    if (!create || _fieldCount >= CHANGE_FILTER_MAX_FIELDS) {
+        return nullptr;
+    }
+
+    Field& field = _fields[_fieldCount++];
+    field.pathHash = pathHash;
+    field.absolute = 0.0f;
+    field.percent = 0.0f;
+    field.lastValue = 0.0f;
+    field.lastHash = 0;
+    field.seenEpoch = 0;
+    field.ignore = false;
+    field.hasValue = false;
+    return &field;
+}
+
+// Compare an object against the baseline, descending into nested objects
+bool ChangeFilter::objectChanged(JsonObjectConst object, uint32_t parentHash, bool root) {
+    for (JsonPairConst pair : object) {
+        uint32_t pathHash = childHash(parentHash, pair.key().c_str(), root);
+        JsonVariantConst value = pair.value();
+
+        if (value.is<JsonObjectConst>()) {
+            if (objectChanged(value.as<JsonObjectConst>(), pathHash, false)) {
+                return true;
+            }
+            continue;
+        }
+
+        Field* field = findField(pathHash, true);
+        if (field == nullptr || !field->hasValue) {
+            // Untracked (table full) or new field
+            return true;
+        }
+        field->seenEpoch = _epoch;
+
+        if (field->ignore) {
+            continue;
+        }
+
+        if (value.is<float>()) {
+            float current = value.as<float>();
+            float threshold = max(field->absolute, field->percent * 0.01f * fabsf(field->lastValue));
+            if (fabsf(current - field->lastValue) > threshold) {
+                return true;
+            }
+        } else if (valueHash(value) != field->lastHash) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Record the values of an object as the baseline
+void ChangeFilter::storeObject(JsonObjectConst object, uint32_t parentHash, bool root) {
+    for (JsonPairConst pair : object) {
+        uint32_t pathHash = childHash(parentHash, pair.key().c_str(), root);
+        JsonVariantConst value = pair.value();
+
+        if (value.is<JsonObjectConst>()) {
+            storeObject(value.as<JsonObjectConst>(), pathHash, false);
+            continue;
+        }
+
+        Field* field = findField(pathHash, true);
+        if (field == nullptr) {
+            continue;
+        }
+
+        field->hasValue = true;
+        if (value.is<float>()) {
+            field->lastValue = value.as<float>();
+        } else {
+            field->lastHash = valueHash(value);
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#include "CredentialStore.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Storage
+#define LOG_MODULE_LEVEL LOG_LEVEL_STORAGE
+
+#define CREDENTIAL_INDEX_KEY "index"
+#define CREDENTIAL_SEQUENCE_KEY "seq"
+
+// Constructor
+CredentialStore::CredentialStore() {
+    memset(_slotHash, 0, sizeof(_slotHash));
+    memset(_table, 0, sizeof(_table));
+}
+
+// Load the index and store the networks added before
+bool CredentialStore::begin() {
+    if (_ready) {
+        return true;
+    }
+
+    if (!_prefs.begin(CREDENTIAL_NAMESPACE, false)) {
+        LOG_E("Credential store: NVS not available");
+        return false;
+    }
+
+    if (_prefs.getBytes(CREDENTIAL_INDEX_KEY, _slotHash, sizeof(_slotHash)) != sizeof(_slotHash)) {
+        memset(_slotHash, 0, sizeof(_slotHash));
+    }
+    _sequence = _prefs.getUInt(CREDENTIAL_SEQUENCE_KEY, 0);
+
+    _count = 0;
+    for (int slot = 0; slot < CREDENTIAL_CAPACITY; slot++) {
+        if (_slotHash[slot] != 0) {
+            _count++;
+        }
+    }
+    rebuildTable();
+    _ready = true;
+
+    for (int i = 0; i < _pendingCount; i++) {
+        add(_pending[i].ssid, _pending[i].password, _pending[i].priority);
+    }
+    _pendingCount = 0;
+
+    LOG_I("Credential store: %d networks", _count);
+    return true;
+}
+
+// Add a network, or update a stored one (NVS is only written on changes)
+bool CredentialStore::add(const char* ssid, const char* password, int priority) {
+    if (ssid == nullptr || ssid[0] == '\0' || strlen(ssid) > 32 || strlen(password) > 64) {
+        return false;
+    }
+    int8_t level = constrain(priority, -128, 127);
+
+    if (!_ready) {
+        int index = 0;
+        while (index < _pendingCount && strcmp(_pending[index].ssid, ssid) != 0) {
+            index++;
+        }
+        if (index < CREDENTIAL_PENDING_MAX) {
+            if (index == _pendingCount) {
+                _pendingCount++;
+            }
+            memset(&_pending[index], 0, sizeof(WiFiCredential));
+            strlcpy(_pending[index].ssid, ssid, sizeof(_pending[index].ssid));
+            strlcpy(_pending[index].password, password, sizeof(_pending[index].password));
+            _pending[index].priority = level;
+            return true;
+        }
+
+        // More than fit in RAM: NVS is up by now (called from setup())
+        if (!begin()) {
+            return false;
+        }
+    }
+
+    WiFiCredential credential;
+    int slot = find(ssid, &credential);
+    if (slot >= 0) {
+        if (strcmp(credential.password, password) == 0 && credential.priority == level) {
+            return true;
+        }
+        strlcpy(credential.password, password, sizeof(credential.password));
+        credential.priority = level;
+        return save(slot, credential);
+    }
+
+    slot = 0;
+    while (slot < CREDENTIAL_CAPACITY && _slotHash[slot] != 0) {
+        slot++;
+    }
+    if (slot >= CREDENTIAL_CAPACITY) {
+        LOG_W("Credential store full");
+        return false;
+    }
+
+    memset(&credential, 0, sizeof(credential));
+    strlcpy(credential.ssid, ssid, sizeof(credential.ssid));
+    strlcpy(credential.password, password, sizeof(credential.password));
+    credential.priority = level;
+    if (!save(slot, credential)) {
+        return false;
+    }
+
+    _slotHash[slot] = hash(ssid);
+    _count++;
+    insertTable(slot);
+    return saveIndex();
+}
+
+// Forget a network
+bool CredentialStore::remove(const char* ssid) {
+    int slot = find(ssid);
+    if (slot < 0) {
+        return false;
+    }
+
+    char key[8];
+    recordKey(slot, key);
+    _prefs.remove(key);
+
+    _slotHash[slot] = 0;
+    _count--;
+    rebuildTable();
+    return saveIndex();
+}
+
+// Probe the hash table; a record is only read when its hash matches
+int CredentialStore::find(const char* ssid, WiFiCredential* credential) const {
+    if (!_ready) {
+        return -1;
+    }
+
+    uint32_t ssidHash = hash(ssid);
+    WiFiCredential record;
+    WiFiCredential& target = credential != nullptr ? *credential : record;
+
+    int position = ssidHash & (CREDENTIAL_TABLE_SIZE - 1);
+    for (int probes = 0; probes < CREDENTIAL_TABLE_SIZE && _table[position] != 0; probes++) {
+        int slot = _table[position] - 1;
+        if (_slotHash[slot] == ssidHash && load(slot, target) && strcmp(target.ssid, ssid) == 0) {
+            return slot;
+        }
+        position = (position + 1) & (CREDENTIAL_TABLE_SIZE - 1);
+    }
+    return -1;
+}
+
+// Read a record
+bool CredentialStore::load(int slot, WiFiCredential& credential) const {
+    if (!_ready || !isUsed(slot)) {
+        return false;
+    }
+
+    char key[8];
+    recordKey(slot, key);
+    return _prefs.getBytes(key, &credential, sizeof(credential)) == sizeof(credential);
+}
+
+// Write a record
+bool CredentialStore::save(int slot, const WiFiCredential& credential) {
+    if (!_ready || slot < 0 || slot >= CREDENTIAL_CAPACITY) {
+        return false;
+    }
+
+    char key[8];
+    recordKey(slot, key);
+    return _prefs.putBytes(key, &credential, sizeof(credential)) == sizeof(credential);
+}
+
+// Remember where and when the network last worked
+void CredentialStore::recordSuccess(int slot, const uint8_t* bssid, uint8_t channel) {
+    WiFiCredential credential;
+    if (!load(slot, credential)) {
+        return;
+    }
+
+    if (credential.successes < UINT16_MAX) {
+        credential.successes++;
+    }
+    credential.failStreak = 0;
+    credential.channel = channel;
+    if (bssid != nullptr) {
+        memcpy(credential.bssid, bssid, sizeof(credential.bssid));
+    }
+
+    // Reconnecting to the newest network again needs no counter write
+    if (credential.lastSuccess == 0 || credential.lastSuccess != _sequence) {
+        credential.lastSuccess = ++_sequence;
+        _prefs.putUInt(CREDENTIAL_SEQUENCE_KEY, _sequence);
+    }
+    save(slot, credential);
+}
+
+// Count a failed attempt
+void CredentialStore::recordFailure(int slot) {
+    WiFiCredential credential;
+    if (!load(slot, credential) || credential.failStreak >= CREDENTIAL_FAIL_LIMIT) {
+        return;
+    }
+
+    credential.failStreak++;
+    save(slot, credential);
+}
+
+// Next used slot after this one, or -1
+int CredentialStore::next(int slot) const {
+    for (int index = slot + 1; index < CREDENTIAL_CAPACITY; index++) {
+        if (_slotHash[index] != 0) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+// FNV-1a of an SSID, never 0 (0 marks a free slot)
+uint32_t CredentialStore::hash(const char* ssid) {
+    uint32_t value = 2166136261UL;
+    for (const char* c = ssid; *c != '\0'; c++) {
+        value = (value ^ (uint8_t)*c) * 16777619UL;
+    }
+    return value != 0 ? value : 1;
+}
+
+// Rebuild the hash table from the index (after a removal)
+void CredentialStore::rebuildTable() {
+    memset(_table, 0, sizeof(_table));
+    for (int slot = 0; slot < CREDENTIAL_CAPACITY; slot++) {
+        if (_slotHash[slot] != 0) {
+            insertTable(slot);
+        }
+    }
+}
+
+// Linear probing from the hash position
+void CredentialStore::insertTable(int slot) {
+    int position = _slotHash[slot] & (CREDENTIAL_TABLE_SIZE - 1);
+    while (_table[position] != 0) {
+        position = (position + 1) & (CREDENTIAL_TABLE_SIZE - 1);
+    }
+    _table[position] = slot + 1;
+}
+
+// Persist the SSID hashes of the used slots
+bool CredentialStore::saveIndex() {
+    return _prefs.putBytes(CREDENTIAL_INDEX_KEY, _slotHash, sizeof(_slotHash)) == sizeof(_slotHash);
+}
+
+// NVS key of a record
+void CredentialStore::recordKey(int slot, char* key) {
+    snprintf(key, 8, "n%d", slot);
+}
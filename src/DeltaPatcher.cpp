@@ -0,0 +1,211 @@
+#include "DeltaPatcher.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Ota
+#define LOG_MODULE_LEVEL LOG_LEVEL_OTA
+
+// Constructor
+DeltaPatcher::DeltaPatcher() {
+}
+
+// Destructor
+DeltaPatcher::~DeltaPatcher() {
+    end();
+}
+
+// Start applying a patch against source
+bool DeltaPatcher::begin(const esp_partition_t* source, Sink sink) {
+    end();
+
+    _source = source;
+    _sink = sink;
+    _stage = Stage::Header;
+    _errorString = "";
+    _position = 0;
+    _sourceSize = 0;
+    _targetSize = 0;
+    _sourcePos = 0;
+    _output = 0;
+    _diffRemaining = 0;
+    _extraRemaining = 0;
+    _seek = 0;
+
+    if (_source == nullptr) {
+        return fail("No running partition");
+    }
+    _buffer = (uint8_t*)malloc(DELTA_READ_CHUNK);
+    if (_buffer == nullptr) {
+        return fail("Out of memory");
+    }
+    return true;
+}
+
+// Feed patch bytes to whichever stage is current
+bool DeltaPatcher::write(const uint8_t* data, size_t len) {
+    while (len > 0 && _stage != Stage::Error) {
+        size_t used;
+        switch (_stage) {
+            case Stage::Header:
+                used = readHeader(data, len);
+                break;
+            case Stage::Record:
+                used = readRecord(data, len);
+                break;
+            case Stage::Diff:
+                used = applyDiff(data, len);
+                break;
+            case Stage::Extra:
+                used = copyExtra(data, len);
+                break;
+            default:
+                return fail("Data after the end of the patch");
+        }
+        data += used;
+        len -= used;
+    }
+    return _stage != Stage::Error;
+}
+
+// Free the read buffer
+void DeltaPatcher::end() {
+    free(_buffer);
+    _buffer = nullptr;
+    _sink = nullptr;
+}
+
+// Collect the header and check that the patch was made for the running image
+size_t DeltaPatcher::readHeader(const uint8_t* data, size_t len) {
+    size_t used = min(len, sizeof(_header) - _position);
+    memcpy(_header + _position, data, used);
+    _position += used;
+    if (_position < sizeof(_header)) {
+        return used;
+    }
+
+    if (memcmp(_header, DELTA_MAGIC, 4) != 0) {
+        fail("Not a delta patch");
+        return used;
+    }
+    if (_header[4] != DELTA_VERSION) {
+        fail("Unsupported delta patch version");
+        return used;
+    }
+
+    _sourceSize = readLE32(_header + 8);
+    _targetSize = readLE32(_header + 12);
+    if (_sourceSize > _source->size) {
+        fail("Patch source larger than the running partition");
+        return used;
+    }
+
+    // Reads the digest stored with the running image, so this costs one
+    // image verification rather than hashing the partition here
+    uint8_t digest[32];
+    if (esp_partition_get_sha256(_source, digest) != ESP_OK || memcmp(digest, _header + 16, sizeof(digest)) != 0) {
+        fail("Patch is for a different running image");
+        return used;
+    }
+
+    LOG_I("Delta: %u byte source -> %u byte image", _sourceSize, _targetSize);
+    nextRecord();
+    return used;
+}
+
+// Collect a control record
+size_t DeltaPatcher::readRecord(const uint8_t* data, size_t len) {
+    size_t used = min(len, sizeof(_record) - _position);
+    memcpy(_record + _position, data, used);
+    _position += used;
+    if (_position < sizeof(_record)) {
+        return used;
+    }
+
+    _diffRemaining = readLE32(_record);
+    _extraRemaining = readLE32(_record + 4);
+    _seek = (int32_t)readLE32(_record + 8);
+
+    size_t remaining = _targetSize - _output;
+    if (_diffRemaining > remaining || _extraRemaining > remaining - _diffRemaining) {
+        fail("Patch record exceeds the image");
+    } else if (_diffRemaining > _sourceSize - min(_sourcePos, _sourceSize)) {
+        fail("Patch reads past the source image");
+    } else if (_diffRemaining > 0) {
+        _stage = Stage::Diff;
+    } else if (_extraRemaining > 0) {
+        _stage = Stage::Extra;
+    } else {
+        nextRecord();
+    }
+    return used;
+}
+
+// Add diff bytes to the source bytes at the current source position
+size_t DeltaPatcher::applyDiff(const uint8_t* data, size_t len) {
+    size_t count = min(min(len, _diffRemaining), (size_t)DELTA_READ_CHUNK);
+    if (esp_partition_read(_source, _sourcePos, _buffer, count) != ESP_OK) {
+        fail("Source read failed");
+        return len;
+    }
+    for (size_t i = 0; i < count; i++) {
+        _buffer[i] += data[i];
+    }
+    if (!_sink(_buffer, count)) {
+        fail("Output rejected");
+        return len;
+    }
+
+    _sourcePos += count;
+    _output += count;
+    _diffRemaining -= count;
+    if (_diffRemaining == 0) {
+        if (_extraRemaining > 0) {
+            _stage = Stage::Extra;
+        } else {
+            nextRecord();
+        }
+    }
+    return count;
+}
+
+// Pass literal bytes through
+size_t DeltaPatcher::copyExtra(const uint8_t* data, size_t len) {
+    size_t count = min(len, _extraRemaining);
+    if (!_sink(data, count)) {
+        fail("Output rejected");
+        return len;
+    }
+
+    _output += count;
+    _extraRemaining -= count;
+    if (_extraRemaining == 0) {
+        nextRecord();
+    }
+    return count;
+}
+
+// Apply the seek of the finished record and expect the next one
+void DeltaPatcher::nextRecord() {
+    int64_t position = (int64_t)_sourcePos + _seek;
+    if (position < 0 || position > (int64_t)_sourceSize) {
+        fail("Patch seeks outside the source image");
+        return;
+    }
+    _sourcePos = position;
+    _seek = 0;
+    _position = 0;
+    _stage = _output < _targetSize ? Stage::Record : Stage::Done;
+}
+
+// Record the first error
+bool DeltaPatcher::fail(const char* message) {
+    if (_stage != Stage::Error) {
+        _errorString = message;
+        _stage = Stage::Error;
+    }
+    return false;
+}
+
+// Little endian 32 bit value
+uint32_t DeltaPatcher::readLE32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
@@ -1,4 +1,8 @@
 #include "DeviceManager.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Device
+#define LOG_MODULE_LEVEL LOG_LEVEL_DEVICE
 
 // Constructor
 DeviceManager::DeviceManager(
@@ -10,24 +14,136 @@ DeviceManager::DeviceManager(
 ) : 
     _wifiManager(wifiManager),
     _mqttManager(mqttManager),
+    _network(nullptr),
+    _mqttConnectsSeen(0),
     _deviceName(deviceName),
     _firmwareVersion(firmwareVersion),
+    _scheduler(&_ownScheduler),
+    _telemetryTaskId(-1),
     _dataSendInterval(dataSendInterval),
-    _lastDataPublish(0),
+    _heartbeatFilter(DEVICE_TELEMETRY_MAX_SILENCE),
+    _statusFilter(0),
+    _history(nullptr),
+    _trace(nullptr),
     _wifiLedPin(-1),
     _mqttLedPin(-1),
     _dataLedPin(-1)
 {
+    // Volatile fields alone never justify a publish
+    _heartbeatFilter.ignoreField("timestamp");
+    _heartbeatFilter.setDeadband("heap", 0, DEVICE_HEAP_DEADBAND_PERCENT);
+    _heartbeatFilter.setDeadband("sampler.jitter_us", DEVICE_JITTER_DEADBAND_US);
+    _heartbeatFilter.ignoreField("rules.avg_cycles");
+    _heartbeatFilter.ignoreField("rules.max_cycles");
+    
+    _statusFilter.ignoreField("uptime");
+    _statusFilter.setDeadband("heap", 0, DEVICE_HEAP_DEADBAND_PERCENT);
+    _statusFilter.setDeadband("rssi", DEVICE_RSSI_DEADBAND);
+    
+    for (int i = 0; i < SAMPLER_MAX_SOURCES; i++) {
+        _sensorFilters[i].setMaxSilence(DEVICE_TELEMETRY_MAX_SILENCE);
+        _sensorFilters[i].ignoreField("timestamp");
+        _sensorFilters[i].ignoreField("n");
+        _sensorFilters[i].ignoreField("rate");
+        _extractors[i] = nullptr;
+    }
+    
+    // Rules refer to sensors by name
+    _rules.setResolver([this](const char* name) {
+        for (int i = 0; i < _sampler.sourceCount(); i++) {
+            if (strcmp(_sampler.source(i)->name(), name) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    });
+    
+    _rules.setEventHandler([this](const RuleEvent& event) {
+        publishRuleEvent(event);
+    });
+}
+
+// Use a shared scheduler
+void DeviceManager::useScheduler(Scheduler* scheduler) {
+    _scheduler = scheduler ? scheduler : &_ownScheduler;
+}
+
+// Attach a network task
+void DeviceManager::attachNetworkTask(NetworkTask* network) {
+    _network = network;
+}
+
+// Add a sampled sensor
+bool DeviceManager::addSensor(SensorSource* source, float rateHz, FeatureExtractor* extractor) {
+    int index = _sampler.addSource(source, rateHz);
+    if (index < 0) {
+        return false;
+    }
+    
+    _extractors[index] = extractor;
+    return true;
+}
+
+// Attach a history store
+void DeviceManager::attachHistory(TimeSeriesStore* history) {
+    _history = history;
+}
+
+// Attach a trace channel and name the sources on it
+void DeviceManager::attachTrace(TraceChannel* trace) {
+    _trace = trace;
+    for (int i = 0; i < _sampler.sourceCount(); i++) {
+        _trace->describeSource(i, _sampler.source(i)->name(), _sampler.rate(i));
+    }
+}
+
+// Change the telemetry publish interval
+void DeviceManager::setDataSendInterval(unsigned long intervalMs) {
+    _dataSendInterval = intervalMs;
+    if (_telemetryTaskId >= 0) {
+        _scheduler->setInterval(_telemetryTaskId, intervalMs);
+    }
+}
+
+// Set the deadband of a sensor's statistics
+bool DeviceManager::setSensorDeadband(const char* sensorName, float absolute, float percent) {
+    static const char* const statFields[] = { "min", "max", "mean", "std", "p50", "p90", "p99" };
+    
+    for (int i = 0; i < _sampler.sourceCount(); i++) {
+        if (strcmp(_sampler.source(i)->name(), sensorName) != 0) {
+            continue;
+        }
+        
+        for (const char* field : statFields) {
+            _sensorFilters[i].setDeadband(field, absolute, percent);
+        }
+        return true;
+    }
+    return false;
+}
+
+// Set the telemetry keepalive
+void DeviceManager::setTelemetryKeepalive(unsigned long maxSilenceMs) {
+    _heartbeatFilter.setMaxSilence(maxSilenceMs);
+    for (int i = 0; i < SAMPLER_MAX_SOURCES; i++) {
+        _sensorFilters[i].setMaxSilence(maxSilenceMs);
+    }
 }
 
 // Initialize device manager
 bool DeviceManager::begin() {
-    Serial.println("Initializing device manager...");
+    LOG_I("Initializing device manager...");
+    
+    // Connections are owned by the network task when running split across cores
+    if (_network != nullptr) {
+        registerTasks();
+        return true;
+    }
     
     // Connect to WiFi
     bool wifiConnected = _wifiManager->begin();
     if (!wifiConnected) {
-        Serial.println("WiFi connection failed. Continuing with limited functionality.");
+        LOG_W("WiFi connection failed. Continuing with limited functionality.");
     }
     
     // Connect to MQTT if WiFi is connected
@@ -35,7 +151,7 @@ bool DeviceManager::begin() {
     if (wifiConnected) {
         mqttConnected = _mqttManager->begin();
         if (!mqttConnected) {
-            Serial.println("MQTT connection failed. Continuing with limited functionality.");
+            LOG_W("MQTT connection failed. Continuing with limited functionality.");
         }
     }
     
@@ -44,30 +160,279 @@ bool DeviceManager::begin() {
         sendStatusInfo();
     }
     
+    registerTasks();
+    
     return wifiConnected && mqttConnected;
 }
 
 // Main loop function
 void DeviceManager::loop() {
-    // Check connections
-    checkConnections();
+    // A shared scheduler is run by its owner
+    if (_scheduler == &_ownScheduler) {
+        _scheduler->runPending();
+    }
+}
+
+// Register periodic tasks
+void DeviceManager::registerTasks() {
+    if (_telemetryTaskId >= 0) {
+        return;
+    }
     
-    // Update status LEDs
-    updateStatusLEDs();
+    if (_network != nullptr) {
+        _scheduler->addPeriodic("leds", DEVICE_CONNECTION_CHECK_INTERVAL, [this]() {
+            updateStatusLEDs();
+        });
+        
+        _scheduler->addPeriodic("commands", DEVICE_COMMAND_POLL_INTERVAL, [this]() {
+            processQueuedCommands();
+            
+            // The retained status goes out as soon as the broker is reachable
+            uint32_t connects = _network->mqttConnectCount();
+            if (connects != _mqttConnectsSeen) {
+                _mqttConnectsSeen = connects;
+                sendStatusInfo(true);
+            }
+        });
+    } else {
+        _scheduler->addPeriodic("connections", DEVICE_CONNECTION_CHECK_INTERVAL, [this]() {
+            checkConnections();
+            updateStatusLEDs();
+        });
+        
+        _scheduler->addPeriodic("mqtt", DEVICE_MQTT_LOOP_INTERVAL, [this]() {
+            _mqttManager->loop();
+        });
+        
+        // With a network task it publishes these itself
+        _scheduler->addPeriodic("wifi_metrics", WIFI_METRICS_INTERVAL, [this]() {
+            if (isMqttConnected()) {
+                JsonDocument metricsDoc;
+                _wifiManager->getMetricsJson(metricsDoc.to<JsonObject>());
+                publishJson("wifi/metrics", metricsDoc, false);
+            }
+        });
+    }
     
-    // Process MQTT messages
-    if (_mqttManager->isConnected()) {
-        _mqttManager->loop();
+    if (_sampler.sourceCount() > 0 && _sampler.begin()) {
+        // Frames are analysed at the rate the sampler actually runs
+        for (int i = 0; i < _sampler.sourceCount(); i++) {
+            if (_extractors[i] == nullptr) {
+                continue;
+            }
+            _extractors[i]->setSampleRate(_sampler.rate(i));
+            if (!_extractors[i]->begin()) {
+                LOG_W("Feature extractor unavailable for %s", _sampler.source(i)->name());
+                _extractors[i] = nullptr;
+            }
+        }
         
-        // Send telemetry data at intervals
-        unsigned long currentMillis = millis();
-        if (currentMillis - _lastDataPublish >= _dataSendInterval) {
-            _lastDataPublish = currentMillis;
-            sendTelemetryData();
+        _scheduler->addPeriodic("samples", DEVICE_SAMPLE_DRAIN_INTERVAL, [this]() {
+            drainSamples();
+        });
+    }
+    
+    // Status is re-checked periodically but only published when it changed
+    _scheduler->addPeriodic("status", DEVICE_STATUS_CHECK_INTERVAL, [this]() {
+        sendStatusInfo();
+    }, _network != nullptr ? 0 : DEVICE_STATUS_CHECK_INTERVAL);
+    
+    // Runs while offline too so history and sensor windows keep going
+    _telemetryTaskId = _scheduler->addPeriodic("telemetry", _dataSendInterval, [this]() {
+        sendTelemetryData();
+    });
+}
+
+// Handle commands queued by the network task
+void DeviceManager::processQueuedCommands() {
+    InboundCommand command;
+    while (_network->nextCommand(command)) {
+        processCommand(String(command.topic), String(command.payload));
+    }
+}
+
+// Move buffered samples into the aggregation windows
+void DeviceManager::drainSamples() {
+    Sample sample;
+    while (_sampler.read(sample)) {
+        if (_trace != nullptr) {
+            _trace->sample(sample.source, sample.value, sample.timestampUs);
+        }
+        _windows[sample.source].add(sample.value);
+        _rules.onSample(sample.source, sample.value, sample.timestampUs);
+        onSample(sample.source, sample.value, sample.timestampUs);
+        
+        FeatureExtractor* extractor = _extractors[sample.source];
+        if (extractor != nullptr && extractor->push(sample.value)) {
+            onFeatures(sample.source, extractor->features());
         }
     }
 }
 
+// Per-sample hook (no-op in the base class)
+void DeviceManager::onSample(int sourceIndex, float value, uint32_t timestampUs) {
+}
+
+// Publish a feature vector
+void DeviceManager::onFeatures(int sourceIndex, const FeatureVector& features) {
+    String name = _sampler.source(sourceIndex)->name();
+    recordHistory((name + ".rms").c_str(), features.rms);
+    
+    if (!isMqttConnected()) {
+        return;
+    }
+    
+    FeatureExtractor* extractor = _extractors[sourceIndex];
+    
+    JsonDocument featureDoc;
+    featureDoc["frame"] = features.frame;
+    featureDoc["mean"] = features.mean;
+    featureDoc["rms"] = features.rms;
+    featureDoc["peak"] = features.peak;
+    featureDoc["crest"] = features.crest;
+    
+    // Peaks as [frequency, amplitude] pairs, bands as powers in registration order
+    JsonArray peaks = featureDoc["peaks"].to<JsonArray>();
+    for (int i = 0; i < features.peakCount; i++) {
+        JsonArray peak = peaks.add<JsonArray>();
+        peak.add(features.peaks[i].frequencyHz);
+        peak.add(features.peaks[i].amplitude);
+    }
+    
+    JsonArray bands = featureDoc["bands"].to<JsonArray>();
+    for (int i = 0; i < features.bandCount; i++) {
+        bands.add(features.bandPower[i]);
+    }
+    featureDoc["fs"] = extractor->sampleRate();
+    featureDoc["n"] = extractor->frameSize();
+    
+    String topic = "features/" + name;
+    publishJson(topic.c_str(), featureDoc, false);
+}
+
+// Publish window statistics of every sensor
+void DeviceManager::publishSensorStats() {
+    // Include samples still waiting in the ring buffer
+    drainSamples();
+    
+    bool connected = isMqttConnected();
+    
+    for (int i = 0; i < _sampler.sourceCount(); i++) {
+        StreamingStats& window = _windows[i];
+        if (window.count() == 0) {
+            continue;
+        }
+        
+        String name = _sampler.source(i)->name();
+        recordHistory(name.c_str(), window.mean());
+        recordHistory((name + ".min").c_str(), window.minimum());
+        recordHistory((name + ".max").c_str(), window.maximum());
+        
+        if (!connected) {
+            window.reset();
+            continue;
+        }
+        
+        JsonDocument statsDoc;
+        statsDoc["timestamp"] = millis() / 1000;
+        statsDoc["n"] = window.count();
+        statsDoc["min"] = window.minimum();
+        statsDoc["max"] = window.maximum();
+        statsDoc["mean"] = window.mean();
+        statsDoc["std"] = window.stddev();
+        statsDoc["p50"] = window.p50();
+        statsDoc["p90"] = window.p90();
+        statsDoc["p99"] = window.p99();
+        statsDoc["rate"] = _sampler.rate(i);
+        
+        String topic = "telemetry/" + name;
+        publishIfChanged(_sensorFilters[i], topic.c_str(), statsDoc, false);
+        
+        window.reset();
+    }
+}
+
+// Load or remove a rule
+void DeviceManager::handleRuleCommand(const char* id, const String& payload) {
+    bool ok = _rules.setRule(id, payload.c_str(), payload.length());
+    
+    if (ok) {
+        LOG_I("Rule %s %s", id, payload.length() ? "loaded" : "removed");
+    } else {
+        LOG_W("Rule %s rejected: %s", id, _rules.lastError());
+    }
+    
+    JsonDocument resultDoc;
+    resultDoc["rule"] = id;
+    resultDoc["ok"] = ok;
+    if (!ok) {
+        resultDoc["error"] = _rules.lastError();
+    }
+    resultDoc["rules"] = _rules.ruleCount();
+    publishJson("rules/result", resultDoc, false);
+}
+
+// Publish a rule transition
+void DeviceManager::publishRuleEvent(const RuleEvent& event) {
+    LOG_I("Rule %s %s", event.ruleId, event.active ? "fired" : "cleared");
+    
+    JsonDocument eventDoc;
+    eventDoc["rule"] = event.ruleId;
+    eventDoc["state"] = event.active ? "fired" : "cleared";
+    eventDoc["sensor"] = _sampler.source(event.source)->name();
+    eventDoc["value"] = event.value;
+    eventDoc["timestamp"] = millis() / 1000;
+    
+    String topic = String("events/") + event.ruleId;
+    publishJson(topic.c_str(), eventDoc, false);
+}
+
+// Record a history value
+void DeviceManager::recordHistory(const char* metric, float value) {
+    if (_history != nullptr) {
+        _history->append(metric, value);
+    }
+}
+
+// Publish a document only if it differs from the last one published
+bool DeviceManager::publishIfChanged(ChangeFilter& filter, const char* topic, const JsonDocument& jsonDoc, bool retain) {
+    if (!filter.shouldPublish(jsonDoc)) {
+        return false;
+    }
+    
+    // Only a delivered document becomes the new baseline
+    if (!publishJson(topic, jsonDoc, retain)) {
+        return false;
+    }
+    
+    filter.markPublished(jsonDoc);
+    return true;
+}
+
+// Publish JSON through the network task or directly
+bool DeviceManager::publishJson(const char* topic, const JsonDocument& jsonDoc, bool retain) {
+    if (_network != nullptr) {
+        return _network->publishJson(topic, jsonDoc, retain);
+    }
+    return _mqttManager->publishJson(topic, jsonDoc, retain);
+}
+
+// Publish a plain payload through the network task or directly
+bool DeviceManager::publish(const char* topic, const char* payload, bool retain) {
+    if (_network != nullptr) {
+        return _network->publish(topic, payload, retain);
+    }
+    return _mqttManager->publish(topic, payload, retain);
+}
+
+// MQTT connection state
+bool DeviceManager::isMqttConnected() const {
+    if (_network != nullptr) {
+        return _network->isMqttConnected();
+    }
+    return _mqttManager->isConnected();
+}
+
 // Check connections status
 bool DeviceManager::checkConnections() {
     // Check WiFi connection
@@ -83,32 +448,58 @@ bool DeviceManager::checkConnections() {
 }
 
 // Send device status information
-void DeviceManager::sendStatusInfo() {
-    if (!_mqttManager->isConnected()) {
+void DeviceManager::sendStatusInfo(bool force) {
+    if (!isMqttConnected()) {
         return;
     }
     
+    if (force) {
+        _statusFilter.reset();
+    }
+    
     // Create JSON document for device status
     JsonDocument statusDoc;
     
     statusDoc["device"] = _deviceName;
     statusDoc["firmware"] = _firmwareVersion;
-    statusDoc["ip"] = _wifiManager->getIPAddress();
+    // The WiFi state machine runs on the network core; read its snapshot
+    WiFiStatus wifiStatus;
+    if (_network != nullptr) {
+        _network->getWiFiStatus(wifiStatus);
+    } else {
+        _wifiManager->getStatus(wifiStatus);
+    }
+    
+    statusDoc["ip"] = wifiStatus.ip;
     statusDoc["mac"] = _wifiManager->getMACAddress();
-    statusDoc["rssi"] = _wifiManager->getSignalStrength();
+    statusDoc["rssi"] = wifiStatus.rssi;
     statusDoc["uptime"] = millis() / 1000; // Uptime in seconds
-    statusDoc["heap"] = ESP.getFreeHeap();
     
-    // Publish status information
-    _mqttManager->publishJson("status/info", statusDoc, true);
+    // Roaming between access points of the same SSID
+    JsonObject roaming = statusDoc["roaming"].to<JsonObject>();
+    roaming["count"] = wifiStatus.roams;
+    roaming["failures"] = wifiStatus.roamFailures;
+    roaming["last_ms"] = wifiStatus.lastRoamMs;
+    roaming["avg_ms"] = wifiStatus.avgRoamMs;
+    roaming["last_gain_db"] = wifiStatus.lastRoamGain;
+    roaming["total_gain_db"] = wifiStatus.totalRoamGain;
+    statusDoc["heap"] = ESP.getFreeHeap();
     
-    Serial.println("Device status information sent");
+    // The retained document is only replaced when something changed
+    if (publishIfChanged(_statusFilter, "status/info", statusDoc, true)) {
+        LOG_D("Device status information sent");
+    }
 }
 
 // Send telemetry data - base implementation
 void DeviceManager::sendTelemetryData() {
+    recordHistory("heap", ESP.getFreeHeap());
+    
+    // Statistics over every sample taken since the previous publish
+    publishSensorStats();
+    
     // Base implementation just sends a heartbeat
-    if (!_mqttManager->isConnected()) {
+    if (!isMqttConnected()) {
         return;
     }
     
@@ -116,39 +507,79 @@ void DeviceManager::sendTelemetryData() {
     telemetryDoc["timestamp"] = millis() / 1000;
     telemetryDoc["heap"] = ESP.getFreeHeap();
     
-    _mqttManager->publishJson("telemetry/heartbeat", telemetryDoc, false);
+    if (_sampler.isRunning()) {
+        JsonObject sampler = telemetryDoc["sampler"].to<JsonObject>();
+        sampler["overruns"] = _sampler.overruns();
+        sampler["jitter_us"] = _sampler.maxJitterUs();
+    }
+    
+    if (_rules.ruleCount() > 0) {
+        JsonObject rules = telemetryDoc["rules"].to<JsonObject>();
+        rules["count"] = _rules.ruleCount();
+        rules["avg_cycles"] = _rules.avgCyclesPerSample();
+        rules["max_cycles"] = _rules.maxCyclesPerSample();
+    }
     
-    Serial.println("Heartbeat telemetry sent");
+    if (publishIfChanged(_heartbeatFilter, "telemetry/heartbeat", telemetryDoc, false)) {
+        LOG_D("Heartbeat telemetry sent");
+    }
 }
 
 // Process MQTT commands
 void DeviceManager::processCommand(const String& topic, const String& payload) {
-    Serial.println("Command received: " + topic + " - " + payload);
+    LOG_D("Command received: %s - %s", topic.c_str(), payload.c_str());
+    
+    // Rules: control/rules/<id> with a JSON definition, empty payload removes
+    int rulesAt = topic.indexOf("/control/rules/");
+    if (rulesAt >= 0) {
+        handleRuleCommand(topic.substring(rulesAt + 15).c_str(), payload);
+        return;
+    }
     
     // Handle common commands
     if (topic.endsWith("/restart")) {
-        Serial.println("Restart command received");
+        LOG_I("Restart command received");
         restart();
     } 
     else if (topic.endsWith("/status/request")) {
-        Serial.println("Status request received");
-        sendStatusInfo();
+        LOG_D("Status request received");
+        sendStatusInfo(true);
+    }
+    else if (topic.endsWith("/log")) {
+        handleLogCommand(payload);
     }
     
     // Additional command processing can be implemented in derived classes
 }
 
+// Change log levels at runtime: "<level>" for every module or "<module> <level>"
+void DeviceManager::handleLogCommand(const String& payload) {
+    String command = payload;
+    command.trim();
+    int space = command.indexOf(' ');
+    String module = space > 0 ? command.substring(0, space) : String("all");
+    String level = space > 0 ? command.substring(space + 1) : command;
+    level.trim();
+    
+    if (Log::setLevel(module.c_str(), level.c_str())) {
+        LOG_I("Log level of %s set to %s", module.c_str(), level.c_str());
+    } else {
+        LOG_W("Log command not understood: %s", command.c_str());
+    }
+}
+
 // Handle device restart
 void DeviceManager::restart() {
-    Serial.println("Restarting device...");
+    LOG_I("Restarting device...");
     
     // Send offline status if connected
-    if (_mqttManager->isConnected()) {
-        _mqttManager->publish("status", "offline", true);
-        delay(100); // Short delay to allow message to be sent
+    if (isMqttConnected()) {
+        publish("status", "offline", true);
+        delay(_network != nullptr ? 250 : 100); // Allow the message to be sent
     }
     
     // Restart the ESP32
+    Log::flush();
     ESP.restart();
 }
 
@@ -156,11 +587,12 @@ void DeviceManager::restart() {
 void DeviceManager::updateStatusLEDs() {
     // Update WiFi status LED if defined
     if (_wifiLedPin >= 0) {
-        digitalWrite(_wifiLedPin, _wifiManager->isConnected() ? HIGH : LOW);
+        bool wifiConnected = _network ? _network->isWiFiConnected() : _wifiManager->isConnected();
+        digitalWrite(_wifiLedPin, wifiConnected ? HIGH : LOW);
     }
     
     // Update MQTT status LED if defined
     if (_mqttLedPin >= 0) {
-        digitalWrite(_mqttLedPin, _mqttManager->isConnected() ? HIGH : LOW);
+        digitalWrite(_mqttLedPin, isMqttConnected() ? HIGH : LOW);
     }
 }
@@ -0,0 +1,327 @@
+#include "FeatureExtractor.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if FEATURE_HAVE_ESP_DSP
+#include "esp_dsp.h"
+#include "esp_heap_caps.h"
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// ESP-DSP's SIMD kernels want 16-byte aligned buffers
+static float* allocFloats(size_t count) {
+#if FEATURE_HAVE_ESP_DSP
+    return (float*)heap_caps_aligned_alloc(16, count * sizeof(float), MALLOC_CAP_8BIT);
+#else
+    return (float*)malloc(count * sizeof(float));
+#endif
+}
+
+static void freeFloats(float* buffer) {
+#if FEATURE_HAVE_ESP_DSP
+    heap_caps_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+#if FEATURE_HAVE_ESP_DSP
+// The ESP-DSP twiddle table is global and shared by every extractor
+static bool espDspInitialized = false;
+
+static bool initEspDsp() {
+    if (!espDspInitialized) {
+        espDspInitialized = dsps_fft2r_init_fc32(NULL, FEATURE_MAX_FRAME) == ESP_OK;
+    }
+    return espDspInitialized;
+}
+#endif
+
+// Constructor
+FeatureExtractor::FeatureExtractor(uint16_t frameSize, float sampleRateHz) :
+    _frameSize(frameSize),
+    _sampleRate(sampleRateHz),
+    _backend(FEATURE_HAVE_ESP_DSP ? DspBackend::EspDsp : DspBackend::Reference),
+    _bandCount(0),
+    _frame(nullptr),
+    _scratch(nullptr),
+    _window(nullptr),
+    _work(nullptr),
+    _twiddle(nullptr),
+    _windowSum(0.0f),
+    _windowPower(0.0f),
+    _fill(0),
+    _frameCount(0) {
+    memset(&_features, 0, sizeof(_features));
+}
+
+// Destructor
+FeatureExtractor::~FeatureExtractor() {
+    end();
+}
+
+// Add a frequency band
+bool FeatureExtractor::addBand(float lowHz, float highHz) {
+    if (_bandCount >= FEATURE_MAX_BANDS || highHz <= lowHz) {
+        return false;
+    }
+
+    _bandLow[_bandCount] = lowHz;
+    _bandHigh[_bandCount] = highHz;
+    _bandCount++;
+    return true;
+}
+
+// Allocate buffers and precompute the window and twiddles
+bool FeatureExtractor::begin() {
+    if (_work != nullptr) {
+        return true;
+    }
+
+    if (_frameSize < 8 || _frameSize > FEATURE_MAX_FRAME || (_frameSize & (_frameSize - 1)) != 0) {
+        return false;
+    }
+
+    _frame = allocFloats(_frameSize);
+    _scratch = allocFloats(_frameSize);
+    _window = allocFloats(_frameSize);
+    _work = allocFloats(2 * _frameSize);
+    _twiddle = allocFloats(_frameSize);
+
+    if (!_frame || !_scratch || !_window || !_work || !_twiddle) {
+        end();
+        return false;
+    }
+
+    // Same Hann definition as dsps_wind_hann_f32 so both backends agree
+    _windowSum = 0.0f;
+    _windowPower = 0.0f;
+    for (int i = 0; i < _frameSize; i++) {
+        _window[i] = 0.5f - 0.5f * cosf(2.0f * M_PI * i / (_frameSize - 1));
+        _windowSum += _window[i];
+        _windowPower += _window[i] * _window[i];
+    }
+
+    // exp(-2*pi*j*k/N) for k < N/2
+    for (int k = 0; k < _frameSize / 2; k++) {
+        double angle = 2.0 * M_PI * k / _frameSize;
+        _twiddle[2 * k] = (float)cos(angle);
+        _twiddle[2 * k + 1] = (float)-sin(angle);
+    }
+
+#if FEATURE_HAVE_ESP_DSP
+    if (_backend == DspBackend::EspDsp && !initEspDsp()) {
+        _backend = DspBackend::Reference;
+    }
+#endif
+
+    _fill = 0;
+    _frameCount = 0;
+    return true;
+}
+
+// Release buffers
+void FeatureExtractor::end() {
+    freeFloats(_frame);
+    freeFloats(_scratch);
+    freeFloats(_window);
+    freeFloats(_work);
+    freeFloats(_twiddle);
+    _frame = _scratch = _window = _work = _twiddle = nullptr;
+}
+
+// Select the processing kernels
+void FeatureExtractor::setBackend(DspBackend backend) {
+#if FEATURE_HAVE_ESP_DSP
+    if (backend == DspBackend::EspDsp && !initEspDsp()) {
+        backend = DspBackend::Reference;
+    }
+#else
+    backend = DspBackend::Reference;
+#endif
+    _backend = backend;
+}
+
+// Collect samples into frames
+bool FeatureExtractor::push(float sample) {
+    if (_frame == nullptr) {
+        return false;
+    }
+
+    _frame[_fill++] = sample;
+    if (_fill < _frameSize) {
+        return false;
+    }
+
+    _fill = 0;
+    return process(_frame, _features);
+}
+
+// Compute the features of one frame
+bool FeatureExtractor::process(const float* frame, FeatureVector& features) {
+    if (_work == nullptr) {
+        return false;
+    }
+
+    const int n = _frameSize;
+
+    // Time-domain features
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += frame[i];
+    }
+    float mean = (float)(sum / n);
+
+    float peak = 0.0f;
+    for (int i = 0; i < n; i++) {
+        float deviation = fabsf(frame[i] - mean);
+        if (deviation > peak) {
+            peak = deviation;
+        }
+    }
+
+    // Remove DC, window into the complex buffer and transform
+    float sumSquares = 0.0f;
+#if FEATURE_HAVE_ESP_DSP
+    if (_backend == DspBackend::EspDsp) {
+        dsps_addc_f32(frame, _scratch, n, -mean, 1, 1);
+        dsps_dotprod_f32(_scratch, _scratch, &sumSquares, n);
+
+        memset(_work, 0, 2 * n * sizeof(float));
+        dsps_mul_f32(_scratch, _window, _work, n, 1, 1, 2);
+        dsps_fft2r_fc32(_work, n);
+        dsps_bit_rev_fc32(_work, n);
+    } else
+#endif
+    {
+        for (int i = 0; i < n; i++) {
+            float ac = frame[i] - mean;
+            sumSquares += ac * ac;
+            _work[2 * i] = ac * _window[i];
+            _work[2 * i + 1] = 0.0f;
+        }
+        referenceFft(_work);
+    }
+
+    features.frame = ++_frameCount;
+    features.mean = mean;
+    features.rms = sqrtf(sumSquares / n);
+    features.peak = peak;
+    features.crest = features.rms > 0.0f ? peak / features.rms : 0.0f;
+
+    extractSpectralFeatures(features);
+    return true;
+}
+
+// In-place iterative radix-2 decimation-in-time FFT
+void FeatureExtractor::referenceFft(float* data) const {
+    const int n = _frameSize;
+
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+
+        if (i < j) {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    for (int length = 2; length <= n; length <<= 1) {
+        int half = length / 2;
+        int stride = n / length;
+        for (int start = 0; start < n; start += length) {
+            for (int k = 0; k < half; k++) {
+                float wr = _twiddle[2 * k * stride];
+                float wi = _twiddle[2 * k * stride + 1];
+                int a = start + k;
+                int b = a + half;
+
+                float tr = wr * data[2 * b] - wi * data[2 * b + 1];
+                float ti = wr * data[2 * b + 1] + wi * data[2 * b];
+                data[2 * b] = data[2 * a] - tr;
+                data[2 * b + 1] = data[2 * a + 1] - ti;
+                data[2 * a] += tr;
+                data[2 * a + 1] += ti;
+            }
+        }
+    }
+}
+
+// Band powers and spectral peaks from the transformed buffer
+void FeatureExtractor::extractSpectralFeatures(FeatureVector& features) const {
+    const int bins = _frameSize / 2;
+
+    // Power spectrum written over the complex data (bin k only reads 2k and 2k+1)
+    float* power = _work;
+    for (int k = 0; k <= bins; k++) {
+        float re = _work[2 * k];
+        float im = _work[2 * k + 1];
+        power[k] = re * re + im * im;
+    }
+
+    // One-sided, window-compensated so the bands add up to the AC mean square
+    float binHz = _sampleRate / _frameSize;
+    float powerScale = 2.0f / (_frameSize * _windowPower);
+
+    features.bandCount = _bandCount;
+    for (int b = 0; b < _bandCount; b++) {
+        int first = (int)ceilf(_bandLow[b] / binHz);
+        int last = (int)ceilf(_bandHigh[b] / binHz) - 1;
+        if (first < 1) {
+            first = 1;
+        }
+        if (last > bins) {
+            last = bins;
+        }
+
+        float total = 0.0f;
+        for (int k = first; k <= last; k++) {
+            total += power[k];
+        }
+        features.bandPower[b] = total * powerScale;
+    }
+
+    // Strongest local maxima, refined by parabolic interpolation of the magnitude
+    features.peakCount = 0;
+    for (int k = 1; k < bins; k++) {
+        if (power[k] <= power[k - 1] || power[k] < power[k + 1]) {
+            continue;
+        }
+
+        float centre = sqrtf(power[k]);
+        float amplitude = 2.0f * centre / _windowSum;
+
+        int slot = features.peakCount;
+        while (slot > 0 && features.peaks[slot - 1].amplitude < amplitude) {
+            slot--;
+        }
+        if (slot >= FEATURE_MAX_PEAKS) {
+            continue;
+        }
+
+        float left = sqrtf(power[k - 1]);
+        float right = sqrtf(power[k + 1]);
+        float denominator = left - 2.0f * centre + right;
+        float offset = denominator != 0.0f ? 0.5f * (left - right) / denominator : 0.0f;
+
+        int count = features.peakCount < FEATURE_MAX_PEAKS ? features.peakCount + 1 : FEATURE_MAX_PEAKS;
+        for (int i = count - 1; i > slot; i--) {
+            features.peaks[i] = features.peaks[i - 1];
+        }
+        features.peaks[slot].frequencyHz = (k + offset) * binHz;
+        features.peaks[slot].amplitude = amplitude;
+        features.peakCount = count;
+    }
+}
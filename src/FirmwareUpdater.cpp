@@ -0,0 +1,756 @@
+#include "FirmwareUpdater.h"
+#include <ArduinoJson.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+#include <esp_image_format.h>
+#include <esp_ota_ops.h>
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Ota
+#define LOG_MODULE_LEVEL LOG_LEVEL_OTA
+
+#define FIRMWARE_CHECKPOINT_KEY "checkpoint"
+#define FIRMWARE_MANIFEST_KEY "state"
+
+// Running image, hashed on first use
+static uint8_t runningImageSha256[32];
+static size_t runningImageSize = 0;
+
+// Constructor
+FirmwareUpdater::FirmwareUpdater() {
+    memset(&_checkpoint, 0, sizeof(_checkpoint));
+}
+
+// Fetch the image (or a patch for the running one) and stream it through
+// the OTA writer
+FirmwareUpdateResult FirmwareUpdater::update(const String& url, const String& currentVersion, const uint8_t* sha256) {
+    FirmwareUpdateResult result = download(url, currentVersion, sha256, true);
+    if (result == FirmwareUpdateResult::Failed && _writer.getStats().delta) {
+        LOG_W("Delta update failed, downloading the full image");
+        result = download(url, currentVersion, sha256, false);
+    }
+    return result;
+}
+
+// Fetch the manifest and download the image it names when that differs
+// from the running one
+FirmwareUpdateResult FirmwareUpdater::checkManifest(const String& manifestUrl, const String& currentVersion) {
+    _errorString = "";
+
+    // The stored ETag only counts for the image it was stored with, so a
+    // device flashed by other means looks at the manifest again
+    FirmwareManifestState state;
+    uint8_t runningDigest[32];
+    bool haveState = false;
+    Preferences prefs;
+    if (prefs.begin(FIRMWARE_MANIFEST_NAMESPACE, true)) {
+        haveState = prefs.getBytes(FIRMWARE_MANIFEST_KEY, &state, sizeof(state)) == sizeof(state) &&
+                    esp_partition_get_sha256(esp_ota_get_running_partition(), runningDigest) == ESP_OK &&
+                    memcmp(state.runningDigest, runningDigest, sizeof(runningDigest)) == 0;
+        prefs.end();
+    }
+
+    HTTPClient http;
+    http.setTimeout(FIRMWARE_UPDATE_TIMEOUT);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    if (!http.begin(manifestUrl)) {
+        return fail("Invalid manifest URL");
+    }
+
+    const char* headers[] = {"ETag"};
+    http.collectHeaders(headers, 1);
+    if (haveState && state.etag[0] != '\0') {
+        http.addHeader("If-None-Match", state.etag);
+    }
+
+    int code = http.GET();
+    if (code == HTTP_CODE_NOT_MODIFIED) {
+        http.end();
+        LOG_D("Firmware manifest: not modified");
+        return FirmwareUpdateResult::NoUpdate;
+    }
+    if (code != HTTP_CODE_OK) {
+        LOG_W("Firmware manifest: HTTP %d", code);
+        http.end();
+        return fail("Manifest request failed");
+    }
+    if (http.getSize() > FIRMWARE_MANIFEST_MAX_SIZE) {
+        http.end();
+        return fail("Manifest too large");
+    }
+
+    String etag = http.header("ETag");
+    String body = http.getString();
+    http.end();
+
+    JsonDocument doc;
+    if (deserializeJson(doc, body) != DeserializationError::Ok) {
+        return fail("Manifest is not valid JSON");
+    }
+    const char* version = doc["version"] | "";
+    const char* url = doc["url"] | "";
+    const char* hex = doc["sha256"] | "";
+    uint8_t sha256[32];
+    if (version[0] == '\0' || url[0] == '\0' || !OtaWriter::parseDigest(String(hex), sha256)) {
+        return fail("Manifest needs version, url and sha256");
+    }
+
+    uint8_t running[32];
+    size_t runningSize;
+    bool hashed = getRunningImage(running, &runningSize);
+    if (!hashed && currentVersion.length() == 0) {
+        return fail("Cannot compare the manifest with the running image");
+    }
+    int order = currentVersion.length() > 0 ? compareVersions(version, currentVersion.c_str()) : 1;
+    LOG_I("Firmware manifest: version %s (running %s)", version,
+          currentVersion.length() > 0 ? currentVersion.c_str() : "unknown");
+
+    if (hashed && memcmp(running, sha256, sizeof(running)) == 0) {
+        LOG_I("Firmware manifest: image already running");
+        storeManifestState(etag.c_str());
+        return FirmwareUpdateResult::NoUpdate;
+    }
+    if (order < 0) {
+        LOG_I("Firmware manifest: older than the running version, not installed");
+        storeManifestState(etag.c_str());
+        return FirmwareUpdateResult::NoUpdate;
+    }
+    if (order == 0 && !hashed) {
+        // Same version and nothing to tell the builds apart
+        storeManifestState(etag.c_str());
+        return FirmwareUpdateResult::NoUpdate;
+    }
+
+    // Chunk hashes allow fetching from peers
+    String imageUrl = resolveUrl(manifestUrl, url);
+    size_t size = doc["size"] | 0;
+    size_t chunkSize = doc["chunk"] | 0;
+    const char* chunks = doc["chunks"] | "";
+    size_t chunkCount = chunkSize > 0 ? (size + chunkSize - 1) / chunkSize : 0;
+    if (chunkCount == 0 || chunkSize > FIRMWARE_CHUNK_MAX || strlen(chunks) != chunkCount * FIRMWARE_CHUNK_HASH_SIZE * 2) {
+        return update(imageUrl, currentVersion, sha256);
+    }
+
+    uint8_t* chunkHashes = (uint8_t*)malloc(chunkCount * FIRMWARE_CHUNK_HASH_SIZE);
+    if (chunkHashes == nullptr || !parseHex(chunks, chunkHashes, chunkCount * FIRMWARE_CHUNK_HASH_SIZE)) {
+        free(chunkHashes);
+        return update(imageUrl, currentVersion, sha256);
+    }
+    FirmwareUpdateResult result = downloadChunks(imageUrl, currentVersion, sha256, size, chunkSize, chunkHashes);
+    free(chunkHashes);
+    return result;
+}
+
+// Set the credentials sent to peers
+void FirmwareUpdater::setPeerCredentials(const String& username, const String& password) {
+    _peerUsername = username;
+    _peerPassword = password;
+}
+
+// Semantic version precedence
+int FirmwareUpdater::compareVersions(const char* a, const char* b) {
+    if (*a == 'v' || *a == 'V') {
+        a++;
+    }
+    if (*b == 'v' || *b == 'V') {
+        b++;
+    }
+
+    // major.minor.patch, missing parts count as 0
+    for (int part = 0; part < 3; part++) {
+        char* end;
+        unsigned long x = strtoul(a, &end, 10);
+        a = end;
+        unsigned long y = strtoul(b, &end, 10);
+        b = end;
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+        if (*a == '.') {
+            a++;
+        }
+        if (*b == '.') {
+            b++;
+        }
+    }
+
+    // A pre-release sorts before its release
+    bool preA = *a == '-';
+    bool preB = *b == '-';
+    if (!preA || !preB) {
+        return preA == preB ? 0 : (preA ? -1 : 1);
+    }
+    a++;
+    b++;
+
+    // Dot-separated identifiers: numeric ones compare as numbers and sort
+    // before alphanumeric ones; a shorter list sorts first
+    for (;;) {
+        size_t lenA = strcspn(a, ".+");
+        size_t lenB = strcspn(b, ".+");
+        if (lenA == 0 || lenB == 0) {
+            return lenA == lenB ? 0 : (lenA == 0 ? -1 : 1);
+        }
+
+        bool numA = strspn(a, "0123456789") == lenA;
+        bool numB = strspn(b, "0123456789") == lenB;
+        int order;
+        if (numA && numB) {
+            unsigned long x = strtoul(a, nullptr, 10);
+            unsigned long y = strtoul(b, nullptr, 10);
+            order = x < y ? -1 : (x > y ? 1 : 0);
+        } else if (numA != numB) {
+            order = numA ? -1 : 1;
+        } else {
+            order = strncmp(a, b, min(lenA, lenB));
+            if (order == 0) {
+                order = lenA < lenB ? -1 : (lenA > lenB ? 1 : 0);
+            }
+        }
+        if (order != 0) {
+            return order < 0 ? -1 : 1;
+        }
+
+        a += lenA;
+        b += lenB;
+        if (*a == '.') {
+            a++;
+        }
+        if (*b == '.') {
+            b++;
+        }
+    }
+}
+
+// Drop a saved checkpoint
+void FirmwareUpdater::clearCheckpoint() {
+    Preferences prefs;
+    if (prefs.begin(FIRMWARE_CHECKPOINT_NAMESPACE, false)) {
+        prefs.remove(FIRMWARE_CHECKPOINT_KEY);
+        prefs.end();
+    }
+}
+
+// Download one resource, resuming after dropped connections
+FirmwareUpdateResult FirmwareUpdater::download(const String& url, const String& currentVersion, const uint8_t* sha256,
+                                               bool allowDelta) {
+    _errorString = "";
+    _resumes = 0;
+    memset(&_checkpoint, 0, sizeof(_checkpoint));
+    _checkpoint.urlHash = hashUrl(url);
+
+    resumeFromCheckpoint(url, sha256);
+
+    int attempts = 0;
+    for (;;) {
+        FetchResult result = fetch(url, currentVersion, sha256, allowDelta);
+
+        if (result == FetchResult::Complete) {
+            break;
+        }
+        if (result == FetchResult::NotModified) {
+            _writer.abort();
+            return FirmwareUpdateResult::NoUpdate;
+        }
+        if (result == FetchResult::Failed) {
+            _writer.abort();
+            clearCheckpoint();
+            return FirmwareUpdateResult::Failed;
+        }
+
+        // Dropped: the writer keeps its state and the rest is requested;
+        // the checkpoint stays behind if this boot gives up
+        saveCheckpoint(true);
+        if (_fetched > 0) {
+            attempts = 0;
+        }
+        if (++attempts > FIRMWARE_UPDATE_RETRIES) {
+            _writer.abort();
+            return fail("Download interrupted");
+        }
+
+        uint32_t wait = min((uint32_t)FIRMWARE_UPDATE_RETRY_DELAY << (attempts - 1),
+                            (uint32_t)FIRMWARE_UPDATE_RETRY_MAX_DELAY);
+        LOG_W("Firmware download interrupted at %u bytes, retrying in %u ms",
+              _writer.isActive() ? _writer.getStats().bytes : 0, wait);
+        delay(wait);
+    }
+
+    clearCheckpoint();
+    if (!_writer.end()) {
+        return fail(_writer.errorString());
+    }
+    if (_resumes > 0) {
+        LOG_I("Firmware download completed after %d resumes", _resumes);
+    }
+    return FirmwareUpdateResult::Updated;
+}
+
+// One HTTP request: the whole resource, or the rest of it when the writer
+// already holds the beginning
+FirmwareUpdater::FetchResult FirmwareUpdater::fetch(const String& url, const String& currentVersion,
+                                                     const uint8_t* sha256, bool allowDelta) {
+    size_t offset = _writer.isActive() ? _writer.getStats().bytes : 0;
+    _fetched = 0;
+
+    HTTPClient http;
+    http.setTimeout(FIRMWARE_UPDATE_TIMEOUT);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    if (!http.begin(url)) {
+        fail("Invalid URL");
+        return FetchResult::Failed;
+    }
+
+    const char* headers[] = {"Content-Encoding", "Content-Range", "ETag"};
+    http.collectHeaders(headers, 3);
+    http.addHeader("Accept-Encoding", "gzip");
+    if (currentVersion.length() > 0) {
+        http.addHeader("x-ESP32-version", currentVersion);
+    }
+    if (allowDelta && runningDigest()[0] != '\0') {
+        http.addHeader("x-ESP32-delta-base", runningDigest());
+    }
+    if (offset > 0) {
+        // With If-Range a changed resource comes back whole (200)
+        http.addHeader("Range", "bytes=" + String(offset) + "-");
+        if (_checkpoint.etag[0] != '\0') {
+            http.addHeader("If-Range", _checkpoint.etag);
+        }
+    }
+
+    int code = http.GET();
+    if (code < 0) {
+        LOG_W("Firmware download: %s", http.errorToString(code).c_str());
+        http.end();
+        return FetchResult::Dropped;
+    }
+
+    if (code == HTTP_CODE_NOT_MODIFIED && offset == 0) {
+        http.end();
+        return FetchResult::NotModified;
+    }
+
+    if (code == HTTP_CODE_PARTIAL_CONTENT && offset > 0) {
+        // Content-Range: bytes <first>-<last>/<total>
+        unsigned first = 0, last = 0, total = 0;
+        String range = http.header("Content-Range");
+        if (sscanf(range.c_str(), "bytes %u-%u/%u", &first, &last, &total) != 3 ||
+            first != offset || total != _checkpoint.size) {
+            http.end();
+            fail("Unexpected Content-Range");
+            return FetchResult::Failed;
+        }
+        LOG_I("Firmware download: resuming at %u of %u bytes", first, total);
+        _resumes++;
+    } else if (code == HTTP_CODE_OK) {
+        if (offset > 0) {
+            LOG_W("Firmware download: resource changed, starting over");
+            _writer.abort();
+            offset = 0;
+        }
+
+        // The raw stream is read, so chunked responses are not supported
+        int length = http.getSize();
+        if (length <= 0) {
+            http.end();
+            fail("Server did not report the size");
+            return FetchResult::Failed;
+        }
+
+        String encoding = http.header("Content-Encoding");
+        LOG_I("Firmware download: %d bytes%s%s", length,
+              encoding.length() > 0 ? ", Content-Encoding " : "", encoding.c_str());
+        if (!startImage(length, sha256, http.header("ETag"))) {
+            http.end();
+            return FetchResult::Failed;
+        }
+    } else {
+        LOG_W("Firmware download: HTTP %d", code);
+        http.end();
+        if (code == HTTP_CODE_RANGE_NOT_SATISFIABLE) {
+            // The resource shrank: start over
+            _writer.abort();
+            clearCheckpoint();
+            return FetchResult::Dropped;
+        }
+        if (code >= 500) {
+            return FetchResult::Dropped;
+        }
+        fail("Unexpected HTTP status");
+        return FetchResult::Failed;
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    size_t remaining = _checkpoint.size - offset;
+    size_t lastReport = offset;
+    uint32_t lastData = millis();
+
+    while (remaining > 0 && (http.connected() || stream->available() > 0)) {
+        size_t available = stream->available();
+        if (available == 0) {
+            if (millis() - lastData > FIRMWARE_UPDATE_TIMEOUT) {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+
+        int count = stream->read(_buffer, min(min(available, sizeof(_buffer)), remaining));
+        if (count <= 0) {
+            continue;
+        }
+        lastData = millis();
+        if (_writer.write(_buffer, count) == 0) {
+            break;
+        }
+        remaining -= count;
+        _fetched += count;
+        saveCheckpoint(false);
+
+        OtaStats stats = _writer.getStats();
+        if (stats.bytes - lastReport >= FIRMWARE_UPDATE_REPORT) {
+            LOG_D("Firmware download: %u KB, %.1f KB/s", stats.bytes / 1024, _writer.getKBps());
+            lastReport = stats.bytes;
+        }
+    }
+    http.end();
+
+    if (_writer.hasError()) {
+        fail(_writer.errorString());
+        return FetchResult::Failed;
+    }
+    return remaining == 0 ? FetchResult::Complete : FetchResult::Dropped;
+}
+
+// Open the writer for a new download and describe it in the checkpoint
+bool FirmwareUpdater::startImage(size_t size, const uint8_t* sha256, const String& etag) {
+    // A checkpoint of an older download points into the same partition
+    clearCheckpoint();
+
+    if (!_writer.begin(size, sha256)) {
+        fail(_writer.errorString());
+        return false;
+    }
+
+    _checkpoint.partition = esp_ota_get_next_update_partition(nullptr)->address;
+    _checkpoint.size = size;
+    _checkpoint.offset = 0;
+    _checkpoint.hasSha256 = sha256 != nullptr;
+    if (_checkpoint.hasSha256) {
+        memcpy(_checkpoint.sha256, sha256, sizeof(_checkpoint.sha256));
+    }
+    strlcpy(_checkpoint.etag, etag.c_str(), sizeof(_checkpoint.etag));
+    return true;
+}
+
+// Continue a plain image download interrupted before a reboot
+bool FirmwareUpdater::resumeFromCheckpoint(const String& url, const uint8_t* sha256) {
+    FirmwareCheckpoint checkpoint;
+    Preferences prefs;
+    if (!prefs.begin(FIRMWARE_CHECKPOINT_NAMESPACE, true)) {
+        return false;
+    }
+    size_t length = prefs.getBytes(FIRMWARE_CHECKPOINT_KEY, &checkpoint, sizeof(checkpoint));
+    prefs.end();
+
+    if (length != sizeof(checkpoint) || checkpoint.urlHash != hashUrl(url) || checkpoint.offset == 0) {
+        return false;
+    }
+
+    // Another image was booted since, or a different one is expected now
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+    if (partition == nullptr || partition->address != checkpoint.partition ||
+        (sha256 != nullptr && (!checkpoint.hasSha256 || memcmp(sha256, checkpoint.sha256, 32) != 0))) {
+        clearCheckpoint();
+        return false;
+    }
+
+    if (!_writer.begin(checkpoint.size, checkpoint.hasSha256 ? checkpoint.sha256 : nullptr, checkpoint.offset)) {
+        LOG_W("Firmware download: checkpoint not usable (%s)", _writer.errorString());
+        clearCheckpoint();
+        return false;
+    }
+
+    _checkpoint = checkpoint;
+    LOG_I("Firmware download: resuming from checkpoint at %u of %u bytes", checkpoint.offset,
+          checkpoint.size);
+    return true;
+}
+
+// Record flash progress every FIRMWARE_CHECKPOINT_INTERVAL bytes, or now
+void FirmwareUpdater::saveCheckpoint(bool force) {
+    size_t offset = _writer.getResumeOffset();
+    if (offset <= _checkpoint.offset || (!force && offset < _checkpoint.offset + FIRMWARE_CHECKPOINT_INTERVAL)) {
+        return;
+    }
+
+    _checkpoint.offset = offset;
+    Preferences prefs;
+    if (prefs.begin(FIRMWARE_CHECKPOINT_NAMESPACE, false)) {
+        prefs.putBytes(FIRMWARE_CHECKPOINT_KEY, &_checkpoint, sizeof(_checkpoint));
+        prefs.end();
+    }
+}
+
+// Digest of the running image as delta patches identify it (the SHA-256
+// stored with the image), empty if it cannot be read
+const char* FirmwareUpdater::runningDigest() {
+    if (_runningDigest[0] == '\0') {
+        uint8_t digest[32];
+        if (esp_partition_get_sha256(esp_ota_get_running_partition(), digest) == ESP_OK) {
+            for (int i = 0; i < 32; i++) {
+                snprintf(&_runningDigest[i * 2], 3, "%02x", digest[i]);
+            }
+        }
+    }
+    return _runningDigest;
+}
+
+// Fetch the image chunk by chunk from peers, each checked against the
+// manifest; a chunk no peer delivers comes from the origin
+FirmwareUpdateResult FirmwareUpdater::downloadChunks(const String& url, const String& currentVersion,
+                                                     const uint8_t* sha256, size_t size, size_t chunkSize,
+                                                     const uint8_t* chunkHashes) {
+    _peerBytes = 0;
+    _originBytes = 0;
+    auto fromOrigin = [&]() {
+        FirmwareUpdateResult result = update(url, currentVersion, sha256);
+        _originBytes = _writer.getStats().bytes;
+        return result;
+    };
+
+    FirmwarePeer peers[FIRMWARE_PEER_MAX];
+    int peerCount = discoverPeers(sha256, peers);
+    if (peerCount == 0) {
+        LOG_I("Firmware peers: none found, downloading from the origin");
+        return fromOrigin();
+    }
+    LOG_I("Firmware peers: %d with the image", peerCount);
+
+    _errorString = "";
+    _chunk = (uint8_t*)malloc(chunkSize);
+    if (_chunk == nullptr) {
+        return fromOrigin();
+    }
+    if (!_writer.begin(size, sha256)) {
+        free(_chunk);
+        _chunk = nullptr;
+        return fail(_writer.errorString());
+    }
+
+    // Peers take turns from a random start, so a site spreads its requests
+    int next = esp_random() % peerCount;
+    for (size_t start = 0; start < size; start += chunkSize) {
+        size_t length = min(chunkSize, size - start);
+        const uint8_t* expected = chunkHashes + start / chunkSize * FIRMWARE_CHUNK_HASH_SIZE;
+        bool fetched = false;
+
+        for (int tries = 0; tries < peerCount && !fetched; tries++) {
+            FirmwarePeer& peer = peers[next];
+            next = (next + 1) % peerCount;
+            if (peer.failures >= FIRMWARE_PEER_MAX_FAILURES) {
+                continue;
+            }
+
+            String peerUrl = "http://" + peer.ip.toString() + ":" + String(peer.port) + FIRMWARE_PEER_PATH;
+            fetched = fetchRange(peerUrl, start, length, true) && chunkMatches(expected, length);
+            if (fetched) {
+                _peerBytes += length;
+            } else {
+                LOG_W("Firmware peers: chunk at %u failed from %s:%u", start, peer.ip.toString().c_str(),
+                      peer.port);
+                peer.failures++;
+            }
+        }
+        if (!fetched) {
+            fetched = fetchRange(url, start, length, false) && chunkMatches(expected, length);
+            if (fetched) {
+                _originBytes += length;
+            }
+        }
+
+        if (!fetched || _writer.write(_chunk, length) == 0) {
+            free(_chunk);
+            _chunk = nullptr;
+            if (_writer.hasError()) {
+                _writer.abort();
+                return fail(_writer.errorString());
+            }
+            // The origin does not serve ranges either
+            LOG_W("Firmware peers: chunk at %u unavailable, downloading from the origin", start);
+            _writer.abort();
+            return fromOrigin();
+        }
+    }
+    free(_chunk);
+    _chunk = nullptr;
+
+    LOG_I("Firmware peers: %u KB from peers, %u KB from the origin", _peerBytes / 1024,
+          _originBytes / 1024);
+    if (!_writer.end()) {
+        return fail(_writer.errorString());
+    }
+    return FirmwareUpdateResult::Updated;
+}
+
+// Peers advertising the image over mDNS
+int FirmwareUpdater::discoverPeers(const uint8_t* sha256, FirmwarePeer* peers) {
+    char prefix[17];
+    for (int i = 0; i < 8; i++) {
+        snprintf(&prefix[i * 2], 3, "%02x", sha256[i]);
+    }
+
+    int found = MDNS.queryService(FIRMWARE_PEER_SERVICE, "tcp");
+    int count = 0;
+    for (int i = 0; i < found && count < FIRMWARE_PEER_MAX; i++) {
+        if (MDNS.txt(i, "sha") == prefix) {
+            peers[count].ip = MDNS.IP(i);
+            peers[count].port = MDNS.port(i);
+            peers[count].failures = 0;
+            count++;
+        }
+    }
+    return count;
+}
+
+// Read bytes [start, start + length) of an image into the chunk buffer
+bool FirmwareUpdater::fetchRange(const String& url, size_t start, size_t length, bool peer) {
+    HTTPClient http;
+    http.setTimeout(FIRMWARE_PEER_TIMEOUT);
+    if (!http.begin(url)) {
+        return false;
+    }
+    if (peer && _peerUsername.length() > 0) {
+        http.setAuthorization(_peerUsername.c_str(), _peerPassword.c_str());
+    }
+    http.addHeader("Range", "bytes=" + String(start) + "-" + String(start + length - 1));
+
+    int code = http.GET();
+    if (code != HTTP_CODE_PARTIAL_CONTENT || http.getSize() != (int)length) {
+        http.end();
+        return false;
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    size_t received = 0;
+    uint32_t lastData = millis();
+    while (received < length && (http.connected() || stream->available() > 0)) {
+        size_t available = stream->available();
+        if (available == 0) {
+            if (millis() - lastData > FIRMWARE_PEER_TIMEOUT) {
+                break;
+            }
+            delay(1);
+            continue;
+        }
+
+        int count = stream->read(_chunk + received, min(available, length - received));
+        if (count > 0) {
+            received += count;
+            lastData = millis();
+        }
+    }
+    http.end();
+    return received == length;
+}
+
+// Compare the chunk buffer with its manifest hash
+bool FirmwareUpdater::chunkMatches(const uint8_t* expected, size_t length) {
+    uint8_t digest[32];
+    mbedtls_sha256_ret(_chunk, length, digest, 0);
+    return memcmp(digest, expected, FIRMWARE_CHUNK_HASH_SIZE) == 0;
+}
+
+// SHA-256 and size of the running image file
+bool FirmwareUpdater::getRunningImage(uint8_t* sha256, size_t* size) {
+    if (runningImageSize == 0) {
+        const esp_partition_t* running = esp_ota_get_running_partition();
+        esp_partition_pos_t position = {running->address, running->size};
+        esp_image_metadata_t metadata;
+        if (esp_image_get_metadata(&position, &metadata) != ESP_OK || metadata.image_len == 0) {
+            return false;
+        }
+
+        uint8_t buffer[1024];
+        mbedtls_sha256_context sha;
+        mbedtls_sha256_init(&sha);
+        mbedtls_sha256_starts_ret(&sha, 0);
+        for (size_t offset = 0; offset < metadata.image_len; offset += sizeof(buffer)) {
+            size_t count = min(sizeof(buffer), (size_t)metadata.image_len - offset);
+            if (esp_partition_read(running, offset, buffer, count) != ESP_OK) {
+                mbedtls_sha256_free(&sha);
+                return false;
+            }
+            mbedtls_sha256_update_ret(&sha, buffer, count);
+        }
+        mbedtls_sha256_finish_ret(&sha, runningImageSha256);
+        mbedtls_sha256_free(&sha);
+        runningImageSize = metadata.image_len;
+    }
+    memcpy(sha256, runningImageSha256, sizeof(runningImageSha256));
+    *size = runningImageSize;
+    return true;
+}
+
+// Remember a manifest found current for the running image
+void FirmwareUpdater::storeManifestState(const char* etag) {
+    FirmwareManifestState state;
+    if (etag[0] == '\0' || esp_partition_get_sha256(esp_ota_get_running_partition(), state.runningDigest) != ESP_OK) {
+        return;
+    }
+    strlcpy(state.etag, etag, sizeof(state.etag));
+
+    Preferences prefs;
+    if (prefs.begin(FIRMWARE_MANIFEST_NAMESPACE, false)) {
+        prefs.putBytes(FIRMWARE_MANIFEST_KEY, &state, sizeof(state));
+        prefs.end();
+    }
+}
+
+// Image URL from the manifest: absolute, host-relative or relative
+String FirmwareUpdater::resolveUrl(const String& base, const String& url) {
+    if (url.indexOf("://") >= 0) {
+        return url;
+    }
+    int hostStart = base.indexOf("://") + 3;
+    if (url.startsWith("/")) {
+        int pathStart = base.indexOf('/', hostStart);
+        return (pathStart < 0 ? base : base.substring(0, pathStart)) + url;
+    }
+    return base.substring(0, base.lastIndexOf('/') + 1) + url;
+}
+
+// Decode hex digits into length bytes
+bool FirmwareUpdater::parseHex(const char* hex, uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length * 2; i++) {
+        char c = hex[i];
+        uint8_t nibble;
+        if (c >= '0' && c <= '9') {
+            nibble = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            nibble = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            nibble = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        data[i / 2] = (i % 2 == 0) ? nibble << 4 : data[i / 2] | nibble;
+    }
+    return true;
+}
+
+// Record the error of a failed update
+FirmwareUpdateResult FirmwareUpdater::fail(const char* message) {
+    _errorString = message;
+    LOG_E("Firmware update failed: %s", message);
+    return FirmwareUpdateResult::Failed;
+}
+
+// FNV-1a of the URL, to match a checkpoint to its download
+uint32_t FirmwareUpdater::hashUrl(const String& url) {
+    uint32_t value = 2166136261UL;
+    for (unsigned i = 0; i < url.length(); i++) {
+        value = (value ^ (uint8_t)url[i]) * 16777619UL;
+    }
+    return value;
+}
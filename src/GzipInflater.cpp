@@ -0,0 +1,265 @@
+#include "GzipInflater.h"
+#include <esp_rom_crc.h>
+
+// Header flags (RFC 1952)
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
+#define GZIP_FLAG_RESERVED 0xE0
+
+// Constructor
+GzipInflater::GzipInflater() {
+}
+
+// Destructor
+GzipInflater::~GzipInflater() {
+    end();
+}
+
+// Start a stream
+bool GzipInflater::begin(Sink sink) {
+    end();
+
+    _sink = sink;
+    _stage = Stage::Header;
+    _errorString = "";
+    _position = 0;
+    _extraLength = 0;
+    _windowBits = 0;
+    _imageSize = 0;
+    _windowSize = 0;
+    _windowPos = 0;
+    _outputSize = 0;
+    _crc = 0;
+
+    _decompressor = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    if (_decompressor == nullptr) {
+        return fail("Out of memory");
+    }
+    tinfl_init(_decompressor);
+    return true;
+}
+
+// Feed input to whichever stage is current
+bool GzipInflater::write(const uint8_t* data, size_t len) {
+    while (len > 0 && _stage != Stage::Error) {
+        size_t used;
+        if (_stage == Stage::Body) {
+            used = inflate(data, len);
+        } else if (_stage == Stage::Trailer) {
+            used = readTrailer(data, len);
+        } else if (_stage == Stage::Done) {
+            return fail("Data after the end of the image");
+        } else {
+            used = parseHeader(data, len);
+        }
+        data += used;
+        len -= used;
+    }
+    return _stage != Stage::Error;
+}
+
+// Free the window and decompressor
+void GzipInflater::end() {
+    free(_window);
+    _window = nullptr;
+    free(_decompressor);
+    _decompressor = nullptr;
+    _sink = nullptr;
+}
+
+// Walk the header fields one byte at a time, so a header split across
+// writes needs no buffering
+size_t GzipInflater::parseHeader(const uint8_t* data, size_t len) {
+    size_t used = 0;
+    while (used < len && _stage != Stage::Body && _stage != Stage::Error) {
+        uint8_t byte = data[used++];
+
+        switch (_stage) {
+            case Stage::Header:
+                _header[_position++] = byte;
+                if ((_position == 1 && byte != 0x1F) || (_position == 2 && byte != 0x8B)) {
+                    fail("Not a gzip stream");
+                } else if (_position == 3 && byte != 8) {
+                    fail("Unsupported gzip compression method");
+                } else if (_position == 4 && (byte & GZIP_FLAG_RESERVED)) {
+                    fail("Unsupported gzip flags");
+                } else if (_position == sizeof(_header)) {
+                    nextField(Stage::ExtraLength);
+                }
+                break;
+
+            case Stage::ExtraLength:
+                _extraLength |= (size_t)byte << (8 * _position++);
+                if (_position == 2) {
+                    _position = 0;
+                    if (_extraLength > 0) {
+                        _stage = Stage::Extra;
+                    } else {
+                        nextField(Stage::Name);
+                    }
+                }
+                break;
+
+            case Stage::Extra:
+                if (_position < sizeof(_extra)) {
+                    _extra[_position] = byte;
+                }
+                if (++_position == _extraLength) {
+                    parseExtra();
+                    nextField(Stage::Name);
+                }
+                break;
+
+            case Stage::Name:
+                if (byte == '\0') {
+                    nextField(Stage::Comment);
+                }
+                break;
+
+            case Stage::Comment:
+                if (byte == '\0') {
+                    nextField(Stage::HeaderCrc);
+                }
+                break;
+
+            case Stage::HeaderCrc:
+                if (++_position == 2) {
+                    startBody();
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+    return used;
+}
+
+// Move to the first optional header field from this one that is present,
+// or to the compressed data
+void GzipInflater::nextField(Stage stage) {
+    uint8_t flags = _header[3];
+    _position = 0;
+
+    if (stage <= Stage::ExtraLength && (flags & GZIP_FLAG_EXTRA)) {
+        _stage = Stage::ExtraLength;
+    } else if (stage <= Stage::Name && (flags & GZIP_FLAG_NAME)) {
+        _stage = Stage::Name;
+    } else if (stage <= Stage::Comment && (flags & GZIP_FLAG_COMMENT)) {
+        _stage = Stage::Comment;
+    } else if (stage <= Stage::HeaderCrc && (flags & GZIP_FLAG_HCRC)) {
+        _stage = Stage::HeaderCrc;
+    } else {
+        startBody();
+    }
+}
+
+// Look for the "ES" subfield: window bits and image size
+void GzipInflater::parseExtra() {
+    size_t available = min(_extraLength, (size_t)sizeof(_extra));
+    size_t offset = 0;
+    while (offset + 4 <= available) {
+        size_t length = _extra[offset + 2] | (_extra[offset + 3] << 8);
+        const uint8_t* field = &_extra[offset + 4];
+        if (_extra[offset] == GZIP_EXTRA_ID1 && _extra[offset + 1] == GZIP_EXTRA_ID2 &&
+            length >= 5 && offset + 4 + length <= available) {
+            _windowBits = field[0];
+            _imageSize = field[1] | (field[2] << 8) | (field[3] << 16) | ((uint32_t)field[4] << 24);
+            return;
+        }
+        offset += 4 + length;
+    }
+}
+
+// Allocate the ring window once its size is known
+bool GzipInflater::startBody() {
+    _windowSize = GZIP_WINDOW_MAX;
+    if (_windowBits > 0) {
+        if (_windowBits > 15) {
+            return fail("Unsupported gzip window");
+        }
+        _windowSize = max((size_t)1 << _windowBits, (size_t)GZIP_WINDOW_MIN);
+    }
+
+    _window = (uint8_t*)malloc(_windowSize);
+    if (_window == nullptr) {
+        return fail("Out of memory");
+    }
+    _windowPos = 0;
+    _stage = Stage::Body;
+    return true;
+}
+
+// Decompress into the ring window and pass each new run to the sink
+size_t GzipInflater::inflate(const uint8_t* data, size_t len) {
+    size_t used = 0;
+    tinfl_status status;
+    do {
+        size_t inBytes = len - used;
+        size_t outBytes = _windowSize - _windowPos;
+        status = tinfl_decompress(_decompressor, data + used, &inBytes, _window, _window + _windowPos,
+                                  &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+        used += inBytes;
+
+        if (outBytes > 0) {
+            _crc = esp_rom_crc32_le(_crc, _window + _windowPos, outBytes);
+            _outputSize += outBytes;
+            if (!_sink(_window + _windowPos, outBytes)) {
+                fail("Output rejected");
+                return len;
+            }
+            _windowPos = (_windowPos + outBytes) & (_windowSize - 1);
+        }
+    } while (status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+    if (status < 0) {
+        fail("Corrupt compressed data");
+        return len;
+    }
+    if (status == TINFL_STATUS_DONE) {
+        // The ROM inflater does not hand back bytes it read ahead, so the
+        // start of the trailer may still be in its bit buffer
+        _position = 0;
+        tinfl_bit_buf_t bits = _decompressor->m_bit_buf >> (_decompressor->m_num_bits & 7);
+        for (uint32_t i = 0; i < _decompressor->m_num_bits / 8 && _position < sizeof(_trailer); i++) {
+            _trailer[_position++] = bits & 0xFF;
+            bits >>= 8;
+        }
+        _stage = Stage::Trailer;
+        if (_position == sizeof(_trailer)) {
+            readTrailer(data + used, 0);
+        }
+    }
+    return used;
+}
+
+// CRC-32 and length of the uncompressed data
+size_t GzipInflater::readTrailer(const uint8_t* data, size_t len) {
+    size_t used = min(len, sizeof(_trailer) - _position);
+    memcpy(_trailer + _position, data, used);
+    _position += used;
+
+    if (_position == sizeof(_trailer)) {
+        uint32_t crc = _trailer[0] | (_trailer[1] << 8) | (_trailer[2] << 16) | ((uint32_t)_trailer[3] << 24);
+        uint32_t size = _trailer[4] | (_trailer[5] << 8) | (_trailer[6] << 16) | ((uint32_t)_trailer[7] << 24);
+        if (crc != _crc) {
+            fail("gzip CRC mismatch");
+        } else if (size != (uint32_t)_outputSize) {
+            fail("gzip length mismatch");
+        } else {
+            _stage = Stage::Done;
+        }
+    }
+    return used;
+}
+
+// Record the first error
+bool GzipInflater::fail(const char* message) {
+    if (_stage != Stage::Error) {
+        _errorString = message;
+        _stage = Stage::Error;
+    }
+    return false;
+}
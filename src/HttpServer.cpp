@@ -4,12 +4,19 @@
 #include <WebServer.h>
 #include <ESPmDNS.h>
 #include <ArduinoJson.h>
+#include <esp_ota_ops.h>
 #include "Config.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Http
+#define LOG_MODULE_LEVEL LOG_LEVEL_HTTP
 
 // Constructor
 HttpServer::HttpServer(WiFiManager* wifiManager, int port) : 
     _wifiManager(wifiManager),
     _port(port),
+    _otaLastReport(0),
+    _uploadAuthorized(false),
     _authEnabled(false) {
     _server = new WebServer(port);
 }
@@ -26,7 +33,7 @@ HttpServer::~HttpServer() {
 // Initialize and start server
 void HttpServer::begin() {
     if (!_wifiManager->isConnected()) {
-        Serial.println("HTTP Server: Cannot start, WiFi not connected");
+        LOG_W("HTTP Server: Cannot start, WiFi not connected");
         return;
     }
 
@@ -36,21 +43,24 @@ void HttpServer::begin() {
     // Start mDNS responder if defined in config
     #ifdef DEVICE_HOSTNAME
     if (MDNS.begin(DEVICE_HOSTNAME)) {
-        Serial.print("HTTP Server: mDNS responder started at http://");
-        Serial.print(DEVICE_HOSTNAME);
-        Serial.println(".local");
+        LOG_I("HTTP Server: mDNS responder started at http://%s.local", DEVICE_HOSTNAME);
         
         // Advertise HTTP service
         MDNS.addService("http", "tcp", _port);
+        
+        // Offer the running image to peers updating to it
+        advertiseFirmware();
     }
     #endif
     
+    // Range requests for /firmware.bin
+    const char* headers[] = {"Range"};
+    _server->collectHeaders(headers, 1);
+    
     // Start server
     _server->begin();
-    Serial.print("HTTP Server: Started on port ");
-    Serial.println(_port);
-    Serial.print("HTTP Server: IP address: ");
-    Serial.println(_wifiManager->getIPAddress());
+    LOG_I("HTTP Server: Started on port %d", _port);
+    LOG_I("HTTP Server: IP address: %s", _wifiManager->getIPAddress().c_str());
 }
 
 // Process client requests (call in loop)
@@ -64,7 +74,7 @@ void HttpServer::handleClient() {
 void HttpServer::stop() {
     if (_server) {
         _server->close();
-        Serial.println("HTTP Server: Stopped");
+        LOG_I("HTTP Server: Stopped");
     }
 }
 
@@ -87,7 +97,7 @@ void HttpServer::setAuthentication(const String& username, const String& passwor
     _username = username;
     _password = password;
     _authEnabled = true;
-    Serial.println("HTTP Server: Basic authentication enabled");
+    LOG_I("HTTP Server: Basic authentication enabled");
 }
 
 // Check if server is running
@@ -126,6 +136,36 @@ void HttpServer::setupDefaultRoutes() {
         this->handleNetworkInfo();
     });
     
+    // Cached WiFi scan results (refreshed in the background)
+    _server->on("/api/wifi/scan", HTTP_GET, [this]() {
+        this->handleWiFiScan();
+    });
+    
+    // WiFi link metrics
+    _server->on("/api/wifi/metrics", HTTP_GET, [this]() {
+        this->handleWiFiMetrics();
+    });
+    
+    // WiFi power profile (?profile=low_latency|balanced|low_power to switch)
+    _server->on("/api/wifi/power", HTTP_GET, [this]() {
+        this->handleWiFiPower();
+    });
+    
+    // Running image for peers (FirmwareUpdater::checkManifest())
+    _server->on(FIRMWARE_PEER_PATH, HTTP_GET, [this]() {
+        this->handleFirmwareImage();
+    });
+    
+    // Firmware upload page and upload target
+    _server->on("/update", HTTP_GET, [this]() {
+        this->handleUpdatePage();
+    });
+    _server->on("/update", HTTP_POST, [this]() {
+        this->handleUpdateComplete();
+    }, [this]() {
+        this->handleUpdateUpload();
+    });
+    
     // 404 handler
     _server->onNotFound([this]() {
         this->handleNotFound();
@@ -168,6 +208,7 @@ void HttpServer::handleRoot() {
         "<button onclick='window.location.href=\"/settings\"'>Settings</button>"
         "<button onclick='window.location.href=\"/system\"'>System Info</button>"
         "<button onclick='window.location.href=\"/network\"'>Network Info</button>"
+        "<button onclick='window.location.href=\"/update\"'>Firmware Update</button>"
         "</p>"
         "</div>"
         "<script>"
@@ -195,6 +236,10 @@ void HttpServer::handleStatus() {
     wifi["ip"] = _wifiManager->getIPAddress();
     wifi["mac"] = _wifiManager->getMACAddress();
     wifi["rssi"] = _wifiManager->getSignalStrength();
+    wifi["rssi_avg"] = _wifiManager->getSmoothedRssi();
+    wifi["state"] = _wifiManager->getStateName();
+    wifi["roams"] = _wifiManager->getMetrics().roams;
+    wifi["last_roam_gain_db"] = _wifiManager->getMetrics().lastRoamGain;
     
     #ifdef MQTT_SERVER
     JsonObject mqtt = doc["mqtt"].to<JsonObject>();
@@ -256,5 +301,387 @@ void HttpServer::handleNetworkInfo() {
     _server->send(200, "application/json", response);
     
     // Also log to serial
-    Serial.println("Network info requested. IP: " + _wifiManager->getIPAddress());
+    LOG_D("Network info requested. IP: %s", _wifiManager->getIPAddress().c_str());
+}
+
+// WiFi scan handler: serves the cached results and starts a background
+// refresh when they are stale (or when ?refresh=1 is given)
+void HttpServer::handleWiFiScan() {
+    if (!authenticateRequest()) return;
+    
+    bool refresh = _server->arg("refresh") == "1";
+    if (refresh || !_wifiManager->hasFreshScan()) {
+        _wifiManager->startScan(refresh);
+    }
+    
+    JsonDocument doc;
+    doc["scanning"] = _wifiManager->isScanning();
+    doc["fresh"] = _wifiManager->hasFreshScan();
+    doc["age_ms"] = _wifiManager->getScanAge();
+    
+    JsonArray networks = doc["networks"].to<JsonArray>();
+    for (int i = 0; i < _wifiManager->getScanCount(); i++) {
+        const WiFiScanResult& result = _wifiManager->getScanResult(i);
+        char bssid[18];
+        snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X",
+                 result.bssid[0], result.bssid[1], result.bssid[2],
+                 result.bssid[3], result.bssid[4], result.bssid[5]);
+        
+        JsonObject network = networks.add<JsonObject>();
+        network["ssid"] = result.ssid;
+        network["bssid"] = bssid;
+        network["rssi"] = result.rssi;
+        network["channel"] = result.channel;
+        network["encryption"] = WiFiManager::encryptionName(result.encryption);
+    }
+    
+    String response;
+    serializeJson(doc, response);
+    _server->send(200, "application/json", response);
+}
+
+// WiFi link metrics handler
+void HttpServer::handleWiFiMetrics() {
+    if (!authenticateRequest()) return;
+    
+    JsonDocument doc;
+    _wifiManager->getMetricsJson(doc.to<JsonObject>());
+    
+    String response;
+    serializeJson(doc, response);
+    _server->send(200, "application/json", response);
+}
+
+// WiFi power profile handler: reports the profiles' measured latency and
+// estimated duty cycle, optionally switching profile first
+void HttpServer::handleWiFiPower() {
+    if (!authenticateRequest()) return;
+    
+    if (_server->hasArg("profile")) {
+        WiFiPowerProfile profile;
+        if (!WiFiManager::parsePowerProfile(_server->arg("profile"), profile)) {
+            _server->send(400, "application/json", "{\"error\":\"unknown profile\"}");
+            return;
+        }
+        _wifiManager->setPowerProfile(profile);
+    }
+    
+    JsonDocument doc;
+    _wifiManager->getPowerJson(doc.to<JsonObject>());
+    
+    String response;
+    serializeJson(doc, response);
+    _server->send(200, "application/json", response);
+}
+
+// Firmware upload page
+void HttpServer::handleUpdatePage() {
+    if (!authenticateRequest()) return;
+    
+    const char* html = R"html(
+    <!DOCTYPE html>
+    <html>
+    <head>
+        <title>ESP Firmware Update</title>
+        <meta name="viewport" content="width=device-width, initial-scale=1">
+        <style>
+            body {
+                font-family: Arial, sans-serif;
+                margin: 20px;
+                background-color: #f0f0f0;
+            }
+            .container {
+                background-color: white;
+                border-radius: 5px;
+                padding: 20px;
+                box-shadow: 0 2px 5px rgba(0,0,0,0.1);
+                max-width: 500px;
+                margin: 0 auto;
+            }
+            h1 {
+                color: #0066cc;
+                text-align: center;
+            }
+            form {
+                margin-top: 20px;
+            }
+            .file-input {
+                margin: 10px 0;
+                padding: 10px;
+                border: 1px solid #ddd;
+                border-radius: 4px;
+                width: 100%;
+            }
+            .btn {
+                background-color: #0066cc;
+                color: white;
+                padding: 10px 15px;
+                border: none;
+                border-radius: 4px;
+                cursor: pointer;
+                width: 100%;
+                font-size: 16px;
+                margin-top: 10px;
+            }
+            .btn:hover {
+                background-color: #0055aa;
+            }
+            .status {
+                margin-top: 20px;
+                padding: 10px;
+                border-radius: 4px;
+                text-align: center;
+            }
+            .info {
+                margin-top: 20px;
+                font-size: 0.9em;
+                color: #666;
+            }
+            progress {
+                width: 100%;
+                height: 20px;
+                margin-top: 10px;
+            }
+        </style>
+    </head>
+    <body>
+        <div class="container">
+            <h1>ESP Firmware Update</h1>
+            <form method="POST" action="/update" enctype="multipart/form-data" id="upload_form">
+                <input type="file" name="update" class="file-input" accept=".bin,.gz,.delta">
+                <input type="text" id="sha256" class="file-input" placeholder="SHA-256 of the uncompressed .bin (optional, verified before flashing completes)">
+                <input type="submit" value="Upload Firmware" class="btn">
+                <div class="status">
+                    <progress id="progressBar" style="display:none"></progress>
+                    <div id="status"></div>
+                </div>
+            </form>
+            <div class="info">
+                <p>Select a .bin firmware file, the .bin.gz made by the build, or a .delta patch made against the running firmware.</p>
+                <p><strong>Warning:</strong> Do not interrupt the upload process once started.</p>
+            </div>
+        </div>
+        <script>
+            var form = document.getElementById('upload_form');
+            var progressBar = document.getElementById('progressBar');
+            var statusDiv = document.getElementById('status');
+            
+            form.addEventListener('submit', function(e) {
+                e.preventDefault();
+                var file = document.querySelector('input[type="file"]').files[0];
+                var xhr = new XMLHttpRequest();
+                var formData = new FormData();
+                
+                if (!file) {
+                    statusDiv.innerHTML = 'Please select a file first!';
+                    return false;
+                }
+                
+                formData.append('update', file);
+                
+                // Size and digest go in the query: they are needed before the body arrives
+                var url = form.action + '?size=' + file.size;
+                var digest = document.getElementById('sha256').value.trim();
+                if (digest) {
+                    url += '&sha256=' + encodeURIComponent(digest);
+                }
+                xhr.open('POST', url, true);
+                
+                xhr.upload.addEventListener('progress', function(e) {
+                    if (e.lengthComputable) {
+                        progressBar.style.display = 'block';
+                        progressBar.value = e.loaded;
+                        progressBar.max = e.total;
+                        statusDiv.innerHTML = 'Upload progress: ' + Math.round((e.loaded / e.total) * 100) + '%';
+                    }
+                });
+                
+                xhr.onreadystatechange = function() {
+                    if (xhr.readyState === 4) {
+                        // The response carries the throughput and stall statistics
+                        if (xhr.status === 200) {
+                            statusDiv.innerText = xhr.responseText + '\nDevice is rebooting...';
+                            setTimeout(function() {
+                                window.location.reload();
+                            }, 10000);
+                        } else {
+                            statusDiv.innerText = 'Upload failed (' + xhr.status + '): ' + xhr.responseText;
+                        }
+                    }
+                };
+                
+                statusDiv.innerHTML = 'Starting upload...';
+                xhr.send(formData);
+            });
+        </script>
+    </body>
+    </html>
+    )html";
+    
+    _server->send(200, "text/html", html);
+}
+
+// Firmware upload data: flashed by the OTA writer while it is received
+void HttpServer::handleUpdateUpload() {
+    HTTPUpload& upload = _server->upload();
+    int ledPin = _wifiManager->getStatusLedPin();
+    
+    if (upload.status == UPLOAD_FILE_START) {
+        // The data arrives before the completion handler runs, so nothing is
+        // flashed unless the request carries the credentials
+        _uploadAuthorized = !_authEnabled || _server->authenticate(_username.c_str(), _password.c_str());
+        if (!_uploadAuthorized) {
+            LOG_W("HTTP Server: Unauthenticated firmware upload rejected");
+            return;
+        }
+        
+        LOG_I("Update: %s", upload.filename.c_str());
+        
+        // Blink LED rapidly to indicate upload beginning
+        if (ledPin >= 0) {
+            for (int i = 0; i < 5; i++) {
+                digitalWrite(ledPin, !digitalRead(ledPin));
+                delay(100);
+            }
+        }
+        
+        // Flash is erased and written by the OTA writer task while the next
+        // chunks are received; the optional digest is checked before the
+        // boot partition is switched
+        uint8_t digest[32];
+        bool hasDigest = OtaWriter::parseDigest(_server->arg("sha256"), digest);
+        if (_server->hasArg("sha256") && !hasDigest) {
+            LOG_W("Ignoring malformed SHA-256 digest");
+        }
+        _otaWriter.begin(_server->arg("size").toInt(), hasDigest ? digest : nullptr);
+        _otaLastReport = 0;
+    } else if (!_uploadAuthorized) {
+        return;
+    } else if (upload.status == UPLOAD_FILE_WRITE) {
+        _otaWriter.write(upload.buf, upload.currentSize);
+        
+        // Toggle LED for each chunk
+        if (ledPin >= 0) {
+            digitalWrite(ledPin, !digitalRead(ledPin));
+        }
+        
+        // Log progress every 64 KB
+        OtaStats stats = _otaWriter.getStats();
+        if (stats.bytes - _otaLastReport >= 65536) {
+            LOG_D("Upload progress: %u KB, %.1f KB/s", stats.bytes / 1024, _otaWriter.getKBps());
+            _otaLastReport = stats.bytes;
+        }
+    } else if (upload.status == UPLOAD_FILE_ABORTED) {
+        LOG_W("Upload aborted");
+        _otaWriter.abort();
+    } else if (upload.status == UPLOAD_FILE_END) {
+        if (_otaWriter.end()) {
+            LOG_I("Update Success: %u bytes, rebooting...", upload.totalSize);
+            
+            // Solid LED to indicate success
+            if (ledPin >= 0) {
+                digitalWrite(ledPin, HIGH);
+            }
+        } else {
+            // Rapid blinking to indicate error
+            if (ledPin >= 0) {
+                for (int i = 0; i < 10; i++) {
+                    digitalWrite(ledPin, !digitalRead(ledPin));
+                    delay(50);
+                }
+            }
+        }
+    }
+}
+
+// Upload complete handler: reports throughput and receive stall time, and
+// reboots into the new image if it was accepted
+void HttpServer::handleUpdateComplete() {
+    if (!authenticateRequest()) return;
+    
+    OtaStats stats = _otaWriter.getStats();
+    
+    if (_otaWriter.hasError() || stats.bytes == 0) {
+        _server->send(500, "text/plain", String("FAIL: ") +
+                      (_otaWriter.hasError() ? _otaWriter.errorString() : "No firmware received"));
+        return;
+    }
+    
+    char summary[256];
+    int length = snprintf(summary, sizeof(summary),
+                          "OK: %u bytes in %u ms (%.1f KB/s), receive stalled %u ms, flash erase %u ms, write %u ms\n",
+                          stats.bytes, stats.elapsedMs, _otaWriter.getKBps(), stats.stallMs, stats.eraseMs,
+                          stats.writeMs);
+    if (stats.compressed || stats.delta) {
+        length += snprintf(summary + length, sizeof(summary) - length, "%s%s: %u byte image, %.1f%% transferred\n",
+                           stats.delta ? "delta" : "", stats.compressed ? (stats.delta ? "+gzip" : "gzip") : "",
+                           stats.imageBytes, 100.0f * stats.bytes / stats.imageBytes);
+    }
+    snprintf(summary + length, sizeof(summary) - length, "SHA-256 %s%s",
+             _otaWriter.getDigest(), stats.verified ? " (verified)" : "");
+    _server->send(200, "text/plain", summary);
+    delay(1000);
+    Log::flush();
+    ESP.restart();
+}
+
+// Advertise the running image as _firmware._tcp with its digest prefix
+void HttpServer::advertiseFirmware() {
+    uint8_t sha256[32];
+    size_t size;
+    if (!FirmwareUpdater::getRunningImage(sha256, &size)) {
+        LOG_W("HTTP Server: Running image unreadable, not offered to peers");
+        return;
+    }
+    
+    char prefix[17];
+    for (int i = 0; i < 8; i++) {
+        snprintf(&prefix[i * 2], 3, "%02x", sha256[i]);
+    }
+    MDNS.addService(FIRMWARE_PEER_SERVICE, "tcp", _port);
+    MDNS.addServiceTxt(FIRMWARE_PEER_SERVICE, "tcp", "sha", prefix);
+}
+
+// Running image handler: the whole file, or "Range: bytes=<first>-<last>"
+// of it with 206, streamed from flash
+void HttpServer::handleFirmwareImage() {
+    if (!authenticateRequest()) return;
+    
+    uint8_t sha256[32];
+    size_t size;
+    if (!FirmwareUpdater::getRunningImage(sha256, &size)) {
+        _server->send(503, "text/plain", "Running image unreadable");
+        return;
+    }
+    
+    size_t first = 0;
+    size_t last = size - 1;
+    bool partial = _server->hasHeader("Range");
+    if (partial) {
+        unsigned rangeFirst = 0, rangeLast = 0;
+        int fields = sscanf(_server->header("Range").c_str(), "bytes=%u-%u", &rangeFirst, &rangeLast);
+        if (fields < 1 || rangeFirst >= size || (fields == 2 && rangeLast < rangeFirst)) {
+            _server->sendHeader("Content-Range", "bytes */" + String(size));
+            _server->send(416, "text/plain", "");
+            return;
+        }
+        first = rangeFirst;
+        if (fields == 2 && rangeLast < size) {
+            last = rangeLast;
+        }
+        _server->sendHeader("Content-Range", "bytes " + String(first) + "-" + String(last) + "/" + String(size));
+    }
+    
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    _server->setContentLength(last - first + 1);
+    _server->send(partial ? 206 : 200, "application/octet-stream", "");
+    
+    char buffer[FIRMWARE_UPDATE_CHUNK];
+    for (size_t offset = first; offset <= last; offset += sizeof(buffer)) {
+        size_t count = min(sizeof(buffer), last + 1 - offset);
+        if (esp_partition_read(running, offset, buffer, count) != ESP_OK) {
+            break;
+        }
+        _server->sendContent(buffer, count);
+    }
 }
@@ -0,0 +1,33 @@
+#include "JsonSnapshot.h"
+
+// Constructor
+JsonSnapshot::JsonSnapshot() :
+    _mutex(xSemaphoreCreateMutex()),
+    _json("{}")
+{
+}
+
+// Destructor
+JsonSnapshot::~JsonSnapshot() {
+    if (_mutex != nullptr) {
+        vSemaphoreDelete(_mutex);
+    }
+}
+
+// Serialize outside the lock, then swap the text in
+void JsonSnapshot::store(const JsonDocument& doc) {
+    String json;
+    serializeJsonPretty(doc, json);
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _json = std::move(json);
+    xSemaphoreGive(_mutex);
+}
+
+// Copy of the last stored text
+String JsonSnapshot::load() const {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    String json = _json;
+    xSemaphoreGive(_mutex);
+    return json;
+}
@@ -0,0 +1,199 @@
+#include "Log.h"
+#include <stddef.h>
+
+static const char* const moduleNames[] = { "app", "wifi", "mqtt", "http", "device", "net", "ota", "storage" };
+static const char* const levelNames[] = { "none", "error", "warn", "info", "debug", "verbose" };
+static const char levelLetters[] = "-EWIDV";
+
+static_assert(sizeof(moduleNames) / sizeof(moduleNames[0]) == (size_t)LogModule::Count, "Module name missing");
+
+uint8_t Log::_levels[(uint8_t)LogModule::Count] = {
+    LOG_LEVEL, LOG_LEVEL, LOG_LEVEL, LOG_LEVEL, LOG_LEVEL, LOG_LEVEL, LOG_LEVEL, LOG_LEVEL
+};
+Log::Sink Log::_sinks[LOG_MAX_SINKS];
+std::atomic<int> Log::_sinkCount(0);
+RingbufHandle_t Log::_ring = nullptr;
+TaskHandle_t Log::_task = nullptr;
+std::atomic<uint32_t> Log::_dropped(0);
+std::atomic<uint32_t> Log::_queued(0);
+std::atomic<uint32_t> Log::_delivered(0);
+uint32_t Log::_reportedDrops = 0;
+
+// Start the log task with a UART sink
+bool Log::begin(uint8_t uartLevel) {
+    if (_task != nullptr) {
+        return true;
+    }
+
+    _ring = xRingbufferCreate(LOG_QUEUE_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (_ring == nullptr) {
+        Serial.println("Log: failed to create buffer");
+        return false;
+    }
+
+    addSink([](const LogEntry& entry) {
+        char line[LOG_MESSAGE_MAX + 32];
+        Serial.write((const uint8_t*)line, format(entry, line, sizeof(line)));
+    }, uartLevel);
+
+    if (xTaskCreate(taskEntry, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, &_task) != pdPASS) {
+        Serial.println("Log: failed to create task");
+        vRingbufferDelete(_ring);
+        _ring = nullptr;
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Format a message and queue it for the log task
+void Log::write(LogModule module, uint8_t level, const char* format, ...) {
+    LogEntry entry;
+    entry.ms = millis();
+    entry.module = module;
+    entry.level = level;
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(entry.text, sizeof(entry.text), format, args);
+    va_end(args);
+    entry.length = length < 0 ? 0 : min((size_t)length, sizeof(entry.text) - 1);
+
+    if (_ring == nullptr) {
+        char line[LOG_MESSAGE_MAX + 32];
+        Serial.write((const uint8_t*)line, Log::format(entry, line, sizeof(line)));
+        return;
+    }
+
+    // Never waits: a full buffer drops the message
+    if (xRingbufferSend(_ring, &entry, offsetof(LogEntry, text) + entry.length + 1, 0) == pdTRUE) {
+        _queued.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Wait until the log task has written what was queued so far
+void Log::flush(uint32_t timeoutMs) {
+    if (_task == nullptr || xTaskGetCurrentTaskHandle() == _task) {
+        return;
+    }
+
+    uint32_t target = _queued.load(std::memory_order_relaxed);
+    unsigned long start = millis();
+    while ((int32_t)(_delivered.load(std::memory_order_relaxed) - target) < 0 && millis() - start < timeoutMs) {
+        delay(1);
+    }
+}
+
+// Set the runtime level of one module
+void Log::setLevel(LogModule module, uint8_t level) {
+    if (module < LogModule::Count) {
+        _levels[(uint8_t)module] = min(level, (uint8_t)LOG_LEVEL_VERBOSE);
+    }
+}
+
+// Set the runtime level of every module
+void Log::setLevel(uint8_t level) {
+    for (uint8_t i = 0; i < (uint8_t)LogModule::Count; i++) {
+        setLevel((LogModule)i, level);
+    }
+}
+
+// Set a level by name
+bool Log::setLevel(const char* module, const char* level) {
+    int levelIndex = -1;
+    for (uint8_t i = 0; i <= LOG_LEVEL_VERBOSE; i++) {
+        if (strcasecmp(level, levelNames[i]) == 0) {
+            levelIndex = i;
+        }
+    }
+    if (levelIndex < 0) {
+        return false;
+    }
+
+    if (strcasecmp(module, "all") == 0) {
+        setLevel((uint8_t)levelIndex);
+        return true;
+    }
+    for (uint8_t i = 0; i < (uint8_t)LogModule::Count; i++) {
+        if (strcasecmp(module, moduleNames[i]) == 0) {
+            setLevel((LogModule)i, levelIndex);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Add a sink; only the log task calls sinks, so it may be added at any time
+bool Log::addSink(LogSink sink, uint8_t level) {
+    int count = _sinkCount.load(std::memory_order_relaxed);
+    if (count >= LOG_MAX_SINKS) {
+        return false;
+    }
+
+    _sinks[count].sink = sink;
+    _sinks[count].level = level;
+    _sinkCount.store(count + 1, std::memory_order_release);
+    return true;
+}
+
+// Format an entry as one output line
+size_t Log::format(const LogEntry& entry, char* out, size_t size) {
+    int length = snprintf(out, size, "%c (%u) %s: %.*s\r\n", levelLetters[min(entry.level, (uint8_t)LOG_LEVEL_VERBOSE)],
+                          entry.ms, moduleName(entry.module), entry.length, entry.text);
+    return length < 0 ? 0 : min((size_t)length, size - 1);
+}
+
+// Module name
+const char* Log::moduleName(LogModule module) {
+    return module < LogModule::Count ? moduleNames[(uint8_t)module] : "?";
+}
+
+// Level name
+const char* Log::levelName(uint8_t level) {
+    return level <= LOG_LEVEL_VERBOSE ? levelNames[level] : "?";
+}
+
+void Log::taskEntry(void* arg) {
+    for (;;) {
+        size_t size;
+        LogEntry* entry = (LogEntry*)xRingbufferReceive(_ring, &size, portMAX_DELAY);
+        if (entry == nullptr) {
+            continue;
+        }
+
+        deliver(*entry);
+        vRingbufferReturnItem(_ring, entry);
+        _delivered.fetch_add(1, std::memory_order_relaxed);
+        reportDrops();
+    }
+}
+
+// Hand an entry to the sinks that want its level
+void Log::deliver(const LogEntry& entry) {
+    int count = _sinkCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        if (entry.level <= _sinks[i].level) {
+            _sinks[i].sink(entry);
+        }
+    }
+}
+
+// Tell the sinks about messages lost since the last report
+void Log::reportDrops() {
+    uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+    if (dropped == _reportedDrops) {
+        return;
+    }
+
+    LogEntry entry;
+    entry.ms = millis();
+    entry.module = LogModule::App;
+    entry.level = LOG_LEVEL_WARN;
+    int length = snprintf(entry.text, sizeof(entry.text), "%u messages dropped, log buffer full",
+                          dropped - _reportedDrops);
+    entry.length = length < 0 ? 0 : min((size_t)length, sizeof(entry.text) - 1);
+    _reportedDrops = dropped;
+    deliver(entry);
+}
@@ -0,0 +1,114 @@
+#include "LogBuffer.h"
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "LogBuffer size must be a power of two");
+
+// Constructor
+LogBuffer::LogBuffer() : _head(0), _reserved(0) {
+}
+
+// Append log text, overwriting the oldest bytes
+void LogBuffer::write(const char* data, size_t len) {
+    if (len > LOG_BUFFER_SIZE) {
+        data += len - LOG_BUFFER_SIZE;
+        len = LOG_BUFFER_SIZE;
+    }
+    if (len == 0) {
+        return;
+    }
+
+    // Readers check _reserved after copying, so announce the bytes about to
+    // be overwritten before touching them (a sequence lock without retries
+    // on this side)
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    _reserved.store(head + len, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t offset = head & (LOG_BUFFER_SIZE - 1);
+    size_t first = min(len, (size_t)LOG_BUFFER_SIZE - offset);
+    memcpy(_data + offset, data, first);
+    memcpy(_data, data + first, len - first);
+
+    _head.store(head + len, std::memory_order_release);
+}
+
+// Cursor at the first line starting within the last backlog bytes
+LogCursor LogBuffer::attach(size_t backlog) const {
+    uint32_t head = _head.load(std::memory_order_acquire);
+    backlog = min(min(backlog, (size_t)LOG_BUFFER_SIZE / 2), (size_t)head);
+
+    LogCursor cursor;
+    cursor.position = head - backlog;
+    if (cursor.position > 0) {
+        cursor.position = nextLine(cursor.position - 1, head);
+    }
+    return cursor;
+}
+
+// Copy the next bytes for a reader without moving its cursor
+size_t LogBuffer::read(LogCursor& cursor, char* out, size_t max) const {
+    while (true) {
+        uint32_t head = _head.load(std::memory_order_acquire);
+        uint32_t reserved = _reserved.load(std::memory_order_acquire);
+
+        // Lapped by the writer: continue at the oldest line still intact
+        if (reserved - cursor.position > LOG_BUFFER_SIZE) {
+            uint32_t oldest = reserved - LOG_BUFFER_SIZE;
+            uint32_t start = nextLine(oldest, head);
+            if (!intact(oldest)) {
+                continue;                       // the line break found may have been overwritten
+            }
+            cursor.gap += start - cursor.position;
+            cursor.dropped += start - cursor.position;
+            cursor.position = start;
+        }
+
+        if (cursor.gap > 0) {
+            int length = snprintf(out, max, "\r\n[... %u bytes dropped]\r\n", cursor.gap);
+            return length < 0 ? 0 : min((size_t)length, max - 1);
+        }
+
+        size_t len = min((size_t)(head - cursor.position), max);
+        if (len == 0) {
+            return 0;
+        }
+        copy(cursor.position, out, len);
+        if (intact(cursor.position)) {
+            return len;
+        }
+    }
+}
+
+// Move the cursor past delivered bytes (or the gap marker)
+void LogBuffer::advance(LogCursor& cursor, size_t len) const {
+    if (cursor.gap > 0) {
+        cursor.gap = 0;
+    } else {
+        cursor.position += len;
+    }
+}
+
+// Copy ring bytes starting at a stream position
+size_t LogBuffer::copy(uint32_t position, char* out, size_t len) const {
+    size_t offset = position & (LOG_BUFFER_SIZE - 1);
+    size_t first = min(len, (size_t)LOG_BUFFER_SIZE - offset);
+    memcpy(out, _data + offset, first);
+    memcpy(out + first, _data, len - first);
+    return len;
+}
+
+// Bytes copied from position onwards were not overwritten meanwhile
+bool LogBuffer::intact(uint32_t position) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return _reserved.load(std::memory_order_relaxed) - position <= LOG_BUFFER_SIZE;
+}
+
+// Start of the first line after a line break at or after position
+// (position itself if none is buffered)
+uint32_t LogBuffer::nextLine(uint32_t position, uint32_t head) const {
+    for (uint32_t i = position; i != head; i++) {
+        if (_data[i & (LOG_BUFFER_SIZE - 1)] == '\n') {
+            return i + 1;
+        }
+    }
+    return position;
+}
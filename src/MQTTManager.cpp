@@ -1,15 +1,13 @@
 #include "MQTTManager.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Mqtt
+#define LOG_MODULE_LEVEL LOG_LEVEL_MQTT
 
 // Default callback function for incoming messages
 void MQTTManager::defaultCallback(char* topic, byte* payload, unsigned int length) {
-    Serial.println("Message received on topic: " + String(topic));
-    Serial.print("Payload: ");
-    
-    // Print the message content
-    for (unsigned int i = 0; i < length; i++) {
-        Serial.print((char)payload[i]);
-    }
-    Serial.println();
+    LOG_D("Message received on topic: %s", topic);
+    LOG_D("Payload: %.*s", (int)length, (const char*)payload);
 }
 
 // Constructor
@@ -35,14 +33,12 @@ MQTTManager::MQTTManager(
 {
     // Set default callback
     _client.setCallback(defaultCallback);
+    _client.setBufferSize(MQTT_BUFFER_SIZE);
 }
 
 // Initialize MQTT connection
 bool MQTTManager::begin() {
-    Serial.print("Connecting to MQTT broker at ");
-    Serial.print(_server);
-    Serial.print(":");
-    Serial.println(_port);
+    LOG_I("Connecting to MQTT broker at %s:%d", _server.c_str(), _port);
     
     // Set server and port
     _client.setServer(_server.c_str(), _port);
@@ -56,23 +52,22 @@ bool MQTTManager::begin() {
     
     if (success) {
         _isConnected = true;
-        Serial.println("MQTT connection successful");
+        LOG_I("MQTT connection successful");
         
         // Subscribe to device-specific control topic
         String controlTopic = buildTopic("control/#");
         _client.subscribe(controlTopic.c_str());
-        Serial.println("Subscribed to: " + controlTopic);
+        LOG_I("Subscribed to: %s", controlTopic.c_str());
         
         // Publish connection status
         String statusTopic = buildTopic("status");
         _client.publish(statusTopic.c_str(), "online", true);
-        Serial.println("Published online status to: " + statusTopic);
+        LOG_D("Published online status to: %s", statusTopic.c_str());
         
         return true;
     } else {
         _isConnected = false;
-        Serial.print("MQTT connection failed with error code: ");
-        Serial.println(_client.state());
+        LOG_W("MQTT connection failed with error code: %d", _client.state());
         return false;
     }
 }
@@ -91,7 +86,7 @@ bool MQTTManager::checkConnection() {
         unsigned long currentTime = millis();
         if (currentTime - _lastReconnectAttempt > 5000) {
             _lastReconnectAttempt = currentTime;
-            Serial.println("MQTT disconnected. Attempting to reconnect...");
+            LOG_W("MQTT disconnected. Attempting to reconnect...");
             
             if (begin()) {
                 _isConnected = true;
@@ -115,6 +110,16 @@ bool MQTTManager::publish(const String& topic, const String& payload, bool retai
     return _client.publish(fullTopic.c_str(), payload.c_str(), retain);
 }
 
+// Publish raw bytes to a topic
+bool MQTTManager::publish(const char* topic, const uint8_t* payload, size_t length, bool retain) {
+    if (!_isConnected || !checkConnection()) {
+        return false;
+    }
+    
+    String fullTopic = buildTopic(topic);
+    return _client.publish(fullTopic.c_str(), payload, length, retain);
+}
+
 // Publish JSON data to a topic
 bool MQTTManager::publishJson(const String& topic, const JsonDocument& jsonDoc, bool retain) {
     if (!_isConnected || !checkConnection()) {
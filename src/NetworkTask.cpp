@@ -0,0 +1,261 @@
+#include "NetworkTask.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Net
+#define LOG_MODULE_LEVEL LOG_LEVEL_NET
+
+// Constructor
+NetworkTask::NetworkTask(WiFiManager* wifiManager, MQTTManager* mqttManager, HttpServer* httpServer) :
+    _wifiManager(wifiManager),
+    _mqttManager(mqttManager),
+    _httpServer(httpServer),
+    _handle(nullptr),
+    _wifiConnected(false),
+    _mqttConnected(false),
+    _mqttConnects(0),
+    _clockStarted(false),
+    _statusMutex(xSemaphoreCreateMutex()) {
+    memset(&_status, 0, sizeof(_status));
+    strlcpy(_status.ip, "Not connected", sizeof(_status.ip));
+}
+
+// Create the network task
+bool NetworkTask::begin(BaseType_t core) {
+    if (_handle != nullptr) {
+        return true;
+    }
+
+    // Inbound messages are copied into the command queue on the network core
+    _mqttManager->setCallback([this](char* topic, byte* payload, unsigned int length) {
+        this->onMqttMessage(topic, payload, length);
+    });
+
+    // Warnings and errors also go to MQTT; the log task is the only producer
+    Log::addSink([this](const LogEntry& entry) {
+        this->queueLog(entry);
+    }, NETWORK_LOG_LEVEL);
+
+    BaseType_t result = xTaskCreatePinnedToCore(
+        taskEntry, "network", NETWORK_TASK_STACK, this, NETWORK_TASK_PRIORITY, &_handle, core);
+
+    if (result != pdPASS) {
+        LOG_E("Network task: failed to create task");
+        _handle = nullptr;
+        return false;
+    }
+
+    LOG_I("Network task: started on core %d", core);
+    return true;
+}
+
+// Queue a message for publishing
+bool NetworkTask::publish(const char* topicSuffix, const char* payload, bool retain) {
+    OutboundMessage* message = _outbound.reserve();
+    if (message == nullptr) {
+        return false;
+    }
+
+    strlcpy(message->topic, topicSuffix, sizeof(message->topic));
+    message->length = strlcpy(message->payload, payload, sizeof(message->payload));
+    if (message->length >= sizeof(message->payload)) {
+        message->length = sizeof(message->payload) - 1;
+    }
+    message->retain = retain;
+
+    _outbound.commit();
+    return true;
+}
+
+// Serialize a JSON document into the outbound queue
+bool NetworkTask::publishJson(const char* topicSuffix, const JsonDocument& jsonDoc, bool retain) {
+    if (measureJson(jsonDoc) >= NETWORK_PAYLOAD_MAX) {
+        LOG_W("Network task: payload too large for %s", topicSuffix);
+        return false;
+    }
+
+    OutboundMessage* message = _outbound.reserve();
+    if (message == nullptr) {
+        return false;
+    }
+
+    strlcpy(message->topic, topicSuffix, sizeof(message->topic));
+    message->length = serializeJson(jsonDoc, message->payload, sizeof(message->payload));
+    message->retain = retain;
+
+    _outbound.commit();
+    return true;
+}
+
+// Take the next received command
+bool NetworkTask::nextCommand(InboundCommand& command) {
+    return _commands.pop(command);
+}
+
+void NetworkTask::taskEntry(void* arg) {
+    static_cast<NetworkTask*>(arg)->run();
+}
+
+// Network task body: WiFi connects in the background and checkWiFi() brings
+// HTTP and MQTT up once it is connected
+void NetworkTask::run() {
+    _wifiManager->start();
+    _wifiConnected = false;
+
+    _scheduler.addPeriodic("wifi", NETWORK_WIFI_CHECK_INTERVAL, [this]() {
+        checkWiFi();
+    });
+
+    _scheduler.addPeriodic("mqtt", NETWORK_MQTT_INTERVAL, [this]() {
+        serviceMqtt();
+    });
+
+    // Link metrics are read on the core that updates them
+    _scheduler.addPeriodic("wifi_metrics", WIFI_METRICS_INTERVAL, [this]() {
+        publishWiFiMetrics();
+    });
+
+    _scheduler.addPeriodic("wifi_status", NETWORK_STATUS_INTERVAL, [this]() {
+        updateWiFiStatus();
+    });
+
+    if (_httpServer != nullptr) {
+        _scheduler.addPeriodic("http", NETWORK_HTTP_INTERVAL, [this]() {
+            if (_wifiConnected) {
+                _httpServer->handleClient();
+            }
+        });
+    }
+
+    for (;;) {
+        _scheduler.run();
+    }
+}
+
+// Check WiFi status and restart services after a reconnection
+void NetworkTask::checkWiFi() {
+    bool prevConnected = _wifiConnected;
+    bool wifiConnected = _wifiManager->checkConnection();
+    _wifiConnected = wifiConnected;
+
+    if (prevConnected == wifiConnected) {
+        return;
+    }
+    updateWiFiStatus();
+
+    if (wifiConnected) {
+        LOG_I("WiFi connected. IP: %s, Signal: %d dBm", _wifiManager->getIPAddress().c_str(),
+              _wifiManager->getSignalStrength());
+
+        if (_httpServer != nullptr && !_httpServer->isRunning()) {
+            LOG_I("Starting HTTP server...");
+            _httpServer->begin();
+        }
+
+        // Keeps resyncing in the background from here on
+        if (!_clockStarted) {
+            configTime(0, 0, NETWORK_NTP_SERVER_1, NETWORK_NTP_SERVER_2);
+            _clockStarted = true;
+        }
+    } else {
+        LOG_W("WiFi disconnected. Attempting to reconnect...");
+        _wifiManager->printConnectionStatus(WiFi.status());
+        _mqttConnected = false;
+    }
+}
+
+// Publish the WiFi link metrics straight through MQTT (network core only)
+void NetworkTask::publishWiFiMetrics() {
+    if (!_mqttConnected) {
+        return;
+    }
+
+    JsonDocument doc;
+    _wifiManager->getMetricsJson(doc.to<JsonObject>());
+    _mqttManager->publishJson("wifi/metrics", doc, false);
+}
+
+// Copy the WiFi status for the application core (network core only)
+void NetworkTask::updateWiFiStatus() {
+    WiFiStatus status;
+    _wifiManager->getStatus(status);
+
+    xSemaphoreTake(_statusMutex, portMAX_DELAY);
+    _status = status;
+    xSemaphoreGive(_statusMutex);
+}
+
+// Last WiFi status copied on the network core (any core)
+void NetworkTask::getWiFiStatus(WiFiStatus& status) const {
+    xSemaphoreTake(_statusMutex, portMAX_DELAY);
+    status = _status;
+    xSemaphoreGive(_statusMutex);
+}
+
+// Keep MQTT alive, deliver inbound messages and drain the outbound queue
+void NetworkTask::serviceMqtt() {
+    if (!_wifiConnected) {
+        return;
+    }
+
+    bool mqttConnected = _mqttManager->checkConnection();
+    bool wasConnected = _mqttConnected.exchange(mqttConnected);
+
+    // Counted after the flag so a reader seeing the new count sees it connected
+    if (mqttConnected && !wasConnected) {
+        _mqttConnects++;
+    }
+    if (!mqttConnected) {
+        return;
+    }
+
+    _mqttManager->loop();
+
+    publishQueued(_outbound);
+    publishQueued(_logs);
+}
+
+// Publish queued messages in order until the client refuses one
+template <typename Queue>
+void NetworkTask::publishQueued(Queue& queue) {
+    const OutboundMessage* message;
+    while ((message = queue.peek()) != nullptr) {
+        if (!_mqttManager->publish(message->topic, (const uint8_t*)message->payload,
+                                   message->length, message->retain)) {
+            // Leave it queued and retry on the next run
+            break;
+        }
+        queue.release();
+    }
+}
+
+// Log sink (log task): queue a message for the log topic, dropped when full
+void NetworkTask::queueLog(const LogEntry& entry) {
+    OutboundMessage* message = _logs.reserve();
+    if (message == nullptr) {
+        return;
+    }
+
+    strlcpy(message->topic, "log", sizeof(message->topic));
+    int length = snprintf(message->payload, sizeof(message->payload), "%s %s: %.*s", Log::levelName(entry.level),
+                          Log::moduleName(entry.module), entry.length, entry.text);
+    message->length = min(max(length, 0), (int)sizeof(message->payload) - 1);
+    message->retain = false;
+
+    _logs.commit();
+}
+
+// MQTT callback (runs on the network core inside MQTTManager::loop)
+void NetworkTask::onMqttMessage(char* topic, byte* payload, unsigned int length) {
+    InboundCommand* command = _commands.reserve();
+    if (command == nullptr) {
+        LOG_W("Network task: command queue full, message dropped");
+        return;
+    }
+
+    strlcpy(command->topic, topic, sizeof(command->topic));
+    command->length = min((unsigned int)(sizeof(command->payload) - 1), length);
+    memcpy(command->payload, payload, command->length);
+    command->payload[command->length] = '\0';
+
+    _commands.commit();
+}
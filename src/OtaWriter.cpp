@@ -0,0 +1,500 @@
+#include "OtaWriter.h"
+#include <esp_ota_ops.h>
+#include <esp_image_format.h>
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Ota
+#define LOG_MODULE_LEVEL LOG_LEVEL_OTA
+
+// Constructor
+OtaWriter::OtaWriter() {
+    mbedtls_sha256_init(&_sha);
+}
+
+// Destructor
+OtaWriter::~OtaWriter() {
+    abort();
+    mbedtls_sha256_free(&_sha);
+}
+
+// Start an update into the next OTA partition
+bool OtaWriter::begin(size_t size, const uint8_t* sha256, size_t resumeFrom) {
+    abort();
+
+    _error = false;
+    _errorString = "";
+    _digestHex[0] = '\0';
+    _received = 0;
+    _imageBytes = 0;
+    _compressed = false;
+    _delta = false;
+    _formatKnown = false;
+    _written = 0;
+    _erasedEnd = 0;
+    _fill = 0;
+    _current = 0;
+    _stallUs = 0;
+    _eraseUs = 0;
+    _writeUs = 0;
+    _verified = false;
+    _startMs = millis();
+    _endMs = 0;
+
+    _partition = esp_ota_get_next_update_partition(nullptr);
+    if (_partition == nullptr) {
+        fail("No OTA partition");
+        return false;
+    }
+    if (size > _partition->size) {
+        fail("Image larger than the OTA partition");
+        return false;
+    }
+    _limit = size > 0 ? size : _partition->size;
+
+    _hasExpected = sha256 != nullptr;
+    if (_hasExpected) {
+        memcpy(_expected, sha256, sizeof(_expected));
+    }
+    mbedtls_sha256_starts_ret(&_sha, 0);
+
+    for (int i = 0; i < OTA_WRITER_BUFFERS; i++) {
+        _buffers[i] = (uint8_t*)malloc(OTA_WRITER_BUFFER_SIZE);
+    }
+    _filled = xQueueCreate(OTA_WRITER_BUFFERS + 1, sizeof(Chunk));
+    _free = xQueueCreate(OTA_WRITER_BUFFERS, sizeof(uint8_t));
+    _done = xSemaphoreCreateBinary();
+
+    bool allocated = _filled != nullptr && _free != nullptr && _done != nullptr;
+    for (int i = 0; i < OTA_WRITER_BUFFERS; i++) {
+        allocated = allocated && _buffers[i] != nullptr;
+    }
+    if (!allocated) {
+        fail("Out of memory");
+        release();
+        return false;
+    }
+
+    if (resumeFrom > 0 && !rehash(resumeFrom)) {
+        release();
+        return false;
+    }
+
+    // Buffer 0 is filled first, the others wait in the free queue
+    for (uint8_t i = 1; i < OTA_WRITER_BUFFERS; i++) {
+        xQueueSend(_free, &i, 0);
+    }
+
+    if (xTaskCreate(taskEntry, "ota_writer", OTA_WRITER_STACK, this, OTA_WRITER_PRIORITY, &_task) != pdPASS) {
+        _task = nullptr;
+        fail("Failed to create writer task");
+        release();
+        return false;
+    }
+
+    _active = true;
+    if (resumeFrom > 0) {
+        LOG_I("Resuming partition %s at %u KB", _partition->label, resumeFrom / 1024);
+    } else {
+        LOG_I("Writing to partition %s (%u KB)", _partition->label, _partition->size / 1024);
+    }
+    return true;
+}
+
+// Take received data, decompressing it first if it is gzipped
+size_t OtaWriter::write(const uint8_t* data, size_t len) {
+    if (!_active || _error || len == 0) {
+        return 0;
+    }
+
+    if (_received == 0 && GzipInflater::isGzip(data[0])) {
+        _compressed = _inflater.begin([this](const uint8_t* output, size_t count) {
+            return decode(output, count) == count;
+        });
+        if (!_compressed) {
+            fail(_inflater.errorString());
+            return 0;
+        }
+    }
+    _received += len;
+
+    if (!_compressed) {
+        return decode(data, len);
+    }
+    if (!_inflater.write(data, len)) {
+        fail(_inflater.errorString());
+        return 0;
+    }
+    return len;
+}
+
+// Route (decompressed) data: a delta patch is applied against the running
+// image, anything else is the image itself
+size_t OtaWriter::decode(const uint8_t* data, size_t len) {
+    if (!_formatKnown) {
+        _formatKnown = true;
+        if (DeltaPatcher::isPatch(data[0])) {
+            _delta = _patcher.begin(esp_ota_get_running_partition(), [this](const uint8_t* output, size_t count) {
+                return writeImage(output, count) == count;
+            });
+            if (!_delta) {
+                fail(_patcher.errorString());
+                return 0;
+            }
+        }
+    }
+
+    if (!_delta) {
+        return writeImage(data, len);
+    }
+    if (!_patcher.write(data, len)) {
+        fail(_patcher.errorString());
+        return 0;
+    }
+    return len;
+}
+
+// Copy image data into the current buffer and hand full ones to the writer task
+size_t OtaWriter::writeImage(const uint8_t* data, size_t len) {
+    if (_error) {
+        return 0;
+    }
+    if (_imageBytes == 0) {
+        if (data[0] != ESP_IMAGE_HEADER_MAGIC) {
+            fail("Not a firmware image");
+            return 0;
+        }
+        // The compressed size passed to begin() says little about how far
+        // to erase; the image size comes with the gzip header if it was
+        // made by compress_firmware.py
+        if (_compressed) {
+            size_t imageSize = _inflater.getImageSize();
+            _limit = imageSize > 0 ? min(imageSize, (size_t)_partition->size) : (size_t)_partition->size;
+        }
+
+        // A patch carries the size and digest of the image it rebuilds
+        if (_delta) {
+            _limit = min(_patcher.getTargetSize(), (size_t)_partition->size);
+            if (_hasExpected && memcmp(_expected, _patcher.getTargetDigest(), sizeof(_expected)) != 0) {
+                fail("Patch does not produce the expected image");
+                return 0;
+            }
+            memcpy(_expected, _patcher.getTargetDigest(), sizeof(_expected));
+            _hasExpected = true;
+        }
+    }
+    if (_imageBytes + len > _partition->size) {
+        fail("Image larger than the OTA partition");
+        return 0;
+    }
+
+    size_t offset = 0;
+    while (offset < len) {
+        size_t count = min(len - offset, (size_t)OTA_WRITER_BUFFER_SIZE - _fill);
+        memcpy(_buffers[_current] + _fill, data + offset, count);
+        _fill += count;
+        offset += count;
+
+        if (_fill == OTA_WRITER_BUFFER_SIZE && !submit(_fill, false)) {
+            return 0;
+        }
+    }
+
+    _imageBytes += len;
+    return len;
+}
+
+// Flush the last buffer, wait for the writer task and verify the image
+bool OtaWriter::end() {
+    if (!_active) {
+        return false;
+    }
+
+    if (!_error && _received == 0) {
+        fail("No data received");
+    }
+    if (!_error && _compressed && !_inflater.isDone()) {
+        fail("Compressed image truncated");
+    }
+    if (!_error && _delta && !_patcher.isDone()) {
+        fail("Delta patch truncated");
+    }
+    if (!_error && _fill > 0) {
+        // Encrypted flash is programmed in 16 byte units; the padding is
+        // written but not hashed
+        size_t padded = (_fill + 15) & ~(size_t)15;
+        memset(_buffers[_current] + _fill, 0xFF, padded - _fill);
+        submit(_fill, true);
+    }
+
+    Chunk stop = {0, 0};
+    xQueueSend(_filled, &stop, portMAX_DELAY);
+    xSemaphoreTake(_done, portMAX_DELAY);
+    _task = nullptr;
+    _endMs = millis();
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish_ret(&_sha, digest);
+    for (int i = 0; i < 32; i++) {
+        snprintf(&_digestHex[i * 2], 3, "%02x", digest[i]);
+    }
+
+    if (!_error && _hasExpected) {
+        if (memcmp(digest, _expected, sizeof(digest)) != 0) {
+            fail("SHA-256 mismatch");
+        } else {
+            _verified = true;
+        }
+    }
+
+    // Checks the image header, segments and appended hash
+    if (!_error) {
+        esp_err_t result = esp_ota_set_boot_partition(_partition);
+        if (result != ESP_OK) {
+            fail(result == ESP_ERR_OTA_VALIDATE_FAILED ? "Image validation failed" : "Failed to set boot partition");
+        }
+    }
+
+    release();
+    _active = false;
+
+    if (_error) {
+        LOG_E("Update failed: %s", _errorString);
+        return false;
+    }
+
+    OtaStats stats = getStats();
+    if (stats.compressed || stats.delta) {
+        LOG_I("%u bytes%s%s -> %u byte image (%.1f%%)", stats.bytes, stats.delta ? " delta" : "",
+              stats.compressed ? " gzip" : "", stats.imageBytes, 100.0f * stats.bytes / stats.imageBytes);
+    }
+    LOG_I("%u bytes in %u ms (%.1f KB/s), receive stalled %u ms, erase %u ms, write %u ms%s",
+          stats.bytes, stats.elapsedMs, getKBps(), stats.stallMs, stats.eraseMs, stats.writeMs,
+          stats.verified ? ", SHA-256 verified" : "");
+    return true;
+}
+
+// Stop the writer task and drop the update
+void OtaWriter::abort() {
+    if (!_active) {
+        return;
+    }
+
+    fail("Aborted");
+    Chunk stop = {0, 0};
+    xQueueSend(_filled, &stop, portMAX_DELAY);
+    xSemaphoreTake(_done, portMAX_DELAY);
+    _task = nullptr;
+    _endMs = millis();
+
+    release();
+    _active = false;
+}
+
+// Sector-aligned flash progress of a plain image
+size_t OtaWriter::getResumeOffset() const {
+    if (!_active || _compressed || _delta) {
+        return 0;
+    }
+    size_t written = _written;
+    return written - written % OTA_WRITER_BUFFER_SIZE;
+}
+
+// Timing of the last (or running) update
+OtaStats OtaWriter::getStats() const {
+    OtaStats stats;
+    stats.bytes = _received;
+    stats.imageBytes = _imageBytes;
+    stats.elapsedMs = (_endMs != 0 ? _endMs : millis()) - _startMs;
+    stats.stallMs = _stallUs / 1000;
+    stats.eraseMs = _eraseUs / 1000;
+    stats.writeMs = _writeUs / 1000;
+    stats.compressed = _compressed;
+    stats.delta = _delta;
+    stats.verified = _verified;
+    return stats;
+}
+
+// Average throughput since begin()
+float OtaWriter::getKBps() const {
+    OtaStats stats = getStats();
+    return stats.elapsedMs > 0 ? (stats.bytes / 1024.0f) / (stats.elapsedMs / 1000.0f) : 0;
+}
+
+// Parse a 64 character hex digest
+bool OtaWriter::parseDigest(const String& hex, uint8_t* digest) {
+    if (hex.length() != 64) {
+        return false;
+    }
+
+    for (int i = 0; i < 32; i++) {
+        uint8_t byte = 0;
+        for (int j = 0; j < 2; j++) {
+            char c = hex[i * 2 + j];
+            uint8_t nibble;
+            if (c >= '0' && c <= '9') {
+                nibble = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                nibble = c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                nibble = c - 'A' + 10;
+            } else {
+                return false;
+            }
+            byte = (byte << 4) | nibble;
+        }
+        digest[i] = byte;
+    }
+    return true;
+}
+
+// Hand the current buffer to the writer task and take a free one. The wait
+// for a free buffer is the time the receiver is stalled by flash.
+bool OtaWriter::submit(uint16_t length, bool last) {
+    Chunk chunk = {_current, length};
+    xQueueSend(_filled, &chunk, portMAX_DELAY);
+    _fill = 0;
+
+    if (last) {
+        return true;
+    }
+
+    uint32_t waitStart = micros();
+    bool received = xQueueReceive(_free, &_current, pdMS_TO_TICKS(OTA_WRITER_TIMEOUT)) == pdTRUE;
+    _stallUs += micros() - waitStart;
+
+    if (!received) {
+        fail("Flash writer timed out");
+        return false;
+    }
+    return !_error;
+}
+
+// Record the first error
+void OtaWriter::fail(const char* message) {
+    if (!_error) {
+        _errorString = message;
+        _error = true;
+    }
+}
+
+// Free the buffers, queues, decompressor and patcher
+void OtaWriter::release() {
+    _inflater.end();
+    _patcher.end();
+    for (int i = 0; i < OTA_WRITER_BUFFERS; i++) {
+        free(_buffers[i]);
+        _buffers[i] = nullptr;
+    }
+    if (_filled != nullptr) {
+        vQueueDelete(_filled);
+        _filled = nullptr;
+    }
+    if (_free != nullptr) {
+        vQueueDelete(_free);
+        _free = nullptr;
+    }
+    if (_done != nullptr) {
+        vSemaphoreDelete(_done);
+        _done = nullptr;
+    }
+}
+
+void OtaWriter::taskEntry(void* arg) {
+    static_cast<OtaWriter*>(arg)->run();
+}
+
+// Writer task: programs and hashes filled buffers; while none is waiting it
+// erases ahead of the write cursor
+void OtaWriter::run() {
+    for (;;) {
+        size_t eraseTarget = min(_written + OTA_WRITER_ERASE_AHEAD, _limit.load());
+        TickType_t wait = (!_error && _erasedEnd < eraseTarget) ? 0 : portMAX_DELAY;
+
+        Chunk chunk;
+        if (xQueueReceive(_filled, &chunk, wait) != pdTRUE) {
+            eraseNext();
+            continue;
+        }
+        if (chunk.length == 0) {
+            break;
+        }
+
+        if (!_error) {
+            size_t padded = (chunk.length + 15) & ~(size_t)15;
+            while (_erasedEnd < _written + padded) {
+                if (!eraseNext()) {
+                    break;
+                }
+            }
+
+            uint32_t writeStart = micros();
+            esp_err_t result = esp_partition_write(_partition, _written, _buffers[chunk.buffer], padded);
+            _writeUs += micros() - writeStart;
+
+            if (result != ESP_OK) {
+                fail("Flash write failed");
+            } else {
+                mbedtls_sha256_update_ret(&_sha, _buffers[chunk.buffer], chunk.length);
+                _written += chunk.length;
+            }
+        }
+
+        xQueueSend(_free, &chunk.buffer, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(_done);
+    vTaskDelete(nullptr);
+}
+
+// Hash the part of a plain image already in the partition and continue
+// after it; the rest of the sector-aligned partition is erased again
+bool OtaWriter::rehash(size_t length) {
+    if (length % OTA_WRITER_BUFFER_SIZE != 0 || length > _limit) {
+        fail("Invalid resume offset");
+        return false;
+    }
+
+    for (size_t offset = 0; offset < length; offset += OTA_WRITER_BUFFER_SIZE) {
+        if (esp_partition_read(_partition, offset, _buffers[0], OTA_WRITER_BUFFER_SIZE) != ESP_OK) {
+            fail("Flash read failed");
+            return false;
+        }
+        if (offset == 0 && _buffers[0][0] != ESP_IMAGE_HEADER_MAGIC) {
+            fail("No partial image to resume");
+            return false;
+        }
+        mbedtls_sha256_update_ret(&_sha, _buffers[0], OTA_WRITER_BUFFER_SIZE);
+    }
+
+    _received = length;
+    _imageBytes = length;
+    _formatKnown = true;
+    _written = length;
+    _erasedEnd = length;
+    return true;
+}
+
+// Erase the next block of the partition when the image covers all of it,
+// otherwise the next sector
+bool OtaWriter::eraseNext() {
+    if (_erasedEnd >= _partition->size) {
+        fail("Image larger than the OTA partition");
+        return false;
+    }
+
+    size_t length = SPI_FLASH_SEC_SIZE;
+    if (_erasedEnd % OTA_WRITER_ERASE_BLOCK == 0 && _erasedEnd + OTA_WRITER_ERASE_BLOCK <= _limit) {
+        length = OTA_WRITER_ERASE_BLOCK;
+    }
+
+    uint32_t eraseStart = micros();
+    esp_err_t result = esp_partition_erase_range(_partition, _erasedEnd, length);
+    _eraseUs += micros() - eraseStart;
+
+    if (result != ESP_OK) {
+        fail("Flash erase failed");
+        return false;
+    }
+    _erasedEnd += length;
+    return true;
+}
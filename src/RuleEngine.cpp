@@ -0,0 +1,681 @@
+#include "RuleEngine.h"
+#include <ArduinoJson.h>
+#include <driver/gpio.h>
+
+// Constructor
+RuleEngine::RuleEngine() :
+    _actionCount(0),
+    _actionPins(0),
+    _error(""),
+    _samples(0),
+    _totalCycles(0),
+    _maxCycles(0) {
+    // Not clear(): it returns active rules to rest, which needs them initialized
+    memset(_rules, 0, sizeof(_rules));
+    memset(&_candidate, 0, sizeof(_candidate));
+    for (int i = 0; i < RULE_MAX_SOURCES; i++) {
+        _sources[i] = {NAN, NAN, 0, 0, 0};
+    }
+}
+
+// Register a local action type
+bool RuleEngine::registerAction(const char* type, EventHandler handler) {
+    if (_actionCount >= RULE_MAX_ACTIONS) {
+        return false;
+    }
+
+    strlcpy(_actions[_actionCount].type, type, sizeof(_actions[_actionCount].type));
+    _actions[_actionCount].handler = handler;
+    _actionCount++;
+    return true;
+}
+
+// Add, replace or (empty definition) remove a rule
+bool RuleEngine::setRule(const char* id, const char* json, size_t length) {
+    if (length == 0) {
+        return removeRule(id);
+    }
+
+    if (strlen(id) == 0 || strlen(id) >= RULE_ID_MAX) {
+        _error = "invalid rule id";
+        return false;
+    }
+
+    JsonDocument doc;
+    if (deserializeJson(doc, json, length) != DeserializationError::Ok) {
+        _error = "invalid JSON";
+        return false;
+    }
+
+    const char* when = doc["when"];
+    if (when == nullptr) {
+        _error = "missing 'when'";
+        return false;
+    }
+
+    // Compile into the scratch rule so a bad definition leaves the old one in place
+    Rule& candidate = _candidate;
+    memset(&candidate, 0, sizeof(candidate));
+    strlcpy(candidate.id, id, sizeof(candidate.id));
+
+    if (!compile(when, candidate, candidate.when)) {
+        return false;
+    }
+
+    const char* clearText = doc["clear"];
+    candidate.hasClear = clearText != nullptr;
+    if (candidate.hasClear && !compile(clearText, candidate, candidate.clear)) {
+        return false;
+    }
+
+    candidate.holdMs = doc["for"] | 0;
+    candidate.cooldownMs = doc["cooldown"] | 0;
+    strlcpy(candidate.action.type, doc["action"] | "", sizeof(candidate.action.type));
+    candidate.action.pin = doc["pin"] | -1;
+    candidate.action.value = doc["value"] | 1.0f;
+    candidate.action.restValue = doc["rest"] | 0.0f;
+
+    if (candidate.action.type[0] != '\0') {
+        bool known = false;
+        for (int i = 0; i < _actionCount; i++) {
+            known = known || strcmp(_actions[i].type, candidate.action.type) == 0;
+        }
+        if (!known) {
+            _error = "unknown action";
+            return false;
+        }
+    }
+
+    // -1 means no pin; anything else must be on the configured list
+    if (candidate.action.pin != -1 && !isActionPin(candidate.action.pin)) {
+        _error = "invalid pin";
+        return false;
+    }
+
+    Rule* slot = findRule(id);
+    for (int i = 0; slot == nullptr && i < RULE_MAX_RULES; i++) {
+        if (!_rules[i].used) {
+            slot = &_rules[i];
+        }
+    }
+    if (slot == nullptr) {
+        _error = "rule table full";
+        return false;
+    }
+
+    // The replaced rule's action is returned to rest first
+    release(*slot);
+    candidate.used = true;
+    *slot = candidate;
+    _error = "";
+    return true;
+}
+
+// Configured and usable as an output on this chip
+bool RuleEngine::isActionPin(int pin) const {
+    return pin >= 0 && pin < 64 && (_actionPins & (1ULL << pin)) != 0 && GPIO_IS_VALID_OUTPUT_GPIO(pin);
+}
+
+// Remove a rule
+bool RuleEngine::removeRule(const char* id) {
+    Rule* rule = findRule(id);
+    if (rule == nullptr) {
+        _error = "no such rule";
+        return false;
+    }
+
+    release(*rule);
+    rule->used = false;
+    return true;
+}
+
+// Remove every rule
+void RuleEngine::clear() {
+    for (int i = 0; i < RULE_MAX_RULES; i++) {
+        release(_rules[i]);
+        _rules[i].used = false;
+    }
+}
+
+// Evaluate the rules that depend on a source
+void RuleEngine::onSample(int source, float value, uint32_t timestampUs) {
+    if (source < 0 || source >= RULE_MAX_SOURCES) {
+        return;
+    }
+
+    SourceState& state = _sources[source];
+    state.previous = state.value;
+    state.previousUs = state.timestampUs;
+    state.value = value;
+    state.timestampUs = timestampUs;
+    state.count++;
+
+    uint8_t bit = 1 << source;
+    uint32_t sampleCycles = 0;
+    bool evaluated = false;
+    unsigned long now = millis();
+
+    for (int i = 0; i < RULE_MAX_RULES; i++) {
+        Rule& rule = _rules[i];
+        if (!rule.used || !(rule.sourceMask & bit)) {
+            continue;
+        }
+
+        uint32_t start = ESP.getCycleCount();
+
+        for (int w = 0; w < rule.windowCount; w++) {
+            Window& window = rule.windows[w];
+            if (window.source != source) {
+                continue;
+            }
+            window.values[window.head] = value;
+            window.head = (window.head + 1) % window.size;
+            if (window.count < window.size) {
+                window.count++;
+            }
+        }
+
+        int transition = 0;     // 1 = fired, -1 = cleared
+        if (!rule.active) {
+            if (!isTrue(evaluate(rule, rule.when))) {
+                rule.pending = false;
+            } else {
+                if (!rule.pending) {
+                    rule.pending = true;
+                    rule.pendingSince = now;
+                }
+                bool held = now - rule.pendingSince >= rule.holdMs;
+                bool rested = rule.fireCount == 0 || now - rule.lastFired >= rule.cooldownMs;
+                if (held && rested) {
+                    rule.active = true;
+                    rule.lastFired = now;
+                    rule.fireCount++;
+                    transition = 1;
+                }
+            }
+        } else {
+            bool cleared = rule.hasClear ? isTrue(evaluate(rule, rule.clear))
+                                         : !isTrue(evaluate(rule, rule.when));
+            if (cleared) {
+                rule.active = false;
+                rule.pending = false;
+                transition = -1;
+            }
+        }
+
+        uint32_t cycles = ESP.getCycleCount() - start;
+        rule.evaluations++;
+        rule.totalCycles += cycles;
+        if (cycles > rule.maxCycles) {
+            rule.maxCycles = cycles;
+        }
+        sampleCycles += cycles;
+        evaluated = true;
+
+        // Actions and publishing are not part of the evaluation cost
+        if (transition != 0) {
+            dispatch(rule, transition > 0, value, source);
+        }
+    }
+
+    if (evaluated) {
+        _samples++;
+        _totalCycles += sampleCycles;
+        if (sampleCycles > _maxCycles) {
+            _maxCycles = sampleCycles;
+        }
+    }
+}
+
+// Number of loaded rules
+int RuleEngine::ruleCount() const {
+    int count = 0;
+    for (int i = 0; i < RULE_MAX_RULES; i++) {
+        if (_rules[i].used) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// Information about the index-th loaded rule
+bool RuleEngine::getRuleInfo(int index, RuleInfo& info) const {
+    for (int i = 0; i < RULE_MAX_RULES; i++) {
+        const Rule& rule = _rules[i];
+        if (!rule.used || index-- > 0) {
+            continue;
+        }
+
+        info.id = rule.id;
+        info.active = rule.active;
+        info.fireCount = rule.fireCount;
+        info.evaluations = rule.evaluations;
+        info.avgCycles = rule.evaluations ? (uint32_t)(rule.totalCycles / rule.evaluations) : 0;
+        info.maxCycles = rule.maxCycles;
+        return true;
+    }
+    return false;
+}
+
+RuleEngine::Rule* RuleEngine::findRule(const char* id) {
+    for (int i = 0; i < RULE_MAX_RULES; i++) {
+        if (_rules[i].used && strcmp(_rules[i].id, id) == 0) {
+            return &_rules[i];
+        }
+    }
+    return nullptr;
+}
+
+// Notify the event handler and run the local action
+void RuleEngine::dispatch(Rule& rule, bool active, float value, int source) {
+    RuleEvent event = {rule.id, &rule.action, active, value, source};
+
+    if (_eventHandler) {
+        _eventHandler(event);
+    }
+
+    if (rule.action.type[0] == '\0') {
+        return;
+    }
+    for (int i = 0; i < _actionCount; i++) {
+        if (strcmp(_actions[i].type, rule.action.type) == 0) {
+            _actions[i].handler(event);
+            return;
+        }
+    }
+}
+
+// Clear an active rule that is about to be removed or replaced, so its
+// action returns to rest and the event stream sees the clear
+void RuleEngine::release(Rule& rule) {
+    if (!rule.used || !rule.active) {
+        return;
+    }
+
+    int source = 0;
+    while (source < RULE_MAX_SOURCES - 1 && !(rule.sourceMask & (1 << source))) {
+        source++;
+    }
+    rule.active = false;
+    rule.pending = false;
+    dispatch(rule, false, _sources[source].value, source);
+}
+
+// Stack machine over the compiled instructions
+float RuleEngine::evaluate(const Rule& rule, const Expression& expr) const {
+    float stack[RULE_MAX_STACK];
+    int sp = 0;
+
+    for (int i = 0; i < expr.length; i++) {
+        const Instruction& in = expr.code[i];
+        switch (in.op) {
+            case OP_CONST:
+                stack[sp++] = in.value;
+                break;
+            case OP_VAR:
+                stack[sp++] = _sources[in.arg].value;
+                break;
+            case OP_RATE: {
+                const SourceState& state = _sources[in.arg];
+                uint32_t elapsedUs = state.timestampUs - state.previousUs;
+                stack[sp++] = (state.count >= 2 && elapsedUs > 0)
+                    ? (state.value - state.previous) * 1000000.0f / elapsedUs : 0.0f;
+                break;
+            }
+            case OP_AVG:
+            case OP_MIN:
+            case OP_MAX: {
+                const Window& window = rule.windows[in.arg];
+                if (window.count == 0) {
+                    stack[sp++] = NAN;
+                    break;
+                }
+                float result = in.op == OP_AVG ? 0.0f : window.values[0];
+                for (int k = 0; k < window.count; k++) {
+                    float x = window.values[k];
+                    if (in.op == OP_AVG) {
+                        result += x;
+                    } else if (in.op == OP_MIN ? x < result : x > result) {
+                        result = x;
+                    }
+                }
+                stack[sp++] = in.op == OP_AVG ? result / window.count : result;
+                break;
+            }
+            case OP_NEG:
+                stack[sp - 1] = -stack[sp - 1];
+                break;
+            case OP_ABS:
+                stack[sp - 1] = fabsf(stack[sp - 1]);
+                break;
+            case OP_NOT:
+                stack[sp - 1] = isTrue(stack[sp - 1]) ? 0.0f : 1.0f;
+                break;
+            default: {
+                // Binary operators
+                float b = stack[--sp];
+                float a = stack[sp - 1];
+                float r;
+                switch (in.op) {
+                    case OP_ADD: r = a + b; break;
+                    case OP_SUB: r = a - b; break;
+                    case OP_MUL: r = a * b; break;
+                    case OP_DIV: r = b != 0.0f ? a / b : NAN; break;
+                    case OP_GT: r = a > b; break;
+                    case OP_LT: r = a < b; break;
+                    case OP_GE: r = a >= b; break;
+                    case OP_LE: r = a <= b; break;
+                    case OP_EQ: r = a == b; break;
+                    case OP_NE: r = a != b; break;
+                    case OP_AND: r = isTrue(a) && isTrue(b); break;
+                    case OP_OR: r = isTrue(a) || isTrue(b); break;
+                    default: r = NAN; break;
+                }
+                stack[sp - 1] = r;
+                break;
+            }
+        }
+    }
+
+    return sp > 0 ? stack[sp - 1] : NAN;
+}
+
+// Compile an expression into instructions
+bool RuleEngine::compile(const char* text, Rule& rule, Expression& out) {
+    Compiler c = {text, &rule, &out, 0, 0};
+    out.length = 0;
+
+    if (!parseOr(c)) {
+        return false;
+    }
+    skipSpace(c);
+    if (*c.text != '\0') {
+        return fail(c, "unexpected characters");
+    }
+    return true;
+}
+
+bool RuleEngine::fail(Compiler& c, const char* message) {
+    _error = message;
+    return false;
+}
+
+void RuleEngine::skipSpace(Compiler& c) {
+    while (*c.text == ' ' || *c.text == '\t') {
+        c.text++;
+    }
+}
+
+bool RuleEngine::emit(Compiler& c, Op op, uint8_t arg, float value) {
+    if (c.out->length >= RULE_MAX_OPS) {
+        return fail(c, "expression too long");
+    }
+
+    // Track the stack depth the expression will need
+    if (op <= OP_MAX) {
+        c.depth++;
+    } else if (op != OP_NEG && op != OP_ABS && op != OP_NOT) {
+        c.depth--;
+    }
+    if (c.depth > RULE_MAX_STACK) {
+        return fail(c, "expression too deep");
+    }
+
+    c.out->code[c.out->length++] = {op, arg, value};
+    return true;
+}
+
+bool RuleEngine::parseOr(Compiler& c) {
+    if (!parseAnd(c)) {
+        return false;
+    }
+    for (;;) {
+        skipSpace(c);
+        if (strncmp(c.text, "||", 2) != 0) {
+            return true;
+        }
+        c.text += 2;
+        if (!parseAnd(c) || !emit(c, OP_OR)) {
+            return false;
+        }
+    }
+}
+
+bool RuleEngine::parseAnd(Compiler& c) {
+    if (!parseComparison(c)) {
+        return false;
+    }
+    for (;;) {
+        skipSpace(c);
+        if (strncmp(c.text, "&&", 2) != 0) {
+            return true;
+        }
+        c.text += 2;
+        if (!parseComparison(c) || !emit(c, OP_AND)) {
+            return false;
+        }
+    }
+}
+
+bool RuleEngine::parseComparison(Compiler& c) {
+    static const struct {
+        const char* token;
+        Op op;
+    } comparisons[] = {
+        {">=", OP_GE}, {"<=", OP_LE}, {"==", OP_EQ}, {"!=", OP_NE}, {">", OP_GT}, {"<", OP_LT}
+    };
+
+    if (!parseAdditive(c)) {
+        return false;
+    }
+
+    skipSpace(c);
+    for (const auto& comparison : comparisons) {
+        size_t length = strlen(comparison.token);
+        if (strncmp(c.text, comparison.token, length) == 0) {
+            c.text += length;
+            return parseAdditive(c) && emit(c, comparison.op);
+        }
+    }
+    return true;
+}
+
+bool RuleEngine::parseAdditive(Compiler& c) {
+    if (!parseTerm(c)) {
+        return false;
+    }
+    for (;;) {
+        skipSpace(c);
+        char symbol = *c.text;
+        if (symbol != '+' && symbol != '-') {
+            return true;
+        }
+        c.text++;
+        if (!parseTerm(c) || !emit(c, symbol == '+' ? OP_ADD : OP_SUB)) {
+            return false;
+        }
+    }
+}
+
+bool RuleEngine::parseTerm(Compiler& c) {
+    if (!parseUnary(c)) {
+        return false;
+    }
+    for (;;) {
+        skipSpace(c);
+        char symbol = *c.text;
+        if (symbol != '*' && symbol != '/') {
+            return true;
+        }
+        c.text++;
+        if (!parseUnary(c) || !emit(c, symbol == '*' ? OP_MUL : OP_DIV)) {
+            return false;
+        }
+    }
+}
+
+// Every nested '(', call argument and prefix operator passes through here,
+// so the nesting count bounds the compiler's recursion
+bool RuleEngine::parseUnary(Compiler& c) {
+    if (c.nesting >= RULE_MAX_NESTING) {
+        return fail(c, "expression too deeply nested");
+    }
+    c.nesting++;
+
+    bool ok;
+    skipSpace(c);
+    if (*c.text == '-') {
+        c.text++;
+        ok = parseUnary(c) && emit(c, OP_NEG);
+    } else if (*c.text == '!' && c.text[1] != '=') {
+        c.text++;
+        ok = parseUnary(c) && emit(c, OP_NOT);
+    } else {
+        ok = parsePrimary(c);
+    }
+
+    c.nesting--;
+    return ok;
+}
+
+bool RuleEngine::parsePrimary(Compiler& c) {
+    skipSpace(c);
+
+    if (*c.text == '(') {
+        c.text++;
+        if (!parseOr(c)) {
+            return false;
+        }
+        skipSpace(c);
+        if (*c.text != ')') {
+            return fail(c, "missing ')'");
+        }
+        c.text++;
+        return true;
+    }
+
+    if (isdigit(*c.text) || *c.text == '.') {
+        char* end;
+        float value = strtof(c.text, &end);
+        c.text = end;
+        return emit(c, OP_CONST, 0, value);
+    }
+
+    // Function call or sensor name
+    const char* start = c.text;
+    while (isalnum(*c.text) || *c.text == '_') {
+        c.text++;
+    }
+    if (c.text == start) {
+        return fail(c, "expected a value");
+    }
+
+    const char* afterName = c.text;
+    skipSpace(c);
+    if (*c.text == '(') {
+        char name[8];
+        strlcpy(name, start, min((size_t)(afterName - start + 1), sizeof(name)));
+        c.text++;
+        return parseFunction(c, name);
+    }
+
+    c.text = start;
+    int source = parseSource(c);
+    return source >= 0 && emit(c, OP_VAR, source);
+}
+
+bool RuleEngine::parseFunction(Compiler& c, const char* name) {
+    if (strcmp(name, "abs") == 0) {
+        if (!parseOr(c)) {
+            return false;
+        }
+        skipSpace(c);
+        if (*c.text != ')') {
+            return fail(c, "missing ')'");
+        }
+        c.text++;
+        return emit(c, OP_ABS);
+    }
+
+    Op op;
+    if (strcmp(name, "rate") == 0) {
+        op = OP_RATE;
+    } else if (strcmp(name, "avg") == 0) {
+        op = OP_AVG;
+    } else if (strcmp(name, "min") == 0) {
+        op = OP_MIN;
+    } else if (strcmp(name, "max") == 0) {
+        op = OP_MAX;
+    } else {
+        return fail(c, "unknown function");
+    }
+
+    int source = parseSource(c);
+    if (source < 0) {
+        return false;
+    }
+    skipSpace(c);
+
+    if (op == OP_RATE) {
+        if (*c.text != ')') {
+            return fail(c, "rate() takes one sensor");
+        }
+        c.text++;
+        return emit(c, OP_RATE, source);
+    }
+
+    // Window size in samples
+    if (*c.text != ',') {
+        return fail(c, "window size missing");
+    }
+    c.text++;
+    char* end;
+    long size = strtol(c.text, &end, 10);
+    c.text = end;
+    skipSpace(c);
+    if (size < 1 || size > RULE_WINDOW_MAX || *c.text != ')') {
+        return fail(c, "invalid window size");
+    }
+    c.text++;
+
+    // Windows over the same sensor and size are shared within a rule
+    Rule& rule = *c.rule;
+    int slot = -1;
+    for (int i = 0; i < rule.windowCount; i++) {
+        if (rule.windows[i].source == source && rule.windows[i].size == size) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        if (rule.windowCount >= RULE_MAX_WINDOWS) {
+            return fail(c, "too many windows");
+        }
+        slot = rule.windowCount++;
+        rule.windows[slot].source = source;
+        rule.windows[slot].size = size;
+        rule.windows[slot].count = 0;
+        rule.windows[slot].head = 0;
+    }
+
+    return emit(c, op, slot);
+}
+
+// Sensor name to source index
+int RuleEngine::parseSource(Compiler& c) {
+    skipSpace(c);
+    char name[32];
+    size_t length = 0;
+    while ((isalnum(*c.text) || *c.text == '_') && length < sizeof(name) - 1) {
+        name[length++] = *c.text++;
+    }
+    name[length] = '\0';
+
+    int source = (length > 0 && _resolver) ? _resolver(name) : -1;
+    if (source < 0 || source >= RULE_MAX_SOURCES) {
+        fail(c, "unknown sensor");
+        return -1;
+    }
+
+    c.rule->sourceMask |= 1 << source;
+    return source;
+}
@@ -0,0 +1,398 @@
+#include "Scheduler.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::App
+#define LOG_MODULE_LEVEL LOG_LEVEL_APP
+
+// Wheel levels are addressed as level * SCHEDULER_WHEEL_SIZE + slot
+#define WHEEL_MASK (SCHEDULER_WHEEL_SIZE - 1)
+#define WHEEL_SPAN(level) (1UL << (SCHEDULER_WHEEL_BITS * (level)))
+
+// Constructor
+Scheduler::Scheduler() :
+    _now(millis()),
+    _pendingCount(0),
+    _firing(-1),
+    _owner(nullptr) {
+
+    for (int i = 0; i < SCHEDULER_WHEEL_LEVELS * SCHEDULER_WHEEL_SIZE; i++) {
+        _wheel[i] = -1;
+    }
+
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        _tasks[i].active = false;
+        _tasks[i].bucket = -1;
+        _tasks[i].generation = 0;
+        _tasks[i].next = -1;
+        _tasks[i].prev = -1;
+    }
+}
+
+// Add a periodic task
+int Scheduler::addPeriodic(const char* name, unsigned long intervalMs, TaskCallback callback,
+                           unsigned long firstDelayMs) {
+    if (intervalMs == 0) {
+        intervalMs = 1;
+    }
+    return addTask(name, intervalMs, firstDelayMs, callback);
+}
+
+// Add a one-shot task
+int Scheduler::addOneShot(const char* name, unsigned long delayMs, TaskCallback callback) {
+    return addTask(name, 0, delayMs, callback);
+}
+
+int Scheduler::addTask(const char* name, unsigned long intervalMs, unsigned long delayMs, TaskCallback callback) {
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        Task& task = _tasks[i];
+        if (task.active || task.bucket != -1 || i == _firing) {
+            continue;
+        }
+
+        task.callback = callback;
+        task.name = name;
+        task.interval = intervalMs;
+        task.deadline = millis() + delayMs;
+        task.generation++;
+        task.active = true;
+
+        memset(&task.stats, 0, sizeof(task.stats));
+        task.stats.name = name;
+        task.stats.interval = intervalMs;
+
+        link(i);
+        return i | (task.generation << 8);
+    }
+
+    LOG_E("Scheduler: no free task slot for %s", name);
+    return -1;
+}
+
+// Cancel a task
+bool Scheduler::cancel(int taskId) {
+    int slot = slotFromId(taskId);
+    if (slot < 0) {
+        return false;
+    }
+
+    if (_tasks[slot].bucket != -1) {
+        unlink(slot);
+    }
+    _tasks[slot].active = false;
+    return true;
+}
+
+// Move the next deadline of a task
+bool Scheduler::reschedule(int taskId, unsigned long delayMs) {
+    int slot = slotFromId(taskId);
+    if (slot < 0) {
+        return false;
+    }
+
+    if (_tasks[slot].bucket != -1) {
+        unlink(slot);
+    }
+    _tasks[slot].deadline = millis() + delayMs;
+    link(slot);
+    return true;
+}
+
+// Change the period of a periodic task
+bool Scheduler::setInterval(int taskId, unsigned long intervalMs) {
+    int slot = slotFromId(taskId);
+    if (slot < 0 || _tasks[slot].interval == 0 || intervalMs == 0) {
+        return false;
+    }
+
+    _tasks[slot].interval = intervalMs;
+    _tasks[slot].stats.interval = intervalMs;
+    return true;
+}
+
+// Run all due tasks without sleeping
+void Scheduler::runPending() {
+    advanceTo(millis());
+}
+
+// Run due tasks, then sleep until the next deadline
+void Scheduler::run(unsigned long maxSleepMs) {
+    if (_owner == nullptr) {
+        _owner = xTaskGetCurrentTaskHandle();
+    }
+
+    runPending();
+
+    unsigned long wait = timeUntilNextDeadline(maxSleepMs);
+    if (wait > 0) {
+        // Blocks the task (no busy-spin); notify() ends the wait early
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    }
+}
+
+// Wake the owning task from another task
+void Scheduler::notify() {
+    if (_owner != nullptr) {
+        xTaskNotifyGive(_owner);
+    }
+}
+
+// Wake the owning task from an interrupt
+void Scheduler::notifyFromISR() {
+    if (_owner != nullptr) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(_owner, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+// Milliseconds until the next deadline
+unsigned long Scheduler::timeUntilNextDeadline(unsigned long maxMs) const {
+    if (_pendingCount == 0) {
+        return maxMs;
+    }
+
+    // Level 0 holds exact ticks; higher levels only tell us when they cascade,
+    // which is the earliest moment one of their tasks can become due
+    bool found = false;
+    uint32_t next = 0;
+
+    for (uint32_t i = 1; i <= SCHEDULER_WHEEL_SIZE; i++) {
+        if (_wheel[(_now + i) & WHEEL_MASK] != -1) {
+            next = _now + i;
+            found = true;
+            break;
+        }
+    }
+
+    for (int level = 1; level < SCHEDULER_WHEEL_LEVELS; level++) {
+        uint32_t base = _now >> (SCHEDULER_WHEEL_BITS * level);
+        for (uint32_t j = 1; j <= SCHEDULER_WHEEL_SIZE; j++) {
+            if (_wheel[level * SCHEDULER_WHEEL_SIZE + ((base + j) & WHEEL_MASK)] != -1) {
+                uint32_t cascadeAt = (base + j) << (SCHEDULER_WHEEL_BITS * level);
+                if (!found || (int32_t)(cascadeAt - next) < 0) {
+                    next = cascadeAt;
+                    found = true;
+                }
+                break;
+            }
+        }
+    }
+
+    if (!found) {
+        return maxMs;
+    }
+
+    int32_t wait = (int32_t)(next - millis());
+    if (wait <= 0) {
+        return 0;
+    }
+    return ((unsigned long)wait < maxMs) ? (unsigned long)wait : maxMs;
+}
+
+// Get statistics of a task
+bool Scheduler::getStats(int taskId, TaskStats& stats) const {
+    int slot = slotFromId(taskId);
+    if (slot < 0) {
+        return false;
+    }
+
+    stats = _tasks[slot].stats;
+    return true;
+}
+
+// Collect ids of active tasks
+int Scheduler::taskIds(int* ids, int maxIds) const {
+    int count = 0;
+    for (int i = 0; i < SCHEDULER_MAX_TASKS && count < maxIds; i++) {
+        if (_tasks[i].active) {
+            ids[count++] = i | (_tasks[i].generation << 8);
+        }
+    }
+    return count;
+}
+
+// Print statistics of all tasks
+void Scheduler::printStats(Print& out) const {
+    out.println("=== Scheduler Tasks ===");
+    for (int i = 0; i < SCHEDULER_MAX_TASKS; i++) {
+        if (!_tasks[i].active) {
+            continue;
+        }
+
+        const TaskStats& stats = _tasks[i].stats;
+        uint32_t avgUs = stats.runCount ? (uint32_t)(stats.totalRunUs / stats.runCount) : 0;
+        out.printf("%-12s every %6lu ms  runs %7u  avg %6u us  max %6u us  late %5u ms  missed %u\n",
+                   stats.name, stats.interval, stats.runCount, avgUs, stats.maxRunUs,
+                   stats.maxLatenessMs, stats.missedDeadlines);
+    }
+    out.println("=======================");
+}
+
+int Scheduler::slotFromId(int taskId) const {
+    if (taskId < 0) {
+        return -1;
+    }
+
+    int slot = taskId & 0xFF;
+    if (slot >= SCHEDULER_MAX_TASKS) {
+        return -1;
+    }
+
+    const Task& task = _tasks[slot];
+    if (!task.active || task.generation != ((taskId >> 8) & 0xFF)) {
+        return -1;
+    }
+    return slot;
+}
+
+// Insert a task into the wheel bucket matching its deadline
+void Scheduler::link(int slot, bool allowCurrentTick) {
+    Task& task = _tasks[slot];
+
+    // Overdue tasks go into the next tick; a cascade may still hit the current one
+    uint32_t deadline = task.deadline;
+    int32_t delta = (int32_t)(deadline - _now);
+    if (delta < 0 || (delta == 0 && !allowCurrentTick)) {
+        deadline = _now + 1;
+        delta = 1;
+    }
+
+    int level = 0;
+    while (level < SCHEDULER_WHEEL_LEVELS - 1 && (uint32_t)delta >= WHEEL_SPAN(level + 1)) {
+        level++;
+    }
+    if ((uint32_t)delta >= WHEEL_SPAN(SCHEDULER_WHEEL_LEVELS)) {
+        // Beyond the wheel range: park in the top level and re-cascade later
+        deadline = _now + WHEEL_SPAN(SCHEDULER_WHEEL_LEVELS) - 1;
+    }
+
+    int bucket = level * SCHEDULER_WHEEL_SIZE +
+                 ((deadline >> (SCHEDULER_WHEEL_BITS * level)) & WHEEL_MASK);
+
+    task.bucket = bucket;
+    task.prev = -1;
+    task.next = _wheel[bucket];
+    if (task.next != -1) {
+        _tasks[task.next].prev = slot;
+    }
+    _wheel[bucket] = slot;
+    _pendingCount++;
+}
+
+// Remove a task from its wheel bucket
+void Scheduler::unlink(int slot) {
+    Task& task = _tasks[slot];
+
+    if (task.prev != -1) {
+        _tasks[task.prev].next = task.next;
+    } else {
+        _wheel[task.bucket] = task.next;
+    }
+    if (task.next != -1) {
+        _tasks[task.next].prev = task.prev;
+    }
+
+    task.bucket = -1;
+    task.next = -1;
+    task.prev = -1;
+    _pendingCount--;
+}
+
+// Redistribute the current bucket of a higher level into lower levels
+void Scheduler::cascade(int level) {
+    int bucket = level * SCHEDULER_WHEEL_SIZE +
+                 ((_now >> (SCHEDULER_WHEEL_BITS * level)) & WHEEL_MASK);
+
+    int slot = _wheel[bucket];
+    while (slot != -1) {
+        int next = _tasks[slot].next;
+        unlink(slot);
+        link(slot, true);
+        slot = next;
+    }
+}
+
+// Advance the wheel tick by tick, firing every expired task in deadline order
+void Scheduler::advanceTo(uint32_t target) {
+    if (_pendingCount == 0) {
+        _now = target;
+        return;
+    }
+
+    while ((int32_t)(target - _now) > 0) {
+        _now++;
+
+        if ((_now & WHEEL_MASK) == 0) {
+            for (int level = 1; level < SCHEDULER_WHEEL_LEVELS; level++) {
+                cascade(level);
+                if (((_now >> (SCHEDULER_WHEEL_BITS * level)) & WHEEL_MASK) != 0) {
+                    break;
+                }
+            }
+        }
+
+        int bucket = _now & WHEEL_MASK;
+        while (_wheel[bucket] != -1) {
+            int slot = _wheel[bucket];
+            unlink(slot);
+            fire(slot);
+        }
+
+        if (_pendingCount == 0) {
+            _now = target;
+            return;
+        }
+    }
+}
+
+// Run a single task and requeue it if periodic
+void Scheduler::fire(int slot) {
+    Task& task = _tasks[slot];
+    if (!task.active) {
+        return;
+    }
+
+    uint32_t lateness = millis() - task.deadline;
+    if (lateness > task.stats.maxLatenessMs) {
+        task.stats.maxLatenessMs = lateness;
+    }
+    if (task.interval == 0 && lateness > SCHEDULER_DEADLINE_SLACK_MS) {
+        task.stats.missedDeadlines++;
+    }
+
+    _firing = slot;
+    uint32_t start = micros();
+    task.callback();
+    uint32_t elapsed = micros() - start;
+    _firing = -1;
+
+    task.stats.runCount++;
+    task.stats.lastRunUs = elapsed;
+    task.stats.totalRunUs += elapsed;
+    if (elapsed > task.stats.maxRunUs) {
+        task.stats.maxRunUs = elapsed;
+    }
+
+    // The callback may have cancelled or rescheduled this task itself
+    if (!task.active || task.bucket != -1) {
+        return;
+    }
+
+    if (task.interval == 0) {
+        task.active = false;
+        return;
+    }
+
+    // Fixed-rate schedule; whole periods that already passed count as missed
+    uint32_t next = task.deadline + task.interval;
+    uint32_t now = millis();
+    if ((int32_t)(next - now) <= 0) {
+        uint32_t skipped = (now - task.deadline) / task.interval;
+        task.stats.missedDeadlines += skipped;
+        next = task.deadline + (skipped + 1) * task.interval;
+    }
+    task.deadline = next;
+    link(slot);
+}
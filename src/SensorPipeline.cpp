@@ -0,0 +1,318 @@
+#include "SensorPipeline.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Device
+#define LOG_MODULE_LEVEL LOG_LEVEL_DEVICE
+
+// Analog sensor constructor
+AnalogSensorSource::AnalogSensorSource(const char* name, int pin, float scale, float offset) :
+    _name(name),
+    _pin(pin),
+    _scale(scale),
+    _offset(offset) {
+    pinMode(_pin, INPUT);
+}
+
+// Read the ADC pin
+float AnalogSensorSource::read() {
+    return analogRead(_pin) * _scale + _offset;
+}
+
+// Function sensor constructor
+FunctionSensorSource::FunctionSensorSource(const char* name, std::function<float()> reader) :
+    _name(name),
+    _reader(reader) {
+}
+
+// P-square quantile estimator
+P2Quantile::P2Quantile(float quantile) : _p(quantile) {
+    reset();
+}
+
+void P2Quantile::reset() {
+    _count = 0;
+    for (int i = 0; i < 5; i++) {
+        _heights[i] = 0.0f;
+        _positions[i] = i + 1;
+    }
+
+    _desired[0] = 1.0f;
+    _desired[1] = 1.0f + 2.0f * _p;
+    _desired[2] = 1.0f + 4.0f * _p;
+    _desired[3] = 3.0f + 2.0f * _p;
+    _desired[4] = 5.0f;
+
+    _increments[0] = 0.0f;
+    _increments[1] = _p / 2.0f;
+    _increments[2] = _p;
+    _increments[3] = (1.0f + _p) / 2.0f;
+    _increments[4] = 1.0f;
+}
+
+void P2Quantile::add(float x) {
+    // The first five observations seed the markers
+    if (_count < 5) {
+        int i = _count++;
+        while (i > 0 && _heights[i - 1] > x) {
+            _heights[i] = _heights[i - 1];
+            i--;
+        }
+        _heights[i] = x;
+        return;
+    }
+
+    // Find the cell containing x and widen the extremes if needed
+    int k;
+    if (x < _heights[0]) {
+        _heights[0] = x;
+        k = 0;
+    } else if (x >= _heights[4]) {
+        _heights[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (k < 3 && x >= _heights[k + 1]) {
+            k++;
+        }
+    }
+
+    for (int i = k + 1; i < 5; i++) {
+        _positions[i] += 1.0f;
+    }
+    for (int i = 0; i < 5; i++) {
+        _desired[i] += _increments[i];
+    }
+    _count++;
+
+    // Move the three middle markers towards their desired positions
+    for (int i = 1; i < 4; i++) {
+        float d = _desired[i] - _positions[i];
+        if ((d >= 1.0f && _positions[i + 1] - _positions[i] > 1.0f) ||
+            (d <= -1.0f && _positions[i - 1] - _positions[i] < -1.0f)) {
+            int step = d > 0 ? 1 : -1;
+            float candidate = parabolic(i, step);
+            if (_heights[i - 1] < candidate && candidate < _heights[i + 1]) {
+                _heights[i] = candidate;
+            } else {
+                _heights[i] = linear(i, step);
+            }
+            _positions[i] += step;
+        }
+    }
+}
+
+float P2Quantile::parabolic(int i, float d) const {
+    return _heights[i] + d / (_positions[i + 1] - _positions[i - 1]) *
+        ((_positions[i] - _positions[i - 1] + d) * (_heights[i + 1] - _heights[i]) /
+             (_positions[i + 1] - _positions[i]) +
+         (_positions[i + 1] - _positions[i] - d) * (_heights[i] - _heights[i - 1]) /
+             (_positions[i] - _positions[i - 1]));
+}
+
+float P2Quantile::linear(int i, int d) const {
+    return _heights[i] + d * (_heights[i + d] - _heights[i]) / (_positions[i + d] - _positions[i]);
+}
+
+float P2Quantile::value() const {
+    if (_count == 0) {
+        return 0.0f;
+    }
+    if (_count < 5) {
+        // Exact quantile of the (sorted) seed observations
+        int index = (int)(_p * (_count - 1) + 0.5f);
+        return _heights[index];
+    }
+    return _heights[2];
+}
+
+// Windowed statistics
+StreamingStats::StreamingStats() :
+    _p50(0.5f),
+    _p90(0.9f),
+    _p99(0.99f) {
+    reset();
+}
+
+void StreamingStats::add(float x) {
+    _count++;
+    if (_count == 1 || x < _min) {
+        _min = x;
+    }
+    if (_count == 1 || x > _max) {
+        _max = x;
+    }
+
+    double delta = x - _mean;
+    _mean += delta / _count;
+    _m2 += delta * (x - _mean);
+
+    _p50.add(x);
+    _p90.add(x);
+    _p99.add(x);
+}
+
+void StreamingStats::reset() {
+    _count = 0;
+    _min = 0.0f;
+    _max = 0.0f;
+    _mean = 0.0;
+    _m2 = 0.0;
+    _p50.reset();
+    _p90.reset();
+    _p99.reset();
+}
+
+float StreamingStats::stddev() const {
+    return _count > 1 ? sqrt(_m2 / (_count - 1)) : 0.0f;
+}
+
+// Sampler constructor
+Sampler::Sampler() :
+    _sourceCount(0),
+    _periodUs(0),
+    _tick(0),
+    _lastTickUs(0),
+    _maxJitterUs(0),
+    _timer(nullptr),
+    _task(nullptr) {
+}
+
+// Destructor
+Sampler::~Sampler() {
+    end();
+}
+
+// Add a sensor source
+int Sampler::addSource(SensorSource* source, float rateHz) {
+    if (isRunning() || source == nullptr || _sourceCount >= SAMPLER_MAX_SOURCES) {
+        return -1;
+    }
+
+    if (rateHz <= 0.0f) {
+        rateHz = 1.0f;
+    } else if (rateHz > SAMPLER_MAX_RATE_HZ) {
+        rateHz = SAMPLER_MAX_RATE_HZ;
+    }
+
+    _sources[_sourceCount] = source;
+    _rates[_sourceCount] = rateHz;
+    return _sourceCount++;
+}
+
+// Start sampling
+bool Sampler::begin() {
+    if (isRunning() || _sourceCount == 0) {
+        return isRunning();
+    }
+
+    // The fastest source sets the timer period; slower ones sample every Nth tick
+    float baseRate = 0.0f;
+    for (int i = 0; i < _sourceCount; i++) {
+        baseRate = max(baseRate, _rates[i]);
+    }
+    _periodUs = (uint32_t)(1000000.0f / baseRate);
+
+    for (int i = 0; i < _sourceCount; i++) {
+        uint32_t divider = (uint32_t)(baseRate / _rates[i] + 0.5f);
+        _dividers[i] = divider < 1 ? 1 : (divider > 0xFFFF ? 0xFFFF : divider);
+        _rates[i] = baseRate / _dividers[i];
+    }
+
+    if (xTaskCreatePinnedToCore(taskEntry, "sampler", SAMPLER_TASK_STACK, this,
+                                SAMPLER_TASK_PRIORITY, &_task, SAMPLER_TASK_CORE) != pdPASS) {
+        LOG_E("Sampler: failed to create task");
+        _task = nullptr;
+        return false;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = timerCallback;
+    args.arg = this;
+    args.name = "sampler";
+
+    if (esp_timer_create(&args, &_timer) != ESP_OK) {
+        LOG_E("Sampler: failed to create timer");
+        _timer = nullptr;
+        end();
+        return false;
+    }
+
+    _tick = 0;
+    _lastTickUs = 0;
+    _maxJitterUs = 0;
+    esp_timer_start_periodic(_timer, _periodUs);
+
+    LOG_I("Sampler: %d sources, base rate %.1f Hz", _sourceCount, baseRate);
+    return true;
+}
+
+// Stop sampling
+void Sampler::end() {
+    if (_timer != nullptr) {
+        esp_timer_stop(_timer);
+        esp_timer_delete(_timer);
+        _timer = nullptr;
+    }
+    if (_task != nullptr) {
+        vTaskDelete(_task);
+        _task = nullptr;
+    }
+}
+
+// Take the next buffered sample
+bool Sampler::read(Sample& sample) {
+    return _queue.pop(sample);
+}
+
+SensorSource* Sampler::source(int index) const {
+    return (index >= 0 && index < _sourceCount) ? _sources[index] : nullptr;
+}
+
+float Sampler::rate(int index) const {
+    return (index >= 0 && index < _sourceCount) ? _rates[index] : 0.0f;
+}
+
+// esp_timer callback: only wakes the sampler task, the reads happen there
+void Sampler::timerCallback(void* arg) {
+    Sampler* sampler = static_cast<Sampler*>(arg);
+    if (sampler->_task != nullptr) {
+        xTaskNotifyGive(sampler->_task);
+    }
+}
+
+void Sampler::taskEntry(void* arg) {
+    Sampler* sampler = static_cast<Sampler*>(arg);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        sampler->sampleDue();
+    }
+}
+
+// Read every source that is due on this tick
+void Sampler::sampleDue() {
+    int64_t now = esp_timer_get_time();
+    if (_lastTickUs != 0) {
+        int64_t deviation = (now - _lastTickUs) - (int64_t)_periodUs;
+        uint32_t jitter = (uint32_t)(deviation < 0 ? -deviation : deviation);
+        if (jitter > _maxJitterUs) {
+            _maxJitterUs = jitter;
+        }
+    }
+    _lastTickUs = now;
+
+    for (int i = 0; i < _sourceCount; i++) {
+        if (_tick % _dividers[i] != 0) {
+            continue;
+        }
+
+        Sample* sample = _queue.reserve();
+        if (sample == nullptr) {
+            continue;
+        }
+        sample->timestampUs = (uint32_t)now;
+        sample->source = i;
+        sample->value = _sources[i]->read();
+        _queue.commit();
+    }
+    _tick++;
+}
@@ -0,0 +1,562 @@
+#include "TimeSeriesStore.h"
+#include <time.h>
+#include <esp_heap_caps.h>
+#include "Log.h"
+
+#define LOG_MODULE LogModule::Storage
+#define LOG_MODULE_LEVEL LOG_LEVEL_STORAGE
+
+// Marks a block that holds data
+#define HISTORY_BLOCK_MAGIC 0x5453
+
+// Worst-case size of one encoded point: '1111' + 32-bit delta-of-delta,
+// '11' + 5-bit leading zeros + 5-bit length + 32 significant bits
+#define HISTORY_MAX_POINT_BITS (4 + 32 + 2 + 5 + 5 + 32)
+
+// Leading/trailing window not set yet
+#define HISTORY_NO_WINDOW 0xFF
+
+static uint32_t hashName(const char* name) {
+    uint32_t hash = 2166136261UL;
+    while (*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619UL;
+    }
+    return hash;
+}
+
+static uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsToFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Append count bits of value, most significant first
+static void writeBits(HistoryBlock& block, uint32_t value, int count) {
+    uint16_t pos = block.header.bitCount;
+    for (int i = count - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            block.data[pos >> 3] |= 0x80 >> (pos & 7);
+        }
+        pos++;
+    }
+    block.header.bitCount = pos;
+}
+
+// Sequential decoder of one block
+class BlockReader {
+public:
+    explicit BlockReader(const HistoryBlock& block) :
+        _block(block), _pos(0), _index(0), _timestamp(0), _delta(0), _bits(0),
+        _leading(HISTORY_NO_WINDOW), _trailing(0) {
+    }
+
+    bool next(uint32_t& timestamp, float& value) {
+        if (_index >= _block.header.count) {
+            return false;
+        }
+
+        if (_index == 0) {
+            _timestamp = read(32);
+            _bits = read(32);
+        } else {
+            _delta += readDeltaOfDelta();
+            _timestamp += _delta;
+            readValue();
+        }
+
+        _index++;
+        timestamp = _timestamp;
+        value = bitsToFloat(_bits);
+        return true;
+    }
+
+private:
+    const HistoryBlock& _block;
+    uint16_t _pos;
+    uint16_t _index;
+    uint32_t _timestamp;
+    int32_t _delta;
+    uint32_t _bits;
+    uint8_t _leading;
+    uint8_t _trailing;
+
+    uint32_t read(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++) {
+            value = (value << 1) | ((_block.data[_pos >> 3] >> (7 - (_pos & 7))) & 1);
+            _pos++;
+        }
+        return value;
+    }
+
+    int32_t readDeltaOfDelta() {
+        if (read(1) == 0) {
+            return 0;
+        }
+        if (read(1) == 0) {
+            return (int32_t)read(7) - 63;
+        }
+        if (read(1) == 0) {
+            return (int32_t)read(9) - 255;
+        }
+        if (read(1) == 0) {
+            return (int32_t)read(12) - 2047;
+        }
+        return (int32_t)read(32);
+    }
+
+    void readValue() {
+        if (read(1) == 0) {
+            return;     // unchanged
+        }
+        if (read(1) == 1) {
+            _leading = read(5);
+            _trailing = 32 - _leading - (read(5) + 1);
+        }
+        int meaningful = 32 - _leading - _trailing;
+        _bits ^= read(meaningful) << _trailing;
+    }
+};
+
+// Collects decoded points into raw or bucketed results
+class QueryAggregator {
+public:
+    QueryAggregator(uint32_t from, uint32_t to, uint32_t step, HistoryPoint* out, size_t maxPoints) :
+        _from(from), _to(to), _step(step), _out(out), _maxPoints(maxPoints),
+        _written(0), _full(false), _bucket() {
+    }
+
+    // Returns false once the output is full
+    bool add(uint32_t timestamp, float value) {
+        if (timestamp < _from || timestamp > _to) {
+            return true;
+        }
+
+        if (_step == 0) {
+            HistoryPoint point = {timestamp, value, value, value, 1};
+            return emit(point);
+        }
+
+        uint32_t bucketStart = _from + ((timestamp - _from) / _step) * _step;
+        if (_bucket.count > 0 && bucketStart != _bucket.timestamp) {
+            if (!flush()) {
+                return false;
+            }
+        }
+
+        if (_bucket.count == 0) {
+            _bucket = {bucketStart, 0.0f, value, value, 0};
+        }
+        _bucket.mean += value;      // running sum until flushed
+        _bucket.min = min(_bucket.min, value);
+        _bucket.max = max(_bucket.max, value);
+        _bucket.count++;
+        return true;
+    }
+
+    bool flush() {
+        if (_bucket.count == 0) {
+            return true;
+        }
+        _bucket.mean /= _bucket.count;
+        bool ok = emit(_bucket);
+        _bucket.count = 0;
+        return ok;
+    }
+
+    size_t written() const { return _written; }
+    bool full() const { return _full; }
+
+private:
+    uint32_t _from;
+    uint32_t _to;
+    uint32_t _step;
+    HistoryPoint* _out;
+    size_t _maxPoints;
+    size_t _written;
+    bool _full;
+    HistoryPoint _bucket;
+
+    bool emit(const HistoryPoint& point) {
+        if (_written >= _maxPoints) {
+            _full = true;
+            return false;
+        }
+        _out[_written++] = point;
+        return true;
+    }
+};
+
+// Feed every point of a block to the aggregator
+static bool decodeInto(const HistoryBlock& block, QueryAggregator& aggregator) {
+    BlockReader reader(block);
+    uint32_t timestamp;
+    float value;
+    while (reader.next(timestamp, value)) {
+        if (!aggregator.add(timestamp, value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Constructor
+TimeSeriesStore::TimeSeriesStore() :
+    _blocks(nullptr),
+    _blockCount(0),
+    _nextBlock(0),
+    _sequence(1),
+    _metricCount(0),
+    _partition(nullptr),
+    _flashIndex(nullptr),
+    _flashSlots(0),
+    _flashNext(0),
+    _mutex(nullptr),
+    _points(0),
+    _bitsUsed(0) {
+}
+
+// Destructor
+TimeSeriesStore::~TimeSeriesStore() {
+    heap_caps_free(_blocks);
+    heap_caps_free(_flashIndex);
+    if (_mutex != nullptr) {
+        vSemaphoreDelete(_mutex);
+    }
+}
+
+// Allocate storage
+bool TimeSeriesStore::begin(size_t ramBytes, bool useFlash) {
+    if (_blocks != nullptr) {
+        return true;
+    }
+
+    bool psram = psramFound();
+    uint32_t caps = psram ? (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) : MALLOC_CAP_8BIT;
+    if (ramBytes == 0) {
+        ramBytes = psram ? HISTORY_RAM_BYTES : HISTORY_RAM_BYTES_NO_PSRAM;
+    }
+
+    _blockCount = ramBytes / sizeof(HistoryBlock);
+    _blocks = (HistoryBlock*)heap_caps_calloc(_blockCount, sizeof(HistoryBlock), caps);
+    _mutex = xSemaphoreCreateMutex();
+
+    // Every metric may hold an open block and one more must be free to evict
+    if (_blocks == nullptr || _mutex == nullptr || _blockCount <= HISTORY_MAX_METRICS) {
+        LOG_E("History: failed to allocate block pool");
+        heap_caps_free(_blocks);
+        _blocks = nullptr;
+        _blockCount = 0;
+        if (_mutex != nullptr) {
+            vSemaphoreDelete(_mutex);
+            _mutex = nullptr;
+        }
+        return false;
+    }
+
+    if (useFlash) {
+        _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                              HISTORY_PARTITION_LABEL);
+    }
+    if (_partition != nullptr) {
+        _flashSlots = (_partition->size / SPI_FLASH_SEC_SIZE) * (SPI_FLASH_SEC_SIZE / sizeof(HistoryBlock));
+        _flashIndex = (FlashIndexEntry*)heap_caps_calloc(_flashSlots, sizeof(FlashIndexEntry), caps);
+        if (_flashIndex == nullptr || _flashSlots == 0) {
+            _partition = nullptr;
+            _flashSlots = 0;
+        } else {
+            loadFlashIndex();
+        }
+    }
+
+    LOG_I("History: %u KB in %s, flash ring %u KB", (unsigned)(_blockCount * sizeof(HistoryBlock) / 1024),
+          psram ? "PSRAM" : "RAM", (unsigned)(flashBytes() / 1024));
+    return true;
+}
+
+// Seconds since the epoch once SNTP (started by NetworkTask) has set the
+// clock, uptime before that
+uint32_t TimeSeriesStore::now() {
+    time_t epoch = time(nullptr);
+    return epoch > HISTORY_MIN_EPOCH ? (uint32_t)epoch : millis() / 1000;
+}
+
+// Record a value
+bool TimeSeriesStore::append(const char* metric, uint32_t timestamp, float value) {
+    if (_blocks == nullptr) {
+        return false;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    Metric* m = findMetric(metric, true);
+    if (m == nullptr || (m->openBlock >= 0 && timestamp < m->prevTimestamp)) {
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+
+    // Seal the open block once the next point might not fit, or when the
+    // clock has just been set so no block mixes uptime and epoch time
+    if (m->openBlock >= 0 &&
+        (_blocks[m->openBlock].header.bitCount + HISTORY_MAX_POINT_BITS > (int)(HISTORY_BLOCK_DATA * 8) ||
+         (m->prevTimestamp < HISTORY_MIN_EPOCH && timestamp >= HISTORY_MIN_EPOCH))) {
+        m->openBlock = -1;
+    }
+
+    uint32_t bits = floatBits(value);
+    uint16_t before;
+    HistoryBlock* block;
+
+    if (m->openBlock < 0) {
+        m->openBlock = allocateBlock(*m, timestamp);
+        if (m->openBlock < 0) {
+            xSemaphoreGive(_mutex);
+            return false;
+        }
+        block = &_blocks[m->openBlock];
+        before = block->header.bitCount;
+
+        writeBits(*block, timestamp, 32);
+        writeBits(*block, bits, 32);
+        m->prevDelta = 0;
+        m->leading = HISTORY_NO_WINDOW;
+    } else {
+        block = &_blocks[m->openBlock];
+        before = block->header.bitCount;
+
+        // Timestamp: delta of delta in variable-width buckets
+        int32_t delta = (int32_t)(timestamp - m->prevTimestamp);
+        int32_t dod = delta - m->prevDelta;
+        if (dod == 0) {
+            writeBits(*block, 0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+            writeBits(*block, 0x2, 2);
+            writeBits(*block, dod + 63, 7);
+        } else if (dod >= -255 && dod <= 256) {
+            writeBits(*block, 0x6, 3);
+            writeBits(*block, dod + 255, 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+            writeBits(*block, 0xE, 4);
+            writeBits(*block, dod + 2047, 12);
+        } else {
+            writeBits(*block, 0xF, 4);
+            writeBits(*block, (uint32_t)dod, 32);
+        }
+        m->prevDelta = delta;
+
+        // Value: XOR with the previous value, reusing the last bit window when it fits
+        uint32_t xored = bits ^ m->prevBits;
+        if (xored == 0) {
+            writeBits(*block, 0, 1);
+        } else {
+            uint8_t leading = __builtin_clz(xored);
+            uint8_t trailing = __builtin_ctz(xored);
+
+            if (m->leading != HISTORY_NO_WINDOW && leading >= m->leading && trailing >= m->trailing) {
+                writeBits(*block, 0x2, 2);
+                writeBits(*block, xored >> m->trailing, 32 - m->leading - m->trailing);
+            } else {
+                int meaningful = 32 - leading - trailing;
+                writeBits(*block, 0x3, 2);
+                writeBits(*block, leading, 5);
+                writeBits(*block, meaningful - 1, 5);
+                writeBits(*block, xored >> trailing, meaningful);
+                m->leading = leading;
+                m->trailing = trailing;
+            }
+        }
+    }
+
+    block->header.count++;
+    block->header.lastTimestamp = timestamp;
+    m->prevTimestamp = timestamp;
+    m->prevBits = bits;
+
+    _points++;
+    _bitsUsed += block->header.bitCount - before;
+
+    xSemaphoreGive(_mutex);
+    return true;
+}
+
+// Range query with optional downsampling
+size_t TimeSeriesStore::query(const char* metric, uint32_t from, uint32_t to, uint32_t step,
+                              HistoryPoint* out, size_t maxPoints, bool* truncated) {
+    if (_blocks == nullptr || to < from) {
+        return 0;
+    }
+
+    uint32_t hash = hashName(metric);
+    QueryAggregator aggregator(from, to, step, out, maxPoints);
+    bool more = true;
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    // Flash holds the oldest data; walk its ring from the oldest slot
+    if (_partition != nullptr) {
+        HistoryBlock* scratch = (HistoryBlock*)malloc(sizeof(HistoryBlock));
+        for (int i = 0; scratch != nullptr && more && i < _flashSlots; i++) {
+            int slot = (_flashNext + i) % _flashSlots;
+            const FlashIndexEntry& entry = _flashIndex[slot];
+            if (entry.metricHash != hash || entry.lastTimestamp < from || entry.firstTimestamp > to) {
+                continue;
+            }
+            if (esp_partition_read(_partition, slot * sizeof(HistoryBlock), scratch, sizeof(HistoryBlock)) == ESP_OK) {
+                more = decodeInto(*scratch, aggregator);
+            }
+        }
+        free(scratch);
+    }
+
+    // RAM blocks, oldest first
+    for (int i = 0; more && i < _blockCount; i++) {
+        const HistoryBlock& block = _blocks[(_nextBlock + i) % _blockCount];
+        if (block.header.magic != HISTORY_BLOCK_MAGIC || block.header.metricHash != hash ||
+            block.header.lastTimestamp < from || block.header.firstTimestamp > to) {
+            continue;
+        }
+        more = decodeInto(block, aggregator);
+    }
+
+    xSemaphoreGive(_mutex);
+
+    if (more) {
+        aggregator.flush();
+    }
+    if (truncated != nullptr) {
+        *truncated = aggregator.full();
+    }
+    return aggregator.written();
+}
+
+// Metric name by index
+const char* TimeSeriesStore::metricName(int index) const {
+    return (index >= 0 && index < _metricCount) ? _metrics[index].name : nullptr;
+}
+
+// Average encoded size of a point
+float TimeSeriesStore::bitsPerPoint() const {
+    return _points > 0 ? (float)_bitsUsed / _points : 0.0f;
+}
+
+TimeSeriesStore::Metric* TimeSeriesStore::findMetric(const char* name, bool create) {
+    uint32_t hash = hashName(name);
+    for (int i = 0; i < _metricCount; i++) {
+        if (_metrics[i].hash == hash) {
+            return &_metrics[i];
+        }
+    }
+
+    if (!create || _metricCount >= HISTORY_MAX_METRICS) {
+        return nullptr;
+    }
+
+    Metric& metric = _metrics[_metricCount++];
+    strlcpy(metric.name, name, sizeof(metric.name));
+    metric.hash = hash;
+    metric.openBlock = -1;
+    metric.prevTimestamp = 0;
+    metric.prevDelta = 0;
+    metric.prevBits = 0;
+    metric.leading = HISTORY_NO_WINDOW;
+    metric.trailing = 0;
+    return &metric;
+}
+
+// Take the oldest block that is not being written, spilling it to flash first
+// (uptime-stamped blocks are dropped instead); -1 if every block is open
+int TimeSeriesStore::allocateBlock(Metric& metric, uint32_t timestamp) {
+    int index = -1;
+    for (int tries = 0; tries < _blockCount && index < 0; tries++) {
+        int candidate = _nextBlock;
+        _nextBlock = (_nextBlock + 1) % _blockCount;
+
+        index = candidate;
+        for (int i = 0; i < _metricCount; i++) {
+            if (_metrics[i].openBlock == candidate) {
+                index = -1;
+                break;
+            }
+        }
+    }
+    if (index < 0) {
+        return -1;
+    }
+
+    HistoryBlock& block = _blocks[index];
+    if (block.header.magic == HISTORY_BLOCK_MAGIC && _partition != nullptr &&
+        block.header.firstTimestamp >= HISTORY_MIN_EPOCH) {
+        spillToFlash(block);
+    }
+
+    memset(&block, 0, sizeof(block));
+    block.header.magic = HISTORY_BLOCK_MAGIC;
+    block.header.metricHash = metric.hash;
+    block.header.sequence = _sequence++;
+    block.header.firstTimestamp = timestamp;
+    block.header.lastTimestamp = timestamp;
+    return index;
+}
+
+// Append a sealed block to the flash ring
+void TimeSeriesStore::spillToFlash(const HistoryBlock& block) {
+    int slot = _flashNext;
+    size_t offset = slot * sizeof(HistoryBlock);
+    const int slotsPerSector = SPI_FLASH_SEC_SIZE / sizeof(HistoryBlock);
+
+    // Entering a new sector: erase it and forget the blocks it held
+    if (offset % SPI_FLASH_SEC_SIZE == 0) {
+        if (esp_partition_erase_range(_partition, offset, SPI_FLASH_SEC_SIZE) != ESP_OK) {
+            return;
+        }
+        memset(&_flashIndex[slot], 0, slotsPerSector * sizeof(FlashIndexEntry));
+    }
+
+    if (esp_partition_write(_partition, offset, &block, sizeof(HistoryBlock)) != ESP_OK) {
+        return;
+    }
+
+    _flashIndex[slot].metricHash = block.header.metricHash;
+    _flashIndex[slot].firstTimestamp = block.header.firstTimestamp;
+    _flashIndex[slot].lastTimestamp = block.header.lastTimestamp;
+    _flashNext = (slot + 1) % _flashSlots;
+}
+
+// Rebuild the flash index and continue after the newest block; blocks stamped
+// with uptime (written by older firmware) are ignored
+void TimeSeriesStore::loadFlashIndex() {
+    uint32_t newest = 0;
+    int newestSlot = -1;
+
+    for (int slot = 0; slot < _flashSlots; slot++) {
+        HistoryBlockHeader header;
+        if (esp_partition_read(_partition, slot * sizeof(HistoryBlock), &header, sizeof(header)) != ESP_OK ||
+            header.magic != HISTORY_BLOCK_MAGIC || header.count == 0) {
+            continue;
+        }
+
+        if (newestSlot < 0 || header.sequence > newest) {
+            newest = header.sequence;
+            newestSlot = slot;
+        }
+
+        if (header.firstTimestamp < HISTORY_MIN_EPOCH) {
+            continue;
+        }
+
+        _flashIndex[slot].metricHash = header.metricHash;
+        _flashIndex[slot].firstTimestamp = header.firstTimestamp;
+        _flashIndex[slot].lastTimestamp = header.lastTimestamp;
+    }
+
+    if (newestSlot >= 0) {
+        _flashNext = (newestSlot + 1) % _flashSlots;
+        _sequence = newest + 1;
+    }
+}
@@ -0,0 +1,227 @@
+#include "TraceChannel.h"
+#include <esp_rom_crc.h>
+
+// Constructor
+TraceChannel::TraceChannel(HardwareSerial& serial) :
+    _serial(serial),
+    _ring(nullptr),
+    _task(nullptr),
+    _dropped(0),
+    _frames(0),
+    _sourceCount(0),
+    _batchLength(0),
+    _sequence(0),
+    _reportedDrops(0),
+    _lastAnnounce(0)
+{
+    _firmwareVersion[0] = '\0';
+}
+
+// Open the UART and start the writer task
+bool TraceChannel::begin(unsigned long baud, const char* firmwareVersion) {
+    if (_task != nullptr) {
+        return true;
+    }
+
+    strlcpy(_firmwareVersion, firmwareVersion, sizeof(_firmwareVersion));
+
+    _ring = xRingbufferCreate(TRACE_BUFFER_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (_ring == nullptr) {
+        return false;
+    }
+
+    // The TX ring size only takes effect when the driver is (re)installed
+    _serial.flush();
+    _serial.end();
+    _serial.setTxBufferSize(TRACE_UART_TX_BUFFER);
+    _serial.begin(baud);
+
+    if (xTaskCreate(taskEntry, "trace", TRACE_TASK_STACK, this, TRACE_TASK_PRIORITY, &_task) != pdPASS) {
+        vRingbufferDelete(_ring);
+        _ring = nullptr;
+        _task = nullptr;
+        return false;
+    }
+    return true;
+}
+
+// Queue a sensor sample
+void TraceChannel::sample(uint8_t source, float value, uint32_t timestampUs) {
+    uint8_t body[5];
+    body[0] = source;
+    memcpy(body + 1, &value, sizeof(value));
+    queue(TraceType::Sample, timestampUs, body, sizeof(body));
+}
+
+// Queue a trace event
+void TraceChannel::event(uint16_t id, uint32_t arg) {
+    uint8_t body[6];
+    memcpy(body, &id, sizeof(id));
+    memcpy(body + 2, &arg, sizeof(arg));
+    queue(TraceType::Event, micros(), body, sizeof(body));
+}
+
+// Queue a log message
+void TraceChannel::log(const LogEntry& entry) {
+    uint8_t body[2 + LOG_MESSAGE_MAX];
+    body[0] = entry.level;
+    body[1] = (uint8_t)entry.module;
+    memcpy(body + 2, entry.text, entry.length);
+    queue(TraceType::Log, entry.ms * 1000, body, 2 + entry.length);
+}
+
+// Name a sample source and announce it
+void TraceChannel::describeSource(uint8_t index, const char* name, float rateHz) {
+    if (index >= TRACE_MAX_SOURCES) {
+        return;
+    }
+
+    strlcpy(_sources[index].name, name, sizeof(_sources[index].name));
+    _sources[index].rate = rateHz;
+    if (index >= _sourceCount.load(std::memory_order_relaxed)) {
+        _sourceCount.store(index + 1, std::memory_order_release);
+    }
+
+    uint8_t body[5 + TRACE_NAME_MAX];
+    size_t nameLength = strlen(_sources[index].name);
+    body[0] = index;
+    memcpy(body + 1, &rateHz, sizeof(rateHz));
+    memcpy(body + 5, _sources[index].name, nameLength);
+    queue(TraceType::Source, micros(), body, 5 + nameLength);
+}
+
+// Copy a record into the ring buffer; never waits
+bool TraceChannel::queue(TraceType type, uint32_t timestamp, const void* body, size_t length) {
+    if (_ring == nullptr) {
+        return false;
+    }
+
+    uint8_t record[TRACE_RECORD_MAX];
+    length = min(length, sizeof(record) - TRACE_RECORD_HEADER);
+    record[0] = (uint8_t)type;
+    memcpy(record + 1, &timestamp, sizeof(timestamp));
+    memcpy(record + TRACE_RECORD_HEADER, body, length);
+
+    if (xRingbufferSend(_ring, record, TRACE_RECORD_HEADER + length, 0) != pdTRUE) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void TraceChannel::taskEntry(void* arg) {
+    static_cast<TraceChannel*>(arg)->run();
+}
+
+// Writer task: encode records into a batch and write it once nothing more
+// is waiting (or it is full)
+void TraceChannel::run() {
+    // Terminate whatever text preceded the channel so the first frame decodes
+    _batch[_batchLength++] = 0;
+    announce();
+
+    for (;;) {
+        TickType_t wait = _batchLength > 0 ? 0 : pdMS_TO_TICKS(TRACE_ANNOUNCE_INTERVAL);
+        size_t size;
+        uint8_t* record = (uint8_t*)xRingbufferReceive(_ring, &size, wait);
+        if (record != nullptr) {
+            uint32_t timestamp;
+            memcpy(&timestamp, record + 1, sizeof(timestamp));
+            emit((TraceType)record[0], timestamp, record + TRACE_RECORD_HEADER, size - TRACE_RECORD_HEADER);
+            vRingbufferReturnItem(_ring, record);
+        } else {
+            flushBatch();
+        }
+
+        reportDrops();
+        if (millis() - _lastAnnounce >= TRACE_ANNOUNCE_INTERVAL) {
+            announce();
+        }
+    }
+}
+
+// Frame a record and append it to the batch
+void TraceChannel::emit(TraceType type, uint32_t timestamp, const uint8_t* body, size_t length) {
+    uint8_t frame[TRACE_FRAME_MAX];
+    length = min(length, sizeof(frame) - 11);
+
+    frame[0] = (uint8_t)type;
+    memcpy(frame + 1, &_sequence, sizeof(_sequence));
+    memcpy(frame + 3, &timestamp, sizeof(timestamp));
+    memcpy(frame + 7, body, length);
+    uint32_t crc = esp_rom_crc32_le(0, frame, 7 + length);
+    memcpy(frame + 7 + length, &crc, sizeof(crc));
+    _sequence++;
+
+    if (_batchLength + TRACE_ENCODED_MAX > sizeof(_batch)) {
+        flushBatch();
+    }
+    _batchLength += encode(frame, 7 + length + 4, _batch + _batchLength);
+    _batch[_batchLength++] = 0;
+    _frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Repeat the hello frame and the source names for hosts attaching later
+void TraceChannel::announce() {
+    _lastAnnounce = millis();
+
+    uint8_t body[1 + TRACE_NAME_MAX];
+    size_t versionLength = strlen(_firmwareVersion);
+    body[0] = TRACE_PROTOCOL_VERSION;
+    memcpy(body + 1, _firmwareVersion, versionLength);
+    emit(TraceType::Hello, micros(), body, 1 + versionLength);
+
+    uint8_t count = _sourceCount.load(std::memory_order_acquire);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t source[5 + TRACE_NAME_MAX];
+        size_t nameLength = strlen(_sources[i].name);
+        source[0] = i;
+        memcpy(source + 1, &_sources[i].rate, sizeof(float));
+        memcpy(source + 5, _sources[i].name, nameLength);
+        emit(TraceType::Source, micros(), source, 5 + nameLength);
+    }
+}
+
+// Tell the host about records lost since the last report
+void TraceChannel::reportDrops() {
+    uint32_t dropped = _dropped.load(std::memory_order_relaxed);
+    if (dropped == _reportedDrops) {
+        return;
+    }
+
+    _reportedDrops = dropped;
+    emit(TraceType::Dropped, micros(), (const uint8_t*)&dropped, sizeof(dropped));
+}
+
+// Hand the batch to the UART driver; blocks only this task when its TX
+// ring is full
+void TraceChannel::flushBatch() {
+    if (_batchLength == 0) {
+        return;
+    }
+
+    _serial.write(_batch, _batchLength);
+    _batchLength = 0;
+}
+
+// COBS-encode length bytes (the output holds no zero and is at most
+// length + length / 254 + 1 bytes)
+size_t TraceChannel::encode(const uint8_t* in, size_t length, uint8_t* out) {
+    size_t codeIndex = 0;
+    size_t outLength = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != 0) {
+            out[outLength++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xFF) {
+            out[codeIndex] = code;
+            codeIndex = outLength++;
+            code = 1;
+        }
+    }
+    out[codeIndex] = code;
+    return outLength;
+}
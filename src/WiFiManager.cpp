@@ -1,4 +1,65 @@
 #include "WiFiManager.h"
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include <esp_wifi.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+#include <lwip/sockets.h>
+#include <time.h>
+#include "Log.h"
+
+#define LOG_MODULE LogModule::WiFi
+#define LOG_MODULE_LEVEL LOG_LEVEL_WIFI
+
+#define FAST_CONNECT_MAGIC 0x57464331
+#define FAST_CONNECT_NAMESPACE "wifi_fast"
+
+// Survives deep sleep and software resets; NVS covers power cycles
+RTC_DATA_ATTR static uint8_t rtcFastConnectCache[64];
+
+// Fallback methods tried after every configured network failed
+struct AdvancedMethod {
+    const char* name;
+    uint8_t channel;            // 0 = any
+    bool staticIp;
+    bool lowTxPower;            // WIFI_FALLBACK_TX_POWER instead of the profile's ceiling
+    unsigned long timeout;
+};
+
+static const AdvancedMethod ADVANCED_METHODS[] = {
+    {"Using automatic channel selection with reduced TX power", 0, false, true, 10000},
+    {"Using static IP address", 0, true, false, 10000},
+#ifdef WIFI_CHANNEL
+    {"Using specific WiFi channel", WIFI_CHANNEL, false, false, 10000},
+#endif
+    {"Trying standard channel 1", 1, false, false, 8000},
+    {"Trying standard channel 6", 6, false, false, 8000},
+    {"Trying standard channel 11", 11, false, false, 8000},
+    {"Final attempt with default settings", 0, false, false, 15000}
+};
+
+#define ADVANCED_METHOD_COUNT (int)(sizeof(ADVANCED_METHODS) / sizeof(ADVANCED_METHODS[0]))
+
+// Settings of the WiFiPowerProfile values, in declaration order
+struct PowerProfileConfig {
+    const char* name;
+    wifi_ps_type_t sleepMode;
+    uint8_t listenInterval;     // beacons slept through in WIFI_PS_MAX_MODEM
+    int8_t maxTxPower;          // 0.25 dBm units
+    uint8_t rssiMargin;         // dB kept above WIFI_TX_TARGET_RSSI by the adaptive TX power
+};
+
+static const PowerProfileConfig POWER_PROFILES[WIFI_POWER_PROFILE_COUNT] = {
+    {"low_latency", WIFI_PS_NONE, 3, 78, 20},          // 19.5 dBm
+    {"balanced", WIFI_PS_MIN_MODEM, 3, 68, 12},        // 17 dBm
+    {"low_power", WIFI_PS_MAX_MODEM, 10, 60, 6}        // 15 dBm
+};
+
+// Names of the WiFiState values, in declaration order
+static const char* const STATE_NAMES[WIFI_STATE_COUNT] = {
+    "idle", "fast_connect", "scanning", "connecting", "advanced", "connected", "roaming", "backoff"
+};
 
 // Constructor for single network (legacy support)
 WiFiManager::WiFiManager(const String& ssid, const String& password, int statusLedPin, unsigned long connectionTimeout) : 
@@ -6,10 +67,8 @@ WiFiManager::WiFiManager(const String& ssid, const String& password, int statusL
     _password(password), 
     _statusLedPin(statusLedPin),
     _connectionTimeout(connectionTimeout),
-    _lastReconnectAttempt(0),
     _isConnected(false),
     _isLegacyMode(true),
-    _networkCount(0),
     _currentNetworkIndex(0) {
     
     // Initialize status LED if specified
@@ -26,19 +85,10 @@ WiFiManager::WiFiManager(const String& ssid, const String& password, int statusL
 WiFiManager::WiFiManager(int statusLedPin, unsigned long connectionTimeout) :
     _statusLedPin(statusLedPin),
     _connectionTimeout(connectionTimeout),
-    _lastReconnectAttempt(0),
     _isConnected(false),
     _isLegacyMode(false),
-    _networkCount(0),
     _currentNetworkIndex(0) {
     
-    // Initialize the networks array
-    for (int i = 0; i < MAX_WIFI_NETWORKS; i++) {
-        _networks[i].active = false;
-        _networks[i].ssid = "";
-        _networks[i].password = "";
-    }
-    
     // Initialize status LED if specified
     if (_statusLedPin >= 0) {
         pinMode(_statusLedPin, OUTPUT);
@@ -46,347 +96,1138 @@ WiFiManager::WiFiManager(int statusLedPin, unsigned long connectionTimeout) :
     }
 }
 
-// Add a WiFi network to the list
-bool WiFiManager::addNetwork(const String& ssid, const String& password) {
-    if (_networkCount >= MAX_WIFI_NETWORKS) {
-        Serial.println("Cannot add more networks, maximum reached");
+// Add a WiFi network to the credential store
+bool WiFiManager::addNetwork(const String& ssid, const String& password, int priority) {
+    if (!_credentials.add(ssid.c_str(), password.c_str(), priority)) {
+        LOG_W("Cannot add WiFi network: %s", ssid.c_str());
+        return false;
+    }
+    
+    LOG_I("Added WiFi network: %s", ssid.c_str());
+    return true;
+}
+
+// Remove a WiFi network from the credential store
+bool WiFiManager::removeNetwork(const String& ssid) {
+    if (!_credentials.remove(ssid.c_str())) {
         return false;
     }
     
-    _networks[_networkCount].ssid = ssid;
-    _networks[_networkCount].password = password;
-    _networks[_networkCount].active = true;
-    _networkCount++;
+    // The cached AP may belong to it
+    FastConnectCache cache;
+    if (loadFastConnectCache(cache) && !_credentials.isUsed(cache.networkIndex)) {
+        clearFastConnectCache();
+    }
     
-    Serial.print("Added WiFi network: ");
-    Serial.println(ssid);
+    LOG_I("Removed WiFi network: %s", ssid.c_str());
     return true;
 }
 
-// Initialize WiFi connection
+// Initialize WiFi connection (blocks until connected or every method failed)
 bool WiFiManager::begin() {
     // If no networks configured, return false
-    if (_networkCount == 0) {
-        Serial.println("No WiFi networks configured!");
+    if (_credentials.count() == 0) {
+        LOG_W("No WiFi networks configured!");
         return false;
     }
     
-    Serial.println("Starting WiFi connection...");
+    LOG_I("Starting WiFi connection...");
+    start();
+    return waitForConnection();
+}
+
+// Start connecting in the background
+void WiFiManager::start() {
+    // Stores the networks added before NVS was available
+    _credentials.begin();
+    if (_credentials.count() == 0) {
+        LOG_W("No WiFi networks configured!");
+        return;
+    }
+    
+    // Link events are queued here and handled in checkConnection()
+    if (!_eventsRegistered) {
+        WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+            onWiFiEvent(event, info);
+        });
+        _eventsRegistered = true;
+    }
     
-    // Set WiFi mode to station (client) and reset WiFi
+    // Station mode without rewriting the WiFi config in flash on every begin();
+    // retries are driven by the state machine, not the driver
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
     WiFi.mode(WIFI_STA);
-    WiFi.disconnect(true, true);  // Disconnect and clear credentials
-    delay(1000);  // Increased delay to ensure WiFi hardware reset
-    
-    // Try connecting to each network in order until one succeeds
-    for (int i = 0; i < _networkCount; i++) {
-        if (_networks[i].active) {
-            Serial.print("Trying to connect to WiFi network: ");
-            Serial.println(_networks[i].ssid);
+    
+    startPlan(0);
+}
+
+// Block until connected, every method failed, or the timeout elapsed
+bool WiFiManager::waitForConnection(unsigned long timeout) {
+    unsigned long startTime = millis();
+    
+    while (!checkConnection()) {
+        if (_state == WiFiState::Idle || _state == WiFiState::Backoff) {
+            return false;
+        }
+        if (timeout > 0 && millis() - startTime >= timeout) {
+            return false;
+        }
+        delay(10);
+    }
+    return true;
+}
+
+// Runs on the WiFi event task: only queues the event
+void WiFiManager::onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    LinkEvent linkEvent;
+    linkEvent.reason = 0;
+    linkEvent.timestamp = millis();
+    
+    switch (event) {
+        case ARDUINO_EVENT_WIFI_STA_CONNECTED:
+            linkEvent.type = LINK_ASSOCIATED;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            linkEvent.type = LINK_GOT_IP;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+            linkEvent.type = LINK_LOST_IP;
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+            linkEvent.type = LINK_DISCONNECTED;
+            linkEvent.reason = info.wifi_sta_disconnected.reason;
+            break;
+        default:
+            return;
+    }
+    
+    _events.push(linkEvent);
+}
+
+// Check and maintain WiFi connection (never blocks)
+bool WiFiManager::checkConnection() {
+    LinkEvent event;
+    while (_events.pop(event)) {
+        handleLinkEvent(event);
+    }
+    uint32_t rttMs;
+    while (_latencySamples.pop(rttMs)) {
+        recordLatency(rttMs);
+    }
+    updateScan();
+    
+    unsigned long now = millis();
+    switch (_state) {
+        case WiFiState::Scanning:
+            if (now - _attemptStart >= WIFI_SCAN_TIMEOUT) {
+                LOG_W("WiFi scan timed out");
+                esp_wifi_scan_stop();
+                _scanRunning = false;
+                buildCandidates(false);
+                nextStep();
+            }
+            break;
             
-            // Try to connect to this network
-            if (tryConnect(_networks[i].ssid, _networks[i].password)) {
-                _currentNetworkIndex = i;
-                return true;
+        case WiFiState::FastConnect:
+        case WiFiState::Connecting:
+        case WiFiState::Advanced:
+        case WiFiState::Roaming:
+            // Static configurations may report the link without a GOT_IP event
+            if (WiFi.status() == WL_CONNECTED) {
+                onAttemptConnected();
+            } else if (now - _attemptStart >= _attemptTimeout) {
+                LOG_W("Connection attempt timed out");
+                failAttempt();
+            } else if (_statusLedPin >= 0 && now - _lastBlink >= 500) {
+                // Blink status LED while connecting
+                _lastBlink = now;
+                digitalWrite(_statusLedPin, !digitalRead(_statusLedPin));
             }
-        }
+            break;
+            
+        case WiFiState::Connected:
+            // Covers a disconnect event lost to a full queue
+            if (WiFi.status() != WL_CONNECTED) {
+                onLinkLost(0);
+            } else {
+                monitorRoaming(now);
+                adaptTxPower(now);
+                checkLeaseRenewal();
+            }
+            break;
+            
+        case WiFiState::Backoff:
+            if (now - _backoffStart >= WIFI_RETRY_BACKOFF) {
+                LOG_I("Retrying WiFi connection...");
+                startPlan(0);
+            }
+            break;
+            
+        case WiFiState::Idle:
+            break;
     }
     
-    Serial.println("Failed to connect to any WiFi network!");
-    return tryAdvancedConnection();
+    return _isConnected;
 }
 
-// Try to connect to a specific network
-bool WiFiManager::tryConnect(const String& ssid, const String& password) {
-    Serial.print("Connecting to WiFi network: ");
-    Serial.println(ssid);
+// Reconnect to WiFi: restart the connection plan now (progress in checkConnection())
+bool WiFiManager::reconnect() {
+    if (_credentials.count() == 0) {
+        return false;
+    }
     
-    // Start connection process
-    WiFi.begin(ssid.c_str(), password.c_str());
+    LOG_I("Attempting WiFi reconnection...");
+    WiFi.mode(WIFI_STA);
+    startPlan(0);
+    return true;
+}
+
+// Skip straight to the fallback connection methods
+bool WiFiManager::tryAdvancedConnection() {
+    if (_credentials.count() == 0) {
+        return false;
+    }
     
-    Serial.print("MAC Address: ");
-    Serial.println(WiFi.macAddress());
+    LOG_I("Trying advanced WiFi connection methods...");
+    _candidateCount = 0;
+    startPlan(2);
+    return true;
+}
+
+// Name of the connection state
+const char* WiFiManager::getStateName() const {
+    return STATE_NAMES[(int)_state];
+}
+
+// Times a disconnect with this reason code was seen
+uint16_t WiFiManager::getDisconnectCount(uint8_t reason) const {
+    return _metrics.reasons[reasonSlot(reason)];
+}
+
+// Upper bound of a reconnect histogram bucket in ms (0 = open-ended)
+uint32_t WiFiManager::reconnectBucketLimit(int bucket) {
+    static const uint32_t limits[WIFI_RECONNECT_BUCKETS - 1] = {500, 1000, 2000, 5000, 10000, 30000, 60000};
+    return bucket < WIFI_RECONNECT_BUCKETS - 1 ? limits[bucket] : 0;
+}
+
+// Address, signal and roaming summary
+void WiFiManager::getStatus(WiFiStatus& status) const {
+    strlcpy(status.ip, getIPAddress().c_str(), sizeof(status.ip));
+    status.rssi = getSignalStrength();
+    status.roams = _metrics.roams;
+    status.roamFailures = _metrics.roamFailures;
+    status.lastRoamMs = _metrics.lastRoamMs;
+    status.avgRoamMs = _metrics.roams ? (uint32_t)(_metrics.totalRoamMs / _metrics.roams) : 0;
+    status.lastRoamGain = _metrics.lastRoamGain;
+    status.totalRoamGain = _metrics.totalRoamGain;
+}
+
+// Link metrics as JSON; histograms are arrays, the reason histogram only
+// lists codes that occurred
+void WiFiManager::getMetricsJson(JsonObject out) const {
+    out["state"] = getStateName();
+    out["rssi"] = getSignalStrength();
+    out["channel"] = _metrics.channel;
+    out["channel_changes"] = _metrics.channelChanges;
     
-    // Wait for connection with timeout
-    unsigned long startTime = millis();
-    int attemptCount = 0;
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime < _connectionTimeout)) {
-        // Blink status LED if available
-        if (_statusLedPin >= 0) {
-            digitalWrite(_statusLedPin, !digitalRead(_statusLedPin));
+    // Seconds per state, including the current one
+    JsonObject states = out["state_s"].to<JsonObject>();
+    for (int i = 0; i < WIFI_STATE_COUNT; i++) {
+        uint64_t ms = _metrics.stateMs[i];
+        if (i == (int)_state) {
+            ms += millis() - _stateSince;
         }
+        states[STATE_NAMES[i]] = (uint32_t)(ms / 1000);
+    }
+    
+    out["attempts"] = _metrics.attempts;
+    out["failures"] = _metrics.failures;
+    out["disconnects"] = _metrics.disconnects;
+    out["last_connect_ms"] = _lastConnectDuration;
+    
+    JsonObject reconnect = out["reconnect"].to<JsonObject>();
+    reconnect["count"] = _metrics.reconnects;
+    JsonArray limits = reconnect["le_ms"].to<JsonArray>();
+    JsonArray counts = reconnect["counts"].to<JsonArray>();
+    for (int i = 0; i < WIFI_RECONNECT_BUCKETS; i++) {
+        if (i < WIFI_RECONNECT_BUCKETS - 1) {
+            limits.add(reconnectBucketLimit(i));
+        }
+        counts.add(_metrics.reconnectHistogram[i]);
+    }
+    
+    JsonObject reasons = out["reasons"].to<JsonObject>();
+    for (int slot = 0; slot < WIFI_REASON_SLOTS; slot++) {
+        if (_metrics.reasons[slot] > 0) {
+            reasons[String(slotReason(slot))] = _metrics.reasons[slot];
+        }
+    }
+    
+    JsonObject rssi = out["rssi_hist"].to<JsonObject>();
+    rssi["from_dbm"] = -100;
+    rssi["width_db"] = 5;
+    JsonArray rssiCounts = rssi["counts"].to<JsonArray>();
+    for (int i = 0; i < WIFI_RSSI_BUCKETS; i++) {
+        rssiCounts.add(_metrics.rssiHistogram[i]);
+    }
+    
+    JsonObject dhcp = out["dhcp_ms"].to<JsonObject>();
+    dhcp["last"] = _metrics.lastDhcpMs;
+    dhcp["max"] = _metrics.maxDhcpMs;
+    dhcp["avg"] = _metrics.dhcpCount ? (uint32_t)(_metrics.totalDhcpMs / _metrics.dhcpCount) : 0;
+    
+    out["roams"] = _metrics.roams;
+    
+    getPowerJson(out["power"].to<JsonObject>());
+}
+
+// Power profile, TX power and the per-profile latency and duty cycle
+void WiFiManager::getPowerJson(JsonObject out) const {
+    out["profile"] = getPowerProfileName();
+    out["tx_dbm"] = getTxPower();
+    
+    JsonObject profiles = out["profiles"].to<JsonObject>();
+    for (int i = 0; i < WIFI_POWER_PROFILE_COUNT; i++) {
+        const WiFiPowerStats& stats = _powerStats[i];
+        uint32_t answered = stats.probes - stats.lost;
         
-        delay(500);
-        Serial.print(".");
-        
-        // Every 5 seconds, print WiFi status and attempt reconnection
-        if ((millis() - startTime) % 5000 < 500) {
-            wl_status_t currentStatus = WiFi.status();
-            printConnectionStatus(currentStatus);
+        JsonObject entry = profiles[POWER_PROFILES[i].name].to<JsonObject>();
+        entry["probes"] = stats.probes;
+        entry["lost"] = stats.lost;
+        entry["rtt_last_ms"] = stats.lastRttMs;
+        entry["rtt_avg_ms"] = answered ? (uint32_t)(stats.totalRttMs / answered) : 0;
+        entry["rtt_max_ms"] = stats.maxRttMs;
+        entry["duty_pct_est"] = estimateDutyCycle((WiFiPowerProfile)i) * 100.0f;
+    }
+}
+
+// Switch profile; applied immediately when connected
+void WiFiManager::setPowerProfile(WiFiPowerProfile profile) {
+    _powerProfile = profile;
+    LOG_I("WiFi power profile: %s", getPowerProfileName());
+    
+    if (_state == WiFiState::Connected) {
+        applyPowerProfile();
+    }
+}
+
+// Name of a power profile
+const char* WiFiManager::powerProfileName(WiFiPowerProfile profile) {
+    return POWER_PROFILES[(int)profile].name;
+}
+
+// Power profile by name (as reported in the metrics)
+bool WiFiManager::parsePowerProfile(const String& name, WiFiPowerProfile& profile) {
+    for (int i = 0; i < WIFI_POWER_PROFILE_COUNT; i++) {
+        if (name == POWER_PROFILES[i].name) {
+            profile = (WiFiPowerProfile)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fraction of time the receiver is on, from the sleep mode alone: awake for
+// one beacon per wake period, traffic not included
+float WiFiManager::estimateDutyCycle(WiFiPowerProfile profile) {
+    const PowerProfileConfig& config = POWER_PROFILES[(int)profile];
+    if (config.sleepMode == WIFI_PS_NONE) {
+        return 1.0f;
+    }
+    
+    int beacons = config.sleepMode == WIFI_PS_MAX_MODEM ? max((int)config.listenInterval, WIFI_DTIM_PERIOD)
+                                                         : WIFI_DTIM_PERIOD;
+    return min(1.0f, WIFI_BEACON_WAKE_MS / (beacons * WIFI_BEACON_INTERVAL_MS));
+}
+
+// Histogram slot of a reason code: 802.11 codes map directly, ESP-IDF codes
+// (200 and up) follow them, anything else lands in slot 0
+uint8_t WiFiManager::reasonSlot(uint8_t reason) {
+    if (reason < 64) {
+        return reason;
+    }
+    if (reason >= 200 && reason < 200 + (WIFI_REASON_SLOTS - 64)) {
+        return 64 + (reason - 200);
+    }
+    return 0;
+}
+
+// Reason code of a histogram slot
+uint8_t WiFiManager::slotReason(int slot) {
+    return slot < 64 ? slot : 200 + (slot - 64);
+}
+
+// Apply one queued link event
+void WiFiManager::handleLinkEvent(const LinkEvent& event) {
+    switch (event.type) {
+        case LINK_ASSOCIATED:
+            if (isAttempting()) {
+                _metrics.lastAssociateMs = event.timestamp - _attemptStart;
+            }
+            _associatedAt = event.timestamp;
+            _associated = true;
+            break;
+            
+        case LINK_GOT_IP:
+            if (_associated) {
+                uint32_t dhcpMs = event.timestamp - _associatedAt;
+                _metrics.dhcpCount++;
+                _metrics.lastDhcpMs = dhcpMs;
+                _metrics.totalDhcpMs += dhcpMs;
+                if (dhcpMs > _metrics.maxDhcpMs) {
+                    _metrics.maxDhcpMs = dhcpMs;
+                }
+                _associated = false;
+            }
+            if (isAttempting()) {
+                onAttemptConnected();
+            } else if (_state == WiFiState::Connected && !_staticConfig) {
+                // DHCP took over from a reused lease
+                _leaseSeconds = dhcpLeaseSeconds();
+                _leaseAcquired = time(nullptr);
+                saveFastConnectCache();
+            }
+            break;
             
-            // If stuck in IDLE or DISCONNECTED for too long, retry connection
-            if ((currentStatus == WL_IDLE_STATUS || currentStatus == WL_DISCONNECTED) && ++attemptCount >= 3) {
-                Serial.println("\nRetrying WiFi connection...");
+        case LINK_LOST_IP:
+            if (_state == WiFiState::Connected) {
+                LOG_W("WiFi lost its IP address");
                 WiFi.disconnect();
-                delay(500);
-                WiFi.begin(ssid.c_str(), password.c_str());
-                attemptCount = 0;
+                onLinkLost(0);
+            }
+            break;
+            
+        case LINK_DISCONNECTED:
+            // Our own WiFi.disconnect() between attempts
+            if ((isAttempting() || _state == WiFiState::Scanning) && event.reason == WIFI_REASON_ASSOC_LEAVE) {
+                break;
             }
+            
+            _metrics.reasons[reasonSlot(event.reason)]++;
+            
+            if (_state == WiFiState::Connected) {
+                onLinkLost(event.reason);
+            } else if (isAttempting()) {
+                LOG_W("Connection attempt rejected (reason %u)", event.reason);
+                
+                // A wrong password will not get better by retrying, nor will a
+                // specific BSSID that has gone away
+                bool final = event.reason == WIFI_REASON_AUTH_FAIL ||
+                             (_attemptTargeted && event.reason == WIFI_REASON_NO_AP_FOUND);
+                if (final || ++_attemptRetries > WIFI_ATTEMPT_RETRIES) {
+                    failAttempt();
+                } else {
+                    WiFi.reconnect();
+                }
+            }
+            break;
+    }
+}
+
+// Change state, accounting the time spent in the previous one
+void WiFiManager::setState(WiFiState state) {
+    unsigned long now = millis();
+    _metrics.stateMs[(int)_state] += now - _stateSince;
+    _stateSince = now;
+    _state = state;
+}
+
+// Restart the connection plan at the given step
+void WiFiManager::startPlan(int firstStep) {
+    _isConnected = false;
+    if (firstStep <= 1) {
+        _candidateCount = 0;
+    }
+    _cycleStart = millis();
+    _step = firstStep - 1;
+    nextStep();
+}
+
+// Start the next applicable step, or back off when none is left
+void WiFiManager::nextStep() {
+    int stepCount = 2 + _candidateCount + ADVANCED_METHOD_COUNT;
+    
+    while (++_step < stepCount) {
+        if (startStep(_step)) {
+            return;
         }
     }
     
-    // Check if connection was successful
-    if (WiFi.status() == WL_CONNECTED) {
-        _isConnected = true;
-        
-        // Turn on status LED if available
-        if (_statusLedPin >= 0) {
-            digitalWrite(_statusLedPin, HIGH);
+    LOG_E("All connection methods failed!");
+    endAttempt();
+    setState(WiFiState::Backoff);
+    _backoffStart = millis();
+    
+    // The next round ranks its candidates from this scan
+    startScan();
+    if (_statusLedPin >= 0) {
+        digitalWrite(_statusLedPin, LOW);
+    }
+}
+
+// Start one step: the cached AP, the scan, a ranked candidate or a fallback
+// method. Returns false if the step does not apply.
+bool WiFiManager::startStep(int step) {
+    if (step == 0) {
+        return startFastConnect();
+    }
+    
+    if (step == 1) {
+        // One scan serves the whole ranking; a fresh cached one is used as is
+        endAttempt();
+        if (hasFreshScan()) {
+            buildCandidates(true);
+            return false;
+        }
+        if (!startScan(true)) {
+            buildCandidates(false);
+            return false;
         }
+        setState(WiFiState::Scanning);
+        _attemptStart = millis();
+        return true;
+    }
+    
+    if (step < 2 + _candidateCount) {
+        const Candidate& candidate = _candidates[step - 2];
         
-        Serial.println("\nWiFi connected successfully!");
-        printStatus();
+        if (candidate.visible) {
+            // Targeted association: no scan of its own, only DHCP left to wait for
+            if (!beginAttempt(WiFiState::Connecting, candidate.network, WIFI_CANDIDATE_TIMEOUT)) {
+                return false;
+            }
+            LOG_I("Connecting to WiFi network: %s (%02X:%02X:%02X:%02X:%02X:%02X, ch %u, %d dBm)",
+                  _credential.ssid, candidate.bssid[0], candidate.bssid[1], candidate.bssid[2],
+                  candidate.bssid[3], candidate.bssid[4], candidate.bssid[5], candidate.channel,
+                  candidate.rssi);
+            _attemptTargeted = true;
+            associate(candidate.channel, candidate.bssid);
+        } else {
+            // Blind: the driver scans for the SSID itself, still bounded per network
+            unsigned long timeout = min(_connectionTimeout, (unsigned long)WIFI_CANDIDATE_TIMEOUT);
+            if (!beginAttempt(WiFiState::Connecting, candidate.network, timeout)) {
+                return false;
+            }
+            LOG_I("Connecting to WiFi network: %s", _credential.ssid);
+            associate();
+        }
         return true;
     }
     
-    return false;
+    int method = step - 2 - _candidateCount;
+    const AdvancedMethod& advanced = ADVANCED_METHODS[method];
+    int index = _candidateCount > 0 ? _candidates[0].network : _currentNetworkIndex;
+    if (!_credentials.isUsed(index)) {
+        index = _credentials.first();
+    }
+    
+    LOG_I("Method %d: %s", method + 1, advanced.name);
+    if (!beginAttempt(WiFiState::Advanced, index, advanced.timeout)) {
+        return false;
+    }
+    
+    // Some boards and APs associate more reliably below full power
+    if (advanced.lowTxPower) {
+        setTxPower(min((int)WIFI_FALLBACK_TX_POWER, (int)POWER_PROFILES[(int)_powerProfile].maxTxPower));
+    }
+    
+    if (advanced.staticIp) {
+        // Set static IP configuration (often helps bypass DHCP issues)
+        IPAddress staticIP(192, 168, 1, 200);  // Static IP
+        IPAddress gateway(192, 168, 1, 1);     // Gateway
+        IPAddress subnet(255, 255, 255, 0);    // Subnet mask
+        IPAddress dns(8, 8, 8, 8);             // DNS (Google)
+        
+        if (WiFi.config(staticIP, gateway, subnet, dns)) {
+            LOG_D("Static IP configuration set");
+            _staticConfig = true;
+        } else {
+            LOG_W("Failed to set static IP configuration");
+        }
+    }
+    
+    associate(advanced.channel);
+    return true;
 }
 
-// Check and maintain WiFi connection
-bool WiFiManager::checkConnection() {
-    wl_status_t currentStatus = WiFi.status();
+// Rank the visible access points of the stored networks, best first: one
+// hash lookup per visible SSID, records are only read for stored ones.
+// Without any, stored networks are tried blind only if the scan failed or
+// saw a hidden SSID that may be one of them; otherwise the round moves on
+// and the next one rescans.
+void WiFiManager::buildCandidates(bool scanned) {
+    _candidateCount = 0;
+    WiFiCredential credential;
+    bool hiddenSeen = false;
     
-    if (currentStatus != WL_CONNECTED) {
-        _isConnected = false;
-        
-        // Turn off status LED if available
-        if (_statusLedPin >= 0) {
-            digitalWrite(_statusLedPin, LOW);
+    for (int i = 0; scanned && i < _scanCount; i++) {
+        const WiFiScanResult& result = _scanResults[i];
+        if (result.ssid[0] == '\0') {
+            hiddenSeen = true;
+            continue;
+        }
+        int slot = _credentials.find(result.ssid, &credential);
+        if (slot < 0) {
+            continue;
         }
         
-        // Try to reconnect if enough time has passed since last attempt
-        unsigned long currentTime = millis();
-        if (currentTime - _lastReconnectAttempt > 10000) { // Reduced from 30000 to 10000
-            _lastReconnectAttempt = currentTime;
-            Serial.print("WiFi disconnected (status: ");
-            printConnectionStatus(currentStatus);
-            Serial.println("). Attempting to reconnect...");
-            return reconnect();
+        Candidate candidate;
+        candidate.network = slot;
+        candidate.visible = true;
+        candidate.channel = result.channel;
+        candidate.rssi = result.rssi;
+        memcpy(candidate.bssid, result.bssid, sizeof(candidate.bssid));
+        candidate.score = scoreCandidate(credential, result.rssi);
+        addCandidate(candidate);
+    }
+    
+    if (_candidateCount == 0 && scanned && !hiddenSeen) {
+        LOG_I("No configured network in range");
+    } else if (_candidateCount == 0) {
+        if (scanned) {
+            LOG_I("No configured network in range, trying them blind (hidden SSID seen)");
+        }
+        for (int slot = _credentials.first(); slot >= 0; slot = _credentials.next(slot)) {
+            if (_credentials.load(slot, credential)) {
+                Candidate candidate = {};
+                candidate.network = slot;
+                candidate.rssi = WIFI_UNSEEN_RSSI;
+                candidate.score = scoreCandidate(credential, WIFI_UNSEEN_RSSI);
+                addCandidate(candidate);
+            }
         }
+    }
+    
+    for (int i = 0; i < _candidateCount; i++) {
+        _credentials.load(_candidates[i].network, credential);
+        LOG_D("Candidate %d: %s (%d dBm, score %d)", i + 1,
+              credential.ssid, _candidates[i].rssi, _candidates[i].score);
+    }
+}
+
+// Signal, adjusted by configured priority and connection history
+int WiFiManager::scoreCandidate(const WiFiCredential& credential, int rssi) const {
+    int score = rssi + credential.priority * WIFI_PRIORITY_WEIGHT;
+    
+    if (credential.successes > 0 && credential.failStreak == 0) {
+        score += WIFI_HISTORY_BONUS;
+    }
+    if (credential.lastSuccess != 0 && credential.lastSuccess == _credentials.lastSequence()) {
+        score += WIFI_RECENT_BONUS;
+    }
+    score -= min((int)credential.failStreak, 3) * WIFI_FAILURE_PENALTY;
+    return score;
+}
+
+// Insert in score order (ties keep insertion order), dropping the weakest
+void WiFiManager::addCandidate(const Candidate& candidate) {
+    int position = _candidateCount;
+    while (position > 0 && _candidates[position - 1].score < candidate.score) {
+        position--;
+    }
+    if (position >= WIFI_MAX_CANDIDATES) {
+        return;
+    }
+    
+    int last = _candidateCount < WIFI_MAX_CANDIDATES ? _candidateCount : WIFI_MAX_CANDIDATES - 1;
+    memmove(&_candidates[position + 1], &_candidates[position], (last - position) * sizeof(Candidate));
+    _candidates[position] = candidate;
+    
+    if (_candidateCount < WIFI_MAX_CANDIDATES) {
+        _candidateCount++;
+    }
+}
+
+// Associate directly with the cached AP, skipping the scan and (while the
+// lease is fresh) DHCP
+bool WiFiManager::startFastConnect() {
+    FastConnectCache cache;
+    bool inRtc = false;
+    if (!loadFastConnectCache(cache, &inRtc)) {
         return false;
     }
     
-    _isConnected = true;
+    int index = cache.networkIndex;
+    if (!_credentials.isUsed(index) || cache.ssidHash != _credentials.slotHash(index) ||
+        !beginAttempt(WiFiState::FastConnect, index, WIFI_FAST_CONNECT_TIMEOUT)) {
+        return false;
+    }
+    _attemptTargeted = true;
+    
+    // The system time only carries on across resets and deep sleep, like RTC
+    // memory; after a power cycle the lease age is unknown, so DHCP runs
+    _fastUseLease = inRtc && cache.ip != 0 && leaseUsable(cache.leaseSeconds, cache.leaseAcquired);
+    if (_fastUseLease) {
+        _leaseSeconds = cache.leaseSeconds;
+        _leaseAcquired = cache.leaseAcquired;
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet),
+                    IPAddress(cache.dns1), IPAddress(cache.dns2));
+        _staticConfig = true;
+    }
+    
+    LOG_I("Fast connect to %s on channel %d%s", _credential.ssid,
+          cache.channel, _fastUseLease ? " with cached lease" : "");
+    
+    associate(cache.channel, cache.bssid);
     return true;
 }
 
-// Reconnect to WiFi if disconnected
-bool WiFiManager::reconnect() {
-    Serial.println("Attempting WiFi reconnection...");
+// Leave whatever the previous step started, load the network's credential
+// and record a new attempt. False if the network is no longer stored.
+bool WiFiManager::beginAttempt(WiFiState state, int networkIndex, unsigned long timeout) {
+    WiFiCredential credential;
+    if (!_credentials.load(networkIndex, credential)) {
+        return false;
+    }
     
-    // Power cycle the WiFi hardware
-    WiFi.disconnect(true, true);  // Disconnect and clear stored credentials
-    delay(1000);
+    endAttempt();
+    stopLatencyProbe();
     
-    // Turn WiFi back on
-    WiFi.mode(WIFI_STA);
-    delay(500);
+    // Associate at the profile's full power; adapted once connected
+    setTxPower(POWER_PROFILES[(int)_powerProfile].maxTxPower);
     
-    // Try to reconnect to the current network first
-    if (_networkCount > 0) {
-        int startIndex = _currentNetworkIndex;
-        int attempts = 0;
-        
-        // Try all networks, starting with the current one
-        do {
-            int networkIndex = (startIndex + attempts) % _networkCount;
-            
-            if (_networks[networkIndex].active) {
-                Serial.print("Reconnection attempt for network: ");
-                Serial.println(_networks[networkIndex].ssid);
-                
-                if (tryConnect(_networks[networkIndex].ssid, _networks[networkIndex].password)) {
-                    _currentNetworkIndex = networkIndex;
-                    return true;
-                }
-            }
-            
-            attempts++;
-        } while (attempts < _networkCount);
-    } else if (_isLegacyMode) {
-        // Legacy mode - try the primary network
-        Serial.println("Reconnection attempt 1: Standard method");
-        WiFi.begin(_ssid.c_str(), _password.c_str());
-        
-        // Wait for connection with a short timeout
-        unsigned long startTime = millis();
-        unsigned short retryTimeout = 10000; // 10 seconds
+    setState(state);
+    _attemptNetwork = networkIndex;
+    _attemptStart = millis();
+    _attemptTimeout = timeout;
+    _attemptRetries = 0;
+    _attemptTargeted = false;
+    _credential = credential;
+    _metrics.attempts++;
+    return true;
+}
+
+// Drop an in-progress association and return to DHCP
+void WiFiManager::endAttempt() {
+    if (isAttempting()) {
+        WiFi.disconnect();
+    }
+    if (_staticConfig) {
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+        _staticConfig = false;
+    }
+}
+
+// The current step timed out or was rejected
+void WiFiManager::failAttempt() {
+    _metrics.failures++;
+    
+    // A failed roam goes back through the normal plan, old AP first
+    if (_state == WiFiState::Roaming) {
+        LOG_W("Roaming failed, reconnecting");
+        _metrics.roamFailures++;
+        _reconnecting = true;
+        startPlan(0);
+        return;
+    }
+    
+    _credentials.recordFailure(_attemptNetwork);
+    
+    if (_state == WiFiState::FastConnect) {
+        LOG_W("Fast connect failed, falling back to a full scan");
+        clearFastConnectCache();
+    }
+    
+    nextStep();
+}
+
+// The current step got an IP address
+void WiFiManager::onAttemptConnected() {
+    unsigned long now = millis();
+    uint32_t elapsed = now - _attemptStart;
+    bool fast = _state == WiFiState::FastConnect;
+    
+    // Roaming statistics and a fresh RSSI baseline
+    _rssiAverage = WiFi.RSSI();
+    _lastRssiSample = now;
+    if (_state == WiFiState::Roaming) {
+        _metrics.roams++;
+        _metrics.lastRoamMs = elapsed;
+        _metrics.totalRoamMs += elapsed;
+        _metrics.lastRoamGain = (int16_t)(_rssiAverage - _roamFromRssi);
+        _metrics.totalRoamGain += _metrics.lastRoamGain;
+        LOG_I("Roamed in %lu ms, gained %d dB", (unsigned long)elapsed, _metrics.lastRoamGain);
+    }
+    
+    _metrics.successes++;
+    _metrics.lastAttemptMs = elapsed;
+    _metrics.totalAttemptMs += elapsed;
+    if (elapsed > _metrics.maxAttemptMs) {
+        _metrics.maxAttemptMs = elapsed;
+    }
+    
+    setState(WiFiState::Connected);
+    _isConnected = true;
+    applyPowerProfile();
+    startLatencyProbe();
+    
+    // Link metrics
+    uint8_t channel = WiFi.channel();
+    if (_metrics.channel != 0 && channel != _metrics.channel) {
+        _metrics.channelChanges++;
+    }
+    _metrics.channel = channel;
+    
+    if (_reconnecting) {
+        _reconnecting = false;
+        _metrics.reconnects++;
         
-        while (WiFi.status() != WL_CONNECTED && (millis() - startTime < retryTimeout)) {
-            if (_statusLedPin >= 0) {
-                digitalWrite(_statusLedPin, !digitalRead(_statusLedPin));
-            }
-            delay(500);
-            Serial.print(".");
+        uint32_t reconnectMs = now - _cycleStart;
+        int bucket = 0;
+        while (bucket < WIFI_RECONNECT_BUCKETS - 1 && reconnectMs >= reconnectBucketLimit(bucket)) {
+            bucket++;
         }
-        
-        // If connected, return success
-        if (WiFi.status() == WL_CONNECTED) {
-            _isConnected = true;
-            if (_statusLedPin >= 0) {
-                digitalWrite(_statusLedPin, HIGH);
-            }
-            Serial.println("\nWiFi reconnected successfully!");
-            printStatus();
-            return true;
+        _metrics.reconnectHistogram[bucket]++;
+    }
+    
+    _currentNetworkIndex = _attemptNetwork;
+    _credentials.recordSuccess(_attemptNetwork, WiFi.BSSID(), channel);
+    _lastConnectFast = fast;
+    _lastConnectDuration = now - _cycleStart;
+    
+    // Turn on status LED if available
+    if (_statusLedPin >= 0) {
+        digitalWrite(_statusLedPin, HIGH);
+    }
+    
+    // A DHCP connect refreshes the cached lease; a reused one keeps its
+    // original acquisition time, and the hardcoded fallback address is never
+    // cached
+    if (!_staticConfig) {
+        _leaseSeconds = dhcpLeaseSeconds();
+        _leaseAcquired = time(nullptr);
+        saveFastConnectCache();
+    } else if (fast && _fastUseLease) {
+        saveFastConnectCache();
+    }
+    
+    LOG_I("WiFi connected in %lu ms%s", _lastConnectDuration,
+          fast ? " (cached AP and lease)" : "");
+    printStatus();
+}
+
+// Sample the RSSI and look for a stronger AP of the same SSID once the
+// smoothed signal stays weak
+void WiFiManager::monitorRoaming(unsigned long now) {
+    if (now - _lastRssiSample < WIFI_ROAM_SAMPLE_INTERVAL) {
+        return;
+    }
+    _lastRssiSample = now;
+    
+    int rssi = WiFi.RSSI();
+    if (rssi == 0) {
+        return;
+    }
+    _rssiAverage += WIFI_ROAM_SMOOTHING * (rssi - _rssiAverage);
+    
+    int bucket = (rssi + 100) / 5;
+    _metrics.rssiHistogram[constrain(bucket, 0, WIFI_RSSI_BUCKETS - 1)]++;
+    
+    if (_rssiAverage >= WIFI_ROAM_RSSI_THRESHOLD || _roamScanPending) {
+        return;
+    }
+    if ((_lastRoamScan != 0 && now - _lastRoamScan < WIFI_ROAM_SCAN_INTERVAL) ||
+        (_lastRoamAttempt != 0 && now - _lastRoamAttempt < WIFI_ROAM_MIN_INTERVAL)) {
+        return;
+    }
+    
+    LOG_I("Weak signal (%.0f dBm), looking for a stronger access point", _rssiAverage);
+    _lastRoamScan = now;
+    _roamScanPending = startScan(true);
+}
+
+// Move to the strongest other BSSID of the current SSID if it is clearly better
+void WiFiManager::evaluateRoam() {
+    const uint8_t* current = WiFi.BSSID();
+    
+    // Results are sorted strongest first
+    int best = -1;
+    for (int i = 0; i < _scanCount; i++) {
+        if (strcmp(_credential.ssid, _scanResults[i].ssid) == 0 &&
+            (current == nullptr || memcmp(_scanResults[i].bssid, current, 6) != 0)) {
+            best = i;
+            break;
         }
     }
     
-    // If all networks failed, try advanced connection methods
-    Serial.println("\nAll standard reconnection attempts failed. Trying advanced methods...");
-    return tryAdvancedConnection();
+    if (best < 0 || _scanResults[best].rssi < _rssiAverage + WIFI_ROAM_MIN_GAIN) {
+        LOG_D("No stronger access point found");
+        return;
+    }
+    
+    const WiFiScanResult& target = _scanResults[best];
+    LOG_I("Roaming to %02X:%02X:%02X:%02X:%02X:%02X (ch %u, %d dBm) from %.0f dBm",
+          target.bssid[0], target.bssid[1], target.bssid[2], target.bssid[3],
+          target.bssid[4], target.bssid[5], target.channel, target.rssi, _rssiAverage);
+    
+    if (!beginAttempt(WiFiState::Roaming, _currentNetworkIndex, WIFI_CANDIDATE_TIMEOUT)) {
+        return;
+    }
+    _attemptTargeted = true;
+    _roamFromRssi = _rssiAverage;
+    _lastRoamAttempt = millis();
+    _cycleStart = _lastRoamAttempt;
+    _isConnected = false;
+    associate(target.channel, target.bssid);
+}
+
+// WiFi.begin() without connecting, so the listen interval of the power
+// profile goes into the association request
+void WiFiManager::associate(int32_t channel, const uint8_t* bssid) {
+    WiFi.begin(_credential.ssid, _credential.password, channel, bssid, false);
+    
+    wifi_config_t config;
+    if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK) {
+        config.sta.listen_interval = POWER_PROFILES[(int)_powerProfile].listenInterval;
+        esp_wifi_set_config(WIFI_IF_STA, &config);
+    }
+    esp_wifi_connect();
+}
+
+// Sleep mode and TX power ceiling of the current profile
+void WiFiManager::applyPowerProfile() {
+    const PowerProfileConfig& profile = POWER_PROFILES[(int)_powerProfile];
+    
+    WiFi.setSleep(profile.sleepMode);
+    if (_txPower == 0 || _txPower > profile.maxTxPower) {
+        setTxPower(profile.maxTxPower);
+    }
+    _lastTxAdjust = millis();
 }
 
-// Try advanced connection methods when standard approach fails
-bool WiFiManager::tryAdvancedConnection() {
-    Serial.println("\nTrying advanced WiFi connection methods...");
+// Set the TX power limit (0.25 dBm units)
+void WiFiManager::setTxPower(int8_t power) {
+    if (power != _txPower && WiFi.setTxPower((wifi_power_t)power)) {
+        _txPower = power;
+    }
+}
+
+// Step the TX power down while the smoothed RSSI has more margin than the
+// profile needs, and back up when it runs short. The AP's signal stands in
+// for our own at the AP, which the station cannot measure.
+void WiFiManager::adaptTxPower(unsigned long now) {
+    if (now - _lastTxAdjust < WIFI_TX_ADAPT_INTERVAL) {
+        return;
+    }
     
-    // Method 1: Try with a fixed channel (auto-select)
-    WiFi.disconnect(true);
-    delay(1000);
-    Serial.println("Method 1: Using automatic channel selection with lower TX power");
-    WiFi.setTxPower(WIFI_POWER_17dBm); // Lower TX power for more stable connection
-    WiFi.begin(_ssid.c_str(), _password.c_str());
+    const PowerProfileConfig& profile = POWER_PROFILES[(int)_powerProfile];
+    float margin = _rssiAverage - WIFI_TX_TARGET_RSSI;
+    int8_t power = _txPower;
     
-    unsigned long startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime < 10000)) {
-        delay(500);
-        Serial.print(".");
+    if (margin < profile.rssiMargin) {
+        power = min(_txPower + WIFI_TX_STEP, (int)profile.maxTxPower);
+    } else if (margin > profile.rssiMargin + WIFI_TX_STEP / 4) {
+        power = max(_txPower - WIFI_TX_STEP, WIFI_TX_MIN_POWER);
     }
     
-    if (WiFi.status() == WL_CONNECTED) {
-        _isConnected = true;
-        Serial.println("\nMethod 1 successful!");
-        printStatus();
-        return true;
+    if (power != _txPower) {
+        _lastTxAdjust = now;
+        setTxPower(power);
+        LOG_D("TX power %.1f dBm (%.0f dBm RSSI)", getTxPower(), _rssiAverage);
+    }
+}
+
+// Ping the gateway periodically; the replies wait at the AP until the
+// station wakes, so the RTT shows the latency the power profile adds
+void WiFiManager::startLatencyProbe() {
+    stopLatencyProbe();
+    
+    IPAddress gateway = WiFi.gatewayIP();
+    if ((uint32_t)gateway == 0) {
+        return;
     }
     
-    // Method 2: Try connecting with a static IP (often helps bypass DHCP issues)
-    Serial.println("\nMethod 2: Using static IP address");
-    WiFi.disconnect();
-    delay(1000);
+    esp_ping_config_t config = ESP_PING_DEFAULT_CONFIG();
+    IP_ADDR4(&config.target_addr, gateway[0], gateway[1], gateway[2], gateway[3]);
+    config.count = ESP_PING_COUNT_INFINITE;
+    config.interval_ms = WIFI_LATENCY_PROBE_INTERVAL;
+    config.timeout_ms = WIFI_LATENCY_PROBE_TIMEOUT;
     
-    // Set static IP configuration (use safe default values)
-    IPAddress staticIP(192, 168, 1, 200);  // Static IP
-    IPAddress gateway(192, 168, 1, 1);     // Gateway
-    IPAddress subnet(255, 255, 255, 0);    // Subnet mask
-    IPAddress dns(8, 8, 8, 8);             // DNS (Google)
+    esp_ping_callbacks_t callbacks = {};
+    callbacks.cb_args = this;
+    callbacks.on_ping_success = onProbeSuccess;
+    callbacks.on_ping_timeout = onProbeTimeout;
     
-    if (WiFi.config(staticIP, gateway, subnet, dns)) {
-        Serial.println("Static IP configuration set");
-    } else {
-        Serial.println("Failed to set static IP configuration");
+    if (esp_ping_new_session(&config, &callbacks, &_latencyProbe) != ESP_OK) {
+        LOG_W("Failed to start latency probe");
+        _latencyProbe = nullptr;
+        return;
+    }
+    esp_ping_start(_latencyProbe);
+}
+
+// Stop the gateway pings
+void WiFiManager::stopLatencyProbe() {
+    if (_latencyProbe != nullptr) {
+        esp_ping_stop(_latencyProbe);
+        esp_ping_delete_session(_latencyProbe);
+        _latencyProbe = nullptr;
+    }
+}
+
+// Runs on the ping task: only queues the RTT
+void WiFiManager::onProbeSuccess(esp_ping_handle_t handle, void* arg) {
+    uint32_t elapsed = 0;
+    esp_ping_get_profile(handle, ESP_PING_PROF_TIMEGAP, &elapsed, sizeof(elapsed));
+    static_cast<WiFiManager*>(arg)->_latencySamples.push(elapsed);
+}
+
+// Runs on the ping task
+void WiFiManager::onProbeTimeout(esp_ping_handle_t handle, void* arg) {
+    static_cast<WiFiManager*>(arg)->_latencySamples.push(UINT32_MAX);
+}
+
+// Account a probe to the profile it was measured under
+void WiFiManager::recordLatency(uint32_t rttMs) {
+    if (_state != WiFiState::Connected) {
+        return;
     }
     
-    WiFi.begin(_ssid.c_str(), _password.c_str());
-    
-    startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime < 10000)) {
-        delay(500);
-        Serial.print(".");
+    WiFiPowerStats& stats = _powerStats[(int)_powerProfile];
+    stats.probes++;
+    if (rttMs == UINT32_MAX) {
+        stats.lost++;
+        return;
     }
+    stats.lastRttMs = rttMs;
+    stats.totalRttMs += rttMs;
+    if (rttMs > stats.maxRttMs) {
+        stats.maxRttMs = rttMs;
+    }
+}
+
+// An established link went down: start over with the cached AP
+void WiFiManager::onLinkLost(uint8_t reason) {
+    _metrics.disconnects++;
+    _reconnecting = true;
+    _associated = false;
+    stopLatencyProbe();
     
-    if (WiFi.status() == WL_CONNECTED) {
-        _isConnected = true;
-        Serial.println("\nMethod 2 successful!");
-        printStatus();
-        return true;
+    // Turn off status LED if available
+    if (_statusLedPin >= 0) {
+        digitalWrite(_statusLedPin, LOW);
     }
     
-    // Method 3: Try specific channels - start with channel from Config.h
-    #ifdef WIFI_CHANNEL
-    Serial.println("\nMethod 3: Using specific WiFi channel " + String(WIFI_CHANNEL));
-    WiFi.disconnect();
-    delay(1000);
-    WiFi.begin(_ssid.c_str(), _password.c_str(), WIFI_CHANNEL);
+    LOG_W("WiFi disconnected (reason %u). Attempting to reconnect...", reason);
+    startPlan(0);
+}
+
+// Read the cache from RTC memory, or from NVS after a power cycle
+bool WiFiManager::loadFastConnectCache(FastConnectCache& cache, bool* inRtc) {
+    static_assert(sizeof(FastConnectCache) <= sizeof(rtcFastConnectCache), "RTC cache too small");
     
-    startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime < 10000)) {
-        delay(500);
-        Serial.print(".");
+    memcpy(&cache, rtcFastConnectCache, sizeof(cache));
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)&cache, offsetof(FastConnectCache, crc));
+    if (cache.magic == FAST_CONNECT_MAGIC && cache.crc == crc) {
+        if (inRtc != nullptr) {
+            *inRtc = true;
+        }
+        return true;
     }
     
-    if (WiFi.status() == WL_CONNECTED) {
-        _isConnected = true;
-        Serial.println("\nMethod 3 successful with channel " + String(WIFI_CHANNEL) + "!");
-        printStatus();
-        return true;
+    Preferences prefs;
+    if (!prefs.begin(FAST_CONNECT_NAMESPACE, true)) {
+        return false;
     }
-    #endif
+    size_t length = prefs.getBytes("cache", &cache, sizeof(cache));
+    prefs.end();
     
-    // Try channels 1, 6, and 11 (standard non-overlapping channels)
-    int standardChannels[] = {1, 6, 11};
-    for (int i = 0; i < 3; i++) {
-        Serial.println("\nMethod 4: Trying standard channel " + String(standardChannels[i]));
-        WiFi.disconnect();
-        delay(1000);
-        WiFi.begin(_ssid.c_str(), _password.c_str(), standardChannels[i]);
-        
-        startTime = millis();
-        while (WiFi.status() != WL_CONNECTED && (millis() - startTime < 8000)) {
-            delay(500);
-            Serial.print(".");
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-            _isConnected = true;
-            Serial.println("\nMethod 4 successful with channel " + String(standardChannels[i]) + "!");
-            printStatus();
-            return true;
-        }
+    crc = esp_rom_crc32_le(0, (const uint8_t*)&cache, offsetof(FastConnectCache, crc));
+    return length == sizeof(cache) && cache.magic == FAST_CONNECT_MAGIC && cache.crc == crc;
+}
+
+// Remember the current association and lease
+void WiFiManager::saveFastConnectCache() {
+    if (WiFi.status() != WL_CONNECTED) {
+        return;
     }
     
-    // If all else fails, try one last attempt with default settings
-    Serial.println("\nMethod 5: Final attempt with default settings");
-    WiFi.disconnect(true);
-    delay(1000);
-    WiFi.mode(WIFI_STA);
-    delay(1000);
-    WiFi.begin(_ssid.c_str(), _password.c_str());
+    FastConnectCache cache;
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = FAST_CONNECT_MAGIC;
+    cache.ssidHash = _credentials.slotHash(_currentNetworkIndex);
+    cache.networkIndex = _currentNetworkIndex;
+    cache.channel = WiFi.channel();
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns1 = WiFi.dnsIP(0);
+    cache.dns2 = WiFi.dnsIP(1);
+    cache.leaseSeconds = _leaseSeconds;
+    cache.leaseAcquired = _leaseAcquired;
+    cache.crc = esp_rom_crc32_le(0, (const uint8_t*)&cache, offsetof(FastConnectCache, crc));
     
-    startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && (millis() - startTime < 15000)) {
-        delay(500);
-        Serial.print(".");
-    }
+    memcpy(rtcFastConnectCache, &cache, sizeof(cache));
     
-    if (WiFi.status() == WL_CONNECTED) {
-        _isConnected = true;
-        Serial.println("\nMethod 5 successful!");
-        printStatus();
-        return true;
+    // The NVS copy is only read after a power cycle, when the lease age is
+    // unknown, so it leaves the lease out and is only rewritten when the AP
+    // or address changed
+    cache.leaseSeconds = 0;
+    cache.leaseAcquired = 0;
+    cache.crc = esp_rom_crc32_le(0, (const uint8_t*)&cache, offsetof(FastConnectCache, crc));
+    Preferences prefs;
+    if (prefs.begin(FAST_CONNECT_NAMESPACE, false)) {
+        FastConnectCache stored;
+        if (prefs.getBytes("cache", &stored, sizeof(stored)) != sizeof(stored) ||
+            memcmp(&stored, &cache, sizeof(cache)) != 0) {
+            prefs.putBytes("cache", &cache, sizeof(cache));
+        }
+        prefs.end();
+    }
+}
+
+// Lease time the DHCP client was granted for the station address (0 if
+// unknown)
+uint32_t WiFiManager::dhcpLeaseSeconds() {
+    esp_netif_t* netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    struct netif* lwipNetif = netif != nullptr ? (struct netif*)esp_netif_get_netif_impl(netif) : nullptr;
+    struct dhcp* dhcp = lwipNetif != nullptr ? netif_dhcp_data(lwipNetif) : nullptr;
+    return dhcp != nullptr ? dhcp->offered_t0_lease : 0;
+}
+
+// A cached lease may be applied until its renewal time (half the lease)
+bool WiFiManager::leaseUsable(uint32_t leaseSeconds, uint32_t leaseAcquired) const {
+    uint32_t now = (uint32_t)time(nullptr);
+    return leaseSeconds != 0 && now >= leaseAcquired && now - leaseAcquired < leaseSeconds / 2;
+}
+
+// Hand a reused lease back to DHCP at its renewal time, so the server never
+// gives the address to another host while it is still in use here
+void WiFiManager::checkLeaseRenewal() {
+    if (!_staticConfig || !_fastUseLease || leaseUsable(_leaseSeconds, _leaseAcquired)) {
+        return;
     }
     
-    Serial.println("\nAll connection methods failed!");
-    return false;
+    LOG_I("Cached DHCP lease due for renewal, switching to DHCP");
+    _fastUseLease = false;
+    _staticConfig = false;
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+}
+
+// Forget the cached AP and lease
+void WiFiManager::clearFastConnectCache() {
+    memset(rtcFastConnectCache, 0, sizeof(rtcFastConnectCache));
+    
+    Preferences prefs;
+    if (prefs.begin(FAST_CONNECT_NAMESPACE, false)) {
+        prefs.remove("cache");
+        prefs.end();
+    }
 }
 
 // OTA firmware update
 bool WiFiManager::updateFirmware(const String& firmwareUrl, const String& currentVersion) {
     if (!isConnected()) {
-        Serial.println("Cannot update firmware: Not connected to WiFi");
+        LOG_W("Cannot update firmware: Not connected to WiFi");
         return false;
     }
 
-    Serial.println("Starting firmware update...");
-    Serial.print("Current version: ");
-    Serial.println(currentVersion.length() > 0 ? currentVersion : "unknown");
-    Serial.print("Update URL: ");
-    Serial.println(firmwareUrl);
+    LOG_I("Starting firmware update...");
+    LOG_I("Current version: %s", currentVersion.length() > 0 ? currentVersion.c_str() : "unknown");
+    LOG_I("Update URL: %s", firmwareUrl.c_str());
 
-    // Set up HTTP client with timeout
-    WiFiClient client;
-    
     // LED status indicator for update
     bool ledState = false;
     if (_statusLedPin >= 0) {
@@ -404,61 +1245,49 @@ bool WiFiManager::updateFirmware(const String& firmwareUrl, const String& curren
         
         // Define update events callback
         ESPhttpUpdate.onStart([]() {
-            Serial.println("Update start");
+            LOG_I("Update start");
         });
         ESPhttpUpdate.onEnd([]() {
-            Serial.println("Update end");
+            LOG_I("Update end");
         });
         ESPhttpUpdate.onProgress([](int cur, int total) {
-            Serial.printf("Update progress: %d%%\n", (cur * 100) / total);
+            LOG_D("Update progress: %d%%", (cur * 100) / total);
         });
         ESPhttpUpdate.onError([](int err) {
-            Serial.printf("Update error: %d\n", err);
+            LOG_E("Update error: %d", err);
         });
 
         // Set timeout
         ESPhttpUpdate.setTimeout(30000);
         
         // Perform update
+        WiFiClient client;
         t_httpUpdate_return ret = ESPhttpUpdate.update(client, firmwareUrl);
     #elif defined(ESP32)
-        HTTPUpdate httpUpdate;
-        httpUpdate.setLedPin(_statusLedPin, LOW);
-        
-        // Use a proper client timeout (ESP32 uses seconds, not milliseconds)
-        // 30 is too short, setting to 60 seconds for safety
-        client.setTimeout(60);
-        
-        // Register callback functions
-        httpUpdate.onStart([]() {
-            Serial.println("Update start");
-        });
-        httpUpdate.onEnd([]() {
-            Serial.println("Update end");
-        });
-        httpUpdate.onProgress([](int cur, int total) {
-            Serial.printf("Update progress: %d%%\n", (cur * 100) / total);
-        });
-        httpUpdate.onError([](int err) {
-            Serial.printf("Update error: %d\n", err);
-        });
-
-        // Create an Update object from the library's namespace for ESP32
+        // Streamed through the pipelined OTA writer; a gzip image is
+        // decompressed on the fly, so only the compressed bytes cross the link
         HTTPUpdateResult ret;
-        ret = httpUpdate.update(client, firmwareUrl);
+        switch (_firmwareUpdater.update(firmwareUrl, currentVersion)) {
+            case FirmwareUpdateResult::Updated:
+                ret = HTTP_UPDATE_OK;
+                break;
+            case FirmwareUpdateResult::NoUpdate:
+                ret = HTTP_UPDATE_NO_UPDATES;
+                break;
+            default:
+                ret = HTTP_UPDATE_FAILED;
+                break;
+        }
     #endif
 
     // Handle update result
     switch (ret) {
         case HTTP_UPDATE_FAILED:
             #if defined(ESP8266)
-                Serial.printf("Update failed. Error (%d): %s\n", 
-                    ESPhttpUpdate.getLastError(), 
-                    ESPhttpUpdate.getLastErrorString().c_str());
+                LOG_E("Update failed. Error (%d): %s", ESPhttpUpdate.getLastError(),
+                      ESPhttpUpdate.getLastErrorString().c_str());
             #elif defined(ESP32)
-                Serial.printf("Update failed. Error (%d): %s\n", 
-                    httpUpdate.getLastError(), 
-                    httpUpdate.getLastErrorString().c_str());
+                LOG_E("Update failed: %s", _firmwareUpdater.errorString());
             #endif
             // Restore LED state
             if (_statusLedPin >= 0) {
@@ -467,7 +1296,7 @@ bool WiFiManager::updateFirmware(const String& firmwareUrl, const String& curren
             return false;
             
         case HTTP_UPDATE_NO_UPDATES:
-            Serial.println("No update needed");
+            LOG_I("No update needed");
             // Restore LED state
             if (_statusLedPin >= 0) {
                 digitalWrite(_statusLedPin, ledState);
@@ -475,13 +1304,13 @@ bool WiFiManager::updateFirmware(const String& firmwareUrl, const String& curren
             return true;
             
         case HTTP_UPDATE_OK:
-            Serial.println("Update successful! Rebooting...");
+            LOG_I("Update successful! Rebooting...");
             delay(1000);
             ESP.restart();
             return true; // Actually never reached due to restart
             
         default:
-            Serial.println("Unexpected update result");
+            LOG_E("Unexpected update result");
             // Restore LED state
             if (_statusLedPin >= 0) {
                 digitalWrite(_statusLedPin, ledState);
@@ -490,6 +1319,53 @@ bool WiFiManager::updateFirmware(const String& firmwareUrl, const String& curren
     }
 }
 
+// Check a manifest and update when it names another image
+bool WiFiManager::checkForUpdate(const String& manifestUrl, const String& currentVersion) {
+    if (!isConnected()) {
+        LOG_W("Cannot check for updates: Not connected to WiFi");
+        return false;
+    }
+    
+    switch (_firmwareUpdater.checkManifest(manifestUrl, currentVersion)) {
+        case FirmwareUpdateResult::Updated:
+            LOG_I("Update successful! Rebooting...");
+            delay(1000);
+            ESP.restart();
+            return true;
+            
+        case FirmwareUpdateResult::NoUpdate:
+            LOG_I("No update needed");
+            return true;
+            
+        default:
+            LOG_W("Update check failed: %s", _firmwareUpdater.errorString());
+            return false;
+    }
+}
+
+// Check a manifest periodically with per-check jitter
+void WiFiManager::scheduleUpdateCheck(const String& manifestUrl, const String& currentVersion,
+                                      unsigned long interval, unsigned long window) {
+    _manifestUrl = manifestUrl;
+    _manifestVersion = currentVersion;
+    _updateCheckInterval = interval;
+    _updateCheckWindow = window;
+    _updateCheckFrom = millis();
+    _updateCheckDelay = window > 0 ? esp_random() % window : 0;
+    LOG_I("First update check in %lu s", _updateCheckDelay / 1000);
+}
+
+// Run the scheduled update check when due
+void WiFiManager::handleUpdateCheck() {
+    if (_manifestUrl.length() == 0 || millis() - _updateCheckFrom < _updateCheckDelay || !isConnected()) {
+        return;
+    }
+    
+    checkForUpdate(_manifestUrl, _manifestVersion);
+    _updateCheckFrom = millis();
+    _updateCheckDelay = _updateCheckInterval + (_updateCheckWindow > 0 ? esp_random() % _updateCheckWindow : 0);
+}
+
 // Get connection status
 bool WiFiManager::isConnected() const {
     return _isConnected;
@@ -516,50 +1392,49 @@ String WiFiManager::getMACAddress() const {
     return WiFi.macAddress();
 }
 
-// Print WiFi connection status code
+// Log WiFi connection status code
 void WiFiManager::printConnectionStatus(wl_status_t status) {
-    Serial.print("\nWiFi status: ");
+    const char* name;
     switch (status) {
         case WL_CONNECTED:
-            Serial.println("Connected");
+            name = "Connected";
             break;
         case WL_NO_SHIELD:
-            Serial.println("No shield");
+            name = "No shield";
             break;
         case WL_IDLE_STATUS:
-            Serial.println("Idle");
+            name = "Idle";
             break;
         case WL_NO_SSID_AVAIL:
-            Serial.println("No SSID available");
+            name = "No SSID available";
             break;
         case WL_SCAN_COMPLETED:
-            Serial.println("Scan completed");
+            name = "Scan completed";
             break;
         case WL_CONNECT_FAILED:
-            Serial.println("Connection failed");
+            name = "Connection failed";
             break;
         case WL_CONNECTION_LOST:
-            Serial.println("Connection lost");
+            name = "Connection lost";
             break;
         case WL_DISCONNECTED:
-            Serial.println("Disconnected");
+            name = "Disconnected";
             break;
         default:
-            Serial.println("Unknown");
+            name = "Unknown";
     }
+    LOG_I("WiFi status: %s", name);
 }
 
 // Print WiFi status information to Serial
 void WiFiManager::printStatus() const {
     if (WiFi.status() == WL_CONNECTED) {
         Serial.println("=== WiFi Status ===");
-        if (_networkCount > 0) {
+        if (_credentials.count() > 0) {
             Serial.print("SSID: ");
-            Serial.println(_networks[_currentNetworkIndex].ssid);
-            Serial.print("Network Index: ");
-            Serial.print(_currentNetworkIndex + 1);
-            Serial.print(" of ");
-            Serial.println(_networkCount);
+            Serial.println(_credential.ssid);
+            Serial.print("Stored Networks: ");
+            Serial.println(_credentials.count());
         } else {
             Serial.print("SSID: ");
             Serial.println(_ssid);
@@ -577,349 +1452,197 @@ void WiFiManager::printStatus() const {
     }
 }
 
-// Scan for available WiFi networks and print results
+// Print the cached scan results, refreshing them in the background when stale
 void WiFiManager::scanNetworks() {
-    Serial.println("Scanning for WiFi networks...");
-    
-    // Set WiFi to station mode and disconnect from any AP
-    WiFi.mode(WIFI_STA);
-    WiFi.disconnect();
-    delay(100);
-    
-    int numNetworks = WiFi.scanNetworks();
+    updateScan();
     
-    if (numNetworks == 0) {
-        Serial.println("No WiFi networks found!");
-    } else {
-        Serial.print("Found ");
-        Serial.print(numNetworks);
-        Serial.println(" networks:");
-        
-        // Print network details
-        for (int i = 0; i < numNetworks; i++) {
-            // Print SSID, RSSI and encryption type
-            Serial.print(i + 1);
-            Serial.print(": ");
-            Serial.print(WiFi.SSID(i));
-            Serial.print(" (");
-            Serial.print(WiFi.RSSI(i));
-            Serial.print(" dBm) ");
-            
-            // Print encryption type
-            switch (WiFi.encryptionType(i)) {
-                case WIFI_AUTH_OPEN:
-                    Serial.println("[Open]");
-                    break;
-                case WIFI_AUTH_WEP:
-                    Serial.println("[WEP]");
-                    break;
-                case WIFI_AUTH_WPA_PSK:
-                    Serial.println("[WPA-PSK]");
-                    break;
-                case WIFI_AUTH_WPA2_PSK:
-                    Serial.println("[WPA2-PSK]");
-                    break;
-                case WIFI_AUTH_WPA_WPA2_PSK:
-                    Serial.println("[WPA/WPA2-PSK]");
-                    break;
-                default:
-                    Serial.println("[Unknown]");
-            }
-            
-            delay(10);
-        }
-        
-        // Check if our configured networks are visible
-        for (int n = 0; n < _networkCount; n++) {
-            bool networkFound = false;
-            for (int i = 0; i < numNetworks; i++) {
-                if (WiFi.SSID(i) == _networks[n].ssid) {
-                    networkFound = true;
-                    Serial.print("Configured network '");
-                    Serial.print(_networks[n].ssid);
-                    Serial.print("' found with signal strength: ");
-                    Serial.print(WiFi.RSSI(i));
-                    Serial.println(" dBm");
-                    break;
-                }
-            }
-            
-            if (!networkFound) {
-                Serial.print("Configured network '");
-                Serial.print(_networks[n].ssid);
-                Serial.println("' NOT FOUND! Please check SSID spelling or if network is in range.");
-            }
+    if (!hasFreshScan()) {
+        startScan();
+        if (_scanCount == 0) {
+            Serial.println("Scanning for WiFi networks, results will follow...");
+            _printScanWhenDone = true;
+            return;
         }
     }
     
-    // Delete scan result to free memory
-    WiFi.scanDelete();
-    Serial.println("Network scan complete.");
+    printScan(Serial);
 }
 
-// Start web server for file uploads
-void WiFiManager::beginUploadServer(int port) {
-    if (!isConnected()) {
-        Serial.println("Cannot start upload server: Not connected to WiFi");
-        return;
+// Start a background scan
+bool WiFiManager::startScan(bool force) {
+    if (_scanRunning || (!force && hasFreshScan())) {
+        return true;
     }
     
-    _uploadServerPort = port;
+    // The driver cannot scan while it is associating; run once the attempt ends
+    if (isAttempting()) {
+        _scanRequested = true;
+        return true;
+    }
     
-    // Create server if it doesn't exist
-    if (_uploadServer == nullptr) {
-        _uploadServer = new WebServer(port);
-        if (_uploadServer == nullptr) {
-            Serial.println("Failed to create upload server");
-            return;
-        }
-        setupUploadServer();
+    if (WiFi.getMode() == WIFI_OFF) {
+        WiFi.mode(WIFI_STA);
     }
     
-    _uploadServer->begin();
-    _uploadServerActive = true;
+    int16_t result = WiFi.scanNetworks(true);
+    if (result != WIFI_SCAN_RUNNING) {
+        LOG_W("WiFi scan could not be started");
+        _scanRequested = false;
+        return false;
+    }
     
-    Serial.print("Upload server started on http://");
-    Serial.print(getIPAddress());
-    Serial.print(":");
-    Serial.println(_uploadServerPort);
-    Serial.println("Navigate to this address in a web browser to upload firmware");
+    _scanRunning = true;
+    _scanRequested = false;
+    return true;
 }
 
-// Set up routes for the upload server
-void WiFiManager::setupUploadServer() {
-    if (_uploadServer == nullptr) return;
-    
-    // Index page
-    _uploadServer->on("/", HTTP_GET, [this]() {
-        this->handleUploadRoot();
-    });
-    
-    // Handle file upload
-    _uploadServer->on("/update", HTTP_POST, [this]() {
-        this->handleUploadComplete();
-    }, [this]() {
-        this->handleFileUpload();
-    });
+// Collect finished scan results, or start a deferred scan
+void WiFiManager::updateScan() {
+    if (!_scanRunning) {
+        if (_scanRequested && !isAttempting()) {
+            startScan(true);
+        }
+        return;
+    }
     
-    // Set up 404 page
-    _uploadServer->onNotFound([this]() {
-        this->_uploadServer->send(404, "text/plain", "404: Not Found");
-    });
-}
-
-// Handle server tasks
-void WiFiManager::handleUploadServer() {
-    if (_uploadServerActive && _uploadServer != nullptr) {
-        _uploadServer->handleClient();
+    int16_t found = WiFi.scanComplete();
+    if (found == WIFI_SCAN_RUNNING) {
+        return;
     }
-}
-
-// Root page handler
-void WiFiManager::handleUploadRoot() {
-    const char* html = R"html(
-    <!DOCTYPE html>
-    <html>
-    <head>
-        <title>ESP Firmware Update</title>
-        <meta name="viewport" content="width=device-width, initial-scale=1">
-        <style>
-            body {
-                font-family: Arial, sans-serif;
-                margin: 20px;
-                background-color: #f0f0f0;
-            }
-            .container {
-                background-color: white;
-                border-radius: 5px;
-                padding: 20px;
-                box-shadow: 0 2px 5px rgba(0,0,0,0.1);
-                max-width: 500px;
-                margin: 0 auto;
-            }
-            h1 {
-                color: #0066cc;
-                text-align: center;
-            }
-            form {
-                margin-top: 20px;
-            }
-            .file-input {
-                margin: 10px 0;
-                padding: 10px;
-                border: 1px solid #ddd;
-                border-radius: 4px;
-                width: 100%;
-            }
-            .btn {
-                background-color: #0066cc;
-                color: white;
-                padding: 10px 15px;
-                border: none;
-                border-radius: 4px;
-                cursor: pointer;
-                width: 100%;
-                font-size: 16px;
-                margin-top: 10px;
-            }
-            .btn:hover {
-                background-color: #0055aa;
-            }
-            .status {
-                margin-top: 20px;
-                padding: 10px;
-                border-radius: 4px;
-                text-align: center;
-            }
-            .info {
-                margin-top: 20px;
-                font-size: 0.9em;
-                color: #666;
-            }
-            progress {
-                width: 100%;
-                height: 20px;
-                margin-top: 10px;
-            }
-        </style>
-    </head>
-    <body>
-        <div class="container">
-            <h1>ESP Firmware Update</h1>
-            <form method="POST" action="/update" enctype="multipart/form-data" id="upload_form">
-                <input type="file" name="update" class="file-input" accept=".bin">
-                <input type="submit" value="Upload Firmware" class="btn">
-                <div class="status">
-                    <progress id="progressBar" style="display:none"></progress>
-                    <div id="status"></div>
-                </div>
-            </form>
-            <div class="info">
-                <p>Select a .bin firmware file to upload to the device.</p>
-                <p><strong>Warning:</strong> Do not interrupt the upload process once started.</p>
-            </div>
-        </div>
-        <script>
-            var form = document.getElementById('upload_form');
-            var progressBar = document.getElementById('progressBar');
-            var statusDiv = document.getElementById('status');
-            
-            form.addEventListener('submit', function(e) {
-                e.preventDefault();
-                var file = document.querySelector('input[type="file"]').files[0];
-                var xhr = new XMLHttpRequest();
-                var formData = new FormData();
-                
-                if (!file) {
-                    statusDiv.innerHTML = 'Please select a file first!';
-                    return false;
-                }
-                
-                formData.append('update', file);
-                
-                xhr.open('POST', form.action, true);
-                
-                xhr.upload.addEventListener('progress', function(e) {
-                    if (e.lengthComputable) {
-                        progressBar.style.display = 'block';
-                        progressBar.value = e.loaded;
-                        progressBar.max = e.total;
-                        statusDiv.innerHTML = 'Upload progress: ' + Math.round((e.loaded / e.total) * 100) + '%';
-                    }
-                });
-                
-                xhr.onreadystatechange = function() {
-                    if (xhr.readyState === 4) {
-                        if (xhr.status === 200) {
-                            statusDiv.innerHTML = 'Upload successful! Device is rebooting...';
-                            setTimeout(function() {
-                                window.location.reload();
-                            }, 10000);
-                        } else {
-                            statusDiv.innerHTML = 'Upload failed with status: ' + xhr.status;
-                        }
-                    }
-                };
-                
-                statusDiv.innerHTML = 'Starting upload...';
-                xhr.send(formData);
-            });
-        </script>
-    </body>
-    </html>
-    )html";
     
-    _uploadServer->send(200, "text/html", html);
-}
-
-// Handle file upload
-void WiFiManager::handleFileUpload() {
-    HTTPUpload& upload = _uploadServer->upload();
+    _scanRunning = false;
+    if (found < 0) {
+        LOG_W("WiFi scan failed");
+        _roamScanPending = false;
+        if (_state == WiFiState::Scanning) {
+            buildCandidates(false);
+            nextStep();
+        }
+        return;
+    }
     
-    if (upload.status == UPLOAD_FILE_START) {
-        Serial.printf("Update: %s\n", upload.filename.c_str());
+    // Keep the strongest access points, sorted by signal
+    _scanCount = 0;
+    for (int i = 0; i < found; i++) {
+        int8_t rssi = WiFi.RSSI(i);
         
-        // Blink LED rapidly to indicate upload beginning
-        if (_statusLedPin >= 0) {
-            for (int i = 0; i < 5; i++) {
-                digitalWrite(_statusLedPin, !digitalRead(_statusLedPin));
-                delay(100);
-            }
+        int position = _scanCount;
+        while (position > 0 && _scanResults[position - 1].rssi < rssi) {
+            position--;
         }
+        if (position >= WIFI_SCAN_MAX_RESULTS) {
+            continue;
+        }
+        
+        int last = _scanCount < WIFI_SCAN_MAX_RESULTS ? _scanCount : WIFI_SCAN_MAX_RESULTS - 1;
+        memmove(&_scanResults[position + 1], &_scanResults[position],
+                (last - position) * sizeof(WiFiScanResult));
         
-        if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-            Update.printError(Serial);
+        WiFiScanResult& result = _scanResults[position];
+        strlcpy(result.ssid, WiFi.SSID(i).c_str(), sizeof(result.ssid));
+        memcpy(result.bssid, WiFi.BSSID(i), sizeof(result.bssid));
+        result.rssi = rssi;
+        result.channel = WiFi.channel(i);
+        result.encryption = WiFi.encryptionType(i);
+        
+        if (_scanCount < WIFI_SCAN_MAX_RESULTS) {
+            _scanCount++;
         }
-    } else if (upload.status == UPLOAD_FILE_WRITE) {
-        if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-            Update.printError(Serial);
+    }
+    
+    // Delete scan result to free memory
+    WiFi.scanDelete();
+    _scanTime = millis();
+    _scanValid = true;
+    
+    if (_printScanWhenDone) {
+        _printScanWhenDone = false;
+        printScan(Serial);
+    }
+    if (_monitorScanClient >= 0) {
+        WiFiClient& client = _monitorClients[_monitorScanClient].client;
+        _monitorScanClient = -1;
+        if (client.connected()) {
+            printScan(client);
         }
-        
-        // Toggle LED for each chunk
-        if (_statusLedPin >= 0) {
-            digitalWrite(_statusLedPin, !digitalRead(_statusLedPin));
+    }
+    
+    // The connection plan was waiting for this scan
+    if (_state == WiFiState::Scanning) {
+        buildCandidates(true);
+        nextStep();
+    }
+    
+    // So was the roaming monitor
+    if (_roamScanPending) {
+        _roamScanPending = false;
+        if (_state == WiFiState::Connected) {
+            evaluateRoam();
         }
-        
-        // Log progress
-        static int lastProgress = 0;
-        int progress = (Update.progress() * 100) / Update.size();
-        if (progress != lastProgress && progress % 10 == 0) {
-            Serial.printf("Upload progress: %d%%\n", progress);
-            lastProgress = progress;
+    }
+}
+
+// Print scan results and whether the configured networks are visible
+void WiFiManager::printScan(Print& out) const {
+    if (_scanCount == 0) {
+        out.println("No WiFi networks found!");
+        return;
+    }
+    
+    out.printf("Found %d networks (%lu s ago):\n", _scanCount, getScanAge() / 1000);
+    
+    // Print SSID, RSSI, channel and encryption type
+    for (int i = 0; i < _scanCount; i++) {
+        const WiFiScanResult& result = _scanResults[i];
+        out.printf("%d: %s (%d dBm, ch %u) [%s]\n", i + 1, result.ssid, result.rssi,
+                   result.channel, encryptionName(result.encryption));
+    }
+    
+    // Check if our configured networks are visible
+    int visible = 0;
+    for (int i = 0; i < _scanCount; i++) {
+        if (findScanResult(_scanResults[i].ssid) == i && _credentials.find(_scanResults[i].ssid) >= 0) {
+            out.printf("Configured network '%s' found with signal strength: %d dBm\n",
+                       _scanResults[i].ssid, _scanResults[i].rssi);
+            visible++;
         }
-    } else if (upload.status == UPLOAD_FILE_END) {
-        if (Update.end(true)) {
-            Serial.printf("Update Success: %u bytes\nRebooting...\n", upload.totalSize);
-            
-            // Solid LED to indicate success
-            if (_statusLedPin >= 0) {
-                digitalWrite(_statusLedPin, HIGH);
-            }
-        } else {
-            Update.printError(Serial);
-            
-            // Rapid blinking to indicate error
-            if (_statusLedPin >= 0) {
-                for (int i = 0; i < 10; i++) {
-                    digitalWrite(_statusLedPin, !digitalRead(_statusLedPin));
-                    delay(50);
-                }
-            }
+    }
+    if (visible == 0) {
+        out.println("No configured network in range! Please check SSID spelling or if network is in range.");
+    } else if (visible < _credentials.count()) {
+        out.printf("%d other configured networks not in range\n", _credentials.count() - visible);
+    }
+}
+
+// Strongest cached result for an SSID, or -1
+int WiFiManager::findScanResult(const String& ssid) const {
+    for (int i = 0; i < _scanCount; i++) {
+        if (ssid == _scanResults[i].ssid) {
+            return i;
         }
     }
+    return -1;
 }
 
-// Upload complete handler
-void WiFiManager::handleUploadComplete() {
-    _uploadServer->send(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
-    delay(1000);
-    ESP.restart();
+// Name of a wifi_auth_mode_t
+const char* WiFiManager::encryptionName(uint8_t type) {
+    switch (type) {
+        case WIFI_AUTH_OPEN: return "Open";
+        case WIFI_AUTH_WEP: return "WEP";
+        case WIFI_AUTH_WPA_PSK: return "WPA-PSK";
+        case WIFI_AUTH_WPA2_PSK: return "WPA2-PSK";
+        case WIFI_AUTH_WPA_WPA2_PSK: return "WPA/WPA2-PSK";
+        case WIFI_AUTH_WPA2_ENTERPRISE: return "WPA2-Enterprise";
+        case WIFI_AUTH_WPA3_PSK: return "WPA3-PSK";
+        case WIFI_AUTH_WPA2_WPA3_PSK: return "WPA2/WPA3-PSK";
+        default: return "Unknown";
+    }
 }
 
 // Start remote monitor server (telnet-style)
 void WiFiManager::beginRemoteMonitor(int port) {
     if (!isConnected()) {
-        Serial.println("Cannot start monitor: Not connected to WiFi");
+        LOG_W("Cannot start monitor: Not connected to WiFi");
         return;
     }
     
@@ -929,19 +1652,22 @@ void WiFiManager::beginRemoteMonitor(int port) {
     if (_monitorServer == nullptr) {
         _monitorServer = new WiFiServer(port);
         if (_monitorServer == nullptr) {
-            Serial.println("Failed to create monitor server");
+            LOG_E("Failed to create monitor server");
             return;
         }
+        
+        // The log task is the only writer of the monitor ring
+        Log::addSink([this](const LogEntry& entry) {
+            char line[LOG_MESSAGE_MAX + 32];
+            _monitorLog.write(line, Log::format(entry, line, sizeof(line)));
+        });
     }
     
     _monitorServer->begin();
     _monitorActive = true;
     
-    Serial.print("Remote monitor started on telnet://");
-    Serial.print(getIPAddress());
-    Serial.print(":");
-    Serial.println(_monitorPort);
-    Serial.println("Use a telnet client to connect");
+    LOG_I("Remote monitor started on telnet://%s:%d", getIPAddress().c_str(), _monitorPort);
+    LOG_I("Use a telnet client to connect");
 }
 
 // Handle monitor tasks
@@ -950,81 +1676,153 @@ void WiFiManager::handleRemoteMonitor() {
     
     // Check if there are any new clients
     if (_monitorServer->hasClient()) {
-        // If we already have a client, disconnect it
-        if (_monitorClient && _monitorClient.connected()) {
-            _monitorClient.stop();
+        acceptMonitorClient();
+    }
+    
+    for (int i = 0; i < REMOTE_MONITOR_MAX_CLIENTS; i++) {
+        MonitorClient& monitor = _monitorClients[i];
+        if (!monitor.client.connected()) {
+            monitor.client.stop();
+            continue;
         }
         
-        // Connect to new client
-        _monitorClient = _monitorServer->available();
-        _monitorClient.println();
-        _monitorClient.println("ESP Remote Monitor");
-        _monitorClient.println("Type 'help' for commands");
-        _monitorClient.println("===================");
-    }
-    
-    // Check for data from client
-    if (_monitorClient && _monitorClient.connected() && _monitorClient.available()) {
-        String command = _monitorClient.readStringUntil('\n');
-        command.trim();
-        
-        if (command == "help") {
-            _monitorClient.println("Available commands:");
-            _monitorClient.println("  help - Show this help");
-            _monitorClient.println("  status - Show WiFi status");
-            _monitorClient.println("  scan - Scan for WiFi networks");
-            _monitorClient.println("  reboot - Reboot device");
-            _monitorClient.println("  exit/quit - Close connection");
-        } else if (command == "status") {
-            _monitorClient.println("=== WiFi Status ===");
-            _monitorClient.print("Connected: ");
-            _monitorClient.println(isConnected() ? "Yes" : "No");
-            _monitorClient.print("IP: ");
-            _monitorClient.println(getIPAddress());
-            _monitorClient.print("RSSI: ");
-            _monitorClient.println(getSignalStrength());
-            _monitorClient.print("MAC: ");
-            _monitorClient.println(getMACAddress());
-        } else if (command == "scan") {
-            _monitorClient.println("Scanning for networks...");
+        if (monitor.client.available()) {
+            handleMonitorCommand(monitor, i);
+        }
+        if (monitor.client.connected()) {
+            flushMonitorClient(monitor);
+        }
+    }
+}
+
+// Give a new client a free slot, starting with the recent log backlog
+void WiFiManager::acceptMonitorClient() {
+    WiFiClient client = _monitorServer->available();
+    
+    for (MonitorClient& monitor : _monitorClients) {
+        if (!monitor.client.connected()) {
+            monitor.client.stop();
+            monitor.client = client;
+            monitor.cursor = _monitorLog.attach();
             
-            int numNetworks = WiFi.scanNetworks();
-            if (numNetworks == 0) {
-                _monitorClient.println("No networks found");
-            } else {
-                _monitorClient.print("Found ");
-                _monitorClient.print(numNetworks);
-                _monitorClient.println(" networks:");
-                
-                for (int i = 0; i < numNetworks; i++) {
-                    _monitorClient.print(i + 1);
-                    _monitorClient.print(": ");
-                    _monitorClient.print(WiFi.SSID(i));
-                    _monitorClient.print(" (");
-                    _monitorClient.print(WiFi.RSSI(i));
-                    _monitorClient.println(" dBm)");
-                    delay(10);
-                }
+            monitor.client.println();
+            monitor.client.println("ESP Remote Monitor");
+            monitor.client.println("Type 'help' for commands");
+            monitor.client.println("===================");
+            return;
+        }
+    }
+    
+    client.println("Too many monitor clients");
+    client.stop();
+}
+
+// Run a command from a monitor client
+void WiFiManager::handleMonitorCommand(MonitorClient& monitor, int index) {
+    WiFiClient& client = monitor.client;
+    String command = client.readStringUntil('\n');
+    command.trim();
+    
+    if (command == "help") {
+        client.println("Available commands:");
+        client.println("  help - Show this help");
+        client.println("  status - Show WiFi status");
+        client.println("  scan - Scan for WiFi networks");
+        client.println("  log [module|all] <level> - Show or set log levels");
+        client.println("  reboot - Reboot device");
+        client.println("  exit/quit - Close connection");
+    } else if (command == "status") {
+        client.println("=== WiFi Status ===");
+        client.print("Connected: ");
+        client.println(isConnected() ? "Yes" : "No");
+        client.print("IP: ");
+        client.println(getIPAddress());
+        client.print("RSSI: ");
+        client.println(getSignalStrength());
+        client.print("MAC: ");
+        client.println(getMACAddress());
+        client.print("Monitor clients: ");
+        client.println(getMonitorClientCount());
+        client.print("Log bytes missed: ");
+        client.println(monitor.cursor.dropped);
+    } else if (command == "scan") {
+        // Served from the scan cache; a refresh runs in the background
+        // without dropping the connection
+        updateScan();
+        if (hasFreshScan()) {
+            printScan(client);
+        } else {
+            client.println("Scanning for networks, results will follow...");
+            _monitorScanClient = index;
+            startScan();
+        }
+    } else if (command == "log" || command.startsWith("log ")) {
+        String args = command.substring(3);
+        args.trim();
+        int space = args.indexOf(' ');
+        String module = space > 0 ? args.substring(0, space) : String("all");
+        String level = space > 0 ? args.substring(space + 1) : args;
+        level.trim();
+        
+        if (level.length() > 0 && !Log::setLevel(module.c_str(), level.c_str())) {
+            client.println("Usage: log [module|all] <none|error|warn|info|debug|verbose>");
+        }
+        for (uint8_t i = 0; i < (uint8_t)LogModule::Count; i++) {
+            client.printf("  %-8s %s\r\n", Log::moduleName((LogModule)i), Log::levelName(Log::getLevel((LogModule)i)));
+        }
+    } else if (command == "reboot") {
+        client.println("Rebooting device...");
+        delay(500);
+        ESP.restart();
+    } else if (command == "exit" || command == "quit") {
+        client.println("Closing connection. Goodbye!");
+        client.stop();
+    } else if (command.length() > 0) {
+        client.print("Unknown command: ");
+        client.println(command);
+    }
+}
+
+// Send buffered log text without waiting for the socket; a slow client
+// keeps its place in the ring and gets a gap marker if it is overtaken
+void WiFiManager::flushMonitorClient(MonitorClient& monitor) {
+    char chunk[REMOTE_MONITOR_SEND_CHUNK];
+    
+    while (true) {
+        size_t len = _monitorLog.read(monitor.cursor, chunk, sizeof(chunk));
+        if (len == 0) {
+            return;
+        }
+        
+        int sent = send(monitor.client.fd(), chunk, len, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN) {
+                monitor.client.stop();
             }
-            
-            WiFi.scanDelete();
-        } else if (command == "reboot") {
-            _monitorClient.println("Rebooting device...");
-            delay(500);
-            ESP.restart();
-        } else if (command == "exit" || command == "quit") {
-            _monitorClient.println("Closing connection. Goodbye!");
-            _monitorClient.stop();
-        } else if (command.length() > 0) {
-            _monitorClient.print("Unknown command: ");
-            _monitorClient.println(command);
+            return;
+        }
+        
+        _monitorLog.advance(monitor.cursor, sent);
+        if ((size_t)sent < len) {
+            return;
         }
     }
 }
 
-// Write to remote monitor
+// Write to remote monitor (an app log message, so every sink gets it)
 void WiFiManager::remoteLog(const String& message) {
-    if (_monitorClient && _monitorClient.connected()) {
-        _monitorClient.println(message);
+    if (Log::enabled(LogModule::App, LOG_LEVEL_INFO)) {
+        Log::write(LogModule::App, LOG_LEVEL_INFO, "%s", message.c_str());
+    }
+}
+
+// Number of connected monitor clients
+int WiFiManager::getMonitorClientCount() {
+    int count = 0;
+    for (MonitorClient& monitor : _monitorClients) {
+        if (monitor.client.connected()) {
+            count++;
+        }
     }
+    return count;
 }
@@ -1,7 +1,20 @@
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESP32Servo.h>
 #include "Config.h"
 #include "WiFiManager.h"
+#include "MQTTManager.h"
 #include "HttpServer.h"
+#include "DeviceManager.h"
+#include "NetworkTask.h"
+#include "Scheduler.h"
+#include "TimeSeriesStore.h"
+#include "TraceChannel.h"
+#include "JsonSnapshot.h"
+#include "Log.h"
+
+#define LOG_MODULE LogModule::App
+#define LOG_MODULE_LEVEL LOG_LEVEL_APP
 
 // LED definitions
 #define LED_BUILTIN 2   // Built-in LED on GPIO2
@@ -13,34 +26,72 @@ void testExternalLED();
 void handleWiFiStatus();
 void setupHttpRoutes();
 void handleLedControl();  // New function for LED control through HTTP
+void toggleLedTask();
+void addSchedulerStats(JsonArray tasks, Scheduler& taskScheduler);
+void storeSnapshots();
+void handleHistoryQuery();
+int appendJsonFloat(char* out, size_t size, float value, int precision);
+void registerRuleActions();
 
 // Create WiFi manager instance
 WiFiManager wifiManager(WIFI_SSID, WIFI_PASSWORD, LED_BUILTIN, WIFI_TIMEOUT);
 
+// Create MQTT manager instance
+MQTTManager mqttManager(MQTT_SERVER, MQTT_PORT, MQTT_USERNAME, MQTT_PASSWORD,
+                        CLIENT_ID, MQTT_TOPIC_PREFIX, DEVICE_ID);
+
 // Create HTTP server instance
 HttpServer httpServer(&wifiManager, HTTP_SERVER_PORT);
 
-// WiFi connection status
-bool wifiConnected = false;
-unsigned long lastWiFiCheck = 0;
-const unsigned long wifiCheckInterval = 10000; // Check WiFi every 10 seconds
+// WiFi, MQTT and HTTP run in a network task pinned to core 0
+NetworkTask networkTask(&wifiManager, &mqttManager, &httpServer);
+
+// Application logic runs in loop() on core 1
+DeviceManager deviceManager(&wifiManager, &mqttManager, DEVICE_ID, FIRMWARE_VERSION);
+
+// Chip temperature fed through the sampling pipeline
+FunctionSensorSource chipTemperature("chip_temp", []() { return temperatureRead(); });
+
+// Compressed telemetry history, queryable over HTTP
+TimeSeriesStore history;
+
+// Binary telemetry/trace stream on the serial port (TRACE_SERIAL_ENABLED)
+TraceChannel trace(Serial);
+
+// Servo driven by rules with action "servo" (attached on first use, moved
+// when a rule names another pin)
+Servo ruleServo;
+int ruleServoPin = -1;
 
-// HTTP server process interval
-unsigned long lastHttpProcess = 0;
-const unsigned long httpProcessInterval = 100; // Process HTTP every 100ms
+// Cooperative scheduler driving all periodic work in loop()
+Scheduler scheduler;
+
+// Application-core statistics served by HTTP handlers on the network core
+JsonSnapshot schedulerSnapshot;
+JsonSnapshot rulesSnapshot;
 
 // Other variables
-unsigned long lastLedToggle = 0;
 const unsigned long ledToggleInterval = 1000;
+const unsigned long snapshotInterval = 1000;
 bool ledState = false;
 
 void setup() {
+  #if TRACE_SERIAL_ENABLED
+  // Binary frames only: logs reach the UART through the trace channel
+  trace.begin(TRACE_BAUD_RATE, FIRMWARE_VERSION);
+  Log::begin(LOG_LEVEL_NONE);
+  Log::addSink([](const LogEntry& entry) { trace.log(entry); });
+  #else
   // Initialize serial communication
   Serial.begin(SERIAL_BAUD_RATE);
   delay(1000);  // Give time for the serial monitor to connect
   
-  Serial.println("\n\n===== ESP32 Node32S =====\n");
-  Serial.println("Device MAC Address: " + WiFi.macAddress());
+  // From here on messages are written to the UART by a low-priority task
+  Log::begin();
+  #endif
+  
+  LOG_I("===== ESP32 Node32S =====");
+  LOG_I("Device MAC Address: %s", WiFi.macAddress().c_str());
   
   // Initialize LEDs
   pinMode(LED_BUILTIN, OUTPUT);
@@ -50,104 +101,68 @@ void setup() {
   digitalWrite(LED_BUILTIN, LOW);
   digitalWrite(LED_EXTERNAL, LOW);
   
-  Serial.println("LEDs initialized");
-  Serial.println("Built-in LED on GPIO" + String(LED_BUILTIN));
-  Serial.println("External LED on GPIO" + String(LED_EXTERNAL));
-  
-  // Run the LED test
-  testExternalLED();
+  LOG_I("LEDs initialized");
+  LOG_D("Built-in LED on GPIO%d", LED_BUILTIN);
+  LOG_D("External LED on GPIO%d", LED_EXTERNAL);
   
   // Connect to WiFi
-  Serial.println("\nStarting WiFi connection process...");
-  Serial.println("WiFi SSID: " + String(WIFI_SSID));
-  Serial.println("Connection timeout: " + String(WIFI_TIMEOUT) + "ms");
+  LOG_I("Starting WiFi connection process...");
+  LOG_I("WiFi SSID: %s", WIFI_SSID);
+  LOG_D("Connection timeout: %d ms", WIFI_TIMEOUT);
+  wifiManager.setPowerProfile(WIFI_POWER_PROFILE);
   
-  // Scan for available networks to diagnose connection issues
-  wifiManager.scanNetworks();
+  // Set authentication if defined in config
+  #if defined(HTTP_USERNAME) && defined(HTTP_PASSWORD)
+  httpServer.setAuthentication(HTTP_USERNAME, HTTP_PASSWORD);
+  // Peers serve their firmware behind the same credentials
+  wifiManager.getFirmwareUpdater().setPeerCredentials(HTTP_USERNAME, HTTP_PASSWORD);
+  #endif
   
-  // Try to connect to WiFi with all available methods
-  Serial.println("Starting WiFi connection with all available methods...");
-  wifiConnected = wifiManager.begin();
+  // Setup custom routes before the network task starts the server
+  setupHttpRoutes();
   
-  if (wifiConnected) {
-    Serial.println("WiFi connection successful!");
-    
-    // Start HTTP server
-    Serial.println("Starting HTTP server...");
-    
-    // Set authentication if defined in config
-    #if defined(HTTP_USERNAME) && defined(HTTP_PASSWORD)
-    httpServer.setAuthentication(HTTP_USERNAME, HTTP_PASSWORD);
-    #endif
-    
-    // Setup custom routes before starting the server
-    setupHttpRoutes();
-    
-    // Start the server
-    httpServer.begin();
-    
-  } else {
-    Serial.println("\nAll WiFi connection attempts failed.");
-    Serial.println("Please check:");
-    Serial.println("1. WiFi credentials are correct");
-    Serial.println("2. The router is within range and powered on");
-    Serial.println("3. The router is not blocking this device (MAC address: " + WiFi.macAddress() + ")");
-    Serial.println("\nContinuing without WiFi connection...");
+  // WiFi connection, HTTP server and MQTT are brought up on core 0 so a slow
+  // (re)connect never stalls the application loop
+  LOG_I("Starting network task...");
+  networkTask.begin();
+  
+  // Run the LED test while the network task connects, so its ~14 s of
+  // delays do not hold up the (fast) connection
+  testExternalLED();
+  
+  // Application side: exchanges telemetry and commands through lock-free queues
+  deviceManager.useScheduler(&scheduler);
+  deviceManager.attachNetworkTask(&networkTask);
+  deviceManager.addSensor(&chipTemperature, 10);
+  if (history.begin()) {
+    deviceManager.attachHistory(&history);
   }
+  registerRuleActions();
+  deviceManager.begin();
+  #if TRACE_SERIAL_ENABLED
+  deviceManager.attachTrace(&trace);
+  #endif
+  
+  // Register periodic work (replaces the millis() interval checks in loop)
+  scheduler.addPeriodic("led", ledToggleInterval, toggleLedTask);
+  scheduler.addPeriodic("snapshots", snapshotInterval, storeSnapshots);
 }
 
 void loop() {
-  // Get current time
-  unsigned long currentMillis = millis();
-  
-  // Check WiFi status periodically
-  if (currentMillis - lastWiFiCheck >= wifiCheckInterval) {
-    lastWiFiCheck = currentMillis;
-    
-    // Check and handle WiFi connection
-    bool prevConnected = wifiConnected;
-    wifiConnected = wifiManager.checkConnection();
-    
-    // Print connection status on change or periodically
-    if (prevConnected != wifiConnected || (currentMillis / 60000) % 2 == 0) {
-      if (wifiConnected) {
-        Serial.print("WiFi connected. IP: ");
-        Serial.print(wifiManager.getIPAddress());
-        Serial.print(", Signal: ");
-        Serial.print(wifiManager.getSignalStrength());
-        Serial.println(" dBm");
-        
-        // If WiFi was previously disconnected and now connected,
-        // try to start HTTP server if it's not already running
-        if (!prevConnected && !httpServer.isRunning()) {
-          Serial.println("Restarting HTTP server after WiFi reconnection...");
-          httpServer.begin();
-        }
-      } else {
-        Serial.println("WiFi disconnected. Attempting to reconnect...");
-        wifiManager.printConnectionStatus(WiFi.status());
-      }
-    }
-  }
+  // Runs due tasks, then sleeps until the next deadline
+  scheduler.run();
+}
+
+/**
+ * Blink external LED to indicate operation
+ */
+void toggleLedTask() {
+  ledState = !ledState;
   
-  // Process HTTP client requests
-  if (wifiConnected && currentMillis - lastHttpProcess >= httpProcessInterval) {
-    lastHttpProcess = currentMillis;
-    httpServer.handleClient();
-  }
+  digitalWrite(LED_EXTERNAL, ledState);
   
-  // Blink external LED to indicate operation
-  if (currentMillis - lastLedToggle >= ledToggleInterval) {
-    lastLedToggle = currentMillis;
-    ledState = !ledState;
-    
-    digitalWrite(LED_EXTERNAL, ledState);
-    
-    // Only print LED status every 5 seconds to reduce serial output
-    if ((currentMillis / 5000) % 2 == 0) {
-      Serial.println(ledState ? "External LED ON" : "External LED OFF");
-    }
-  }
+  // Compiled out unless the app log level is raised to debug
+  LOG_D(ledState ? "External LED ON" : "External LED OFF");
 }
 
 /**
@@ -169,42 +184,42 @@ void blinkLED(int pin, int times, int delayMs) {
  * Test the external LED with various patterns
  */
 void testExternalLED() {
-  Serial.println("\nRunning LED test sequence...");
+  LOG_I("Running LED test sequence...");
 
   // First, test the built-in LED to verify the system
-  Serial.println("Testing built-in LED...");
+  LOG_D("Testing built-in LED...");
   blinkLED(LED_BUILTIN, 3, 200);
   delay(1000);
 
   // Now test the external LED
-  Serial.println("Testing external LED...");
+  LOG_D("Testing external LED...");
   
   // Test 1: Simple on-off
-  Serial.println("Test 1: Simple on-off");
+  LOG_D("Test 1: Simple on-off");
   digitalWrite(LED_EXTERNAL, HIGH);
-  Serial.println("External LED should be ON");
+  LOG_D("External LED should be ON");
   delay(2000);
   
   digitalWrite(LED_EXTERNAL, LOW);
-  Serial.println("External LED should be OFF");
+  LOG_D("External LED should be OFF");
   delay(1000);
   
   // Test 2: Blink pattern
-  Serial.println("Test 2: Blink pattern");
+  LOG_D("Test 2: Blink pattern");
   blinkLED(LED_EXTERNAL, 5, 200);
   delay(1000);
   
   // Test 3: Alternate with built-in LED
-  Serial.println("Test 3: Alternating with built-in LED");
+  LOG_D("Test 3: Alternating with built-in LED");
   for (int i = 0; i < 5; i++) {
     digitalWrite(LED_BUILTIN, HIGH);
     digitalWrite(LED_EXTERNAL, LOW);
-    Serial.println("Built-in ON, External OFF");
+    LOG_D("Built-in ON, External OFF");
     delay(500);
     
     digitalWrite(LED_BUILTIN, LOW);
     digitalWrite(LED_EXTERNAL, HIGH);
-    Serial.println("Built-in OFF, External ON");
+    LOG_D("Built-in OFF, External ON");
     delay(500);
   }
   
@@ -212,8 +227,8 @@ void testExternalLED() {
   digitalWrite(LED_BUILTIN, LOW);
   digitalWrite(LED_EXTERNAL, LOW);
   
-  Serial.println("LED test sequence complete");
-  Serial.println("Now starting continuous alternating pattern...");
+  LOG_I("LED test sequence complete");
+  LOG_D("Now starting continuous alternating pattern...");
   delay(1000);
 }
 
@@ -334,6 +349,217 @@ void setupHttpRoutes() {
       
     httpServer.getServer()->send(200, "text/html", html);
   });
+  
+  // Scheduler task statistics
+  httpServer.on("/api/scheduler", HTTP_GET, []() {
+    if (!httpServer.getServer()->authenticate(HTTP_USERNAME, HTTP_PASSWORD)) {
+      return httpServer.getServer()->requestAuthentication();
+    }
+    
+    // The application scheduler belongs to the other core: use its snapshot.
+    // The network scheduler runs this handler, so it is read directly
+    JsonDocument doc;
+    deserializeJson(doc, schedulerSnapshot.load());
+    addSchedulerStats(doc["network"].to<JsonArray>(), networkTask.scheduler());
+    doc["dropped_outbound"] = networkTask.droppedOutbound();
+    doc["dropped_commands"] = networkTask.droppedCommands();
+    
+    String response;
+    serializeJsonPretty(doc, response);
+    httpServer.getServer()->send(200, "application/json", response);
+  });
+  
+  // Loaded rules with their firing counts and evaluation cost
+  httpServer.on("/api/rules", HTTP_GET, []() {
+    if (!httpServer.getServer()->authenticate(HTTP_USERNAME, HTTP_PASSWORD)) {
+      return httpServer.getServer()->requestAuthentication();
+    }
+    
+    // Rules are compiled and evaluated on the application core
+    httpServer.getServer()->send(200, "application/json", rulesSnapshot.load());
+  });
+  
+  // Telemetry history: /api/history?metric=&from=&to=&step=
+  httpServer.on("/api/history", HTTP_GET, handleHistoryQuery);
+}
+
+/**
+ * Local actions available to rules on the RULE_ACTION_PINS GPIOs: "led"
+ * drives the pin, "servo" moves a servo to value while the rule is active
+ * and back to rest when it clears
+ */
+void registerRuleActions() {
+  deviceManager.rules().setActionPins(RULE_ACTION_PINS);
+  
+  deviceManager.rules().registerAction("led", [](const RuleEvent& event) {
+    if (event.action->pin < 0) {
+      return;
+    }
+    float level = event.active ? event.action->value : event.action->restValue;
+    pinMode(event.action->pin, OUTPUT);
+    digitalWrite(event.action->pin, level != 0.0f ? HIGH : LOW);
+  });
+  
+  deviceManager.rules().registerAction("servo", [](const RuleEvent& event) {
+    if (event.action->pin < 0) {
+      return;
+    }
+    if (ruleServo.attached() && ruleServoPin != event.action->pin) {
+      ruleServo.detach();
+    }
+    if (!ruleServo.attached()) {
+      ruleServo.setPeriodHertz(50);
+      ruleServo.attach(event.action->pin, 500, 2400);
+      ruleServoPin = event.action->pin;
+    }
+    ruleServo.write((int)(event.active ? event.action->value : event.action->restValue));
+  });
+}
+
+/**
+ * Answer a history range query. Without a metric the known metrics are
+ * listed; from/to default to the last hour and step > 0 downsamples into
+ * buckets of step seconds ([t, mean, min, max, n]), otherwise raw [t, v]
+ */
+void handleHistoryQuery() {
+  WebServer* server = httpServer.getServer();
+  if (!server->authenticate(HTTP_USERNAME, HTTP_PASSWORD)) {
+    return server->requestAuthentication();
+  }
+  
+  if (!server->hasArg("metric")) {
+    JsonDocument doc;
+    JsonArray metrics = doc["metrics"].to<JsonArray>();
+    for (int i = 0; i < history.metricCount(); i++) {
+      metrics.add(history.metricName(i));
+    }
+    doc["now"] = TimeSeriesStore::now();
+    doc["points"] = history.pointCount();
+    doc["bits_per_point"] = history.bitsPerPoint();
+    doc["ram_bytes"] = history.ramBytes();
+    doc["flash_bytes"] = history.flashBytes();
+    
+    String response;
+    serializeJson(doc, response);
+    server->send(200, "application/json", response);
+    return;
+  }
+  
+  String metric = server->arg("metric");
+  if (metric.length() >= HISTORY_METRIC_NAME_MAX || metric.indexOf('"') >= 0 || metric.indexOf('\\') >= 0) {
+    server->send(400, "application/json", "{\"error\":\"invalid metric\"}");
+    return;
+  }
+  uint32_t to = server->hasArg("to") ? server->arg("to").toInt() : TimeSeriesStore::now();
+  uint32_t from = server->hasArg("from") ? server->arg("from").toInt() : (to > 3600 ? to - 3600 : 0);
+  uint32_t step = server->hasArg("step") ? server->arg("step").toInt() : 0;
+  
+  HistoryPoint* points = (HistoryPoint*)malloc(HISTORY_MAX_QUERY_POINTS * sizeof(HistoryPoint));
+  if (points == nullptr) {
+    server->send(503, "application/json", "{\"error\":\"out of memory\"}");
+    return;
+  }
+  
+  bool truncated = false;
+  size_t count = history.query(metric.c_str(), from, to, step, points, HISTORY_MAX_QUERY_POINTS, &truncated);
+  
+  // Stream the result instead of building one large document
+  char chunk[512];
+  int length = snprintf(chunk, sizeof(chunk),
+                        "{\"metric\":\"%s\",\"from\":%u,\"to\":%u,\"step\":%u,\"truncated\":%s,\"points\":[",
+                        metric.c_str(), (unsigned)from, (unsigned)to, (unsigned)step, truncated ? "true" : "false");
+  
+  server->setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server->send(200, "application/json", "");
+  
+  for (size_t i = 0; i < count; i++) {
+    const HistoryPoint& point = points[i];
+    if (length > (int)sizeof(chunk) - 96) {
+      server->sendContent(chunk, length);
+      length = 0;
+    }
+    
+    const char* separator = i > 0 ? "," : "";
+    length += snprintf(chunk + length, sizeof(chunk) - length, "%s[%u", separator, (unsigned)point.timestamp);
+    if (step > 0) {
+      length += appendJsonFloat(chunk + length, sizeof(chunk) - length, point.mean, 4);
+      length += appendJsonFloat(chunk + length, sizeof(chunk) - length, point.min, 4);
+      length += appendJsonFloat(chunk + length, sizeof(chunk) - length, point.max, 4);
+      length += snprintf(chunk + length, sizeof(chunk) - length, ",%u]", (unsigned)point.count);
+    } else {
+      length += appendJsonFloat(chunk + length, sizeof(chunk) - length, point.mean, 6);
+      length += snprintf(chunk + length, sizeof(chunk) - length, "]");
+    }
+  }
+  
+  length += snprintf(chunk + length, sizeof(chunk) - length, "]}");
+  server->sendContent(chunk, length);
+  server->sendContent("");
+  
+  free(points);
+}
+
+/**
+ * Write ",<value>" into a JSON buffer; NaN and infinity have no JSON
+ * representation and are written as null
+ */
+int appendJsonFloat(char* out, size_t size, float value, int precision) {
+  if (!isfinite(value)) {
+    return snprintf(out, size, ",null");
+  }
+  return snprintf(out, size, ",%.*g", precision, value);
+}
+
+/**
+ * Copy the application scheduler and rule statistics for the HTTP handlers
+ * (runs on the application core, which owns both)
+ */
+void storeSnapshots() {
+  JsonDocument schedulerDoc;
+  addSchedulerStats(schedulerDoc["application"].to<JsonArray>(), scheduler);
+  schedulerSnapshot.store(schedulerDoc);
+  
+  RuleEngine& rules = deviceManager.rules();
+  JsonDocument rulesDoc;
+  rulesDoc["samples"] = rules.evaluatedSamples();
+  rulesDoc["avg_cycles_per_sample"] = rules.avgCyclesPerSample();
+  rulesDoc["max_cycles_per_sample"] = rules.maxCyclesPerSample();
+  
+  JsonArray list = rulesDoc["rules"].to<JsonArray>();
+  RuleInfo info;
+  for (int i = 0; rules.getRuleInfo(i, info); i++) {
+    JsonObject rule = list.add<JsonObject>();
+    rule["id"] = info.id;
+    rule["active"] = info.active;
+    rule["fired"] = info.fireCount;
+    rule["evaluations"] = info.evaluations;
+    rule["avg_cycles"] = info.avgCycles;
+    rule["max_cycles"] = info.maxCycles;
+  }
+  rulesSnapshot.store(rulesDoc);
+}
+
+/**
+ * Append per-task statistics of a scheduler to a JSON array
+ */
+void addSchedulerStats(JsonArray tasks, Scheduler& taskScheduler) {
+  int ids[SCHEDULER_MAX_TASKS];
+  int count = taskScheduler.taskIds(ids, SCHEDULER_MAX_TASKS);
+  for (int i = 0; i < count; i++) {
+    Scheduler::TaskStats stats;
+    if (!taskScheduler.getStats(ids[i], stats)) {
+      continue;
+    }
+    
+    JsonObject task = tasks.add<JsonObject>();
+    task["name"] = stats.name;
+    task["interval_ms"] = stats.interval;
+    task["runs"] = stats.runCount;
+    task["avg_us"] = stats.runCount ? (uint32_t)(stats.totalRunUs / stats.runCount) : 0;
+    task["max_us"] = stats.maxRunUs;
+    task["max_late_ms"] = stats.maxLatenessMs;
+    task["missed"] = stats.missedDeadlines;
+  }
 }
 
 /**
@@ -360,19 +586,19 @@ void handleLedControl() {
       ledState = true;
       digitalWrite(LED_EXTERNAL, HIGH);
       state = "ON";
-      Serial.println("LED turned ON via web interface");
+      LOG_I("LED turned ON via web interface");
     } 
     else if (action == "off") {
       ledState = false;
       digitalWrite(LED_EXTERNAL, LOW);
       state = "OFF";
-      Serial.println("LED turned OFF via web interface");
+      LOG_I("LED turned OFF via web interface");
     }
     else if (action == "toggle") {
       ledState = !ledState;
       digitalWrite(LED_EXTERNAL, ledState);
       state = ledState ? "ON" : "OFF";
-      Serial.println("LED toggled via web interface: " + state);
+      LOG_I("LED toggled via web interface: %s", state.c_str());
     }
     else if (action == "blink") {
       // Temporarily blink without changing the main state
@@ -384,7 +610,7 @@ void handleLedControl() {
       }
       // Restore previous state
       digitalWrite(LED_EXTERNAL, ledState);
-      Serial.println("LED blink pattern executed via web interface");
+      LOG_I("LED blink pattern executed via web interface");
     }
   }
   